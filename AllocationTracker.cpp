@@ -0,0 +1,421 @@
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <DbgHelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#endif
+
+// --------------------------------------------------------
+// Everything in here is plain static data so it's ready
+// before any constructor runs - operator new can be called
+// before main() - and never allocates itself.
+// --------------------------------------------------------
+namespace
+{
+	// Sits in front of every tracked allocation.  16 bytes
+	// keeps the memory after it aligned like malloc's.
+	struct alignas(16) AllocationHeader
+	{
+		size_t size;
+		unsigned int tag;
+	};
+
+	struct TagCounters
+	{
+		std::atomic<unsigned long long> allocations;
+		std::atomic<unsigned long long> frees;
+		std::atomic<unsigned long long> bytes;
+	};
+
+	const unsigned int TagCount = (unsigned int)AllocationTag::Count;
+
+	TagCounters frameCounters[TagCount];	// Frame in progress
+	AllocationStats lastFrame[TagCount];	// Last finished frame
+	AllocationStats totals[TagCount];		// Finished frames, added up
+	unsigned long long framesTracked;
+
+	std::atomic<long long> liveBytes;
+	std::atomic<long long> peakBytes;
+
+	thread_local AllocationTag currentTag = AllocationTag::General;
+	thread_local bool insideTracker = false;	// Stops the tracker tracking itself
+
+	// Call site aggregation - a fixed open-addressing table
+	// keyed by a hash of the allocating call stack
+	const unsigned int CallSiteFrames = 8;
+	const unsigned int CallSiteSkipFrames = 2;	// Allocate() and operator new
+	const unsigned int MaxCallSites = 4096;		// Must be a power of two
+
+	struct CallSite
+	{
+		unsigned long hash;
+		unsigned int frameCount;
+		void* frames[CallSiteFrames];
+		unsigned long long allocations;
+		unsigned long long bytes;
+	};
+
+	CallSite callSites[MaxCallSites];
+	unsigned int callSitesDropped;	// Allocations that didn't fit in the table
+	std::atomic_flag callSiteLock = ATOMIC_FLAG_INIT;
+	std::atomic<bool> callSiteTracking(false);
+
+	void LockCallSites()
+	{
+		while (callSiteLock.test_and_set(std::memory_order_acquire)) {}
+	}
+
+	void UnlockCallSites()
+	{
+		callSiteLock.clear(std::memory_order_release);
+	}
+
+	// --------------------------------------------------------
+	// Adds one allocation to the entry for the current call stack
+	// --------------------------------------------------------
+	void RecordCallSite(size_t size)
+	{
+#ifdef _WIN32
+		void* frames[CallSiteFrames];
+		unsigned long hash = 0;
+		unsigned int frameCount = CaptureStackBackTrace(CallSiteSkipFrames, CallSiteFrames, frames, &hash);
+		if (frameCount == 0)
+			return;
+
+		LockCallSites();
+		for (unsigned int probe = 0; probe < MaxCallSites; probe++)
+		{
+			CallSite& site = callSites[(hash + probe) & (MaxCallSites - 1)];
+
+			// Empty slot - this stack hasn't been seen yet
+			if (site.allocations == 0)
+			{
+				site.hash = hash;
+				site.frameCount = frameCount;
+				memcpy(site.frames, frames, sizeof(void*) * frameCount);
+			}
+			else if (site.hash != hash || site.frameCount != frameCount ||
+				memcmp(site.frames, frames, sizeof(void*) * frameCount) != 0)
+			{
+				continue;
+			}
+
+			site.allocations++;
+			site.bytes += size;
+			UnlockCallSites();
+			return;
+		}
+
+		callSitesDropped++;
+		UnlockCallSites();
+#else
+		(void)size;
+#endif
+	}
+
+	AllocationStats LoadStats(const TagCounters& counters)
+	{
+		AllocationStats stats;
+		stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+		stats.frees = counters.frees.load(std::memory_order_relaxed);
+		stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void AddStats(AllocationStats& total, const AllocationStats& stats)
+	{
+		total.allocations += stats.allocations;
+		total.frees += stats.frees;
+		total.bytes += stats.bytes;
+	}
+
+	void PrintStatsRow(FILE* file, const char* name, const AllocationStats& stats)
+	{
+		fprintf(file, "  %-12s %12llu %12llu %16llu\n", name, stats.allocations, stats.frees, stats.bytes);
+	}
+}
+
+
+#ifdef ALLOCATION_TRACKING
+
+// --------------------------------------------------------
+// Global new/delete replacements - every form funnels into
+// AllocationTracker::Allocate() and Free().  Over-aligned
+// new/delete are left alone and aren't tracked.
+// --------------------------------------------------------
+void* operator new(size_t size)
+{
+	void* memory = AllocationTracker::Allocate(size);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocationTracker::Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocationTracker::Allocate(size);
+}
+
+void operator delete(void* memory) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, size_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, size_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
+
+#endif
+
+
+bool AllocationTracker::IsEnabled()
+{
+#ifdef ALLOCATION_TRACKING
+	return true;
+#else
+	return false;
+#endif
+}
+
+// --------------------------------------------------------
+// Allocates size bytes plus a header, and counts it against
+// the calling thread's current tag
+// --------------------------------------------------------
+void* AllocationTracker::Allocate(size_t size)
+{
+	AllocationHeader* header = (AllocationHeader*)malloc(sizeof(AllocationHeader) + (size ? size : 1));
+	if (!header)
+		return 0;
+
+	header->size = size;
+	header->tag = (unsigned int)currentTag;
+
+	TagCounters& counters = frameCounters[header->tag];
+	counters.allocations.fetch_add(1, std::memory_order_relaxed);
+	counters.bytes.fetch_add(size, std::memory_order_relaxed);
+
+	long long live = liveBytes.fetch_add((long long)size, std::memory_order_relaxed) + (long long)size;
+	long long peak = peakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+
+	if (callSiteTracking.load(std::memory_order_relaxed) && !insideTracker)
+	{
+		insideTracker = true;
+		RecordCallSite(size);
+		insideTracker = false;
+	}
+
+	return header + 1;
+}
+
+void AllocationTracker::Free(void* memory)
+{
+	if (!memory)
+		return;
+
+	AllocationHeader* header = (AllocationHeader*)memory - 1;
+	frameCounters[header->tag].frees.fetch_add(1, std::memory_order_relaxed);
+	liveBytes.fetch_sub((long long)header->size, std::memory_order_relaxed);
+
+	free(header);
+}
+
+// --------------------------------------------------------
+// Moves the running counts into "last frame" and the totals
+// --------------------------------------------------------
+void AllocationTracker::EndFrame()
+{
+	for (unsigned int i = 0; i < TagCount; i++)
+	{
+		AllocationStats stats;
+		stats.allocations = frameCounters[i].allocations.exchange(0, std::memory_order_relaxed);
+		stats.frees = frameCounters[i].frees.exchange(0, std::memory_order_relaxed);
+		stats.bytes = frameCounters[i].bytes.exchange(0, std::memory_order_relaxed);
+
+		lastFrame[i] = stats;
+		AddStats(totals[i], stats);
+	}
+	framesTracked++;
+}
+
+AllocationStats AllocationTracker::GetFrameStats(AllocationTag tag)
+{
+	return lastFrame[(unsigned int)tag];
+}
+
+AllocationStats AllocationTracker::GetFrameTotals()
+{
+	AllocationStats total = {};
+	for (unsigned int i = 0; i < TagCount; i++)
+		AddStats(total, lastFrame[i]);
+	return total;
+}
+
+AllocationStats AllocationTracker::GetTotalStats(AllocationTag tag)
+{
+	// Include the frame in progress
+	AllocationStats stats = totals[(unsigned int)tag];
+	AddStats(stats, LoadStats(frameCounters[(unsigned int)tag]));
+	return stats;
+}
+
+long long AllocationTracker::GetLiveBytes()
+{
+	return liveBytes.load(std::memory_order_relaxed);
+}
+
+long long AllocationTracker::GetPeakBytes()
+{
+	return peakBytes.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::SetCallSiteTracking(bool enabled)
+{
+	callSiteTracking = enabled;
+}
+
+const char* AllocationTracker::GetTagName(AllocationTag tag)
+{
+	switch (tag)
+	{
+	case AllocationTag::General:	return "General";
+	case AllocationTag::Init:		return "Init";
+	case AllocationTag::Update:		return "Update";
+	case AllocationTag::Draw:		return "Draw";
+	case AllocationTag::Shaders:	return "Shaders";
+	case AllocationTag::Materials:	return "Materials";
+	case AllocationTag::Meshes:		return "Meshes";
+	case AllocationTag::Textures:	return "Textures";
+	case AllocationTag::Entities:	return "Entities";
+	case AllocationTag::Batching:	return "Batching";
+	case AllocationTag::RenderGraph:	return "RenderGraph";
+	case AllocationTag::Commands:	return "Commands";
+	default:						return "???";
+	}
+}
+
+AllocationTag AllocationTracker::GetCurrentTag()
+{
+	return currentTag;
+}
+
+void AllocationTracker::SetCurrentTag(AllocationTag tag)
+{
+	currentTag = tag;
+}
+
+// --------------------------------------------------------
+// Writes a plain text report.  Call sites are sorted by
+// number of allocations, with symbols where they can be found.
+// --------------------------------------------------------
+bool AllocationTracker::DumpToFile(const char* path)
+{
+	FILE* file = 0;
+	if (fopen_s(&file, path, "w") != 0 || !file)
+		return false;
+
+	insideTracker = true;
+
+	fprintf(file, "Allocation report\n");
+	fprintf(file, "  Tracking:    %s\n", IsEnabled() ? "on" : "off (define ALLOCATION_TRACKING)");
+	fprintf(file, "  Frames:      %llu\n", framesTracked);
+	fprintf(file, "  Live bytes:  %lld\n", GetLiveBytes());
+	fprintf(file, "  Peak bytes:  %lld\n\n", GetPeakBytes());
+
+	fprintf(file, "Last frame\n");
+	fprintf(file, "  %-12s %12s %12s %16s\n", "Tag", "Allocs", "Frees", "Bytes");
+	for (unsigned int i = 0; i < TagCount; i++)
+		PrintStatsRow(file, GetTagName((AllocationTag)i), lastFrame[i]);
+	PrintStatsRow(file, "Total", GetFrameTotals());
+
+	fprintf(file, "\nSince startup\n");
+	fprintf(file, "  %-12s %12s %12s %16s\n", "Tag", "Allocs", "Frees", "Bytes");
+	for (unsigned int i = 0; i < TagCount; i++)
+		PrintStatsRow(file, GetTagName((AllocationTag)i), GetTotalStats((AllocationTag)i));
+
+	// Sort the call sites without allocating - indices into a static array
+	static unsigned short order[MaxCallSites];
+	unsigned int siteCount = 0;
+
+	LockCallSites();
+	for (unsigned int i = 0; i < MaxCallSites; i++)
+	{
+		if (callSites[i].allocations > 0)
+			order[siteCount++] = (unsigned short)i;
+	}
+	std::sort(order, order + siteCount, [](unsigned short a, unsigned short b)
+	{
+		return callSites[a].allocations > callSites[b].allocations;
+	});
+
+	fprintf(file, "\nCall sites (%u recorded, %u allocations dropped)\n", siteCount, callSitesDropped);
+	if (!callSiteTracking && siteCount == 0)
+		fprintf(file, "  Call site tracking is off - see SetCallSiteTracking()\n");
+
+#ifdef _WIN32
+	HANDLE process = GetCurrentProcess();
+	bool symbols = SymInitialize(process, 0, TRUE) == TRUE;
+	SymSetOptions(SymGetOptions() | SYMOPT_LOAD_LINES);
+#endif
+
+	const unsigned int MaxSitesReported = 64;
+	for (unsigned int i = 0; i < siteCount && i < MaxSitesReported; i++)
+	{
+		const CallSite& site = callSites[order[i]];
+		fprintf(file, "\n  #%u  %llu allocations, %llu bytes\n", i + 1, site.allocations, site.bytes);
+
+		for (unsigned int f = 0; f < site.frameCount; f++)
+		{
+#ifdef _WIN32
+			if (symbols)
+			{
+				char symbolBuffer[sizeof(SYMBOL_INFO) + 256] = {};
+				SYMBOL_INFO* symbol = (SYMBOL_INFO*)symbolBuffer;
+				symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+				symbol->MaxNameLen = 255;
+
+				DWORD64 address = (DWORD64)site.frames[f];
+				DWORD lineOffset = 0;
+				IMAGEHLP_LINE64 line = {};
+				line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+				if (SymFromAddr(process, address, 0, symbol))
+				{
+					if (SymGetLineFromAddr64(process, address, &lineOffset, &line))
+						fprintf(file, "      %s  (%s:%lu)\n", symbol->Name, line.FileName, line.LineNumber);
+					else
+						fprintf(file, "      %s\n", symbol->Name);
+					continue;
+				}
+			}
+#endif
+			fprintf(file, "      %p\n", site.frames[f]);
+		}
+	}
+	UnlockCallSites();
+
+#ifdef _WIN32
+	if (symbols)
+		SymCleanup(process);
+#endif
+
+	insideTracker = false;
+	fclose(file);
+	return true;
+}
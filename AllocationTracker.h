@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+
+// Define this (here or in the project's preprocessor settings) to
+// replace the global operator new/delete with tracking versions.
+// Without it everything below still compiles, but reports zeros.
+//#define ALLOCATION_TRACKING
+
+// --------------------------------------------------------
+// What part of the program an allocation came from.  Set
+// for the current thread with an AllocationScope - the
+// innermost scope wins, so the frame phases only count what
+// no subsystem scope inside them has claimed.
+// --------------------------------------------------------
+enum class AllocationTag : unsigned int
+{
+	// Frame phases, set by DXCore
+	General,
+	Init,
+	Update,
+	Draw,
+
+	// Subsystems, set where they're called
+	Shaders,		// Loading, reflection and setting shader variables
+	Materials,		// Materials and the material table
+	Meshes,			// Model loading and geometry uploads
+	Textures,		// Texture loading and packing
+	Entities,		// Entity creation and snapshots
+	Batching,		// Static chunks and instance batches
+	RenderGraph,	// Building and executing the graph
+	Commands,		// Recording and submitting command streams
+
+	Count
+};
+
+struct AllocationStats
+{
+	unsigned long long allocations;
+	unsigned long long frees;
+	unsigned long long bytes;	// Bytes allocated (not net of frees)
+};
+
+// --------------------------------------------------------
+// Counts every global new/delete by tag, per frame.  Can
+// also group allocations by call stack, which is slower, so
+// it has to be switched on with SetCallSiteTracking().
+// --------------------------------------------------------
+class AllocationTracker
+{
+public:
+	static bool IsEnabled();
+
+	// Called once per frame by DXCore::Run, while nothing else is running
+	static void EndFrame();
+
+	// Stats for the last finished frame
+	static AllocationStats GetFrameStats(AllocationTag tag);
+	static AllocationStats GetFrameTotals();
+
+	// Stats since startup
+	static AllocationStats GetTotalStats(AllocationTag tag);
+	static long long GetLiveBytes();
+	static long long GetPeakBytes();
+
+	static void SetCallSiteTracking(bool enabled);
+
+	// Writes everything above, plus the busiest call sites, to a text file
+	static bool DumpToFile(const char* path);
+
+	static const char* GetTagName(AllocationTag tag);
+
+	// Used by the global operator new/delete
+	static void* Allocate(size_t size);
+	static void Free(void* memory);
+
+private:
+	friend class AllocationScope;
+	static AllocationTag GetCurrentTag();
+	static void SetCurrentTag(AllocationTag tag);
+};
+
+// --------------------------------------------------------
+// Tags this thread's allocations until it goes out of scope
+// --------------------------------------------------------
+class AllocationScope
+{
+public:
+	AllocationScope(AllocationTag tag)
+	{
+		previousTag = AllocationTracker::GetCurrentTag();
+		AllocationTracker::SetCurrentTag(tag);
+	}
+
+	~AllocationScope()
+	{
+		AllocationTracker::SetCurrentTag(previousTag);
+	}
+
+	AllocationScope(AllocationScope const&) = delete;
+	void operator=(AllocationScope const&) = delete;
+
+private:
+	AllocationTag previousTag;
+};
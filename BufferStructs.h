@@ -2,11 +2,118 @@
 
 #include <DirectXMath.h>
 
-struct VertexShaderExternalData
+#include "Lights.h"
+#include "SimpleShader.h"
+
+// C++ mirrors of the shaders' cbuffers, each filled and uploaded as a whole.
+// Members (and padding) have to match the HLSL exactly - the static_asserts
+// check the packing rules, and GetConstantBufferHandle() checks the shader.
+
+// VertexShader.hlsl - PerFrame
+struct VSPerFrameData
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+
+	DirectX::XMFLOAT4X4 shadowView;
+	DirectX::XMFLOAT4X4 shadowProjection;
+};
+
+template<> struct ConstantBufferLayout<VSPerFrameData>
+{
+	static constexpr const char* Name = "PerFrame";
+	static constexpr ConstantBufferField Fields[] =
+	{
+		CBUFFER_FIELD(VSPerFrameData, view),
+		CBUFFER_FIELD(VSPerFrameData, projection),
+		CBUFFER_FIELD(VSPerFrameData, shadowView),
+		CBUFFER_FIELD(VSPerFrameData, shadowProjection),
+	};
+};
+static_assert(IsValidConstantBufferLayout<VSPerFrameData>(), "VSPerFrameData doesn't follow cbuffer packing");
+
+// ShadowVS.hlsl - PerFrame
+struct ShadowVSPerFrameData
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+};
+
+template<> struct ConstantBufferLayout<ShadowVSPerFrameData>
 {
+	static constexpr const char* Name = "PerFrame";
+	static constexpr ConstantBufferField Fields[] =
+	{
+		CBUFFER_FIELD(ShadowVSPerFrameData, view),
+		CBUFFER_FIELD(ShadowVSPerFrameData, projection),
+	};
+};
+static_assert(IsValidConstantBufferLayout<ShadowVSPerFrameData>(), "ShadowVSPerFrameData doesn't follow cbuffer packing");
+
+// PixelShader.hlsl - PerFrame
+struct PSPerFrameData
+{
+	DirectX::XMFLOAT3 cameraPos;
+	float padding0;				// a float3 can't straddle a register, so ambient starts on the next one
+	DirectX::XMFLOAT3 ambient;
+	float padding1;
+};
+
+template<> struct ConstantBufferLayout<PSPerFrameData>
+{
+	static constexpr const char* Name = "PerFrame";
+	static constexpr ConstantBufferField Fields[] =
+	{
+		CBUFFER_FIELD(PSPerFrameData, cameraPos),
+		CBUFFER_FIELD(PSPerFrameData, ambient),
+	};
+};
+static_assert(IsValidConstantBufferLayout<PSPerFrameData>(), "PSPerFrameData doesn't follow cbuffer packing");
+
+// PixelShader.hlsl - PerLight
+struct PSPerLightData
+{
+	Light directionalLight3;
+};
+
+template<> struct ConstantBufferLayout<PSPerLightData>
+{
+	static constexpr const char* Name = "PerLight";
+	static constexpr ConstantBufferField Fields[] =
+	{
+		CBUFFER_FIELD(PSPerLightData, directionalLight3),
+	};
+};
+static_assert(IsValidConstantBufferLayout<PSPerLightData>(), "PSPerLightData doesn't follow cbuffer packing");
+
+// PixelShader.hlsl - one element of the Materials structured buffer (MaterialData
+// in ShaderInclude.hlsli).  Structured buffers pack tightly, but the stride is kept
+// a multiple of 16 anyway.
+struct MaterialData
+{
+	static const unsigned int MaxTextureSlices = 4;
+
 	DirectX::XMFLOAT4 colorTint;
-	DirectX::XMFLOAT4X4 world;
+	float roughness;
+	float padding[3];
+	unsigned int textureSlices[MaxTextureSlices];	// By texture register - see TextureArrayPacker
+};
+static_assert(sizeof(MaterialData) % 16 == 0, "MaterialData's stride should be a multiple of 16");
 
-	DirectX::XMFLOAT4X4 viewMatrix;
-	DirectX::XMFLOAT4X4 projectionMatrix;
-};
\ No newline at end of file
+// SkyVertexShader.hlsl - ExternalData
+struct SkyVSData
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+};
+
+template<> struct ConstantBufferLayout<SkyVSData>
+{
+	static constexpr const char* Name = "ExternalData";
+	static constexpr ConstantBufferField Fields[] =
+	{
+		CBUFFER_FIELD(SkyVSData, view),
+		CBUFFER_FIELD(SkyVSData, projection),
+	};
+};
+static_assert(IsValidConstantBufferLayout<SkyVSData>(), "SkyVSData doesn't follow cbuffer packing");
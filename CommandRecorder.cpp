@@ -0,0 +1,94 @@
+#include "CommandRecorder.h"
+#include "JobSystem.h"
+
+CommandRecorder::CommandRecorder(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int contextCount)
+	: driverCommandLists(false),
+	lastListCount(0)
+{
+	if (contextCount > MaxContexts)
+		contextCount = MaxContexts;
+
+	D3D11_FEATURE_DATA_THREADING threading = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))))
+		driverCommandLists = threading.DriverCommandLists != FALSE;
+
+	for (unsigned int i = 0; i < contextCount; i++)
+	{
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> deferred;
+		if (FAILED(device->CreateDeferredContext(0, deferred.GetAddressOf())))
+			break;
+
+		deferredContexts.push_back(deferred);
+		contexts.push_back(RenderContext(deferred, std::make_shared<StateCache>(deferred), i + 1));
+	}
+	commandLists.resize(contexts.size());
+}
+
+void CommandRecorder::Record(unsigned int count, const std::function<void(unsigned int, RenderContext&)>& record)
+{
+	if (count > contexts.size())
+		count = (unsigned int)contexts.size();
+
+	// One list per job - they're few, and each is plenty of work
+	JobSystem::GetInstance().ParallelFor(count, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			// Each list starts from nothing, and so do the cache and pipeline
+			contexts[i].GetStateCache().Reset();
+			contexts[i].ResetPipelineState();
+			record(i, contexts[i]);
+			contexts[i].Submit();
+			deferredContexts[i]->FinishCommandList(FALSE, commandLists[i].ReleaseAndGetAddressOf());
+		}
+	});
+
+	lastListCount = count;
+}
+
+void CommandRecorder::Execute(StateCache& immediate)
+{
+	for (unsigned int i = 0; i < lastListCount; i++)
+	{
+		if (commandLists[i])
+			immediate.GetContext()->ExecuteCommandList(commandLists[i].Get(), FALSE);
+		commandLists[i].Reset();
+	}
+
+	// Not restoring state clears it
+	if (lastListCount > 0)
+		immediate.Reset();
+}
+
+unsigned long long CommandRecorder::GetCallsIssued()
+{
+	unsigned long long calls = 0;
+	for (RenderContext& context : contexts)
+		calls += context.GetStateCache().GetCallsIssued();
+	return calls;
+}
+
+unsigned long long CommandRecorder::GetCallsFiltered()
+{
+	unsigned long long calls = 0;
+	for (RenderContext& context : contexts)
+		calls += context.GetStateCache().GetCallsFiltered();
+	return calls;
+}
+
+unsigned long long CommandRecorder::GetCommandsSubmitted()
+{
+	unsigned long long commands = 0;
+	for (RenderContext& context : contexts)
+		commands += context.GetCommandsSubmitted();
+	return commands;
+}
+
+void CommandRecorder::ResetCounters()
+{
+	for (RenderContext& context : contexts)
+	{
+		context.GetStateCache().ResetCounters();
+		context.ResetCounters();
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "CommandStream.h"
+#include "D3D11CommandExecutor.h"
+#include "NullCommandExecutor.h"
+#include "SimpleShader.h"
+#include "StateCache.h"
+
+class PipelineState;
+
+// --------------------------------------------------------
+// What one thread draws with: a command stream to encode
+// into, the device context (and its state cache) Submit()
+// plays the stream on, and a slot that picks the thread's
+// own copy of every shader's constants (see ISimpleShader::
+// SetShader(RenderContext&) and friends).
+//
+// It also remembers the last PipelineState bound through it,
+// so binding it again costs nothing.  Anything that clears
+// the context's state has to reset that too.
+//
+// Slot 0 is the immediate context.  Shaders use their own
+// constants and ring for it, and keep binding through their
+// cache outside of streams, so its cache has to be the one
+// the shaders were given.
+// --------------------------------------------------------
+class RenderContext
+{
+public:
+	RenderContext(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<StateCache> stateCache, unsigned int slot)
+		: context(context), stateCache(stateCache), executor(stateCache), capture(0), pipelineState(0), slot(slot), commandsSubmitted(0) {}
+
+	ID3D11DeviceContext* GetContext() { return context.Get(); }
+	StateCache& GetStateCache() { return *stateCache; }
+	CommandStream& GetStream() { return stream; }
+	unsigned int GetSlot() { return slot; }
+
+	// Plays everything encoded so far on the context, then empties the stream
+	void Submit()
+	{
+		if (capture)
+			capture->Execute(stream);
+		executor.Execute(stream);
+
+		commandsSubmitted += stream.GetCommandCount();
+		stream.Reset();
+	}
+
+	// The pipeline the stream leaves bound - only PipelineState::Bind() sets it
+	const PipelineState* GetPipelineState() { return pipelineState; }
+	void SetPipelineState(const PipelineState* pipelineState) { this->pipelineState = pipelineState; }
+	void ResetPipelineState() { pipelineState = 0; }
+
+	// Also plays submitted streams on capture, until set back to null
+	void SetCapture(NullCommandExecutor* capture) { this->capture = capture; }
+
+	unsigned long long GetCommandsSubmitted() { return commandsSubmitted; }
+	void ResetCounters() { commandsSubmitted = 0; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<StateCache> stateCache;
+	CommandStream stream;
+	D3D11CommandExecutor executor;
+	NullCommandExecutor* capture;
+	const PipelineState* pipelineState;
+	unsigned int slot;
+	unsigned long long commandsSubmitted;
+};
+
+// --------------------------------------------------------
+// Records draws on several threads at once, each into its
+// own deferred context, then plays the command lists back
+// in order on the immediate context.
+//
+// Every list starts from cleared state and is executed
+// without restoring any, so a recording sets everything it
+// draws with (render targets and viewport included), and
+// the immediate context is left cleared after Execute().
+//
+// Anything the lists read but don't write - mapped buffers,
+// updated tables - has to be written on the immediate
+// context before Execute(), and not changed while the jobs
+// record.
+// --------------------------------------------------------
+class CommandRecorder
+{
+public:
+	// Slot 0 is the immediate context's
+	static const unsigned int MaxContexts = ISimpleShader::MaxContextSlots - 1;
+
+	CommandRecorder(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int contextCount);
+
+	unsigned int GetContextCount() { return (unsigned int)contexts.size(); }
+
+	// Whether the driver records command lists itself - without
+	// it the runtime emulates them, and recording on threads
+	// saves less
+	bool HasDriverCommandLists() { return driverCommandLists; }
+
+	// --------------------------------------------------------
+	// Calls record(i, context) for every i in [0, count) on
+	// the job system, each encoding into context i's stream,
+	// then submits the streams and keeps the finished lists in
+	// that order.  count is clamped to the number of contexts.
+	// --------------------------------------------------------
+	void Record(unsigned int count, const std::function<void(unsigned int, RenderContext&)>& record);
+
+	// Runs the recorded lists in order on the immediate context,
+	// then resets its cache to match the cleared state
+	void Execute(StateCache& immediate);
+
+	// The deferred contexts' state cache and command counts, summed
+	unsigned long long GetCallsIssued();
+	unsigned long long GetCallsFiltered();
+	unsigned long long GetCommandsSubmitted();
+	void ResetCounters();
+
+	unsigned int GetLastListCount() { return lastListCount; }
+
+private:
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DeviceContext>> deferredContexts;
+	std::vector<RenderContext> contexts;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11CommandList>> commandLists;
+	bool driverCommandLists;
+	unsigned int lastListCount;
+};
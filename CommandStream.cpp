@@ -0,0 +1,315 @@
+#include "CommandStream.h"
+
+#include <cstring>
+
+CommandStream::CommandStream()
+	: size(0),
+	commandCount(0)
+{
+}
+
+void CommandStream::Reset()
+{
+	size = 0;
+	commandCount = 0;
+}
+
+// --------------------------------------------------------
+// Adds a header and room for the payload plus trailingSize
+// bytes after it, and returns the payload.  The room is
+// zeroed, so padding never carries an older frame's bytes.
+// --------------------------------------------------------
+void* CommandStream::Push(CommandType type, size_t payloadSize, size_t trailingSize)
+{
+	size_t commandSize = AlignCommandSize(payloadSize) + AlignCommandSize(trailingSize);
+	size_t totalSize = sizeof(CommandHeader) + commandSize;
+
+	// Doubling, so a growing stream copies itself rarely
+	if (size + totalSize > data.size())
+	{
+		size_t newSize = data.empty() ? 4096 : data.size() * 2;
+		while (newSize < size + totalSize)
+			newSize *= 2;
+		data.resize(newSize);
+	}
+
+	CommandHeader* header = reinterpret_cast<CommandHeader*>(&data[size]);
+	header->type = type;
+	header->size = (unsigned int)commandSize;
+
+	unsigned char* payload = &data[size + sizeof(CommandHeader)];
+	memset(payload, 0, commandSize);
+
+	size += totalSize;
+	commandCount++;
+	return payload;
+}
+
+void CommandStream::PushResources(CommandType type, ShaderStage stage, unsigned int startSlot, unsigned int count, void* const* items)
+{
+	SetResourcesCommand* command = (SetResourcesCommand*)Push(type, sizeof(SetResourcesCommand), sizeof(void*) * count);
+	command->stage = stage;
+	command->startSlot = startSlot;
+	command->count = count;
+	memcpy((unsigned char*)command + AlignCommandSize(sizeof(SetResourcesCommand)), items, sizeof(void*) * count);
+}
+
+void CommandStream::SetRenderTargets(unsigned int count, void* const* targets, void* depthStencil)
+{
+	if (count > SetRenderTargetsCommand::MaxTargets)
+		count = SetRenderTargetsCommand::MaxTargets;
+
+	SetRenderTargetsCommand* command = (SetRenderTargetsCommand*)Push(CommandType::SetRenderTargets, sizeof(SetRenderTargetsCommand), 0);
+	command->count = count;
+	for (unsigned int i = 0; i < count; i++)
+		command->targets[i] = targets[i];
+	command->depthStencil = depthStencil;
+}
+
+void CommandStream::ClearRenderTarget(void* target, const float color[4])
+{
+	ClearRenderTargetCommand* command = (ClearRenderTargetCommand*)Push(CommandType::ClearRenderTarget, sizeof(ClearRenderTargetCommand), 0);
+	command->target = target;
+	for (int i = 0; i < 4; i++)
+		command->color[i] = color[i];
+}
+
+void CommandStream::ClearDepthStencil(void* depthStencil, unsigned int flags, float depth, unsigned int stencil)
+{
+	ClearDepthStencilCommand* command = (ClearDepthStencilCommand*)Push(CommandType::ClearDepthStencil, sizeof(ClearDepthStencilCommand), 0);
+	command->depthStencil = depthStencil;
+	command->flags = flags;
+	command->depth = depth;
+	command->stencil = stencil;
+}
+
+void CommandStream::SetDepthStencilState(void* state, unsigned int stencilRef)
+{
+	SetDepthStencilStateCommand* command = (SetDepthStencilStateCommand*)Push(CommandType::SetDepthStencilState, sizeof(SetDepthStencilStateCommand), 0);
+	command->state = state;
+	command->stencilRef = stencilRef;
+}
+
+void CommandStream::SetBlendState(void* state, const float blendFactor[4], unsigned int sampleMask)
+{
+	SetBlendStateCommand* command = (SetBlendStateCommand*)Push(CommandType::SetBlendState, sizeof(SetBlendStateCommand), 0);
+	command->state = state;
+	for (int i = 0; i < 4; i++)
+		command->blendFactor[i] = blendFactor[i];
+	command->sampleMask = sampleMask;
+}
+
+void CommandStream::SetViewport(float x, float y, float width, float height, float minDepth, float maxDepth)
+{
+	SetViewportCommand* command = (SetViewportCommand*)Push(CommandType::SetViewport, sizeof(SetViewportCommand), 0);
+	command->x = x;
+	command->y = y;
+	command->width = width;
+	command->height = height;
+	command->minDepth = minDepth;
+	command->maxDepth = maxDepth;
+}
+
+void CommandStream::SetRasterizerState(void* state)
+{
+	SetRasterizerStateCommand* command = (SetRasterizerStateCommand*)Push(CommandType::SetRasterizerState, sizeof(SetRasterizerStateCommand), 0);
+	command->state = state;
+}
+
+void CommandStream::SetTopology(unsigned int topology)
+{
+	SetTopologyCommand* command = (SetTopologyCommand*)Push(CommandType::SetTopology, sizeof(SetTopologyCommand), 0);
+	command->topology = topology;
+}
+
+void CommandStream::SetInputLayout(void* layout)
+{
+	SetInputLayoutCommand* command = (SetInputLayoutCommand*)Push(CommandType::SetInputLayout, sizeof(SetInputLayoutCommand), 0);
+	command->layout = layout;
+}
+
+void CommandStream::SetVertexBuffers(unsigned int startSlot, unsigned int count, void* const* buffers, const unsigned int* strides, const unsigned int* offsets)
+{
+	SetVertexBuffersCommand* command = (SetVertexBuffersCommand*)Push(CommandType::SetVertexBuffers, sizeof(SetVertexBuffersCommand), sizeof(VertexBufferBinding) * count);
+	command->startSlot = startSlot;
+	command->count = count;
+
+	VertexBufferBinding* bindings = (VertexBufferBinding*)((unsigned char*)command + AlignCommandSize(sizeof(SetVertexBuffersCommand)));
+	for (unsigned int i = 0; i < count; i++)
+	{
+		bindings[i].buffer = buffers[i];
+		bindings[i].stride = strides[i];
+		bindings[i].offset = offsets[i];
+	}
+}
+
+void CommandStream::SetIndexBuffer(void* buffer, unsigned int format, unsigned int offset)
+{
+	SetIndexBufferCommand* command = (SetIndexBufferCommand*)Push(CommandType::SetIndexBuffer, sizeof(SetIndexBufferCommand), 0);
+	command->buffer = buffer;
+	command->format = format;
+	command->offset = offset;
+}
+
+void CommandStream::SetShader(ShaderStage stage, void* shader)
+{
+	SetShaderCommand* command = (SetShaderCommand*)Push(CommandType::SetShader, sizeof(SetShaderCommand), 0);
+	command->stage = stage;
+	command->shader = shader;
+}
+
+void CommandStream::SetConstantBuffer(ShaderStage stage, unsigned int slot, void* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	SetConstantBufferCommand* command = (SetConstantBufferCommand*)Push(CommandType::SetConstantBuffer, sizeof(SetConstantBufferCommand), 0);
+	command->stage = stage;
+	command->slot = slot;
+	command->buffer = buffer;
+	command->firstConstant = firstConstant;
+	command->constantCount = constantCount;
+}
+
+void CommandStream::SetResources(ShaderStage stage, unsigned int startSlot, unsigned int count, void* const* views)
+{
+	PushResources(CommandType::SetResources, stage, startSlot, count, views);
+}
+
+void CommandStream::SetSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, void* const* samplers)
+{
+	PushResources(CommandType::SetSamplers, stage, startSlot, count, samplers);
+}
+
+void CommandStream::UpdateBuffer(void* buffer, unsigned int offset, unsigned int size, const void* data, UpdateBufferCommand::Mode mode)
+{
+	UpdateBufferCommand* command = (UpdateBufferCommand*)Push(CommandType::UpdateBuffer, sizeof(UpdateBufferCommand), size);
+	command->buffer = buffer;
+	command->offset = mode == UpdateBufferCommand::Range ? offset : 0;
+	command->size = size;
+	command->mode = mode;
+	memcpy((unsigned char*)command + AlignCommandSize(sizeof(UpdateBufferCommand)), data, size);
+}
+
+void CommandStream::DrawIndexed(unsigned int indexCount, unsigned int firstIndex, int baseVertex)
+{
+	DrawIndexedCommand* command = (DrawIndexedCommand*)Push(CommandType::DrawIndexed, sizeof(DrawIndexedCommand), 0);
+	command->indexCount = indexCount;
+	command->firstIndex = firstIndex;
+	command->baseVertex = baseVertex;
+}
+
+void CommandStream::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int firstIndex, int baseVertex, unsigned int firstInstance)
+{
+	DrawIndexedInstancedCommand* command = (DrawIndexedInstancedCommand*)Push(CommandType::DrawIndexedInstanced, sizeof(DrawIndexedInstancedCommand), 0);
+	command->indexCount = indexCount;
+	command->instanceCount = instanceCount;
+	command->firstIndex = firstIndex;
+	command->baseVertex = baseVertex;
+	command->firstInstance = firstInstance;
+}
+
+// --------------------------------------------------------
+// Walks the headers.  Every payload (and whatever trails
+// it) starts aligned, so commands are read where they are,
+// without copying.
+// --------------------------------------------------------
+void CommandExecutor::Execute(const CommandStream& stream)
+{
+	const unsigned char* position = stream.GetData();
+	const unsigned char* end = position + stream.GetSize();
+
+	while (position < end)
+	{
+		const CommandHeader* header = reinterpret_cast<const CommandHeader*>(position);
+		const void* payload = position + sizeof(CommandHeader);
+		position += sizeof(CommandHeader) + header->size;
+
+		switch (header->type)
+		{
+		case CommandType::SetRenderTargets:
+			SetRenderTargets(*(const SetRenderTargetsCommand*)payload);
+			break;
+
+		case CommandType::ClearRenderTarget:
+			ClearRenderTarget(*(const ClearRenderTargetCommand*)payload);
+			break;
+
+		case CommandType::ClearDepthStencil:
+			ClearDepthStencil(*(const ClearDepthStencilCommand*)payload);
+			break;
+
+		case CommandType::SetViewport:
+			SetViewport(*(const SetViewportCommand*)payload);
+			break;
+
+		case CommandType::SetRasterizerState:
+			SetRasterizerState(*(const SetRasterizerStateCommand*)payload);
+			break;
+
+		case CommandType::SetDepthStencilState:
+			SetDepthStencilState(*(const SetDepthStencilStateCommand*)payload);
+			break;
+
+		case CommandType::SetBlendState:
+			SetBlendState(*(const SetBlendStateCommand*)payload);
+			break;
+
+		case CommandType::SetTopology:
+			SetTopology(*(const SetTopologyCommand*)payload);
+			break;
+
+		case CommandType::SetInputLayout:
+			SetInputLayout(*(const SetInputLayoutCommand*)payload);
+			break;
+
+		case CommandType::SetShader:
+			SetShader(*(const SetShaderCommand*)payload);
+			break;
+
+		case CommandType::SetConstantBuffer:
+			SetConstantBuffer(*(const SetConstantBufferCommand*)payload);
+			break;
+
+		case CommandType::SetResources:
+		{
+			const SetResourcesCommand* command = (const SetResourcesCommand*)payload;
+			SetResources(*command, (void* const*)((const unsigned char*)payload + AlignCommandSize(sizeof(SetResourcesCommand))));
+			break;
+		}
+
+		case CommandType::SetSamplers:
+		{
+			const SetResourcesCommand* command = (const SetResourcesCommand*)payload;
+			SetSamplers(*command, (void* const*)((const unsigned char*)payload + AlignCommandSize(sizeof(SetResourcesCommand))));
+			break;
+		}
+
+		case CommandType::SetVertexBuffers:
+		{
+			const SetVertexBuffersCommand* command = (const SetVertexBuffersCommand*)payload;
+			SetVertexBuffers(*command, (const VertexBufferBinding*)((const unsigned char*)payload + AlignCommandSize(sizeof(SetVertexBuffersCommand))));
+			break;
+		}
+
+		case CommandType::SetIndexBuffer:
+			SetIndexBuffer(*(const SetIndexBufferCommand*)payload);
+			break;
+
+		case CommandType::UpdateBuffer:
+		{
+			const UpdateBufferCommand* command = (const UpdateBufferCommand*)payload;
+			UpdateBuffer(*command, (const unsigned char*)payload + AlignCommandSize(sizeof(UpdateBufferCommand)));
+			break;
+		}
+
+		case CommandType::DrawIndexed:
+			DrawIndexed(*(const DrawIndexedCommand*)payload);
+			break;
+
+		case CommandType::DrawIndexedInstanced:
+			DrawIndexedInstanced(*(const DrawIndexedInstancedCommand*)payload);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "ShaderStage.h"
+
+// --------------------------------------------------------
+// What each command in a CommandStream does.  The payloads
+// below are written one after another, each behind a
+// CommandHeader.
+// --------------------------------------------------------
+enum class CommandType : unsigned int
+{
+	SetRenderTargets,
+	ClearRenderTarget,
+	ClearDepthStencil,
+	SetViewport,
+	SetRasterizerState,
+	SetDepthStencilState,
+	SetBlendState,
+	SetTopology,
+	SetInputLayout,
+	SetShader,
+	SetConstantBuffer,
+	SetResources,
+	SetSamplers,
+	SetVertexBuffers,
+	SetIndexBuffer,
+	UpdateBuffer,
+	DrawIndexed,
+	DrawIndexedInstanced,
+
+	Count
+};
+
+// size covers the payload and anything trailing it, padded
+// so the next header stays aligned
+struct CommandHeader
+{
+	CommandType type;
+	unsigned int size;
+};
+
+// Payloads, and the data trailing them, start on pointer boundaries
+static const size_t CommandAlignment = sizeof(void*);
+inline size_t AlignCommandSize(size_t size) { return (size + CommandAlignment - 1) & ~(CommandAlignment - 1); }
+
+// --------------------------------------------------------
+// Command payloads.  GPU objects are opaque pointers and
+// enums are the API's raw values - only an executor knows
+// what they are, so nothing here needs a graphics header.
+// --------------------------------------------------------
+struct SetRenderTargetsCommand
+{
+	static const unsigned int MaxTargets = 8;
+
+	unsigned int count;
+	void* targets[MaxTargets];
+	void* depthStencil;
+};
+
+struct ClearRenderTargetCommand
+{
+	void* target;
+	float color[4];
+};
+
+struct ClearDepthStencilCommand
+{
+	enum Flags : unsigned int
+	{
+		Depth = 1,
+		Stencil = 2,
+	};
+
+	void* depthStencil;
+	unsigned int flags;
+	float depth;
+	unsigned int stencil;
+};
+
+struct SetViewportCommand
+{
+	float x;
+	float y;
+	float width;
+	float height;
+	float minDepth;
+	float maxDepth;
+};
+
+struct SetRasterizerStateCommand
+{
+	void* state;
+};
+
+struct SetDepthStencilStateCommand
+{
+	void* state;
+	unsigned int stencilRef;
+};
+
+struct SetBlendStateCommand
+{
+	void* state;
+	float blendFactor[4];
+	unsigned int sampleMask;
+};
+
+struct SetTopologyCommand
+{
+	unsigned int topology;
+};
+
+struct SetInputLayoutCommand
+{
+	void* layout;
+};
+
+struct SetShaderCommand
+{
+	ShaderStage stage;
+	void* shader;
+};
+
+// A constant count of 0 binds the whole buffer
+struct SetConstantBufferCommand
+{
+	ShaderStage stage;
+	unsigned int slot;
+	void* buffer;
+	unsigned int firstConstant;
+	unsigned int constantCount;
+};
+
+// Followed by count view (or sampler) pointers
+struct SetResourcesCommand
+{
+	ShaderStage stage;
+	unsigned int startSlot;
+	unsigned int count;
+};
+
+struct VertexBufferBinding
+{
+	void* buffer;
+	unsigned int stride;
+	unsigned int offset;
+};
+
+// Followed by count VertexBufferBindings
+struct SetVertexBuffersCommand
+{
+	unsigned int startSlot;
+	unsigned int count;
+};
+
+struct SetIndexBufferCommand
+{
+	void* buffer;
+	unsigned int format;
+	unsigned int offset;
+};
+
+// --------------------------------------------------------
+// Followed by size bytes, which go at offset in the buffer.
+// Whole updates replace all of it (and offset is 0) - only
+// they work on constant buffers everywhere.  Discard is for
+// dynamic buffers, which can't be updated any other way: it
+// writes from the start and drops whatever was past size.
+// --------------------------------------------------------
+struct UpdateBufferCommand
+{
+	enum Mode : unsigned int
+	{
+		Range,
+		Whole,
+		Discard,
+	};
+
+	void* buffer;
+	unsigned int offset;
+	unsigned int size;
+	Mode mode;
+};
+
+struct DrawIndexedCommand
+{
+	unsigned int indexCount;
+	unsigned int firstIndex;
+	int baseVertex;
+};
+
+struct DrawIndexedInstancedCommand
+{
+	unsigned int indexCount;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int firstInstance;
+};
+
+// --------------------------------------------------------
+// A frame's binds, uploads and draws, written into one
+// linear buffer instead of being made on a device context.
+// Game code encodes, and a CommandExecutor plays the stream
+// back later - on Direct3D, or on nothing at all, to time
+// or check the CPU side of a frame without a GPU.
+//
+// Upload data is copied into the stream, so whatever it
+// came from can change right after.  Objects are only
+// pointed to, and have to outlive execution.
+//
+// Reset() keeps the memory, so a stream reused every frame
+// stops allocating once it has grown to fit one.
+// --------------------------------------------------------
+class CommandStream
+{
+public:
+	CommandStream();
+
+	// Empties the stream, keeping its memory
+	void Reset();
+
+	// Output merger
+	void SetRenderTargets(unsigned int count, void* const* targets, void* depthStencil);
+	void ClearRenderTarget(void* target, const float color[4]);
+	void ClearDepthStencil(void* depthStencil, unsigned int flags, float depth, unsigned int stencil);
+	void SetDepthStencilState(void* state, unsigned int stencilRef);
+	void SetBlendState(void* state, const float blendFactor[4], unsigned int sampleMask);
+
+	// Rasterizer
+	void SetViewport(float x, float y, float width, float height, float minDepth, float maxDepth);
+	void SetRasterizerState(void* state);
+
+	// Input assembler
+	void SetTopology(unsigned int topology);
+	void SetInputLayout(void* layout);
+	void SetVertexBuffers(unsigned int startSlot, unsigned int count, void* const* buffers, const unsigned int* strides, const unsigned int* offsets);
+	void SetIndexBuffer(void* buffer, unsigned int format, unsigned int offset);
+
+	// Shader stages
+	void SetShader(ShaderStage stage, void* shader);
+	void SetConstantBuffer(ShaderStage stage, unsigned int slot, void* buffer, unsigned int firstConstant = 0, unsigned int constantCount = 0);
+	void SetResources(ShaderStage stage, unsigned int startSlot, unsigned int count, void* const* views);
+	void SetSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, void* const* samplers);
+
+	// Uploads
+	void UpdateBuffer(void* buffer, unsigned int offset, unsigned int size, const void* data, UpdateBufferCommand::Mode mode);
+
+	// Draws
+	void DrawIndexed(unsigned int indexCount, unsigned int firstIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int firstIndex, int baseVertex, unsigned int firstInstance);
+
+	const unsigned char* GetData() const { return data.data(); }
+	size_t GetSize() const { return size; }
+	unsigned int GetCommandCount() const { return commandCount; }
+	bool IsEmpty() const { return commandCount == 0; }
+
+private:
+	std::vector<unsigned char> data;	// Only ever grows - size is how much is in use
+	size_t size;
+	unsigned int commandCount;
+
+	void* Push(CommandType type, size_t payloadSize, size_t trailingSize);
+	void PushResources(CommandType type, ShaderStage stage, unsigned int startSlot, unsigned int count, void* const* items);
+};
+
+// --------------------------------------------------------
+// Plays a CommandStream back.  Execute() walks the stream
+// and hands each command to the matching method - a backend
+// only has to say what each one means.
+// --------------------------------------------------------
+class CommandExecutor
+{
+public:
+	virtual ~CommandExecutor() {}
+
+	// Runs every command in the stream, in order
+	void Execute(const CommandStream& stream);
+
+protected:
+	virtual void SetRenderTargets(const SetRenderTargetsCommand& command) = 0;
+	virtual void ClearRenderTarget(const ClearRenderTargetCommand& command) = 0;
+	virtual void ClearDepthStencil(const ClearDepthStencilCommand& command) = 0;
+	virtual void SetViewport(const SetViewportCommand& command) = 0;
+	virtual void SetRasterizerState(const SetRasterizerStateCommand& command) = 0;
+	virtual void SetDepthStencilState(const SetDepthStencilStateCommand& command) = 0;
+	virtual void SetBlendState(const SetBlendStateCommand& command) = 0;
+	virtual void SetTopology(const SetTopologyCommand& command) = 0;
+	virtual void SetInputLayout(const SetInputLayoutCommand& command) = 0;
+	virtual void SetShader(const SetShaderCommand& command) = 0;
+	virtual void SetConstantBuffer(const SetConstantBufferCommand& command) = 0;
+	virtual void SetResources(const SetResourcesCommand& command, void* const* views) = 0;
+	virtual void SetSamplers(const SetResourcesCommand& command, void* const* samplers) = 0;
+	virtual void SetVertexBuffers(const SetVertexBuffersCommand& command, const VertexBufferBinding* buffers) = 0;
+	virtual void SetIndexBuffer(const SetIndexBufferCommand& command) = 0;
+	virtual void UpdateBuffer(const UpdateBufferCommand& command, const void* data) = 0;
+	virtual void DrawIndexed(const DrawIndexedCommand& command) = 0;
+	virtual void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) = 0;
+};
@@ -0,0 +1,168 @@
+#include "ConstantBufferRing.h"
+
+#include <cstring>
+#include <thread>
+
+// --------------------------------------------------------
+// Creates the buffer and fences, if the device can bind
+// parts of a constant buffer.  Otherwise the ring stays
+// empty and IsSupported() returns false.
+// --------------------------------------------------------
+ConstantBufferRing::ConstantBufferRing(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int size)
+	: context(context),
+	supported(false),
+	discardNext(true),
+	nextFence(0),
+	generation(1),
+	discardCount(0),
+	frameBytes(0),
+	lastFrameBytes(0)
+{
+	// Offsets are bound through the 11.1 context, and NO_OVERWRITE
+	// on a constant buffer also needs 11.1
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (FAILED(context.As(&context1)) ||
+		FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+		!options.ConstantBufferOffsetting ||
+		!options.MapNoOverwriteOnDynamicConstantBuffer)
+	{
+		return;
+	}
+
+	// Offsets must be multiples of 16 constants (256 bytes)
+	size = (size + 255) & ~255u;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = size;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+		return;
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	for (unsigned int i = 0; i < FramesInFlight; i++)
+	{
+		if (FAILED(device->CreateQuery(&queryDesc, fences[i].GetAddressOf())))
+			return;
+	}
+
+	allocator.Reset(size, 256);
+	supported = true;
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+}
+
+// --------------------------------------------------------
+// Hands back the space of every frame the GPU has finished.
+// Only waits when every fence is taken, for the oldest, so
+// the ring can't be outrun indefinitely - a full ring doesn't
+// wait at all, Allocate() orphans the buffer instead.
+// --------------------------------------------------------
+void ConstantBufferRing::BeginFrame()
+{
+	if (!supported)
+		return;
+
+	while (allocator.GetFramesInFlight() > 0)
+	{
+		unsigned int oldest = (nextFence + FramesInFlight - allocator.GetFramesInFlight()) % FramesInFlight;
+		bool wait = allocator.GetFramesInFlight() >= FramesInFlight;
+		if (!IsFenceDone(oldest, wait))
+			break;
+
+		allocator.RetireOldestFrame();
+	}
+
+	// Last frame's slices may be reused from now on
+	generation++;
+}
+
+// --------------------------------------------------------
+// Marks the end of this frame's allocations with a fence
+// --------------------------------------------------------
+void ConstantBufferRing::EndFrame()
+{
+	if (!supported)
+		return;
+
+	context->End(fences[nextFence].Get());
+	nextFence = (nextFence + 1) % FramesInFlight;
+	allocator.FinishFrame();
+
+	lastFrameBytes = frameBytes;
+	frameBytes = 0;
+}
+
+// --------------------------------------------------------
+// Copies data to the next free slice of the ring
+// --------------------------------------------------------
+bool ConstantBufferRing::Allocate(const void* data, unsigned int size, unsigned int& firstConstant, unsigned int& constantCount, bool allowDiscard)
+{
+	if (!supported)
+		return false;
+
+	unsigned int offset = allocator.Allocate(size);
+	if (offset == RingAllocator::InvalidOffset)
+	{
+		if (!allowDiscard)
+			return false;
+
+		// Everything is still in use - orphan the buffer and start
+		// over.  Slices handed out before this point are gone.
+		allocator.Clear();
+		offset = allocator.Allocate(size);
+		if (offset == RingAllocator::InvalidOffset)
+			return false;	// Bigger than the whole ring
+
+		discardNext = true;
+		discardCount++;
+		generation++;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	D3D11_MAP mapType = discardNext ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (FAILED(context->Map(buffer.Get(), 0, mapType, 0, &mapped)))
+		return false;
+
+	memcpy((unsigned char*)mapped.pData + offset, data, size);
+	context->Unmap(buffer.Get(), 0);
+	discardNext = false;
+
+	// The bound range has to be a multiple of 16 constants too
+	firstConstant = offset / 16;
+	constantCount = ((size + 255) & ~255u) / 16;
+
+	frameBytes += size;
+	return true;
+}
+
+// --------------------------------------------------------
+// Checks (or waits for) one of the frame fences.  Waiting
+// gives the rest of the time slice up between polls, so the
+// render thread doesn't spin against the job system workers.
+// --------------------------------------------------------
+bool ConstantBufferRing::IsFenceDone(unsigned int fence, bool wait)
+{
+	BOOL done = FALSE;
+	if (!wait)
+		return context->GetData(fences[fence].Get(), &done, sizeof(done), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK && done;
+
+	// S_FALSE means not yet - anything else (even an error, like a
+	// removed device) means there's nothing more to wait for.  Only
+	// the first poll flushes, to make sure the fence is submitted.
+	UINT flags = 0;
+	while (context->GetData(fences[fence].Get(), &done, sizeof(done), flags) == S_FALSE)
+	{
+		flags = D3D11_ASYNC_GETDATA_DONOTFLUSH;
+		std::this_thread::yield();
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3d11_1.h>
+#include <wrl/client.h>
+
+#include "RingAllocator.h"
+
+// --------------------------------------------------------
+// One large dynamic constant buffer that per-draw constants
+// are streamed into.  Each upload takes the next slice of
+// the buffer (Map with NO_OVERWRITE), and the slice is bound
+// with *SetConstantBuffers1 offsets - so no draw ever waits
+// on a buffer the GPU is still reading.
+//
+// Slices are handed back once an event query shows the GPU
+// has finished the frame that used them.  If the ring fills
+// up anyway, the whole buffer is orphaned with DISCARD.
+//
+// Needs Direct3D 11.1 constant buffer offsetting.  Check
+// IsSupported() - without it, shaders should keep updating
+// their own constant buffers.
+// --------------------------------------------------------
+class ConstantBufferRing
+{
+public:
+	static const unsigned int DefaultSize = 4 * 1024 * 1024;
+	// One more than DXGI's default frame latency, so Present holds
+	// the CPU back before BeginFrame ever has to wait on a fence
+	static const unsigned int FramesInFlight = 4;
+
+	ConstantBufferRing(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int size = DefaultSize);
+	~ConstantBufferRing();
+
+	bool IsSupported() { return supported; }
+
+	// Called by the render thread around each frame's drawing
+	void BeginFrame();
+	void EndFrame();
+
+	// Copies size bytes into the ring and returns where they went,
+	// in 16-byte constants, ready for *SetConstantBuffers1.  Without
+	// allowDiscard a full ring fails instead of orphaning the buffer -
+	// for callers with slices that haven't been bound yet.
+	bool Allocate(const void* data, unsigned int size, unsigned int& firstConstant, unsigned int& constantCount, bool allowDiscard = true);
+
+	ID3D11Buffer* GetBuffer() { return buffer.Get(); }
+
+	// Changes whenever earlier allocations stop being usable - at
+	// the start of each frame, and when the buffer is discarded
+	unsigned int GetGeneration() { return generation; }
+
+	unsigned int GetDiscardCount() { return discardCount; }
+	unsigned int GetLastFrameBytes() { return lastFrameBytes; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11Query> fences[FramesInFlight];
+
+	RingAllocator allocator;
+	bool supported;
+	bool discardNext;	// The first map after creating or orphaning must DISCARD
+	unsigned int nextFence;
+	unsigned int generation;
+
+	unsigned int discardCount;
+	unsigned int frameBytes;
+	unsigned int lastFrameBytes;
+
+	bool IsFenceDone(unsigned int fence, bool wait);
+};
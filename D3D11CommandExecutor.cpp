@@ -0,0 +1,178 @@
+#include "D3D11CommandExecutor.h"
+
+#include <cstring>
+
+D3D11CommandExecutor::D3D11CommandExecutor(std::shared_ptr<StateCache> stateCache)
+	: stateCache(stateCache)
+{
+	stateCache->GetContext()->QueryInterface(IID_PPV_ARGS(context1.GetAddressOf()));
+}
+
+void D3D11CommandExecutor::SetRenderTargets(const SetRenderTargetsCommand& command)
+{
+	stateCache->GetContext()->OMSetRenderTargets(
+		command.count,
+		(ID3D11RenderTargetView* const*)command.targets,
+		(ID3D11DepthStencilView*)command.depthStencil);
+}
+
+void D3D11CommandExecutor::ClearRenderTarget(const ClearRenderTargetCommand& command)
+{
+	stateCache->GetContext()->ClearRenderTargetView((ID3D11RenderTargetView*)command.target, command.color);
+}
+
+void D3D11CommandExecutor::ClearDepthStencil(const ClearDepthStencilCommand& command)
+{
+	UINT flags = 0;
+	if (command.flags & ClearDepthStencilCommand::Depth) flags |= D3D11_CLEAR_DEPTH;
+	if (command.flags & ClearDepthStencilCommand::Stencil) flags |= D3D11_CLEAR_STENCIL;
+
+	stateCache->GetContext()->ClearDepthStencilView((ID3D11DepthStencilView*)command.depthStencil, flags, command.depth, (UINT8)command.stencil);
+}
+
+void D3D11CommandExecutor::SetViewport(const SetViewportCommand& command)
+{
+	D3D11_VIEWPORT viewport = {};
+	viewport.TopLeftX = command.x;
+	viewport.TopLeftY = command.y;
+	viewport.Width = command.width;
+	viewport.Height = command.height;
+	viewport.MinDepth = command.minDepth;
+	viewport.MaxDepth = command.maxDepth;
+	stateCache->GetContext()->RSSetViewports(1, &viewport);
+}
+
+void D3D11CommandExecutor::SetRasterizerState(const SetRasterizerStateCommand& command)
+{
+	stateCache->RSSetState((ID3D11RasterizerState*)command.state);
+}
+
+void D3D11CommandExecutor::SetDepthStencilState(const SetDepthStencilStateCommand& command)
+{
+	stateCache->OMSetDepthStencilState((ID3D11DepthStencilState*)command.state, command.stencilRef);
+}
+
+void D3D11CommandExecutor::SetBlendState(const SetBlendStateCommand& command)
+{
+	stateCache->OMSetBlendState((ID3D11BlendState*)command.state, command.blendFactor, command.sampleMask);
+}
+
+void D3D11CommandExecutor::SetTopology(const SetTopologyCommand& command)
+{
+	stateCache->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)command.topology);
+}
+
+void D3D11CommandExecutor::SetInputLayout(const SetInputLayoutCommand& command)
+{
+	stateCache->IASetInputLayout((ID3D11InputLayout*)command.layout);
+}
+
+void D3D11CommandExecutor::SetShader(const SetShaderCommand& command)
+{
+	switch (command.stage)
+	{
+	case ShaderStage::Vertex:	stateCache->VSSetShader((ID3D11VertexShader*)command.shader); break;
+	case ShaderStage::Hull:		stateCache->HSSetShader((ID3D11HullShader*)command.shader); break;
+	case ShaderStage::Domain:	stateCache->DSSetShader((ID3D11DomainShader*)command.shader); break;
+	case ShaderStage::Geometry:	stateCache->GSSetShader((ID3D11GeometryShader*)command.shader); break;
+	case ShaderStage::Pixel:	stateCache->PSSetShader((ID3D11PixelShader*)command.shader); break;
+	case ShaderStage::Compute:	stateCache->CSSetShader((ID3D11ComputeShader*)command.shader); break;
+	default: break;
+	}
+}
+
+void D3D11CommandExecutor::SetConstantBuffer(const SetConstantBufferCommand& command)
+{
+	ID3D11Buffer* buffer = (ID3D11Buffer*)command.buffer;
+	if (command.constantCount == 0)
+		stateCache->SetConstantBuffers(command.stage, command.slot, 1, &buffer);
+	else
+		stateCache->SetConstantBuffers1(command.stage, command.slot, 1, &buffer, &command.firstConstant, &command.constantCount);
+}
+
+void D3D11CommandExecutor::SetResources(const SetResourcesCommand& command, void* const* views)
+{
+	stateCache->SetShaderResources(command.stage, command.startSlot, command.count, (ID3D11ShaderResourceView* const*)views);
+}
+
+void D3D11CommandExecutor::SetSamplers(const SetResourcesCommand& command, void* const* samplers)
+{
+	stateCache->SetSamplers(command.stage, command.startSlot, command.count, (ID3D11SamplerState* const*)samplers);
+}
+
+void D3D11CommandExecutor::SetVertexBuffers(const SetVertexBuffersCommand& command, const VertexBufferBinding* buffers)
+{
+	ID3D11Buffer* vertexBuffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	UINT strides[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	UINT offsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+
+	unsigned int count = command.count;
+	if (count > D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT)
+		count = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		vertexBuffers[i] = (ID3D11Buffer*)buffers[i].buffer;
+		strides[i] = buffers[i].stride;
+		offsets[i] = buffers[i].offset;
+	}
+	stateCache->IASetVertexBuffers(command.startSlot, count, vertexBuffers, strides, offsets);
+}
+
+void D3D11CommandExecutor::SetIndexBuffer(const SetIndexBufferCommand& command)
+{
+	stateCache->IASetIndexBuffer((ID3D11Buffer*)command.buffer, (DXGI_FORMAT)command.format, command.offset);
+}
+
+// --------------------------------------------------------
+// Whole updates are a plain UpdateSubresource.  Partial ones
+// need a box, which constant buffers only take through 11.1's
+// UpdateSubresource1 - other buffers take one either way.
+// Discards map the (dynamic) buffer and copy into it.
+// --------------------------------------------------------
+void D3D11CommandExecutor::UpdateBuffer(const UpdateBufferCommand& command, const void* data)
+{
+	ID3D11Buffer* buffer = (ID3D11Buffer*)command.buffer;
+	ID3D11DeviceContext* context = stateCache->GetContext();
+	if (command.mode == UpdateBufferCommand::Whole)
+	{
+		context->UpdateSubresource(buffer, 0, 0, data, 0, 0);
+		return;
+	}
+
+	if (command.mode == UpdateBufferCommand::Discard)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (FAILED(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			return;
+
+		memcpy(mapped.pData, data, command.size);
+		context->Unmap(buffer, 0);
+		return;
+	}
+
+	D3D11_BOX box = {};
+	box.left = command.offset;
+	box.right = command.offset + command.size;
+	box.bottom = 1;
+	box.back = 1;
+	if (context1)
+		context1->UpdateSubresource1(buffer, 0, &box, data, 0, 0, 0);
+	else
+		context->UpdateSubresource(buffer, 0, &box, data, 0, 0);
+}
+
+void D3D11CommandExecutor::DrawIndexed(const DrawIndexedCommand& command)
+{
+	stateCache->GetContext()->DrawIndexed(command.indexCount, command.firstIndex, command.baseVertex);
+}
+
+void D3D11CommandExecutor::DrawIndexedInstanced(const DrawIndexedInstancedCommand& command)
+{
+	stateCache->GetContext()->DrawIndexedInstanced(
+		command.indexCount,
+		command.instanceCount,
+		command.firstIndex,
+		command.baseVertex,
+		command.firstInstance);
+}
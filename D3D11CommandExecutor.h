@@ -0,0 +1,45 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include <memory>
+
+#include "CommandStream.h"
+#include "StateCache.h"
+
+// --------------------------------------------------------
+// Plays command streams back on a Direct3D 11 context.
+// Binds go through the context's StateCache, so a stream
+// full of redundant binds still only reaches the driver
+// once per change.
+// --------------------------------------------------------
+class D3D11CommandExecutor : public CommandExecutor
+{
+public:
+	D3D11CommandExecutor(std::shared_ptr<StateCache> stateCache);
+
+protected:
+	void SetRenderTargets(const SetRenderTargetsCommand& command);
+	void ClearRenderTarget(const ClearRenderTargetCommand& command);
+	void ClearDepthStencil(const ClearDepthStencilCommand& command);
+	void SetViewport(const SetViewportCommand& command);
+	void SetRasterizerState(const SetRasterizerStateCommand& command);
+	void SetDepthStencilState(const SetDepthStencilStateCommand& command);
+	void SetBlendState(const SetBlendStateCommand& command);
+	void SetTopology(const SetTopologyCommand& command);
+	void SetInputLayout(const SetInputLayoutCommand& command);
+	void SetShader(const SetShaderCommand& command);
+	void SetConstantBuffer(const SetConstantBufferCommand& command);
+	void SetResources(const SetResourcesCommand& command, void* const* views);
+	void SetSamplers(const SetResourcesCommand& command, void* const* samplers);
+	void SetVertexBuffers(const SetVertexBuffersCommand& command, const VertexBufferBinding* buffers);
+	void SetIndexBuffer(const SetIndexBufferCommand& command);
+	void UpdateBuffer(const UpdateBufferCommand& command, const void* data);
+	void DrawIndexed(const DrawIndexedCommand& command);
+	void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command);
+
+private:
+	std::shared_ptr<StateCache> stateCache;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;	// For partial updates, if there's 11.1
+};
@@ -1,8 +1,12 @@
 #include "DXCore.h"
 #include "Input.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
 
 #include <WindowsX.h>
 #include <sstream>
+#include <cstdio>
 
 // Define the static instance variable so our OS-level 
 // message handling function below can talk to our object
@@ -46,18 +50,37 @@ DXCore::DXCore(
 	this->titleBarText = titleBarText;
 	this->width = windowWidth;
 	this->height = windowHeight;
+	this->bufferWidth = windowWidth;
+	this->bufferHeight = windowHeight;
 	this->titleBarStats = debugTitleBarStats;
 
 	// Initialize fields
 	this->hasFocus = true; 
+	this->pipelinedFrames = false;
 	
 	this->fpsFrameCount = 0;
 	this->fpsTimeElapsed = 0.0f;
+	this->updateSecondsElapsed = 0.0;
+	this->drawSecondsElapsed = 0.0;
 	this->currentTime = 0;
 	this->deltaTime = 0;
 	this->startTime = 0;
 	this->totalTime = 0;
 
+	this->renderPending = false;
+	this->renderQuit = false;
+	this->renderDeltaTime = 0;
+	this->renderTotalTime = 0;
+	this->resizePending = false;
+	this->resizeWidth = windowWidth;
+	this->resizeHeight = windowHeight;
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		this->modeSeconds[mode] = 0.0;
+		this->modeFrames[mode] = 0;
+	}
+
 	// Query performance counter for accurate timing information
 	__int64 perfFreq;
 	QueryPerformanceFrequency((LARGE_INTEGER*)&perfFreq);
@@ -69,6 +92,10 @@ DXCore::DXCore(
 // --------------------------------------------------------
 DXCore::~DXCore()
 {
+	// Run() normally stops the render thread, but make sure
+	// it isn't left running if we never got that far
+	StopRenderThread();
+
 	// Note: Since we're using smart pointers (ComPtr),
 	// we don't need to explicitly clean up those DirectX objects
 	// - If we weren't using smart pointers, we'd need
@@ -76,6 +103,12 @@ DXCore::~DXCore()
 
 	// Delete input manager singleton
 	delete& Input::GetInstance();
+
+	// Delete job system singleton (stops the worker threads)
+	delete& JobSystem::GetInstance();
+
+	// Delete frame arena singleton - nothing can be allocating from it now
+	delete& FrameArena::GetInstance();
 }
 
 // --------------------------------------------------------
@@ -169,6 +202,10 @@ HRESULT DXCore::InitDirectX()
 	// This will hold options for DirectX initialization
 	unsigned int deviceFlags = 0;
 
+	// The buffers start out at the window's size
+	bufferWidth = width;
+	bufferHeight = height;
+
 #if defined(DEBUG) || defined(_DEBUG)
 	// If we're in debug mode in visual studio, we also
 	// want to make a "Debug DirectX Device" to see some
@@ -291,8 +328,44 @@ HRESULT DXCore::InitDirectX()
 // If we don't do this, the window size and our rendering
 // resolution won't match up.  This can result in odd
 // stretching/skewing.
+//
+// The render thread may be drawing (and presenting) right
+// now, so this only asks for the resize - waiting for it
+// here could deadlock, since Present() can send messages to
+// this window and wait for them to be handled.
 // --------------------------------------------------------
 void DXCore::OnResize()
+{
+	std::lock_guard<std::mutex> lock(renderMutex);
+	resizeWidth = width;
+	resizeHeight = height;
+	resizePending = true;
+}
+
+// --------------------------------------------------------
+// Resizes the buffers if the window has changed size since
+// the last frame.  Called just before Draw(), on the thread
+// that calls it.
+// --------------------------------------------------------
+void DXCore::ApplyPendingResize()
+{
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		if (!resizePending)
+			return;
+
+		bufferWidth = resizeWidth;
+		bufferHeight = resizeHeight;
+		resizePending = false;
+	}
+
+	ResizeBuffers();
+}
+
+// --------------------------------------------------------
+// Resizes the swap chain and depth buffer to the buffer size
+// --------------------------------------------------------
+void DXCore::ResizeBuffers()
 {
 	// Release the buffers before resizing the swap chain
 	backBufferRTV.Reset();
@@ -301,8 +374,8 @@ void DXCore::OnResize()
 	// Resize the underlying swap chain buffers
 	swapChain->ResizeBuffers(
 		2,
-		width,
-		height,
+		bufferWidth,
+		bufferHeight,
 		DXGI_FORMAT_R8G8B8A8_UNORM,
 		0);
 
@@ -321,8 +394,8 @@ void DXCore::OnResize()
 
 	// Set up the description of the texture to use for the depth buffer
 	D3D11_TEXTURE2D_DESC depthStencilDesc;
-	depthStencilDesc.Width				= width;
-	depthStencilDesc.Height				= height;
+	depthStencilDesc.Width				= bufferWidth;
+	depthStencilDesc.Height				= bufferHeight;
 	depthStencilDesc.MipLevels			= 1;
 	depthStencilDesc.ArraySize			= 1;
 	depthStencilDesc.Format				= DXGI_FORMAT_D24_UNORM_S8_UINT;
@@ -358,8 +431,8 @@ void DXCore::OnResize()
 	D3D11_VIEWPORT viewport = {};
 	viewport.TopLeftX = 0;
 	viewport.TopLeftY = 0;
-	viewport.Width = (float)width;
-	viewport.Height = (float)height;
+	viewport.Width = (float)bufferWidth;
+	viewport.Height = (float)bufferHeight;
 	viewport.MinDepth = 0.0f;
 	viewport.MaxDepth = 1.0f;
 	context->RSSetViewports(1, &viewport);
@@ -370,6 +443,15 @@ void DXCore::OnResize()
 // This is the main game loop, handling the following:
 //  - OS-level messages coming in from Windows itself
 //  - Calling update & draw back and forth, forever
+//
+// With pipelinedFrames on, Draw() runs on the render thread
+// one frame behind Update():
+//
+//   main:    | Update N+1 |wait| Publish | Update N+2 |wait| ...
+//   render:  | Draw N          |         | Draw N+1        | ...
+//
+// The frame arena moves on to the next frame at Publish,
+// while neither thread is running.
 // --------------------------------------------------------
 HRESULT DXCore::Run()
 {
@@ -381,8 +463,23 @@ HRESULT DXCore::Run()
 	currentTime = now;
 	previousTime = now;
 
+	// Start the worker threads before Init(), so loading can use them
+	JobSystem::GetInstance().Initialize();
+
+	// One arena per job system thread, so per-frame allocations take no locks
+	FrameArena::GetInstance().Initialize(JobSystem::GetInstance().GetThreadCount());
+
+	// Tracking builds also group allocations by call stack
+	AllocationTracker::SetCallSiteTracking(AllocationTracker::IsEnabled());
+
 	// Give subclass a chance to initialize
-	Init();
+	{
+		AllocationScope allocationScope(AllocationTag::Init);
+		Init();
+	}
+
+	// Which mode the last frame ran in, so its time counts there
+	int lastMode = -1;
 
 	// Our overall game and message loop
 	MSG msg = {};
@@ -403,12 +500,57 @@ HRESULT DXCore::Run()
 			if(titleBarStats)
 				UpdateTitleBarStats();
 
+			if (lastMode >= 0)
+			{
+				modeSeconds[lastMode] += deltaTime;
+				modeFrames[lastMode]++;
+			}
+
 			// Update the input manager
 			Input::GetInstance().Update();
 
+			// Start or stop the render thread if the frame mode changed
+			if (pipelinedFrames && !renderThread.joinable())
+				StartRenderThread();
+			else if (!pipelinedFrames && renderThread.joinable())
+				StopRenderThread();
+			lastMode = renderThread.joinable() ? 1 : 0;
+
 			// The game loop
-			Update(deltaTime, totalTime);
-			Draw(deltaTime, totalTime);
+			__int64 updateStart;
+			QueryPerformanceCounter((LARGE_INTEGER*)&updateStart);
+			{
+				AllocationScope allocationScope(AllocationTag::Update);
+				Update(deltaTime, totalTime);
+			}
+			updateSecondsElapsed += GetSecondsSince(updateStart);
+
+			if (renderThread.joinable())
+			{
+				// Let the render thread finish the previous frame, then
+				// hand it this one and go straight back to updating
+				WaitForRenderThread();
+				PublishFrame();
+				FrameArena::GetInstance().EndFrame();
+				AllocationTracker::EndFrame();
+				KickRenderThread(deltaTime, totalTime);
+			}
+			else
+			{
+				PublishFrame();
+				FrameArena::GetInstance().EndFrame();
+				AllocationTracker::EndFrame();
+
+				ApplyPendingResize();
+
+				__int64 drawStart;
+				QueryPerformanceCounter((LARGE_INTEGER*)&drawStart);
+				{
+					AllocationScope allocationScope(AllocationTag::Draw);
+					Draw(deltaTime, totalTime);
+				}
+				drawSecondsElapsed += GetSecondsSince(drawStart);
+			}
 
 			// Frame is over, notify the input manager
 			Input::GetInstance().EndOfFrame();
@@ -417,10 +559,155 @@ HRESULT DXCore::Run()
 
 	// We'll end up here once we get a WM_QUIT message,
 	// which usually comes from the user closing the window
+	StopRenderThread();
+
+#if defined(DEBUG) || defined(_DEBUG)
+	FrameArena::GetInstance().ReportHighWaterMark();
+#endif
+
+	// Leave a report next to the executable for benchmark runs to pick up
+	if (AllocationTracker::IsEnabled())
+		AllocationTracker::DumpToFile(GetFullPathTo("allocations.txt").c_str());
+	ReportFrameTimes();
+
 	return (HRESULT)msg.wParam;
 }
 
 
+// --------------------------------------------------------
+// Starts the render thread used for pipelined frames
+// --------------------------------------------------------
+void DXCore::StartRenderThread()
+{
+	renderPending = false;
+	renderQuit = false;
+	renderThread = std::thread(&DXCore::RenderThreadLoop, this);
+}
+
+// --------------------------------------------------------
+// Lets the render thread finish its current frame, then
+// shuts it down.  Safe to call if it isn't running.
+// --------------------------------------------------------
+void DXCore::StopRenderThread()
+{
+	if (!renderThread.joinable())
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock(renderMutex);
+		renderCondition.wait(lock, [this] { return !renderPending; });
+		renderQuit = true;
+	}
+	renderCondition.notify_all();
+
+	renderThread.join();
+}
+
+// --------------------------------------------------------
+// Blocks until the render thread has no frame in flight.
+// Anything that touches the device context from the main
+// thread must call this first - but not from a message
+// handler, since Present() can wait on this window.
+// --------------------------------------------------------
+void DXCore::WaitForRenderThread()
+{
+	std::unique_lock<std::mutex> lock(renderMutex);
+	renderCondition.wait(lock, [this] { return !renderPending; });
+}
+
+// --------------------------------------------------------
+// Hands the most recently published frame to the render thread
+// --------------------------------------------------------
+void DXCore::KickRenderThread(float deltaTime, float totalTime)
+{
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		renderDeltaTime = deltaTime;
+		renderTotalTime = totalTime;
+		renderPending = true;
+	}
+	renderCondition.notify_all();
+}
+
+// --------------------------------------------------------
+// Body of the render thread - waits for a frame, draws it,
+// reports back, and repeats until told to quit
+// --------------------------------------------------------
+void DXCore::RenderThreadLoop()
+{
+	// Lets Draw() create and wait on jobs
+	JobSystem::GetInstance().RegisterThread();
+
+	// Everything allocated on this thread is part of drawing
+	AllocationScope allocationScope(AllocationTag::Draw);
+
+	while (true)
+	{
+		float frameDeltaTime;
+		float frameTotalTime;
+		{
+			std::unique_lock<std::mutex> lock(renderMutex);
+			renderCondition.wait(lock, [this] { return renderPending || renderQuit; });
+			if (!renderPending)
+				break;
+
+			frameDeltaTime = renderDeltaTime;
+			frameTotalTime = renderTotalTime;
+		}
+
+		// The main thread only asks for resizes, since it can't wait for this one
+		ApplyPendingResize();
+
+		__int64 drawStart;
+		QueryPerformanceCounter((LARGE_INTEGER*)&drawStart);
+		Draw(frameDeltaTime, frameTotalTime);
+		double drawSeconds = GetSecondsSince(drawStart);
+
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			drawSecondsElapsed += drawSeconds;
+			renderPending = false;
+		}
+		renderCondition.notify_all();
+	}
+
+	JobSystem::GetInstance().UnregisterThread();
+}
+
+// --------------------------------------------------------
+// Seconds elapsed between a performance counter value and now
+// --------------------------------------------------------
+double DXCore::GetSecondsSince(__int64 startCount)
+{
+	__int64 now;
+	QueryPerformanceCounter((LARGE_INTEGER*)&now);
+	return (now - startCount) * perfCounterSeconds;
+}
+
+
+// --------------------------------------------------------
+// Writes the average frame time in each mode next to the
+// executable, so a run that toggles pipelining (P) leaves
+// the two to compare
+// --------------------------------------------------------
+void DXCore::ReportFrameTimes()
+{
+	FILE* file = 0;
+	if (fopen_s(&file, GetFullPathTo("frametimes.txt").c_str(), "w") != 0 || !file)
+		return;
+
+	const char* names[2] = { "Serial", "Pipelined" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		double ms = modeFrames[mode] ? modeSeconds[mode] * 1000.0 / modeFrames[mode] : 0.0;
+		double fps = modeSeconds[mode] > 0.0 ? modeFrames[mode] / modeSeconds[mode] : 0.0;
+		fprintf(file, "%-10s %8u frames %10.3f ms/frame %10.1f fps\n", names[mode], modeFrames[mode], ms, fps);
+		printf("%s: %u frames, %.3f ms/frame, %.1f fps\n", names[mode], modeFrames[mode], ms, fps);
+	}
+
+	fclose(file);
+}
+
 // --------------------------------------------------------
 // Sends an OS-level window close message to our process, which
 // will be handled by our message processing function
@@ -474,6 +761,18 @@ void DXCore::UpdateTitleBarStats()
 	// How long did each frame take?  (Approx)
 	float mspf = 1000.0f / (float)fpsFrameCount;
 
+	// Average time spent in Update() and Draw() per frame - in
+	// pipelined mode these overlap, so frame time approaches the larger
+	double drawSeconds;
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		drawSeconds = drawSecondsElapsed;
+		drawSecondsElapsed = 0.0;
+	}
+	float updateMs = (float)(updateSecondsElapsed * 1000.0 / fpsFrameCount);
+	float drawMs = (float)(drawSeconds * 1000.0 / fpsFrameCount);
+	updateSecondsElapsed = 0.0;
+
 	// Quick and dirty title bar text (mostly for debugging)
 	std::ostringstream output;
 	output.precision(6);
@@ -481,7 +780,17 @@ void DXCore::UpdateTitleBarStats()
 		"    Width: "		<< width <<
 		"    Height: "		<< height <<
 		"    FPS: "			<< fpsFrameCount <<
-		"    Frame Time: "	<< mspf << "ms";
+		"    Frame Time: "	<< mspf << "ms" <<
+		"    Update: "		<< updateMs << "ms" <<
+		"    Draw: "		<< drawMs << "ms" <<
+		"    Frame Arena: "	<< FrameArena::GetInstance().GetLastFrameBytes() / 1024 << "/" << FrameArena::GetInstance().GetHighWaterMark() / 1024 << "KB" <<
+		(renderThread.joinable() ? "    Pipelined" : "    Serial");
+
+	// Heap allocations in the last frame, when they're being counted
+	if (AllocationTracker::IsEnabled())
+		output << "    Allocs/Frame: " << AllocationTracker::GetFrameTotals().allocations;
+
+	AppendTitleBarStats(output);
 
 	// Append the version of DirectX the app is using
 	switch (dxFeatureLevel)
@@ -642,6 +951,7 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 	{
 	// This is the message that signifies the window closing
 	case WM_DESTROY:
+		WaitForRenderThread(); // Don't let a frame in flight present to a dead window
 		PostQuitMessage(0); // Send a quit message to our own program
 		return 0;
 
@@ -662,7 +972,7 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		// and that doesn't play well with the GPU
 		if (wParam == SIZE_MINIMIZED)
 			return 0;
-		
+
 		// Save the new client area dimensions.
 		width = LOWORD(lParam);
 		height = HIWORD(lParam);
@@ -3,6 +3,10 @@
 #include <Windows.h>
 #include <d3d11.h>
 #include <string>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 
 // We can include the correct library files here
@@ -37,6 +41,10 @@ public:
 	HRESULT InitDirectX();
 	HRESULT Run();
 	void Quit();
+
+	// Called on the main thread when the window's client area changes
+	// size, with width and height already set.  The buffers are resized
+	// later, by whichever thread draws, just before its next Draw().
 	virtual void OnResize();
 
 	// Pure virtual methods for setup and game functionality
@@ -44,6 +52,14 @@ public:
 	virtual void Update(float deltaTime, float totalTime) = 0;
 	virtual void Draw(float deltaTime, float totalTime) = 0;
 
+	// Called between Update() and Draw() while neither is running,
+	// so the subclass can hand the state Update() produced to Draw()
+	virtual void PublishFrame() {}
+
+	// Lets the subclass add its own numbers to the title bar stats.
+	// Called on the main thread, possibly while Draw() is running.
+	virtual void AppendTitleBarStats(std::ostream& output) {}
+
 protected:
 	HINSTANCE	hInstance;		// The handle to the application
 	HWND		hWnd;			// The handle to the window itself
@@ -54,10 +70,20 @@ protected:
 	unsigned int width;
 	unsigned int height;
 
+	// Size of the back buffer, which catches up with the window's
+	// before the next Draw().  Only read these while drawing.
+	unsigned int bufferWidth;
+	unsigned int bufferHeight;
+
 	// Does our window currently have focus?
 	// Helpful if we want to pause while not the active window
 	bool hasFocus;
 
+	// Pipelined frame mode - when true, Draw() for frame N runs on
+	// a render thread while Update() for frame N+1 runs on this one.
+	// Can be changed at any time; it takes effect on the next frame.
+	bool pipelinedFrames;
+
 	// DirectX related objects and variables
 	D3D_FEATURE_LEVEL		dxFeatureLevel;
 	Microsoft::WRL::ComPtr<IDXGISwapChain>		swapChain;
@@ -90,6 +116,35 @@ private:
 	// FPS calculation
 	int fpsFrameCount;
 	float fpsTimeElapsed;
+	double updateSecondsElapsed;	// Time spent in Update() since the last title bar refresh
+	double drawSecondsElapsed;		// Time spent in Draw() since the last title bar refresh
+
+	// Render thread for pipelined frames
+	std::thread renderThread;
+	std::mutex renderMutex;
+	std::condition_variable renderCondition;
+	bool renderPending;		// A frame has been handed over and is not done drawing yet
+	bool renderQuit;		// Tells the render thread to exit once it is idle
+	float renderDeltaTime;
+	float renderTotalTime;
+	bool resizePending;		// The window changed size since the buffers were last resized
+	unsigned int resizeWidth;
+	unsigned int resizeHeight;
+
+	// Frame times in each mode, for comparing them - [0] serial, [1] pipelined
+	double modeSeconds[2];
+	unsigned int modeFrames[2];
+
+	void StartRenderThread();
+	void StopRenderThread();
+	void WaitForRenderThread();	// Blocks until the render thread is idle
+	void KickRenderThread(float deltaTime, float totalTime);
+	void RenderThreadLoop();
+	void ApplyPendingResize();	// On the thread that draws, while nothing else uses the context
+	void ResizeBuffers();
+	void ReportFrameTimes();
+
+	double GetSecondsSince(__int64 startCount);
 
 	void UpdateTimer();			// Updates the timer for this frame
 	void UpdateTitleBarStats();	// Puts debug info in the title bar
@@ -0,0 +1,108 @@
+#include "DrawPacket.h"
+
+#include <cstring>
+
+static unsigned long long Field(unsigned int value, unsigned int bits, unsigned int shift)
+{
+	return ((unsigned long long)value & ((1ull << bits) - 1)) << shift;
+}
+
+unsigned long long DrawKey::Make(unsigned int pass, unsigned int pipeline, unsigned int material, unsigned int mesh, float viewDepth)
+{
+	return
+		Field(pass, PassBits, PassShift) |
+		Field(pipeline, PipelineBits, PipelineShift) |
+		Field(material, MaterialBits, MaterialShift) |
+		Field(mesh, MeshBits, MeshShift) |
+		Field(QuantizeDepth(viewDepth), DepthBits, DepthShift);
+}
+
+unsigned int DrawKey::QuantizeDepth(float viewDepth)
+{
+	// (Also catches NaN)
+	if (!(viewDepth > 0.0f))
+		return 0;
+
+	// A positive float's bits sort the same way the float does,
+	// so the top bits are a depth with more precision up close
+	unsigned int bits;
+	memcpy(&bits, &viewDepth, sizeof(bits));
+	return bits >> (32 - DepthBits);
+}
+
+void SortDrawPackets(FrameVector<DrawPacket>& packets, FrameVector<DrawPacket>& scratch)
+{
+	// 11-bit digits - six passes cover 64 bits, and each
+	// digit's histogram (8KB) still fits in L1
+	const unsigned int DigitBits = 11;
+	const unsigned int DigitCount = (64 + DigitBits - 1) / DigitBits;
+	const unsigned int Buckets = 1 << DigitBits;
+
+	size_t count = packets.size();
+	if (count < 2)
+		return;
+
+	// Which bits differ at all?  Digits where none do are skipped
+	// outright, so constant fields (the pass, usually the pipeline)
+	// aren't even counted
+	unsigned long long allOr = 0;
+	unsigned long long allAnd = ~0ull;
+	for (size_t i = 0; i < count; i++)
+	{
+		allOr |= packets[i].key;
+		allAnd &= packets[i].key;
+	}
+	unsigned long long varying = allOr ^ allAnd;
+	if (varying == 0)
+		return;
+
+	unsigned int digits[DigitCount];
+	unsigned int digitCount = 0;
+	for (unsigned int d = 0; d < DigitCount; d++)
+	{
+		if ((varying >> (d * DigitBits)) & (Buckets - 1))
+			digits[digitCount++] = d * DigitBits;
+	}
+
+	// Every remaining digit's histogram in one pass over the keys
+	static thread_local unsigned int counts[DigitCount][Buckets];
+	memset(counts, 0, sizeof(counts));
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned long long key = packets[i].key;
+		for (unsigned int d = 0; d < digitCount; d++)
+			counts[d][(key >> digits[d]) & (Buckets - 1)]++;
+	}
+
+	scratch.resize(count);
+	DrawPacket* source = packets.data();
+	DrawPacket* destination = scratch.data();
+
+	for (unsigned int d = 0; d < digitCount; d++)
+	{
+		// Bucket start offsets
+		unsigned int* offsets = counts[d];
+		unsigned int total = 0;
+		for (unsigned int b = 0; b < Buckets; b++)
+		{
+			unsigned int bucketSize = offsets[b];
+			offsets[b] = total;
+			total += bucketSize;
+		}
+
+		unsigned int shift = digits[d];
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned int digit = (unsigned int)((source[i].key >> shift) & (Buckets - 1));
+			destination[offsets[digit]++] = source[i];
+		}
+
+		DrawPacket* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	// Odd number of passes leaves the result in scratch
+	if (source != packets.data())
+		memcpy(packets.data(), source, count * sizeof(DrawPacket));
+}
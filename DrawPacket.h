@@ -0,0 +1,65 @@
+#pragma once
+
+#include "FrameArena.h"
+
+// --------------------------------------------------------
+// One thing to draw, and the key it's submitted in order
+// of.  entity indexes the frame's entity snapshots.
+// --------------------------------------------------------
+struct DrawPacket
+{
+	unsigned long long key;
+	unsigned int entity;
+};
+
+// --------------------------------------------------------
+// Builds 64-bit draw sort keys.  From the top bit down:
+//
+//   pass     4 bits  - which pass (and so which order) it's in
+//   pipeline 12 bits  - PipelineState id, most expensive to
+//                       change, so outermost
+//   material 12 bits  - binding id, so materials that only
+//                       differ in parameters sort together
+//   mesh    12 bits
+//   depth   24 bits  - view depth, near to far
+//
+// Ids wider than their field wrap around.  That only costs
+// some grouping - two things sharing a field still draw
+// correctly, just not necessarily next to each other.
+// --------------------------------------------------------
+class DrawKey
+{
+public:
+	static const unsigned int PassBits = 4;
+	static const unsigned int PipelineBits = 12;
+	static const unsigned int MaterialBits = 12;
+	static const unsigned int MeshBits = 12;
+	static const unsigned int DepthBits = 24;
+
+	static const unsigned int DepthShift = 0;
+	static const unsigned int MeshShift = DepthShift + DepthBits;
+	static const unsigned int MaterialShift = MeshShift + MeshBits;
+	static const unsigned int PipelineShift = MaterialShift + MaterialBits;
+	static const unsigned int PassShift = PipelineShift + PipelineBits;
+
+	// Passes, in the order they're drawn
+	enum Pass : unsigned int
+	{
+		Opaque = 0,
+		ShadowOnly = 1,	// Outside the camera's view, but still casts shadows into it
+	};
+
+	static unsigned long long Make(unsigned int pass, unsigned int pipeline, unsigned int material, unsigned int mesh, float viewDepth);
+
+	// Keeps the order of non-negative depths - anything behind the
+	// camera counts as 0.  No near/far planes needed.
+	static unsigned int QuantizeDepth(float viewDepth);
+};
+
+// --------------------------------------------------------
+// Sorts packets by key, least significant digit first (LSD
+// radix sort, 11-bit digits).  Digits that are the same in
+// every key are skipped, so constant fields cost nothing.
+// Stable.  scratch is resized to fit, from the frame arena.
+// --------------------------------------------------------
+void SortDrawPackets(FrameVector<DrawPacket>& packets, FrameVector<DrawPacket>& scratch);
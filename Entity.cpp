@@ -1,13 +1,14 @@
 #include "Entity.h"
-#include "BufferStructs.h"
 #include "Mesh.h"
+#include "DrawPacket.h"
 using namespace DirectX;
 
-Entity::Entity(std::shared_ptr<Mesh> mesh, Material* _material)
+Entity::Entity(std::shared_ptr<Mesh> mesh, MaterialHandle _material)
 {
 	meshPtr = mesh;
 	transform = Transform();
 	material = _material;
+	isStatic = false;
 }
 
 Entity::~Entity()
@@ -24,38 +25,41 @@ std::shared_ptr<Mesh> Entity::GetMesh()
 	return meshPtr;
 }
 
-Material* Entity::GetMaterial()
+MaterialHandle Entity::GetMaterial()
 {
 	return material;
 }
 
+void Entity::SetStatic(bool isStatic)
+{
+	this->isStatic = isStatic;
+}
 
-
-void Entity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera, XMFLOAT3 ambient)
+bool Entity::IsStatic()
 {
-	//Step 2 - Put data into buffer struct
-	std::shared_ptr<SimpleVertexShader> vs = material->GetVertexShader();	//simplifies the next few lines
-	vs->SetMatrix4x4("world", transform.GetWorldMatrix());
-	vs->SetMatrix4x4("view", camera->GetView());
-	vs->SetMatrix4x4("projection", camera->GetProjection());
-	vs->SetMatrix4x4("worldInvTranspose", transform.GetWorldInverseTransposeMatrix());
+	return isStatic;
+}
 
-	std::shared_ptr<SimplePixelShader> ps = material->GetPixelShader();
-	ps->SetFloat4("colorTint", material->GetColor());
-	ps->SetFloat("roughness", material->GetRoughness());
-	ps->SetFloat3("cameraPos", camera->GetTransform()->GetPosition());
-	ps->SetFloat3("ambient", ambient);
-	material->PrepareMaterials();
 
 
-	//step 3 - map, memcpy, unmap constant buffer
-	vs->CopyAllBufferData();
-	ps->CopyAllBufferData();
+EntitySnapshot Entity::GetSnapshot(const Pool<Material>& materials, const DirectX::XMFLOAT4X4& view)
+{
+	EntitySnapshot snapshot;
+	snapshot.world = transform.GetWorldMatrix();
+	snapshot.worldInvTranspose = transform.GetWorldInverseTransposeMatrix();
+	snapshot.mesh = meshPtr.get();
+	snapshot.material = materials.Get(material);
+	snapshot.materialIndex = material.index;
 
-	//activating vertex and pixelShader
-	material->GetVertexShader()->SetShader();
-	material->GetPixelShader()->SetShader();
+	//view space z of the entity's origin - everything is opaque, so this sorts front to back
+	const XMFLOAT4X4& w = snapshot.world;
+	float viewDepth = w._41 * view._13 + w._42 * view._23 + w._43 * view._33 + view._43;
 
-	//step 4+5 - set buffers and render with currently bound resources
-	meshPtr->Draw();
+	snapshot.sortKey = DrawKey::Make(
+		DrawKey::Opaque,
+		snapshot.material->GetPipelineState()->GetId(),
+		snapshot.material->GetBindingId(),
+		meshPtr->GetId(),
+		viewDepth);
+	return snapshot;
 }
@@ -5,23 +5,35 @@
 #include "Camera.h"
 #include "Material.h"
 #include "Lights.h"
+#include "SceneState.h"
 
 class Entity
 {
 public:
-	Entity(std::shared_ptr<Mesh> mesh, Material* _material);
+	Entity(std::shared_ptr<Mesh> mesh, MaterialHandle _material);
 	~Entity();
 
 	//setters
 	Transform* GetTransform();
 	std::shared_ptr<Mesh> GetMesh();
-	Material* GetMaterial();
+	MaterialHandle GetMaterial();
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera, DirectX::XMFLOAT3 ambient);
+	//static entities never move once the scene is built, so they're baked into
+	//StaticBatcher chunks instead of being drawn on their own
+	void SetStatic(bool isStatic);
+	bool IsStatic();
+
+	//copies out everything drawing needs, so Draw never touches a live entity.
+	//the view is only used for the sort key's depth.
+	EntitySnapshot GetSnapshot(const Pool<Material>& materials, const DirectX::XMFLOAT4X4& view);
 
 private:
 	Transform transform;
 	std::shared_ptr<Mesh> meshPtr;
-	Material* material;
+	MaterialHandle material;
+	bool isStatic;
 };
 
+//entities live in a Pool and are referred to by handle
+typedef Handle<Entity> EntityHandle;
+
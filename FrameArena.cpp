@@ -0,0 +1,207 @@
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+#include <cstdint>
+#include <cstdio>
+
+// Singleton requirement
+FrameArena* FrameArena::instance;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ LINEAR ARENA --------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+LinearArena::LinearArena()
+	: current(0), currentSize(0), offset(0), usedInEarlierBlocks(0), capacity(0), heapAllocations(0)
+{
+}
+
+LinearArena::~LinearArena()
+{
+	for (Block& block : overflowBlocks)
+		delete[] block.memory;
+	delete[] current;
+}
+
+void LinearArena::Initialize(size_t capacity)
+{
+	if (current)
+		return;
+
+	current = AllocateBlock(capacity);
+	currentSize = capacity;
+	this->capacity = capacity;
+}
+
+// --------------------------------------------------------
+// Carves the next size bytes off the current block
+// --------------------------------------------------------
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	uintptr_t base = (uintptr_t)current;
+	uintptr_t start = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+	if (!current || start + size > base + currentSize)
+	{
+		// Out of room - keep the full block until Reset() and
+		// move on to a bigger one
+		size_t blockSize = currentSize * 2;
+		if (blockSize < size + alignment)
+			blockSize = size + alignment;
+		if (blockSize < 4096)
+			blockSize = 4096;
+
+		if (current)
+		{
+			Block full = { current, currentSize };
+			overflowBlocks.push_back(full);
+			usedInEarlierBlocks += offset;
+		}
+
+		current = AllocateBlock(blockSize);
+		currentSize = blockSize;
+		capacity += blockSize;
+		offset = 0;
+
+		base = (uintptr_t)current;
+		start = (base + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	}
+
+	offset = (size_t)(start + size - base);
+	return (void*)start;
+}
+
+// --------------------------------------------------------
+// Frees everything.  If this frame needed extra blocks, they
+// are swapped for a single block of the combined size.
+// --------------------------------------------------------
+void LinearArena::Reset()
+{
+	if (!overflowBlocks.empty())
+	{
+		for (Block& block : overflowBlocks)
+			delete[] block.memory;
+		overflowBlocks.clear();
+
+		delete[] current;
+		current = AllocateBlock(capacity);
+		currentSize = capacity;
+	}
+
+	offset = 0;
+	usedInEarlierBlocks = 0;
+}
+
+unsigned char* LinearArena::AllocateBlock(size_t size)
+{
+	heapAllocations++;
+	return new unsigned char[size];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ FRAME ARENA ---------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+FrameArena::FrameArena()
+	: threadCount(0), currentSet(0), lastFrameBytes(0), highWaterMark(0)
+{
+	arenas[0] = 0;
+	arenas[1] = 0;
+}
+
+FrameArena::~FrameArena()
+{
+	delete[] arenas[0];
+	delete[] arenas[1];
+}
+
+// --------------------------------------------------------
+// Creates both sets of arenas up front, so the first
+// frames don't have to grow them from nothing
+// --------------------------------------------------------
+void FrameArena::Initialize(unsigned int threadCount, size_t arenaSize)
+{
+	if (arenas[0])
+		return;
+
+	this->threadCount = threadCount;
+	for (int set = 0; set < 2; set++)
+	{
+		arenas[set] = new LinearArena[threadCount];
+		for (unsigned int i = 0; i < threadCount; i++)
+			arenas[set][i].Initialize(arenaSize);
+
+		sharedArenas[set].Initialize(arenaSize);
+	}
+}
+
+// --------------------------------------------------------
+// Allocates from the calling thread's arena for this frame
+// --------------------------------------------------------
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	int threadIndex = JobSystem::GetInstance().GetThreadIndex();
+	if (arenas[currentSet] && threadIndex >= 0 && (unsigned int)threadIndex < threadCount)
+		return arenas[currentSet][threadIndex].Allocate(size, alignment);
+
+	std::lock_guard<std::mutex> lock(sharedMutex);
+	return sharedArenas[currentSet].Allocate(size, alignment);
+}
+
+// --------------------------------------------------------
+// Records how much the frame used, then resets the other
+// set - it belongs to the frame before, which is finished
+// --------------------------------------------------------
+void FrameArena::EndFrame()
+{
+	size_t frameBytes = sharedArenas[currentSet].GetUsed();
+	if (arenas[currentSet])
+	{
+		for (unsigned int i = 0; i < threadCount; i++)
+			frameBytes += arenas[currentSet][i].GetUsed();
+	}
+
+	lastFrameBytes = frameBytes;
+	if (frameBytes > highWaterMark)
+		highWaterMark = frameBytes;
+
+	currentSet ^= 1;
+
+	sharedArenas[currentSet].Reset();
+	if (arenas[currentSet])
+	{
+		for (unsigned int i = 0; i < threadCount; i++)
+			arenas[currentSet][i].Reset();
+	}
+}
+
+// --------------------------------------------------------
+// Total blocks ever taken from the heap - this stops going
+// up once every arena is big enough for a whole frame
+// --------------------------------------------------------
+unsigned int FrameArena::GetHeapAllocations()
+{
+	unsigned int total = sharedArenas[0].GetHeapAllocations() + sharedArenas[1].GetHeapAllocations();
+	for (int set = 0; set < 2; set++)
+	{
+		if (!arenas[set])
+			continue;
+
+		for (unsigned int i = 0; i < threadCount; i++)
+			total += arenas[set][i].GetHeapAllocations();
+	}
+	return total;
+}
+
+// --------------------------------------------------------
+// Prints the most any one frame has allocated
+// --------------------------------------------------------
+void FrameArena::ReportHighWaterMark()
+{
+	printf("Frame arena: high water mark %zu bytes, last frame %zu bytes, %u heap blocks\n",
+		highWaterMark,
+		lastFrameBytes,
+		GetHeapAllocations());
+}
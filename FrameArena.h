@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// --------------------------------------------------------
+// Bump allocator over one block of memory.  Allocate() just
+// moves a pointer and Reset() frees everything at once.
+//
+// If a frame needs more than the block holds, extra blocks
+// come from the heap, and the next Reset() replaces them all
+// with one block big enough for that frame - so the heap is
+// only touched until the arena has grown to fit.
+// --------------------------------------------------------
+class LinearArena
+{
+public:
+	LinearArena();
+	~LinearArena();
+
+	LinearArena(LinearArena const&) = delete;
+	void operator=(LinearArena const&) = delete;
+
+	void Initialize(size_t capacity);
+
+	void* Allocate(size_t size, size_t alignment);
+	void Reset();
+
+	size_t GetUsed() { return usedInEarlierBlocks + offset; }
+	size_t GetCapacity() { return capacity; }
+	unsigned int GetHeapAllocations() { return heapAllocations; }
+
+private:
+	struct Block
+	{
+		unsigned char* memory;
+		size_t size;
+	};
+
+	unsigned char* current;		// Block being allocated from
+	size_t currentSize;
+	size_t offset;				// Bytes used in the current block
+	size_t usedInEarlierBlocks;	// Bytes used in blocks we've moved past this frame
+	size_t capacity;			// Total bytes across all blocks
+
+	std::vector<Block> overflowBlocks;	// Only non-empty on a frame that outgrew the arena
+	unsigned int heapAllocations;		// Blocks ever taken from the heap
+
+	unsigned char* AllocateBlock(size_t size);
+};
+
+// --------------------------------------------------------
+// Memory that only lives for a frame.  Every job system
+// thread gets its own arena, so allocating takes no locks.
+//
+// There are two sets of arenas, swapped by EndFrame().  An
+// allocation stays valid until the end of the *next* frame,
+// which covers data made in Update() for frame N and read by
+// Draw() for frame N while Update() for frame N+1 is running.
+// --------------------------------------------------------
+class FrameArena
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static FrameArena& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new FrameArena();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	FrameArena(FrameArena const&) = delete;
+	void operator=(FrameArena const&) = delete;
+
+private:
+	static FrameArena* instance;
+	FrameArena();
+#pragma endregion
+
+public:
+	~FrameArena();
+
+	static const size_t DefaultArenaSize = 256 * 1024;	// Per thread, per set
+
+	// threadCount is the job system's thread count - arenas are picked by thread index
+	void Initialize(unsigned int threadCount, size_t arenaSize = DefaultArenaSize);
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	template <typename T>
+	T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T))); }
+
+	// Starts a new frame.  Must only be called while nothing
+	// else is allocating (DXCore::Run calls it between frames).
+	void EndFrame();
+
+	// Stats
+	size_t GetLastFrameBytes() { return lastFrameBytes; }
+	size_t GetHighWaterMark() { return highWaterMark; }
+	unsigned int GetHeapAllocations();
+	void ReportHighWaterMark();
+
+private:
+	unsigned int threadCount;
+	LinearArena* arenas[2];		// [threadCount] each
+	int currentSet;
+
+	// Threads the job system doesn't know about share this one
+	LinearArena sharedArenas[2];
+	std::mutex sharedMutex;
+
+	size_t lastFrameBytes;
+	size_t highWaterMark;
+};
+
+// --------------------------------------------------------
+// STL allocator that allocates from the frame arena, so
+// temporary containers never touch the heap.  Memory is
+// never given back individually, so a container using it
+// must not outlive the frame after the one it was made in.
+// One kept between frames (as a member, say) has to be
+// replaced with a new one each frame, not cleared - its
+// old capacity is in an arena that's since been reset.
+// --------------------------------------------------------
+template <typename T>
+class FrameAllocator
+{
+public:
+	typedef T value_type;
+
+	FrameAllocator() noexcept {}
+	template <typename U> FrameAllocator(const FrameAllocator<U>&) noexcept {}
+
+	T* allocate(size_t count) { return FrameArena::GetInstance().AllocateArray<T>(count); }
+	void deallocate(T*, size_t) noexcept {}
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T>&, const FrameAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T>&, const FrameAllocator<U>&) { return false; }
+
+// A vector for per-frame lists (draw lists, sort buffers, ...)
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -3,6 +3,11 @@
 #include "Input.h"
 #include "BufferStructs.h"
 #include "SimpleShader.h"
+#include "JobSystem.h"
+#include "DrawPacket.h"
+#include "AllocationTracker.h"
+
+#include <fstream>
 
 // Needed for a helper function to read compiled shader files from the hard drive
 #pragma comment(lib, "d3dcompiler.lib")
@@ -36,6 +41,23 @@ Game::Game(HINSTANCE hInstance)
 #endif
 
 	camera = 0;
+	stateCallsIssued = 0;
+	stateCallsFiltered = 0;
+	drawCalls = 0;
+	drawCallsUninstanced = 0;
+	staticChunksVisible = 0;
+	instancing = true;
+	parallelRecording = true;
+	commandListsRecorded = 0;
+	commandsSubmitted = 0;
+	renderGraphTextures = 0;
+	captureCommands = false;
+
+	//false gives every material texture an array of its own, so each material is its own batch
+	packMaterialTextures = true;
+
+	//overlap Update and Draw on separate threads - press P to toggle
+	pipelinedFrames = true;
 }
 
 // --------------------------------------------------------
@@ -50,23 +72,10 @@ Game::~Game()
 	// - If we weren't using smart pointers, we'd need
 	//   to call Release() on each DirectX object created in Game
 
-	//deleting pointers in entityList
-	for (Entity* entity : entityList)
-	{
-		delete entity;
-	}
+	//entities and materials are cleaned up by their pools
 
 	delete camera;
 
-	//deleting materials
-	delete matBronze;
-	delete matCobblestone;
-	delete matFloor;
-	delete matPaint;
-	delete matScratched;
-	delete matTree;
-	delete matMoss;
-
 	delete skybox;
 }
 
@@ -86,11 +95,7 @@ void Game::Init()
 	// Tell the input assembler stage of the pipeline what kind of
 	// geometric primitives (points, lines or triangles) we want to draw.  
 	// Essentially: "What kind of shape should the GPU draw with our data?"
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-	//getting byte width of buffer
-	unsigned int size = sizeof(VertexShaderExternalData);
-	size = (size + 15) / 16 * 16;
+	stateCache->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	//creating camera
 	camera = new Camera(0, -1.75, -5, (float)width / height, 4.0f, 2.0f, XM_PIDIV2);
@@ -143,15 +148,70 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadShaders()
 {
+	AllocationScope allocationScope(AllocationTag::Shaders);
+
+	stateCache = std::make_shared<StateCache>(context);
+
 	vertexShader = std::shared_ptr<SimpleVertexShader>(new SimpleVertexShader(device.Get(), context.Get(), GetFullPathTo_Wide(L"VertexShader.cso").c_str()));
 	pixelShader = std::shared_ptr<SimplePixelShader>(new SimplePixelShader(device.Get(), context.Get(), GetFullPathTo_Wide(L"PixelShader.cso").c_str()));
 	//pixelShader = std::shared_ptr<SimplePixelShader>(new SimplePixelShader(device.Get(), context.Get(), GetFullPathTo_Wide(L"CustomPS.cso").c_str()));
+	vsPerFrame = vertexShader->GetConstantBufferHandle<VSPerFrameData>();
+	psPerFrame = pixelShader->GetConstantBufferHandle<PSPerFrameData>();
+	psPerLight = pixelShader->GetConstantBufferHandle<PSPerLightData>();
+
+	//a set that doesn't change anything leaves its buffer clean, so unchanged
+	//per-frame, per-light and per-material buffers are never uploaded again
+	vertexShader->SetCompareOnSet(true);
+	pixelShader->SetCompareOnSet(true);
 
 	shadowVS = std::shared_ptr<SimpleVertexShader>(new SimpleVertexShader(device.Get(), context.Get(), GetFullPathTo_Wide(L"ShadowVS.cso").c_str()));
+	shadowVSPerFrame = shadowVS->GetConstantBufferHandle<ShadowVSPerFrameData>();
 
 	//sky shaders
 	skyVertexShader = std::shared_ptr<SimpleVertexShader>(new SimpleVertexShader(device.Get(), context.Get(), GetFullPathTo_Wide(L"SkyVertexShader.cso").c_str()));
 	skyPixelShader = std::shared_ptr<SimplePixelShader>(new SimplePixelShader(device.Get(), context.Get(), GetFullPathTo_Wide(L"SkyPixelShader.cso").c_str()));
+
+	vertexShader->SetStateCache(stateCache);
+	pixelShader->SetStateCache(stateCache);
+	shadowVS->SetStateCache(stateCache);
+	skyVertexShader->SetStateCache(stateCache);
+	skyPixelShader->SetStateCache(stateCache);
+
+	//stream per-draw constants through one dynamic buffer when the device allows it (11.1),
+	//otherwise every shader keeps updating its own constant buffers
+	constantBufferRing = std::make_shared<ConstantBufferRing>(device, context);
+	if (constantBufferRing->IsSupported())
+	{
+		vertexShader->SetConstantBufferRing(constantBufferRing);
+		pixelShader->SetConstantBufferRing(constantBufferRing);
+		shadowVS->SetConstantBufferRing(constantBufferRing);
+		skyVertexShader->SetConstantBufferRing(constantBufferRing);
+		skyPixelShader->SetConstantBufferRing(constantBufferRing);
+	}
+
+	//every distinct set of shaders and render states is made once, and shared
+	pipelineStateCache = std::make_shared<PipelineStateCache>(device);
+
+	//the main pass's shaders, with the default states - every material draws with it for now
+	PipelineStateDesc mainDesc;
+	mainDesc.vertexShader = vertexShader;
+	mainDesc.pixelShader = pixelShader;
+	mainPipeline = pipelineStateCache->Get(mainDesc);
+
+	//the shadow pass draws depth only, biased so surfaces don't shadow themselves
+	PipelineStateDesc shadowDesc;
+	shadowDesc.vertexShader = shadowVS;
+	shadowDesc.rasterizer.DepthBias = 1000;
+	shadowDesc.rasterizer.DepthBiasClamp = 0.0f;
+	shadowDesc.rasterizer.SlopeScaledDepthBias = 1.0f;
+	shadowPipeline = pipelineStateCache->Get(shadowDesc);
+
+	instanceBatcher = std::make_shared<InstanceBatcher>(device);
+	materialTable = std::make_shared<MaterialTable>(device);
+
+	//a context per job system thread - the shadow pass and the sky take one each, the main pass the rest
+	commandRecorder = std::make_shared<CommandRecorder>(device, JobSystem::GetInstance().GetThreadCount());
+	immediateContext = std::make_shared<RenderContext>(context, stateCache, 0);
 }
 
 
@@ -194,7 +254,6 @@ void Game::CreateBasicGeometry()
 	unsigned int indices0[] = { 0, 1, 2 };
 
 	//mesh0 = std::make_shared<Mesh>(vertices0, 3, indices0, 3, device, context);
-	mesh0 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/cube.obj").c_str(), device, context);
 
 	//Vertex vertices1[] =
 	//{
@@ -207,7 +266,6 @@ void Game::CreateBasicGeometry()
 	unsigned int indices1[] = { 0, 1, 2, 0, 2, 3 };
 
 	//mesh1 = std::make_shared<Mesh>(vertices1, 4, indices1, 6, device, context);
-	mesh1 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device, context);
 
 	//Vertex vertices2[] =
 	//{													//PENTAGON
@@ -221,48 +279,111 @@ void Game::CreateBasicGeometry()
 	unsigned int indices2[] = { 0, 3, 1, 0, 4, 3, 0, 2, 4 };
 
 	//mesh2 = std::make_shared<Mesh>(vertices2, 5, indices2, 9, device, context);
-	mesh2 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/helix.obj").c_str(), device, context);
 
-	mesh3 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/cylinder.obj").c_str(), device, context);
+	//every mesh is a range of these shared buffers, so switching meshes doesn't rebind anything
+	geometryArena = std::make_shared<GeometryArena>(device);
 
-	treeMesh = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/tree.obj").c_str(), device, context);
+	//loading models on all threads - the arena takes the geometry under a lock and uploads it at the start of Draw.
+	//each keeps a cpu copy too, for baking static entities, until that's done below
+	struct MeshLoad
+	{
+		const char* file;
+		std::shared_ptr<Mesh>* mesh;
+	};
+	MeshLoad meshLoads[] =
+	{
+		{ "../../Assets/Models/cube.obj", &mesh0 },
+		{ "../../Assets/Models/sphere.obj", &mesh1 },
+		{ "../../Assets/Models/helix.obj", &mesh2 },
+		{ "../../Assets/Models/cylinder.obj", &mesh3 },
+		{ "../../Assets/Models/tree.obj", &treeMesh },
+	};
+	JobSystem::GetInstance().ParallelFor(ARRAYSIZE(meshLoads), [&](unsigned int begin, unsigned int end)
+	{
+		AllocationScope allocationScope(AllocationTag::Meshes);
+		for (unsigned int i = begin; i < end; i++)
+			*meshLoads[i].mesh = std::make_shared<Mesh>(GetFullPathTo(meshLoads[i].file).c_str(), geometryArena, true);
+	});
+
+	//creating textures - decoding is the slow part, so each texture is loaded on a worker into
+	//its own deferred context, and the recorded uploads are replayed here in order afterwards
+	struct TextureLoad
+	{
+		const wchar_t* file;
+		PackedTexture* texture;
+		Microsoft::WRL::ComPtr<ID3D11CommandList> commands;
+	};
+	TextureLoad textureLoads[] =
+	{
+		//creating albedo textures
+		{ L"../../Assets/Textures/PBR/bronze_albedo.png", &bronzeAlbedo },
+		{ L"../../Assets/Textures/PBR/cobblestone_albedo.png", &cobblestoneAlbedo },
+		{ L"../../Assets/Textures/PBR/floor_albedo.png", &floorAlbedo },
+		{ L"../../Assets/Textures/PBR/paint_albedo.png", &paintAlbedo },
+		{ L"../../Assets/Textures/PBR/scratched_albedo.png", &scratchedAlbedo },
+		{ L"../../Assets/Textures/PBR/tree_albedo.jpg", &treeAlbedo },
+		{ L"../../Assets/Textures/PBR/moss_albedo.png", &mossAlbedo },
+
+		//creating roughness textures
+		{ L"../../Assets/Textures/PBR/bronze_roughness.png", &bronzeRoughness },
+		{ L"../../Assets/Textures/PBR/cobblestone_roughness.png", &cobblestoneRoughness },
+		{ L"../../Assets/Textures/PBR/floor_roughness.png", &floorRoughness },
+		{ L"../../Assets/Textures/PBR/paint_roughness.png", &paintRoughness },
+		{ L"../../Assets/Textures/PBR/scratched_roughness.png", &scratchedRoughness },
+		{ L"../../Assets/Textures/PBR/tree_roughness.jpg", &treeRoughness },
+		{ L"../../Assets/Textures/PBR/dark1_roughness.png", &mossRoughness },
+
+		//creating normalMap textures
+		{ L"../../Assets/Textures/PBR/bronze_normals.png", &bronzeNormal },
+		{ L"../../Assets/Textures/PBR/cobblestone_normals.png", &cobblestoneNormal },
+		{ L"../../Assets/Textures/PBR/floor_normals.png", &floorNormal },
+		{ L"../../Assets/Textures/PBR/paint_normals.png", &paintNormal },
+		{ L"../../Assets/Textures/PBR/scratched_normals.png", &scratchedNormal },
+		{ L"../../Assets/Textures/PBR/tree_normals.png", &treeNormal },
+		{ L"../../Assets/Textures/PBR/moss_normals.png", &mossNormal },
+
+		//creating metalnessMap textures
+		{ L"../../Assets/Textures/PBR/bronze_metal.png", &bronzeMetalness },
+		{ L"../../Assets/Textures/PBR/cobblestone_metal.png", &cobblestoneMetalness },
+		{ L"../../Assets/Textures/PBR/floor_metal.png", &floorMetalness },
+		{ L"../../Assets/Textures/PBR/paint_metal.png", &paintMetalness },
+		{ L"../../Assets/Textures/PBR/scratched_metal.png", &scratchedMetalness },
+		{ L"../../Assets/Textures/PBR/tree_metal.jpg", &treeMetalness },
+		{ L"../../Assets/Textures/PBR/moss_metal.jpg", &mossMetalness },
+	};
+	JobSystem::GetInstance().ParallelFor(ARRAYSIZE(textureLoads), [&](unsigned int begin, unsigned int end)
+	{
+		AllocationScope allocationScope(AllocationTag::Textures);
+		for (unsigned int i = begin; i < end; i++)
+		{
+			Microsoft::WRL::ComPtr<ID3D11DeviceContext> deferredContext;
+			device->CreateDeferredContext(0, deferredContext.GetAddressOf());
+			CreateWICTextureFromFile(device.Get(), deferredContext.Get(), GetFullPathTo_Wide(textureLoads[i].file).c_str(), 0, textureLoads[i].texture->srv.GetAddressOf());
+			deferredContext->FinishCommandList(FALSE, textureLoads[i].commands.GetAddressOf());
+		}
+	});
+	for (TextureLoad& load : textureLoads)
+	{
+		if (load.commands)
+			context->ExecuteCommandList(load.commands.Get(), FALSE);
+	}
 
-	//creating textures
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_albedo.png").c_str(), 0, bronzeAlbedoSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_albedo.png").c_str(), 0, cobblestoneAlbedoSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_albedo.png").c_str(), 0, floorAlbedoSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_albedo.png").c_str(), 0, paintAlbedoSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_albedo.png").c_str(), 0, scratchedAlbedoSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/tree_albedo.jpg").c_str(), 0, treeAlbedoSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/moss_albedo.png").c_str(), 0, mossAlbedoSRV.GetAddressOf());
-	
-	//creating roughness textures
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_roughness.png").c_str(), 0, bronzeRoughnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_roughness.png").c_str(), 0, cobblestoneRoughnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_roughness.png").c_str(), 0, floorRoughnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_roughness.png").c_str(), 0, paintRoughnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_roughness.png").c_str(), 0, scratchedRoughnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/tree_roughness.jpg").c_str(), 0, treeRoughnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/dark1_roughness.png").c_str(), 0, mossRoughnessSRV.GetAddressOf());
-
-
-	//creating normalMap textures
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_normals.png").c_str(), 0, bronzeNormalSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_normals.png").c_str(), 0, cobblestoneNormalSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_normals.png").c_str(), 0, floorNormalSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_normals.png").c_str(), 0, paintNormalSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_normals.png").c_str(), 0, scratchedNormalSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/tree_normals.png").c_str(), 0, treeNormalSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/moss_normals.png").c_str(), 0, mossNormalSRV.GetAddressOf());
-
-	//creating metalnessMap textures
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_metal.png").c_str(), 0, bronzeMetalnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_metal.png").c_str(), 0, cobblestoneMetalnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_metal.png").c_str(), 0, floorMetalnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_metal.png").c_str(), 0, paintMetalnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_metal.png").c_str(), 0, scratchedMetalnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/tree_metal.jpg").c_str(), 0, treeMetalnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/moss_metal.jpg").c_str(), 0, mossMetalnessSRV.GetAddressOf());
+	//textures with the same size and format go in one Texture2DArray, so materials differ only
+	//by slice and can share a batch.  the copies go after the mip generation replayed above.
+	//(each scope from here on tags what follows it, until the next one)
+	AllocationScope textureScope(AllocationTag::Textures);
+	TextureArrayPacker packer(device, packMaterialTextures);
+	for (TextureLoad& load : textureLoads)
+		packer.Add(load.texture->srv);
+	packer.Build(context.Get());
+	for (unsigned int i = 0; i < ARRAYSIZE(textureLoads); i++)
+	{
+		textureLoads[i].texture->srv = packer.GetSRV(i);
+		textureLoads[i].texture->slice = packer.GetSlice(i);
+	}
+
+	//executing without restoring state leaves the context cleared
+	stateCache->Reset();
 
 	//creating sampler
 	D3D11_SAMPLER_DESC sampDesc = {};
@@ -284,49 +405,50 @@ void Game::CreateBasicGeometry()
 	//materialWhiteSciFiFabric = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 0.0f), 0.5f, pixelShader, vertexShader);
 
 	//materials
-	matBronze = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, pixelShader, vertexShader);
-	matCobblestone = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, pixelShader, vertexShader);
-	matFloor = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, pixelShader, vertexShader);
-	matPaint = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, pixelShader, vertexShader);
-	matScratched = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, pixelShader, vertexShader);
-	matTree = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, pixelShader, vertexShader);
-	matMoss = new Material(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, pixelShader, vertexShader);
+	AllocationScope materialScope(AllocationTag::Materials);
+	matBronze = materials.Create(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, mainPipeline);
+	matCobblestone = materials.Create(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, mainPipeline);
+	matFloor = materials.Create(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, mainPipeline);
+	matPaint = materials.Create(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, mainPipeline);
+	matScratched = materials.Create(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, mainPipeline);
+	matTree = materials.Create(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, mainPipeline);
+	matMoss = materials.Create(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), 0.8f, mainPipeline);
 
 	//albedos
-	matBronze->AddTextureSRV("SurfaceTexture", bronzeAlbedoSRV);
-	matCobblestone->AddTextureSRV("SurfaceTexture", cobblestoneAlbedoSRV);
-	matFloor->AddTextureSRV("SurfaceTexture", floorAlbedoSRV);
-	matPaint->AddTextureSRV("SurfaceTexture", paintAlbedoSRV);
-	matScratched->AddTextureSRV("SurfaceTexture", scratchedAlbedoSRV);
-	matTree->AddTextureSRV("SurfaceTexture", treeAlbedoSRV);
-	matMoss->AddTextureSRV("SurfaceTexture", mossAlbedoSRV);
+	materials.Get(matBronze)->AddTextureSRV("SurfaceTexture", bronzeAlbedo.srv, bronzeAlbedo.slice);
+	materials.Get(matCobblestone)->AddTextureSRV("SurfaceTexture", cobblestoneAlbedo.srv, cobblestoneAlbedo.slice);
+	materials.Get(matFloor)->AddTextureSRV("SurfaceTexture", floorAlbedo.srv, floorAlbedo.slice);
+	materials.Get(matPaint)->AddTextureSRV("SurfaceTexture", paintAlbedo.srv, paintAlbedo.slice);
+	materials.Get(matScratched)->AddTextureSRV("SurfaceTexture", scratchedAlbedo.srv, scratchedAlbedo.slice);
+	materials.Get(matTree)->AddTextureSRV("SurfaceTexture", treeAlbedo.srv, treeAlbedo.slice);
+	materials.Get(matMoss)->AddTextureSRV("SurfaceTexture", mossAlbedo.srv, mossAlbedo.slice);
 
 	//roughness
-	matBronze->AddTextureSRV("SurfaceRoughness", bronzeRoughnessSRV);
-	matCobblestone->AddTextureSRV("SurfaceRoughness", cobblestoneRoughnessSRV);
-	matFloor->AddTextureSRV("SurfaceRoughness", floorRoughnessSRV);
-	matPaint->AddTextureSRV("SurfaceRoughness", paintRoughnessSRV);
-	matScratched->AddTextureSRV("SurfaceRoughness", scratchedRoughnessSRV);
-	matTree->AddTextureSRV("SurfaceRoughness", treeRoughnessSRV);
-	matMoss->AddTextureSRV("SurfaceRoughness", mossRoughnessSRV);
+	materials.Get(matBronze)->AddTextureSRV("SurfaceRoughness", bronzeRoughness.srv, bronzeRoughness.slice);
+	materials.Get(matCobblestone)->AddTextureSRV("SurfaceRoughness", cobblestoneRoughness.srv, cobblestoneRoughness.slice);
+	materials.Get(matFloor)->AddTextureSRV("SurfaceRoughness", floorRoughness.srv, floorRoughness.slice);
+	materials.Get(matPaint)->AddTextureSRV("SurfaceRoughness", paintRoughness.srv, paintRoughness.slice);
+	materials.Get(matScratched)->AddTextureSRV("SurfaceRoughness", scratchedRoughness.srv, scratchedRoughness.slice);
+	materials.Get(matTree)->AddTextureSRV("SurfaceRoughness", treeRoughness.srv, treeRoughness.slice);
+	materials.Get(matMoss)->AddTextureSRV("SurfaceRoughness", mossRoughness.srv, mossRoughness.slice);
 
 	//normalMaps
-	matBronze->AddTextureSRV("NormalMap", bronzeNormalSRV);
-	matCobblestone->AddTextureSRV("NormalMap", cobblestoneNormalSRV);
-	matFloor->AddTextureSRV("NormalMap", floorNormalSRV);
-	matPaint->AddTextureSRV("NormalMap", paintNormalSRV);
-	matScratched->AddTextureSRV("NormalMap", scratchedNormalSRV);
-	matTree->AddTextureSRV("NormalMap", treeNormalSRV);
-	matMoss->AddTextureSRV("NormalMap", mossNormalSRV);
+	materials.Get(matBronze)->AddTextureSRV("NormalMap", bronzeNormal.srv, bronzeNormal.slice);
+	materials.Get(matCobblestone)->AddTextureSRV("NormalMap", cobblestoneNormal.srv, cobblestoneNormal.slice);
+	materials.Get(matFloor)->AddTextureSRV("NormalMap", floorNormal.srv, floorNormal.slice);
+	materials.Get(matPaint)->AddTextureSRV("NormalMap", paintNormal.srv, paintNormal.slice);
+	materials.Get(matScratched)->AddTextureSRV("NormalMap", scratchedNormal.srv, scratchedNormal.slice);
+	materials.Get(matTree)->AddTextureSRV("NormalMap", treeNormal.srv, treeNormal.slice);
+	materials.Get(matMoss)->AddTextureSRV("NormalMap", mossNormal.srv, mossNormal.slice);
 
 	//metalnessMaps
-	matBronze->AddTextureSRV("MetalnessMap", bronzeMetalnessSRV);
-	matCobblestone->AddTextureSRV("MetalnessMap", cobblestoneMetalnessSRV);
-	matFloor->AddTextureSRV("MetalnessMap", floorMetalnessSRV);
-	matPaint->AddTextureSRV("MetalnessMap", paintMetalnessSRV);
-	matScratched->AddTextureSRV("MetalnessMap", scratchedMetalnessSRV);
-	matTree->AddTextureSRV("MetalnessMap", treeMetalnessSRV);
-	matMoss->AddTextureSRV("MetalnessMap", mossMetalnessSRV);
+	materials.Get(matBronze)->AddTextureSRV("MetalnessMap", bronzeMetalness.srv, bronzeMetalness.slice);
+	materials.Get(matCobblestone)->AddTextureSRV("MetalnessMap", cobblestoneMetalness.srv, cobblestoneMetalness.slice);
+	materials.Get(matFloor)->AddTextureSRV("MetalnessMap", floorMetalness.srv, floorMetalness.slice);
+	materials.Get(matPaint)->AddTextureSRV("MetalnessMap", paintMetalness.srv, paintMetalness.slice);
+	materials.Get(matScratched)->AddTextureSRV("MetalnessMap", scratchedMetalness.srv, scratchedMetalness.slice);
+	materials.Get(matTree)->AddTextureSRV("MetalnessMap", treeMetalness.srv, treeMetalness.slice);
+	materials.Get(matMoss)->AddTextureSRV("MetalnessMap", mossMetalness.srv, mossMetalness.slice);
 
 	//shadowMaps
 	//matBronze->AddTextureSRV("ShadowMap", shadowSRV);
@@ -337,92 +459,82 @@ void Game::CreateBasicGeometry()
 	//matTree->AddTextureSRV("ShadowMap", shadowSRV);
 
 	//samplers
-	matBronze->AddSampler("BasicSampler", samplerState);
-	matCobblestone->AddSampler("BasicSampler", samplerState);
-	matFloor->AddSampler("BasicSampler", samplerState);
-	matPaint->AddSampler("BasicSampler", samplerState);
-	matScratched->AddSampler("BasicSampler", samplerState);
-	matTree->AddSampler("BasicSampler", samplerState);
-	matMoss->AddSampler("BasicSampler", samplerState);
+	materials.Get(matBronze)->AddSampler("BasicSampler", samplerState);
+	materials.Get(matCobblestone)->AddSampler("BasicSampler", samplerState);
+	materials.Get(matFloor)->AddSampler("BasicSampler", samplerState);
+	materials.Get(matPaint)->AddSampler("BasicSampler", samplerState);
+	materials.Get(matScratched)->AddSampler("BasicSampler", samplerState);
+	materials.Get(matTree)->AddSampler("BasicSampler", samplerState);
+	materials.Get(matMoss)->AddSampler("BasicSampler", samplerState);
 
 	//pushing to entity list
-	entityList.push_back(new Entity(mesh0, matMoss));
-	entityList[0]->GetTransform()->SetScale(70, 70, 70);
-	entityList[0]->GetTransform()->SetPosition(0, -37.5, 0);
-
-	entityList.push_back(new Entity(treeMesh, matTree));
-	entityList.push_back(new Entity(treeMesh, matTree));
-	entityList.push_back(new Entity(treeMesh, matTree));
-	entityList.push_back(new Entity(treeMesh, matTree));
-	entityList.push_back(new Entity(treeMesh, matTree));
-	entityList.push_back(new Entity(treeMesh, matTree));
-	entityList.push_back(new Entity(treeMesh, matTree));
-	entityList.push_back(new Entity(treeMesh, matTree));
+	AllocationScope entityScope(AllocationTag::Entities);
+	entityList.push_back(entities.Create(mesh0, matMoss));
+	entities.Get(entityList[0])->GetTransform()->SetScale(70, 70, 70);
+	entities.Get(entityList[0])->GetTransform()->SetPosition(0, -37.5, 0);
+
+	entityList.push_back(entities.Create(treeMesh, matTree));
+	entityList.push_back(entities.Create(treeMesh, matTree));
+	entityList.push_back(entities.Create(treeMesh, matTree));
+	entityList.push_back(entities.Create(treeMesh, matTree));
+	entityList.push_back(entities.Create(treeMesh, matTree));
+	entityList.push_back(entities.Create(treeMesh, matTree));
+	entityList.push_back(entities.Create(treeMesh, matTree));
+	entityList.push_back(entities.Create(treeMesh, matTree));
 	
 	//placing trees
-	entityList[1]->GetTransform()->Scale(.01, .01, .01);
-	entityList[1]->GetTransform()->MoveAbsolute(-7.5f, -2.5f, 9.0f);
-	entityList[2]->GetTransform()->Scale(.01, .01, .01);
-	entityList[2]->GetTransform()->MoveAbsolute(15.0f, -2.5f, -4.0f);
-	entityList[3]->GetTransform()->Scale(.01, .01, .01);
-	entityList[3]->GetTransform()->MoveAbsolute(0.0f, -2.5f, 2.0f);
-	entityList[4]->GetTransform()->Scale(.01, .01, .01);
-	entityList[4]->GetTransform()->MoveAbsolute(-15.0f, -2.5f, -7.0f);
-	entityList[5]->GetTransform()->Scale(.01, .01, .01);
-	entityList[5]->GetTransform()->MoveAbsolute(4.5f, -2.5f, 5.0f);
-	entityList[6]->GetTransform()->Scale(.01, .01, .01);
-	entityList[6]->GetTransform()->MoveAbsolute(8.0f, -2.5f, -5.0f);
-	entityList[7]->GetTransform()->Scale(.01, .01, .01);
-	entityList[7]->GetTransform()->MoveAbsolute(4.5f, -2.5f, -5.0f);
-	entityList[8]->GetTransform()->Scale(.01, .01, .01);
-	entityList[8]->GetTransform()->MoveAbsolute(2.0f, -2.5f, -15.0f);
-
-	entityList.push_back(new Entity(mesh1, matBronze));
-	entityList.push_back(new Entity(mesh1, matBronze));
-	entityList.push_back(new Entity(mesh1, matBronze));
-	entityList.push_back(new Entity(mesh1, matBronze));
-
-	entityList[9]->GetTransform()->MoveAbsolute(-5.0f, -2.5f, 0.0f);
-	entityList[10]->GetTransform()->MoveAbsolute(4.0f, -2.5f, 2.0f);
-	entityList[11]->GetTransform()->MoveAbsolute(3.0f, -2.5f, -12.0f);
-	entityList[12]->GetTransform()->MoveAbsolute(-3.0f, -2.5f, -7.0f);
+	entities.Get(entityList[1])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[1])->GetTransform()->MoveAbsolute(-7.5f, -2.5f, 9.0f);
+	entities.Get(entityList[2])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[2])->GetTransform()->MoveAbsolute(15.0f, -2.5f, -4.0f);
+	entities.Get(entityList[3])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[3])->GetTransform()->MoveAbsolute(0.0f, -2.5f, 2.0f);
+	entities.Get(entityList[4])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[4])->GetTransform()->MoveAbsolute(-15.0f, -2.5f, -7.0f);
+	entities.Get(entityList[5])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[5])->GetTransform()->MoveAbsolute(4.5f, -2.5f, 5.0f);
+	entities.Get(entityList[6])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[6])->GetTransform()->MoveAbsolute(8.0f, -2.5f, -5.0f);
+	entities.Get(entityList[7])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[7])->GetTransform()->MoveAbsolute(4.5f, -2.5f, -5.0f);
+	entities.Get(entityList[8])->GetTransform()->Scale(.01, .01, .01);
+	entities.Get(entityList[8])->GetTransform()->MoveAbsolute(2.0f, -2.5f, -15.0f);
+
+	//the ground and the trees never move, so they're baked into world-space chunks below
+	for (EntityHandle handle : entityList)
+		entities.Get(handle)->SetStatic(true);
+
+	entityList.push_back(entities.Create(mesh1, matBronze));
+	entityList.push_back(entities.Create(mesh1, matBronze));
+	entityList.push_back(entities.Create(mesh1, matBronze));
+	entityList.push_back(entities.Create(mesh1, matBronze));
+
+	entities.Get(entityList[9])->GetTransform()->MoveAbsolute(-5.0f, -2.5f, 0.0f);
+	entities.Get(entityList[10])->GetTransform()->MoveAbsolute(4.0f, -2.5f, 2.0f);
+	entities.Get(entityList[11])->GetTransform()->MoveAbsolute(3.0f, -2.5f, -12.0f);
+	entities.Get(entityList[12])->GetTransform()->MoveAbsolute(-3.0f, -2.5f, -7.0f);
+
+	//only the dynamic entities (the spheres) are left in entityList, to be snapshotted (and drawn) one by one
+	std::vector<EntityHandle> staticEntities;
+	std::vector<EntityHandle> dynamicEntities;
+	for (EntityHandle handle : entityList)
+		(entities.Get(handle)->IsStatic() ? staticEntities : dynamicEntities).push_back(handle);
+	entityList = dynamicEntities;
+
+	AllocationScope batchingScope(AllocationTag::Batching);
+	staticBatcher = std::make_shared<StaticBatcher>(geometryArena);
+	staticBatcher->Build(entities, staticEntities);
+
+	//the chunks have their own geometry, so the models' cpu copies aren't needed any more
+	for (MeshLoad& load : meshLoads)
+		(*load.mesh)->ReleaseGeometry();
 
 	ambient = XMFLOAT3(0.05f, 0.05f, 0.15f);
 
 	//FINAL PROJECT: SHADOW MAPPING
 	
-	//texture to draw shadow map to
-	D3D11_TEXTURE2D_DESC shadowDesc = {};
-	shadowDesc.Width = 2048;
-	shadowDesc.Height = 2048;
-	shadowDesc.ArraySize = 1;
-	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
-	shadowDesc.CPUAccessFlags = 0;
-	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-	shadowDesc.MipLevels = 1;
-	shadowDesc.MiscFlags = 0;
-	shadowDesc.SampleDesc.Count = 1;
-	shadowDesc.SampleDesc.Quality = 0;
-	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
-	device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
-
-	//depth stencil view for using texture as a depth buffer
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowDSV.GetAddressOf());
-
-	//SRV for the shadow map
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, shadowSRV.GetAddressOf());
-
 	//special comparison sampler state for shadows
+	AllocationScope shadowMaterialScope(AllocationTag::Materials);
 	D3D11_SAMPLER_DESC shadowSampDesc = {};
 	shadowSampDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_MIP_LINEAR;	//comparison filter
 	shadowSampDesc.ComparisonFunc = D3D11_COMPARISON_LESS;
@@ -436,23 +548,13 @@ void Game::CreateBasicGeometry()
 	device->CreateSamplerState(&shadowSampDesc, &shadowSampler);
 
 	//shadow samplers
-	matBronze->AddSampler("ShadowSampler", shadowSampler);
-	matCobblestone->AddSampler("ShadowSampler", shadowSampler);
-	matFloor->AddSampler("ShadowSampler", shadowSampler);
-	matPaint->AddSampler("ShadowSampler", shadowSampler);
-	matScratched->AddSampler("ShadowSampler", shadowSampler);
-	matTree->AddSampler("ShadowSampler", shadowSampler);
-	matMoss->AddSampler("ShadowSampler", shadowSampler);
-
-	//Rasterizer State
-	D3D11_RASTERIZER_DESC shadowRastDesc = {};
-	shadowRastDesc.FillMode = D3D11_FILL_SOLID;
-	shadowRastDesc.CullMode = D3D11_CULL_BACK;
-	shadowRastDesc.DepthClipEnable = true;
-	shadowRastDesc.DepthBias = 1000;
-	shadowRastDesc.DepthBiasClamp = 0.0f;
-	shadowRastDesc.SlopeScaledDepthBias = 1.0f;
-	device->CreateRasterizerState(&shadowRastDesc, &shadowRasterizer);
+	materials.Get(matBronze)->AddSampler("ShadowSampler", shadowSampler);
+	materials.Get(matCobblestone)->AddSampler("ShadowSampler", shadowSampler);
+	materials.Get(matFloor)->AddSampler("ShadowSampler", shadowSampler);
+	materials.Get(matPaint)->AddSampler("ShadowSampler", shadowSampler);
+	materials.Get(matScratched)->AddSampler("ShadowSampler", shadowSampler);
+	materials.Get(matTree)->AddSampler("ShadowSampler", shadowSampler);
+	materials.Get(matMoss)->AddSampler("ShadowSampler", shadowSampler);
 
 	//Creating fake camera for rendering shadow map
 
@@ -469,9 +571,11 @@ void Game::CreateBasicGeometry()
 	XMStoreFloat4x4(&shadowProjectionMatrix, shadowProj);
 
 	//creating sky
+	AllocationScope skyScope(AllocationTag::Textures);
 	CreateDDSTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/Skies/SunnyCubeMap.dds").c_str(), 0, skySRV.GetAddressOf());
-	skybox = new Sky(mesh0, samplerState, device, skySRV, skyPixelShader, skyVertexShader);
+	skybox = new Sky(mesh0, samplerState, pipelineStateCache, skySRV, skyPixelShader, skyVertexShader);
 
+	BuildRenderGraph();
 
 }
 
@@ -479,6 +583,7 @@ void Game::CreateBasicGeometry()
 // --------------------------------------------------------
 // Handle resizing DirectX "stuff" to match the new window size.
 // For instance, updating our projection matrix's aspect ratio.
+// Runs on the main thread - the buffers catch up before the next Draw.
 // --------------------------------------------------------
 void Game::OnResize()
 {
@@ -510,6 +615,75 @@ void Game::Update(float deltaTime, float totalTime)
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
 
+	//toggle between pipelined and serial frames to compare frame times
+	if (Input::GetInstance().KeyPress('P'))
+		pipelinedFrames = !pipelinedFrames;
+
+	//toggle instancing to compare draw counts
+	if (Input::GetInstance().KeyPress('I'))
+		instancing = !instancing;
+
+	//toggle recording on worker threads to compare draw times
+	if (Input::GetInstance().KeyPress('R'))
+		parallelRecording = !parallelRecording;
+
+	//write the next frame's commands out, to compare against another build's
+	if (Input::GetInstance().KeyPress('C'))
+		captureCommands = true;
+
+	//capturing everything Draw needs, since it may run while the next Update does
+	SceneSnapshot& scene = sceneState.GetWrite();
+	scene.deltaTime = deltaTime;
+	scene.totalTime = totalTime;
+	scene.view = camera->GetView();
+	scene.projection = camera->GetProjection();
+	scene.cameraPosition = camera->GetTransform()->GetPosition();
+	scene.ambient = ambient;
+	scene.directionalLight = directionalLight3;
+	scene.shadowView = shadowViewMatrix;
+	scene.shadowProjection = shadowProjectionMatrix;
+	scene.instancing = instancing;
+	scene.parallelRecording = parallelRecording;
+	scene.captureCommands = captureCommands;
+	captureCommands = false;
+
+	//each snapshot only touches its own entity, so this splits across threads once there are enough of them
+	//(room for the static chunks too, so the list is one arena allocation)
+	scene.entities.reserve(entityList.size() + staticBatcher->GetChunks().size());
+	scene.entities.resize(entityList.size());
+	JobSystem::GetInstance().ParallelFor((unsigned int)entityList.size(), [&](unsigned int begin, unsigned int end)
+	{
+		AllocationScope allocationScope(AllocationTag::Entities);
+		for (unsigned int i = begin; i < end; i++)
+			scene.entities[i] = entities.Get(entityList[i])->GetSnapshot(materials, scene.view);
+	}, 64);
+
+	//static chunks the camera or the shadow map can see go after them
+	AllocationScope batchingScope(AllocationTag::Batching);
+	staticChunksVisible = staticBatcher->AppendVisible(materials, scene);
+
+	//parameters of any material that changed, for Draw to write into the material table
+	AllocationScope materialScope(AllocationTag::Materials);
+	materialTable->CollectChanges(materials, scene.materialChanges);
+}
+
+// --------------------------------------------------------
+// Hands the snapshot Update just wrote over to Draw.  DXCore
+// only calls this while neither Update nor Draw is running.
+// --------------------------------------------------------
+void Game::PublishFrame()
+{
+	sceneState.Swap();
+
+	//the snapshot Update writes next is the one Draw just finished with.  Its lists are in the
+	//arena set the next EndFrame resets, so they're let go of now, while they're still valid
+	SceneSnapshot& next = sceneState.GetWrite();
+	next.entities = FrameVector<EntitySnapshot>();
+	next.materialChanges = FrameVector<MaterialTableEntry>();
+
+	//entities and materials destroyed two Updates ago are in no snapshot Draw can still be reading
+	entities.EndFrame();
+	materials.EndFrame();
 }
 
 // --------------------------------------------------------
@@ -517,77 +691,100 @@ void Game::Update(float deltaTime, float totalTime)
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
-	// Background color (Cornflower Blue in this case) for clearing
-	const float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-	// Clear the render target and depth buffer (erases what's on the screen)
-	//  - Do this ONCE PER FRAME
-	//  - At the beginning of Draw (before drawing *anything*)
-	context->ClearRenderTargetView(backBufferRTV.Get(), color);
-	context->ClearDepthStencilView(
-		depthStencilView.Get(),
-		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
-		1.0f,
-		0);
-
-
-	// Render the shadow map before rendering anything to the screen
-	RenderShadowMap();
-
-	// Set the vertex and pixel shaders to use for the next Draw() command
-	//  - These don't technically need to be set every frame
-	//  - Once you start applying different shaders to different objects,
-	//    you'll need to swap the current shaders before each draw
-	context->VSSetShader(vertexShader.get()->GetDirectXShader().Get(), 0, 0);
-	context->PSSetShader(pixelShader.get()->GetDirectXShader().Get(), 0, 0);
-
-
-	// Ensure the pipeline knows how to interpret the data (numbers)
-	// from the vertex buffer.  
-	// - If all of your 3D models use the exact same vertex layout,
-	//    this could simply be done once in Init()
-	// - However, this isn't always the case (but might be for this course)
-	//context->IASetInputLayout(inputLayout.Get());	//to remove
-
-
-	//creating buffer struct
-	VertexShaderExternalData vsData;
-	vsData.colorTint	= XMFLOAT4(1.0f, 0.5f, 0.5f, 1.0f);
-	vsData.world = XMFLOAT4X4(); //idk what to put here
-
-	//draw entities
-	for (int i = 0; i < entityList.size(); i++)
-	{	
-		//shadow data set here so that it doesn't have to be passed to entity
-		
-		std::shared_ptr<SimpleVertexShader> vs = entityList[i]->GetMaterial()->GetVertexShader();
-		vs->SetMatrix4x4("shadowView", shadowViewMatrix);
-		vs->SetMatrix4x4("shadowProjection", shadowProjectionMatrix);
-		
-		std::shared_ptr<SimplePixelShader> ps = entityList[i]->GetMaterial()->GetPixelShader();
-		ps->SetShaderResourceView("ShadowMap", shadowSRV);
-		ps->SetSamplerState("ShadowSampler", shadowSampler);
-
-		//entityList[i]->GetMaterial()->PrepareMaterials();
-
-		//vs->CopyAllBufferData();
-		//ps->CopyAllBufferData();
-
-		//entityList[i]->GetMaterial()->GetPixelShader()->SetData("directionalLight1", &directionalLight1, sizeof(directionalLight1));
-		//entityList[i]->GetMaterial()->GetPixelShader()->SetData("directionalLight2", &directionalLight2, sizeof(directionalLight2));
-		entityList[i]->GetMaterial()->GetPixelShader()->SetData("directionalLight3", &directionalLight3, sizeof(directionalLight3));
-		//entityList[i]->GetMaterial()->GetPixelShader()->SetData("pointLight1", &pointLight1, sizeof(pointLight1));
-		//entityList[i]->GetMaterial()->GetPixelShader()->SetData("pointLight2", &pointLight2, sizeof(pointLight2));
-
-		entityList[i]->Draw(context, camera, ambient);
+	//everything below reads from the published snapshot, never from live entities
+	const SceneSnapshot& scene = sceneState.GetRead();
+
+	//frees ring space the GPU is done with - constants from earlier frames can't be reused after this
+	constantBufferRing->BeginFrame();
+
+	//geometry for meshes created since the last frame - encoded into the immediate context's
+	//stream like the rest of the frame's uploads, so they're played before anything draws
+	//(each scope from here on tags what follows it, until the next one)
+	CommandStream& uploads = immediateContext->GetStream();
+	AllocationScope meshScope(AllocationTag::Meshes);
+	geometryArena->FlushUploads(uploads);
+
+	//and parameters for materials changed since the last frame (if any)
+	AllocationScope materialScope(AllocationTag::Materials);
+	materialTable->Apply(uploads, scene.materialChanges);
+
+	stateCallsIssued = stateCache->GetCallsIssued() + commandRecorder->GetCallsIssued();
+	stateCallsFiltered = stateCache->GetCallsFiltered() + commandRecorder->GetCallsFiltered();
+	commandsSubmitted = immediateContext->GetCommandsSubmitted() + commandRecorder->GetCommandsSubmitted();
+	stateCache->ResetCounters();
+	immediateContext->ResetCounters();
+	commandRecorder->ResetCounters();
+
+	//a capture plays this frame's streams on a logging null backend too, in the order they run
+	AllocationScope captureScope(AllocationTag::Commands);
+	std::unique_ptr<NullCommandExecutor> capture;
+	if (scene.captureCommands)
+	{
+		capture = std::make_unique<NullCommandExecutor>(true);
+		immediateContext->SetCapture(capture.get());
+
+		//so the capture has every pipeline bind, not just the ones that changed since last frame
+		immediateContext->ResetPipelineState();
+	}
+
+	//one set of batches (and one object buffer upload) for both passes
+	AllocationScope batchingScope(AllocationTag::Batching);
+	instanceBatcher->Build(uploads, scene.entities, scene.instancing);
+	const FrameVector<InstanceBatch>& batches = instanceBatcher->GetBatches();
+	unsigned int shadowBatchCount = (unsigned int)batches.size();
+	unsigned int mainBatchCount = 0;
+	unsigned int mainEntityCount = 0;
+	for (const InstanceBatch& batch : batches)
+	{
+		if (batch.pass != DrawKey::ShadowOnly)
+		{
+			mainBatchCount++;
+			mainEntityCount += batch.instanceCount;
+		}
 	}
+	drawCalls = shadowBatchCount + mainBatchCount + 1;	//shadow and main pass, plus the sky
+	drawCallsUninstanced = (unsigned int)scene.entities.size() + mainEntityCount + 1;
+
+	//captures are recorded on this thread, so the log has one order
+	bool parallel = scene.parallelRecording && !scene.captureCommands && commandRecorder->GetContextCount() > 1;
 
-	//draw sky
-	skybox->Draw(context, camera);
+	//the shadow pass and the sky are a list each and the main pass is split over the rest, but
+	//never so finely that a list is only a handful of draws
+	unsigned int mainParts = 1;
+	if (parallel && commandRecorder->GetContextCount() > 2)
+	{
+		const unsigned int minBatchesPerList = 32;
+		mainParts = ((unsigned int)batches.size() + minBatchesPerList - 1) / minBatchesPerList;
+		if (mainParts > commandRecorder->GetContextCount() - 2)
+			mainParts = commandRecorder->GetContextCount() - 2;
+		if (mainParts == 0)
+			mainParts = 1;
+	}
+	batchesPerPart = ((unsigned int)batches.size() + mainParts - 1) / mainParts;
+	renderGraph->SetPartCount(mainPass, mainParts);
+
+	//the swap chain's views change on resize, so the graph is given them every frame
+	AllocationScope renderGraphScope(AllocationTag::RenderGraph);
+	graphScene = &scene;
+	renderGraphExecutor->SetImported(backBufferResource, backBufferRTV.Get(), 0, 0, bufferWidth, bufferHeight);
+	renderGraphExecutor->SetImported(depthResource, 0, depthStencilView.Get(), 0, bufferWidth, bufferHeight);
+
+	//sets each pass's targets, clears and shadow map binds (and unbinds), then records it - into
+	//the immediate context's stream, which is played below, or into deferred lists
+	commandListsRecorded = renderGraphExecutor->Execute(*renderGraph, *immediateContext, parallel ? commandRecorder.get() : 0);
+	renderGraphTextures = renderGraphExecutor->GetTextureCount();
+	graphScene = 0;
+
+	AllocationScope submitScope(AllocationTag::Commands);
+	immediateContext->Submit();
+	if (capture)
+	{
+		immediateContext->SetCapture(0);
+		WriteCommandCapture(*capture);
+	}
 
-	//need to unbind shadow map as a srv because using it as depth buffer
-	ID3D11ShaderResourceView* nullSRVs[16] = {};
-	context->PSSetShaderResources(0, 16, nullSRVs);
+	//fence this frame's ring allocations
+	constantBufferRing->EndFrame();
 
 	// Present the back buffer to the user
 	//  - Puts the final frame we're drawing into the window so the user can see it
@@ -599,45 +796,207 @@ void Game::Draw(float deltaTime, float totalTime)
 	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
 }
 
-void Game::RenderShadowMap()
+// --------------------------------------------------------
+// Declares the frame's passes and what they draw into.  The
+// graph sets targets and clears, binds the shadow map for
+// the main pass and unbinds it before it's drawn into again,
+// so the passes below only draw.  Compiled once - Draw only
+// changes how many parts the main pass records in.
+// --------------------------------------------------------
+void Game::BuildRenderGraph()
 {
-	//initializing pipeline setup - clear shadow map
-	context->OMSetRenderTargets(0, 0, shadowDSV.Get());
-	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	context->RSSetState(shadowRasterizer.Get());
-
-	//viewport matching shadow map resolution
-	D3D11_VIEWPORT viewport = {};
-	viewport.TopLeftX = 0.0f;
-	viewport.TopLeftY = 0.0f;
-	viewport.Width = (float)2048;
-	viewport.Height = (float)2048;
-	viewport.MinDepth = 0.0f;
-	viewport.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &viewport);
+	AllocationScope allocationScope(AllocationTag::RenderGraph);
+
+	renderGraph = std::make_shared<RenderGraph>();
+	renderGraphExecutor = std::make_shared<RenderGraphExecutor>(device);
+	graphScene = 0;
+	batchesPerPart = 0;
+
+	//the screen, which the graph doesn't own but has to finish
+	backBufferResource = renderGraph->ImportTexture("BackBuffer");
+	depthResource = renderGraph->ImportTexture("Depth");
+	renderGraph->MarkOutput(backBufferResource);
+
+	//typeless, so it can be drawn into as depth and read as a float
+	RenderGraphTextureDesc shadowDesc;
+	shadowDesc.width = 2048;
+	shadowDesc.height = 2048;
+	shadowDesc.format = DXGI_FORMAT_R32_TYPELESS;
+	shadowDesc.shaderResourceFormat = DXGI_FORMAT_R32_FLOAT;
+	shadowDesc.depthStencilFormat = DXGI_FORMAT_D32_FLOAT;
+	RenderGraphResource shadowMap = renderGraph->CreateTexture("ShadowMap", shadowDesc);
+
+	unsigned int shadowPass = renderGraph->AddPass("Shadow", [this](unsigned int, RenderContext& renderContext)
+	{
+		RecordShadowPass(renderContext, *graphScene);
+	});
+	renderGraph->AddDepthStencil(shadowPass, shadowMap, 1.0f);
+
+	//split into parts of batchesPerPart batches, recorded on their own contexts when there are enough
+	mainPass = renderGraph->AddPass("Main", [this](unsigned int part, RenderContext& renderContext)
+	{
+		unsigned int batchCount = (unsigned int)instanceBatcher->GetBatches().size();
+		unsigned int first = part * batchesPerPart;
+		unsigned int end = first + batchesPerPart;
+		if (first > batchCount) first = batchCount;
+		if (end > batchCount) end = batchCount;
+		RecordMainPass(renderContext, *graphScene, first, end);
+	});
+	const SimpleSRV* shadowMapInfo = pixelShader->GetShaderResourceViewInfo("ShadowMap");
+	if (shadowMapInfo)
+		renderGraph->AddRead(mainPass, shadowMap, ShaderStage::Pixel, shadowMapInfo->BindIndex);
+	const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	renderGraph->AddRenderTarget(mainPass, backBufferResource, clearColor);
+	renderGraph->AddDepthStencil(mainPass, depthResource, 1.0f, true);
+
+	//over what the main pass drew, so it keeps it
+	unsigned int skyPass = renderGraph->AddPass("Sky", [this](unsigned int, RenderContext& renderContext)
+	{
+		AllocationScope allocationScope(AllocationTag::Commands);
+		renderContext.GetStream().SetTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		skybox->Draw(renderContext, graphScene->view, graphScene->projection);
+	});
+	renderGraph->AddRenderTarget(skyPass, backBufferResource);
+	renderGraph->AddDepthStencil(skyPass, depthResource);
+
+	if (!renderGraph->Compile())
+		printf("Render graph: %s\n", renderGraph->GetError().c_str());
+}
+
+// --------------------------------------------------------
+// Encodes drawing every batch into the shadow map.  Sets
+// everything it uses, so it can go on a deferred context
+// that starts out cleared.
+// --------------------------------------------------------
+void Game::RecordShadowPass(RenderContext& renderContext, const SceneSnapshot& scene)
+{
+	//may be on a job system thread, which has no scope of its own
+	AllocationScope allocationScope(AllocationTag::Commands);
+	CommandStream& stream = renderContext.GetStream();
+
+	//the graph has set (and cleared) the shadow map and a viewport matching it
+	stream.SetTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	//turning on the shadow map vertex shader, turning off pixel shader
-	shadowVS->SetShader();
-	shadowVS->SetMatrix4x4("view", shadowViewMatrix);
-	shadowVS->SetMatrix4x4("projection", shadowProjectionMatrix);
-	context->PSSetShader(0, 0, 0);	//no pixel shader
+	AllocationScope shaderScope(AllocationTag::Shaders);
+	ShadowVSPerFrameData shadowFrame = {};
+	shadowFrame.view = scene.shadowView;
+	shadowFrame.projection = scene.shadowProjection;
+	shadowVS->SetBufferData(renderContext, shadowVSPerFrame, shadowFrame);
+	shadowVS->CopyAllBufferData(renderContext);
+	shadowPipeline->Bind(renderContext);	//no pixel shader
+
+	//draw all entities - the same batches as the main pass (plus any shadow-only ones), so materials are just ignored
+	AllocationScope drawScope(AllocationTag::Commands);
+	instanceBatcher->Bind(stream);
+	for (const InstanceBatch& batch : instanceBatcher->GetBatches())
+		batch.mesh->DrawInstanced(stream, batch.instanceCount, batch.firstInstance);
+}
 
-	//draw all entities
-	for (int i = 0; i < entityList.size(); i++)
+// --------------------------------------------------------
+// Encodes drawing batches [firstBatch, endBatch) to the
+// screen.  Like the shadow pass it sets everything it uses,
+// so several of these can be recorded at once, one per range.
+// --------------------------------------------------------
+void Game::RecordMainPass(RenderContext& renderContext, const SceneSnapshot& scene, unsigned int firstBatch, unsigned int endBatch)
+{
+	//may be on a job system thread, which has no scope of its own
+	AllocationScope allocationScope(AllocationTag::Commands);
+	CommandStream& stream = renderContext.GetStream();
+
+	//the graph has set the screen as the target and bound the shadow map
+	stream.SetTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	//per-frame and per-light data, set once for every entity below - into this context's own copy
+	AllocationScope shaderScope(AllocationTag::Shaders);
+	VSPerFrameData vsFrame = {};
+	vsFrame.view = scene.view;
+	vsFrame.projection = scene.projection;
+	vsFrame.shadowView = scene.shadowView;
+	vsFrame.shadowProjection = scene.shadowProjection;
+	vertexShader->SetBufferData(renderContext, vsPerFrame, vsFrame);
+
+	PSPerFrameData psFrame = {};
+	psFrame.cameraPos = scene.cameraPosition;
+	psFrame.ambient = scene.ambient;
+	pixelShader->SetBufferData(renderContext, psPerFrame, psFrame);
+
+	PSPerLightData psLight = {};
+	psLight.directionalLight3 = scene.directionalLight;
+	pixelShader->SetBufferData(renderContext, psPerLight, psLight);
+
+	pixelShader->SetSamplerState(renderContext, "ShadowSampler", shadowSampler);
+
+	AllocationScope drawScope(AllocationTag::Commands);
+	materialTable->Bind(stream);
+
+	//draw entities - one instanced draw per batch, with every entity's matrices in the object buffer
+	instanceBatcher->Bind(stream);
+	const FrameVector<InstanceBatch>& batches = instanceBatcher->GetBatches();
+	unsigned int currentBindings = 0xFFFFFFFF;
+	for (unsigned int i = firstBatch; i < endBatch; i++)
 	{
-		shadowVS->SetMatrix4x4("world", entityList[i]->GetTransform()->GetWorldMatrix());
-		//entityList[i]->GetMaterial()->PrepareMaterials();
-		shadowVS->CopyAllBufferData();
+		const InstanceBatch& batch = batches[i];
+
+		//static chunks outside the camera's view are only there for the shadow map
+		if (batch.pass == DrawKey::ShadowOnly)
+			continue;
 
-		//draw mesh
-		entityList[i]->GetMesh()->Draw();
-		//entityList[i]->Draw(context, camera, ambient);
+		//batches are sorted by material bindings, so this is only once per distinct set
+		if (batch.material->GetBindingId() != currentBindings)
+		{
+			AllocationScope materialScope(AllocationTag::Materials);
+			batch.material->PrepareMaterials(stream);
+
+			//shaders and states - nothing at all if the last material's pipeline was the same one
+			batch.material->GetPipelineState()->Bind(renderContext);
+
+			//copy constant buffers into the stream (only the ones that changed)
+			AllocationScope shaderScope(AllocationTag::Shaders);
+			batch.material->GetVertexShader()->CopyAllBufferData(renderContext);
+			batch.material->GetPixelShader()->CopyAllBufferData(renderContext);
+			currentBindings = batch.material->GetBindingId();
+		}
+
+		batch.mesh->DrawInstanced(stream, batch.instanceCount, batch.firstInstance);
 	}
+}
 
-	//after rendering shadow map, return to rendering screen
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
-	viewport.Width = (float)this->width;
-	viewport.Height = (float)this->height;
-	context->RSSetViewports(1, &viewport);
-	context->RSSetState(0);
+// --------------------------------------------------------
+// Writes a capture's checksum, counts and log
+// --------------------------------------------------------
+void Game::WriteCommandCapture(const NullCommandExecutor& capture)
+{
+	const CommandStreamStats& stats = capture.GetStats();
+
+	std::ofstream file("CommandCapture.txt");
+	file << "Checksum: " << std::hex << capture.GetChecksum() << std::dec << "\n";
+	file << "Draws: " << stats.draws << " (" << stats.instances << " instances, " << stats.triangles << " triangles)\n";
+	file << "Uploads: " << stats.uploadBytes << " bytes\n";
+	file << "Redundant binds: " << stats.redundantBinds << "\n";
+	file << "Stream: " << stats.streamBytes << " bytes\n\n";
+	file << capture.GetLog();
+}
+
+// --------------------------------------------------------
+// Adds the state cache's counts for the last frame
+// --------------------------------------------------------
+void Game::AppendTitleBarStats(std::ostream& output)
+{
+	output << "    State Calls: " << stateCallsIssued << " (" << stateCallsFiltered << " filtered)";
+	output << "    Draws: " << drawCalls << " (" << drawCallsUninstanced << " without instancing)";
+	output << "    Command Lists: " << commandListsRecorded;
+	output << "    Commands: " << commandsSubmitted;
+	output << "    Graph: " << renderGraph->GetOrder().size() << " passes (" << renderGraph->GetCulledCount() << " culled), " <<
+		renderGraph->GetTransientCount() << " transients in " << renderGraphTextures << " textures";
+
+	output << "    Pipelines: " << pipelineStateCache->GetCount() << " (" << pipelineStateCache->GetRequestCount() << " requested)";
+	output << "    Material Uploads: " << materialTable->GetUploadCount();
+	output << "    Static: " << staticBatcher->GetEntityCount() << " entities in " << staticBatcher->GetChunks().size() <<
+		" chunks (" << staticChunksVisible << " visible)";
+
+	GeometryArenaStats geometry = geometryArena->GetStats();
+	output << "    Geometry: " << geometry.verticesUsed / 1024 << "/" << geometry.vertexCapacity / 1024 << "K verts, " <<
+		geometry.indicesUsed / 1024 << "/" << geometry.indexCapacity / 1024 << "K indices in " << geometry.pages << " pages, " <<
+		(int)(geometry.fragmentation * 100.0f) << "% fragmented";
 }
\ No newline at end of file
@@ -6,12 +6,24 @@
 #include "Mesh.h"
 #include "Entity.h"
 #include <vector>
+#include <atomic>
 #include "Camera.h"
 #include "Material.h"
 #include "Lights.h"
 #include "WICTextureLoader.h"
 #include "Sky.h"
 #include "DDSTextureLoader.h"
+#include "SceneState.h"
+#include "ConstantBufferRing.h"
+#include "BufferStructs.h"
+#include "InstanceBatcher.h"
+#include "GeometryArena.h"
+#include "StaticBatcher.h"
+#include "MaterialTable.h"
+#include "TextureArrayPacker.h"
+#include "CommandRecorder.h"
+#include "RenderGraphExecutor.h"
+#include "PipelineState.h"
 
 class Game 
 	: public DXCore
@@ -27,13 +39,17 @@ public:
 	void OnResize();
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
+	void PublishFrame();
+	void AppendTitleBarStats(std::ostream& output);
 
 private:
 
 	// Initialization helper methods - feel free to customize, combine, etc.
 	void LoadShaders(); 
 	void CreateBasicGeometry();
-	void RenderShadowMap();
+	void BuildRenderGraph();
+	void RecordShadowPass(RenderContext& renderContext, const SceneSnapshot& scene);
+	void RecordMainPass(RenderContext& renderContext, const SceneSnapshot& scene, unsigned int firstBatch, unsigned int endBatch);
 
 	
 	// Note the usage of ComPtr below
@@ -50,11 +66,73 @@ private:
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
 
+	//main shader buffers that change once per frame (or when the lights do), not per entity
+	ConstantBufferHandle<VSPerFrameData> vsPerFrame;
+	ConstantBufferHandle<PSPerFrameData> psPerFrame;
+	ConstantBufferHandle<PSPerLightData> psPerLight;
+
 	std::shared_ptr<SimpleVertexShader> shadowVS;
+	ConstantBufferHandle<ShadowVSPerFrameData> shadowVSPerFrame;
+
+	//shaders and render states, bound as one - the cache hands out one object per distinct set
+	std::shared_ptr<PipelineStateCache> pipelineStateCache;
+	std::shared_ptr<PipelineState> mainPipeline;
+	std::shared_ptr<PipelineState> shadowPipeline;
 
 	std::shared_ptr<SimplePixelShader> skyPixelShader;
 	std::shared_ptr<SimpleVertexShader> skyVertexShader;
 
+	//dynamic buffer the shaders above stream their constants into (if supported)
+	std::shared_ptr<ConstantBufferRing> constantBufferRing;
+
+	//shared vertex/index buffers every mesh lives in
+	std::shared_ptr<GeometryArena> geometryArena;
+
+	//whether CreateBasicGeometry packs material textures into shared arrays
+	bool packMaterialTextures;
+
+	//every material's parameters, read by the pixel shader through the object's material index
+	std::shared_ptr<MaterialTable> materialTable;
+
+	//entities that never move, merged into a few world-space meshes at load
+	std::shared_ptr<StaticBatcher> staticBatcher;
+	std::atomic<unsigned int> staticChunksVisible;	//to the camera, last Update
+
+	//groups entities by mesh and material so each group is one instanced draw - press I to toggle
+	std::shared_ptr<InstanceBatcher> instanceBatcher;
+	bool instancing;
+	std::atomic<unsigned int> drawCalls;			//last frame's draws, for the title bar
+	std::atomic<unsigned int> drawCallsUninstanced;	//what they would have been with one draw per entity
+
+	//every bind on the immediate context goes through this, so redundant ones are dropped
+	std::shared_ptr<StateCache> stateCache;
+	std::atomic<unsigned long long> stateCallsIssued;	//last frame's counts, for the title bar
+	std::atomic<unsigned long long> stateCallsFiltered;
+
+	//records the shadow pass and slices of the main pass on the job system, each into its own
+	//deferred context - press R to toggle.  off, the same passes draw on immediateContext.
+	std::shared_ptr<CommandRecorder> commandRecorder;
+	std::shared_ptr<RenderContext> immediateContext;
+	bool parallelRecording;
+	std::atomic<unsigned int> commandListsRecorded;	//last frame's, for the title bar
+	std::atomic<unsigned long long> commandsSubmitted;	//stream commands, last frame
+
+	//the shadow, main and sky passes, and the textures between them - the graph sets targets,
+	//clears and shadow map binds, and makes the shadow map itself
+	std::shared_ptr<RenderGraph> renderGraph;
+	std::shared_ptr<RenderGraphExecutor> renderGraphExecutor;
+	RenderGraphResource backBufferResource;
+	RenderGraphResource depthResource;
+	std::atomic<unsigned int> renderGraphTextures;	//the executor's, last frame - it resizes them on the render thread
+	unsigned int mainPass;
+	const SceneSnapshot* graphScene;	//the snapshot being drawn, while the graph runs
+	unsigned int batchesPerPart;		//of the main pass, this frame
+
+	//press C to write the next frame's commands, with object numbers instead of pointers, to
+	//CommandCapture.txt - two builds that draw the same frame should write the same file
+	bool captureCommands;
+	void WriteCommandCapture(const NullCommandExecutor& capture);
+
 
 	//meshes, replace with shared_ptr when I figure out how to do those
 	std::shared_ptr<Mesh> mesh0;
@@ -63,8 +141,12 @@ private:
 	std::shared_ptr<Mesh> mesh3;
 	std::shared_ptr<Mesh> treeMesh;
 
-	//for holding entities
-	std::vector<Entity*> entityList;
+	//for holding entities - the pool owns them, the list keeps them in creation order
+	Pool<Entity> entities;
+	std::vector<EntityHandle> entityList;
+
+	//render data handed from Update to Draw - Draw may be on another thread
+	DoubleBuffer<SceneSnapshot> sceneState;
 
 	//Camera
 	Camera* camera;
@@ -77,13 +159,14 @@ private:
 	//Material* materialWhiteWood;
 	//Material* materialWhiteConcrete;
 	//Material* materialWhiteSciFiFabric;
-	Material* matBronze;
-	Material* matCobblestone;
-	Material* matFloor;
-	Material* matPaint;
-	Material* matScratched;
-	Material* matTree;
-	Material* matMoss;
+	Pool<Material> materials;
+	MaterialHandle matBronze;
+	MaterialHandle matCobblestone;
+	MaterialHandle matFloor;
+	MaterialHandle matPaint;
+	MaterialHandle matScratched;
+	MaterialHandle matTree;
+	MaterialHandle matMoss;
 
 	//Lights
 	DirectX::XMFLOAT3 ambient;
@@ -94,40 +177,40 @@ private:
 	Light pointLight2;
 
 	//textures - albedo
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeAlbedoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneAlbedoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorAlbedoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintAlbedoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedAlbedoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> treeAlbedoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mossAlbedoSRV;
+	PackedTexture bronzeAlbedo;
+	PackedTexture cobblestoneAlbedo;
+	PackedTexture floorAlbedo;
+	PackedTexture paintAlbedo;
+	PackedTexture scratchedAlbedo;
+	PackedTexture treeAlbedo;
+	PackedTexture mossAlbedo;
 
 	//textures - roughness
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeRoughnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneRoughnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorRoughnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintRoughnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedRoughnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> treeRoughnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mossRoughnessSRV;
+	PackedTexture bronzeRoughness;
+	PackedTexture cobblestoneRoughness;
+	PackedTexture floorRoughness;
+	PackedTexture paintRoughness;
+	PackedTexture scratchedRoughness;
+	PackedTexture treeRoughness;
+	PackedTexture mossRoughness;
 
 	//textures - normalMap
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeNormalSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneNormalSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorNormalSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintNormalSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedNormalSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> treeNormalSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mossNormalSRV;
+	PackedTexture bronzeNormal;
+	PackedTexture cobblestoneNormal;
+	PackedTexture floorNormal;
+	PackedTexture paintNormal;
+	PackedTexture scratchedNormal;
+	PackedTexture treeNormal;
+	PackedTexture mossNormal;
 
 	//textures - metalnessMap
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeMetalnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneMetalnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorMetalnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintMetalnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedMetalnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> treeMetalnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mossMetalnessSRV;
+	PackedTexture bronzeMetalness;
+	PackedTexture cobblestoneMetalness;
+	PackedTexture floorMetalness;
+	PackedTexture paintMetalness;
+	PackedTexture scratchedMetalness;
+	PackedTexture treeMetalness;
+	PackedTexture mossMetalness;
 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
 
@@ -142,10 +225,7 @@ private:
 	//Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> back;
 
 	//shadow stuff
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
-	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
 	DirectX::XMFLOAT4X4 shadowViewMatrix;
 	DirectX::XMFLOAT4X4 shadowProjectionMatrix;
 };
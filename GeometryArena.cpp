@@ -0,0 +1,221 @@
+#include "GeometryArena.h"
+
+GeometryArena::GeometryArena(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device),
+	pageCount(0)
+{
+}
+
+// --------------------------------------------------------
+// Finds room for the mesh in the first page it fits in,
+// adding a page if none has room, and queues its upload
+// --------------------------------------------------------
+bool GeometryArena::Allocate(const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount, GeometryRange& range)
+{
+	range = GeometryRange();
+	if (vertexCount == 0 || indexCount == 0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	unsigned int page = 0;
+	RangeAllocation vertexAllocation;
+	RangeAllocation indexAllocation;
+	for (; page < pageCount; page++)
+	{
+		vertexAllocation = pages[page]->vertices.Allocate(vertexCount);
+		if (!vertexAllocation.IsValid())
+			continue;
+
+		indexAllocation = pages[page]->indices.Allocate(indexCount);
+		if (indexAllocation.IsValid())
+			break;
+
+		pages[page]->vertices.Free(vertexAllocation);
+	}
+
+	// Nowhere had room - a mesh bigger than a page gets a page of its own,
+	// rounded up so its allocators can hand the whole page to it
+	if (page == pageCount)
+	{
+		unsigned int vertexCapacity = VerticesPerPage;
+		if (vertexCount > vertexCapacity)
+			vertexCapacity = RangeAllocator::GetFitSize(vertexCount);
+
+		unsigned int indexCapacity = IndicesPerPage;
+		if (indexCount > indexCapacity)
+			indexCapacity = RangeAllocator::GetFitSize(indexCount);
+
+		if (vertexCapacity == 0 || indexCapacity == 0 || !AddPage(vertexCapacity, indexCapacity))
+			return false;
+
+		// Pages can't be taken back (drawing reads them without the
+		// lock), so if this fails the page just stays, empty
+		vertexAllocation = pages[page]->vertices.Allocate(vertexCount);
+		indexAllocation = pages[page]->indices.Allocate(indexCount);
+		if (!vertexAllocation.IsValid() || !indexAllocation.IsValid())
+		{
+			pages[page]->vertices.Free(vertexAllocation);
+			pages[page]->indices.Free(indexAllocation);
+			return false;
+		}
+	}
+
+	range.page = page;
+	range.baseVertex = vertexAllocation.offset;
+	range.firstIndex = indexAllocation.offset;
+	range.vertexCount = vertexCount;
+	range.indexCount = indexCount;
+	range.vertexAllocation = vertexAllocation;
+	range.indexAllocation = indexAllocation;
+
+	PendingUpload upload;
+	upload.page = page;
+	upload.baseVertex = range.baseVertex;
+	upload.firstIndex = range.firstIndex;
+	upload.vertices.assign(vertices, vertices + vertexCount);
+	upload.indices.assign(indices, indices + indexCount);
+	pendingUploads.push_back(std::move(upload));
+	return true;
+}
+
+void GeometryArena::Free(GeometryRange& range)
+{
+	if (!range.IsValid())
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Never uploaded?  Then it mustn't be - the space could be reused
+	for (size_t i = 0; i < pendingUploads.size(); i++)
+	{
+		if (pendingUploads[i].page == range.page && pendingUploads[i].baseVertex == range.baseVertex)
+		{
+			pendingUploads.erase(pendingUploads.begin() + i);
+			break;
+		}
+	}
+
+	pages[range.page]->vertices.Free(range.vertexAllocation);
+	pages[range.page]->indices.Free(range.indexAllocation);
+	range = GeometryRange();
+}
+
+// --------------------------------------------------------
+// Encodes copying the queued geometry into its pages.  The
+// buffers are DEFAULT usage, so these are ordinary range
+// updates - the driver keeps them in order with the draws.
+// The stream holds its own copy, so the queue goes now.
+// --------------------------------------------------------
+void GeometryArena::FlushUploads(CommandStream& stream)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (pendingUploads.empty())
+		return;
+
+	for (PendingUpload& upload : pendingUploads)
+	{
+		Page* page = pages[upload.page].get();
+
+		stream.UpdateBuffer(
+			page->vertexBuffer.Get(),
+			(unsigned int)(upload.baseVertex * sizeof(Vertex)),
+			(unsigned int)(upload.vertices.size() * sizeof(Vertex)),
+			upload.vertices.data(),
+			UpdateBufferCommand::Range);
+
+		stream.UpdateBuffer(
+			page->indexBuffer.Get(),
+			(unsigned int)(upload.firstIndex * sizeof(unsigned int)),
+			(unsigned int)(upload.indices.size() * sizeof(unsigned int)),
+			upload.indices.data(),
+			UpdateBufferCommand::Range);
+	}
+
+	pendingUploads.clear();
+	pendingUploads.shrink_to_fit();
+}
+
+void GeometryArena::Bind(CommandStream& stream, unsigned int page)
+{
+	if (page >= pageCount)
+		return;
+
+	unsigned int stride = sizeof(Vertex);
+	unsigned int offset = 0;
+	void* vertexBuffer = pages[page]->vertexBuffer.Get();
+
+	// The cache skips both when the stream is played, if this page is already bound
+	stream.SetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	stream.SetIndexBuffer(pages[page]->indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
+ID3D11Buffer* GeometryArena::GetVertexBuffer(unsigned int page)
+{
+	return page < pageCount ? pages[page]->vertexBuffer.Get() : 0;
+}
+
+ID3D11Buffer* GeometryArena::GetIndexBuffer(unsigned int page)
+{
+	return page < pageCount ? pages[page]->indexBuffer.Get() : 0;
+}
+
+GeometryArenaStats GeometryArena::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	GeometryArenaStats stats = {};
+	stats.pages = pageCount;
+	for (unsigned int i = 0; i < pageCount; i++)
+	{
+		const Page& page = *pages[i];
+		stats.vertexCapacity += page.vertices.GetCapacity();
+		stats.verticesUsed += page.vertices.GetUsed();
+		stats.indexCapacity += page.indices.GetCapacity();
+		stats.indicesUsed += page.indices.GetUsed();
+		stats.freeRanges += page.vertices.GetFreeRangeCount() + page.indices.GetFreeRangeCount();
+
+		float fragmentation = page.vertices.GetFragmentation();
+		if (page.indices.GetFragmentation() > fragmentation)
+			fragmentation = page.indices.GetFragmentation();
+		if (fragmentation > stats.fragmentation)
+			stats.fragmentation = fragmentation;
+	}
+	return stats;
+}
+
+// --------------------------------------------------------
+// Creates an empty page.  Called with the lock held.
+// --------------------------------------------------------
+bool GeometryArena::AddPage(unsigned int vertexCapacity, unsigned int indexCapacity)
+{
+	if (pageCount == MaxPages ||
+		vertexCapacity > 0xFFFFFFFF / sizeof(Vertex) ||
+		indexCapacity > 0xFFFFFFFF / sizeof(unsigned int))
+		return false;
+
+	std::unique_ptr<Page> page(new Page());
+
+	// DEFAULT rather than IMMUTABLE, since meshes come and go
+	D3D11_BUFFER_DESC vbd = {};
+	vbd.Usage = D3D11_USAGE_DEFAULT;
+	vbd.ByteWidth = sizeof(Vertex) * vertexCapacity;
+	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	if (FAILED(device->CreateBuffer(&vbd, 0, page->vertexBuffer.GetAddressOf())))
+		return false;
+
+	D3D11_BUFFER_DESC ibd = {};
+	ibd.Usage = D3D11_USAGE_DEFAULT;
+	ibd.ByteWidth = sizeof(unsigned int) * indexCapacity;
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	if (FAILED(device->CreateBuffer(&ibd, 0, page->indexBuffer.GetAddressOf())))
+		return false;
+
+	page->vertices.Reset(vertexCapacity);
+	page->indices.Reset(indexCapacity);
+
+	// Only counted once it's complete, for the threads that don't lock
+	pages[pageCount] = std::move(page);
+	pageCount++;
+	return true;
+}
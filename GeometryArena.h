@@ -0,0 +1,114 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CommandStream.h"
+#include "RangeAllocator.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Where a mesh lives in a GeometryArena
+// --------------------------------------------------------
+struct GeometryRange
+{
+	static const unsigned int InvalidPage = 0xFFFFFFFF;
+
+	unsigned int page = InvalidPage;
+	unsigned int baseVertex = 0;	// Added to every index
+	unsigned int firstIndex = 0;
+	unsigned int vertexCount = 0;
+	unsigned int indexCount = 0;
+
+	RangeAllocation vertexAllocation;
+	RangeAllocation indexAllocation;
+
+	bool IsValid() const { return page != InvalidPage; }
+};
+
+struct GeometryArenaStats
+{
+	unsigned int pages;
+	unsigned int vertexCapacity;
+	unsigned int verticesUsed;
+	unsigned int indexCapacity;
+	unsigned int indicesUsed;
+	unsigned int freeRanges;		// Vertex and index, in every page
+	float fragmentation;			// Worst page, see RangeAllocator::GetFragmentation()
+};
+
+// --------------------------------------------------------
+// Shared vertex and index buffers that every mesh is a
+// range of, so drawing a different mesh only changes the
+// draw's offsets - the buffers stay bound.
+//
+// Geometry goes in pages: one vertex buffer and one index
+// buffer each, carved up by RangeAllocators.  A mesh that
+// doesn't fit in any page starts a new one (sized to fit,
+// if it's bigger than a page).  Meshes only need a rebind
+// when they're in different pages.
+//
+// Allocate() and Free() may be called from any thread -
+// Allocate() only queues the upload, and FlushUploads()
+// encodes them into a stream for the thread that owns the
+// context to play.
+// --------------------------------------------------------
+class GeometryArena
+{
+public:
+	static const unsigned int VerticesPerPage = 1 << 19;
+	static const unsigned int IndicesPerPage = 1 << 20;
+	static const unsigned int MaxPages = 64;
+
+	GeometryArena(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Copies the geometry, so the arrays can go as soon as this returns.
+	// False (and an invalid range) if there's no room for it.
+	bool Allocate(const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount, GeometryRange& range);
+	void Free(GeometryRange& range);
+
+	// Encodes writing everything allocated since the last flush into the buffers
+	void FlushUploads(CommandStream& stream);
+
+	// Binds the page's buffers to vertex slot 0 and the index buffer
+	void Bind(CommandStream& stream, unsigned int page);
+
+	ID3D11Buffer* GetVertexBuffer(unsigned int page);
+	ID3D11Buffer* GetIndexBuffer(unsigned int page);
+
+	GeometryArenaStats GetStats();
+
+private:
+	struct Page
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+		RangeAllocator vertices;
+		RangeAllocator indices;
+	};
+
+	struct PendingUpload
+	{
+		unsigned int page;
+		unsigned int baseVertex;
+		unsigned int firstIndex;
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	// Pages never move or go away, so drawing can read them
+	// without the lock - only pageCount has to be seen first
+	std::unique_ptr<Page> pages[MaxPages];
+	std::atomic<unsigned int> pageCount;
+
+	std::mutex mutex;	// For the allocators and pendingUploads
+	std::vector<PendingUpload> pendingUploads;
+
+	bool AddPage(unsigned int vertexCapacity, unsigned int indexCapacity);
+};
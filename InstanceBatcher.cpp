@@ -0,0 +1,143 @@
+#include "InstanceBatcher.h"
+
+InstanceBatcher::InstanceBatcher(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device),
+	capacity(0)
+{
+}
+
+// --------------------------------------------------------
+// Sorts the entities by key so each (material, mesh) pair
+// is one contiguous run, then turns each run into a batch
+// --------------------------------------------------------
+void InstanceBatcher::Build(CommandStream& stream, const FrameVector<EntitySnapshot>& entities, bool grouping)
+{
+	// Last frame's arrays may be gone by now, so start from
+	// new ones - each is a single allocation at most
+	packets = FrameVector<DrawPacket>(entities.size());
+	scratch = FrameVector<DrawPacket>();
+	objects = FrameVector<ObjectData>(entities.size());
+	batches = FrameVector<InstanceBatch>();
+	batches.reserve(entities.size());
+
+	for (unsigned int i = 0; i < packets.size(); i++)
+	{
+		packets[i].key = entities[i].sortKey;
+		packets[i].entity = i;
+	}
+
+	// Shader, then material, then mesh - so consecutive batches
+	// rarely change the expensive state - and front to back
+	// within a batch
+	if (grouping)
+		SortDrawPackets(packets, scratch);
+
+	for (unsigned int i = 0; i < packets.size(); i++)
+	{
+		const EntitySnapshot& entity = entities[packets[i].entity];
+		unsigned int pass = (unsigned int)(packets[i].key >> DrawKey::PassShift);
+		objects[i].World = entity.world;
+		objects[i].WorldInvTranspose = entity.worldInvTranspose;
+		objects[i].MaterialIndex = entity.materialIndex;
+
+		// Same as the batch before?  Then just extend it
+		if (grouping && !batches.empty() &&
+			batches.back().mesh == entity.mesh &&
+			batches.back().material->GetBindingId() == entity.material->GetBindingId() &&
+			batches.back().pass == pass)
+		{
+			batches.back().instanceCount++;
+			continue;
+		}
+
+		InstanceBatch batch;
+		batch.mesh = entity.mesh;
+		batch.material = entity.material;
+		batch.pass = pass;
+		batch.firstInstance = i;
+		batch.instanceCount = 1;
+		batches.push_back(batch);
+	}
+
+	// No buffer means nothing can be drawn
+	if (!Upload(stream))
+		batches.clear();
+}
+
+void InstanceBatcher::Bind(CommandStream& stream)
+{
+	void* indices = indexBuffer.Get();
+	unsigned int stride = sizeof(unsigned int);
+	unsigned int offset = 0;
+	stream.SetVertexBuffers(1, 1, &indices, &stride, &offset);
+
+	void* objectView = objectSRV.Get();
+	stream.SetResources(ShaderStage::Vertex, ObjectBufferRegister, 1, &objectView);
+}
+
+// --------------------------------------------------------
+// Encodes copying the objects to the GPU, growing the
+// buffers (to the next power of two) if they don't fit
+// --------------------------------------------------------
+bool InstanceBatcher::Upload(CommandStream& stream)
+{
+	if (objects.empty())
+		return true;
+
+	if (objects.size() > capacity)
+	{
+		unsigned int newCapacity = capacity ? capacity : 64;
+		while (newCapacity < objects.size())
+			newCapacity *= 2;
+
+		// Unbind the old buffers first - the cache only knows them by
+		// address, and the new ones could end up at the same ones
+		void* nullBuffer = 0;
+		unsigned int zero = 0;
+		stream.SetVertexBuffers(1, 1, &nullBuffer, &zero, &zero);
+		stream.SetResources(ShaderStage::Vertex, ObjectBufferRegister, 1, &nullBuffer);
+
+		objectBuffer.Reset();
+		objectSRV.Reset();
+		indexBuffer.Reset();
+		capacity = 0;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = newCapacity * sizeof(ObjectData);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = sizeof(ObjectData);
+		if (FAILED(device->CreateBuffer(&desc, 0, objectBuffer.GetAddressOf())))
+			return false;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = newCapacity;
+		if (FAILED(device->CreateShaderResourceView(objectBuffer.Get(), &srvDesc, objectSRV.GetAddressOf())))
+			return false;
+
+		// The indices only depend on the capacity
+		std::vector<unsigned int> indices(newCapacity);
+		for (unsigned int i = 0; i < newCapacity; i++)
+			indices[i] = i;
+
+		D3D11_BUFFER_DESC indexDesc = {};
+		indexDesc.ByteWidth = newCapacity * sizeof(unsigned int);
+		indexDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		indexDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		D3D11_SUBRESOURCE_DATA indexData = {};
+		indexData.pSysMem = indices.data();
+		if (FAILED(device->CreateBuffer(&indexDesc, &indexData, indexBuffer.GetAddressOf())))
+			return false;
+
+		capacity = newCapacity;
+	}
+
+	// Written once per frame, so the whole buffer is discarded
+	stream.UpdateBuffer(objectBuffer.Get(), 0, (unsigned int)(objects.size() * sizeof(ObjectData)), objects.data(), UpdateBufferCommand::Discard);
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+#include "CommandStream.h"
+#include "DrawPacket.h"
+#include "SceneState.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// A run of instances that share a mesh and material
+// bindings, and so can be drawn with one
+// DrawIndexedInstanced.  Their materials' parameters can
+// still differ - material is just the first one.
+// --------------------------------------------------------
+struct InstanceBatch
+{
+	Mesh* mesh;
+	Material* material;
+	unsigned int pass;				// DrawKey::Pass
+	unsigned int firstInstance;		// Into the object buffer
+	unsigned int instanceCount;
+};
+
+// --------------------------------------------------------
+// Sorts a frame's entities by their sort keys, which puts
+// each (material, mesh) pair in one run, and writes their
+// ObjectData into one dynamic structured buffer with a
+// single discarding upload, so each group is a single draw.  Build once
+// per frame - every pass that draws the same entities can
+// reuse the batches.
+//
+// Draws find their objects through vertex buffer slot 1,
+// which just holds 0, 1, 2... per instance.  Per-instance
+// data is offset by the draw's start instance, so a batch
+// drawn from firstInstance reads indices firstInstance and
+// up - the draw's index, without a per-draw constant buffer.
+//
+// Grouping can be turned off, which gives every entity its
+// own batch of one (the old one-draw-per-entity behavior,
+// for comparison).
+// --------------------------------------------------------
+class InstanceBatcher
+{
+public:
+	InstanceBatcher(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Sorts, groups and encodes the upload into stream, which
+	// has to be played before anything drawn with the batches.
+	// Its arrays come from the frame arena, so the batches last
+	// until the end of the next frame - Build again every frame
+	// before using them.
+	void Build(CommandStream& stream, const FrameVector<EntitySnapshot>& entities, bool grouping = true);
+
+	// Objects in VertexShader.hlsl and ShadowVS.hlsl
+	static const unsigned int ObjectBufferRegister = 0;
+
+	// Puts the object indices in vertex buffer slot 1, and the
+	// objects themselves in the vertex shader's t0
+	void Bind(CommandStream& stream);
+
+	const FrameVector<InstanceBatch>& GetBatches() const { return batches; }
+	unsigned int GetInstanceCount() const { return (unsigned int)objects.size(); }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> objectBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> objectSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;	// 0 to capacity - 1, never changes
+	unsigned int capacity;	// In objects
+
+	FrameVector<DrawPacket> packets;	// Entity indices, sorted into batches
+	FrameVector<DrawPacket> scratch;	// For the sort
+	FrameVector<ObjectData> objects;
+	FrameVector<InstanceBatch> batches;
+
+	bool Upload(CommandStream& stream);
+};
@@ -0,0 +1,496 @@
+#include "JobSystem.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>	// For CoInitializeEx - jobs may use COM (WIC texture loading does)
+#endif
+
+// Singleton requirement
+JobSystem* JobSystem::instance;
+
+// Which ThreadData slot the calling thread owns, or -1
+static thread_local int currentThreadIndex = -1;
+
+// Per-thread state for picking steal victims
+static thread_local unsigned int stealSeed = 0;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ WORK STEALING QUEUE -------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+WorkStealingQueue::WorkStealingQueue()
+	: top(0), bottom(0)
+{
+	for (unsigned int i = 0; i < Capacity; i++)
+		jobs[i].store(0, std::memory_order_relaxed);
+}
+
+// --------------------------------------------------------
+// Adds a job to the bottom.  Only the owning thread may call this.
+// --------------------------------------------------------
+bool WorkStealingQueue::Push(Job* job)
+{
+	long long b = bottom.load(std::memory_order_relaxed);
+	long long t = top.load(std::memory_order_acquire);
+	if (b - t >= (long long)Capacity)
+		return false;
+
+	jobs[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+
+	// The job must be visible before the new bottom is
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+// --------------------------------------------------------
+// Takes the most recently pushed job.  Only the owning
+// thread may call this.
+// --------------------------------------------------------
+Job* WorkStealingQueue::Pop()
+{
+	// Claim the bottom slot first, then see if a thief got there too
+	long long b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long t = top.load(std::memory_order_relaxed);
+
+	// Empty - put bottom back
+	if (t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	Job* job = jobs[b & (Capacity - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// This was the last job, so we race thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = 0;
+
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+// --------------------------------------------------------
+// Takes the oldest job.  Any thread may call this.
+// --------------------------------------------------------
+Job* WorkStealingQueue::Steal()
+{
+	long long t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+		return 0;
+
+	// Read the job before claiming it - if the claim fails,
+	// someone else has it and we just try again later
+	Job* job = jobs[t & (Capacity - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return 0;
+
+	return job;
+}
+
+bool WorkStealingQueue::IsEmpty() const
+{
+	return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ JOB SYSTEM ----------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+JobSystem::JobSystem()
+	: workerCount(0), threadCount(0), threads(0), running(false), sleepingWorkers(0)
+{
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+// --------------------------------------------------------
+// Creates the worker threads.  The calling thread becomes
+// thread 0 and runs jobs whenever it waits on one.
+// --------------------------------------------------------
+void JobSystem::Initialize(unsigned int workerCount)
+{
+	// Already running?
+	if (threads)
+		return;
+
+	if (workerCount == 0)
+	{
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	this->workerCount = workerCount;
+	this->threadCount = 1 + workerCount + MaxExternalThreads;
+
+	// Slot 0 is this thread, then the workers, then
+	// slots for threads that register themselves later
+	threads = new ThreadData[threadCount];
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		threads[i].jobPool = new Job[JobsPerThread];
+		threads[i].allocatedJobs = 0;
+		for (unsigned int j = 0; j < JobsPerThread; j++)
+			threads[i].jobPool[j].unfinishedJobs.store(0, std::memory_order_relaxed);
+		threads[i].inUse = (i <= workerCount);
+	}
+	currentThreadIndex = 0;
+
+	running = true;
+	for (unsigned int i = 1; i <= workerCount; i++)
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+}
+
+// --------------------------------------------------------
+// Stops and joins the workers.  Any jobs still queued are dropped.
+// --------------------------------------------------------
+void JobSystem::Shutdown()
+{
+	if (!threads)
+		return;
+
+	running = false;
+	sleepCondition.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		delete[] threads[i].jobPool;
+	delete[] threads;
+
+	threads = 0;
+	threadCount = 0;
+	workerCount = 0;
+	currentThreadIndex = -1;
+}
+
+// --------------------------------------------------------
+// Gives the calling thread its own queue so it can create,
+// run and wait on jobs.  Returns false if none are free.
+// --------------------------------------------------------
+bool JobSystem::RegisterThread()
+{
+	if (!threads)
+		return false;
+
+	if (currentThreadIndex >= 0)
+		return true;
+
+	for (unsigned int i = 1 + workerCount; i < threadCount; i++)
+	{
+		bool expected = false;
+		if (threads[i].inUse.compare_exchange_strong(expected, true))
+		{
+			currentThreadIndex = (int)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// --------------------------------------------------------
+// Gives a registered thread's slot back.  All jobs it
+// created must be finished first.
+// --------------------------------------------------------
+void JobSystem::UnregisterThread()
+{
+	if (currentThreadIndex <= (int)workerCount)
+		return;
+
+	threads[currentThreadIndex].inUse = false;
+	currentThreadIndex = -1;
+}
+
+int JobSystem::GetThreadIndex()
+{
+	return currentThreadIndex;
+}
+
+// --------------------------------------------------------
+// Hands out the next job from this thread's ring.  Slots
+// whose job hasn't finished (a parent still running its
+// body, say) are skipped rather than written over, and if
+// the whole ring is busy this helps run jobs until one
+// finishes.  Null if this thread can't run jobs.
+// --------------------------------------------------------
+Job* JobSystem::AllocateJob()
+{
+	assert(currentThreadIndex >= 0 && "Only the main thread, workers and registered threads can create jobs");
+	if (currentThreadIndex < 0)
+		return 0;
+
+	ThreadData& thread = threads[currentThreadIndex];
+	while (true)
+	{
+		for (unsigned int i = 0; i < JobsPerThread; i++)
+		{
+			Job* job = &thread.jobPool[thread.allocatedJobs++ & (JobsPerThread - 1)];
+			if (IsFinished(job))
+				return job;
+		}
+
+		Job* next = GetJob();
+		if (next)
+			Execute(next);
+		else
+			std::this_thread::yield();
+	}
+}
+
+// --------------------------------------------------------
+// Creates a job that isn't attached to anything.  data is
+// copied into the job, so it can live on the caller's stack.
+// Null if the data doesn't fit in Job::DataSize, or this
+// thread can't run jobs.
+// --------------------------------------------------------
+Job* JobSystem::CreateJob(JobFunction function, const void* data, unsigned int dataSize)
+{
+	// The job would run on whatever the slot held last
+	assert(dataSize <= Job::DataSize && "Job data doesn't fit in Job::DataSize");
+	if (dataSize > Job::DataSize)
+		return 0;
+
+	Job* job = AllocateJob();
+	if (!job)
+		return 0;
+
+	job->function = function;
+	job->parent = 0;
+	job->unfinishedJobs.store(1, std::memory_order_relaxed);
+
+	if (data && dataSize > 0)
+		memcpy(job->data, data, dataSize);
+
+	return job;
+}
+
+// --------------------------------------------------------
+// Creates a job that its parent won't finish without
+// --------------------------------------------------------
+Job* JobSystem::CreateJobAsChild(Job* parent, JobFunction function, const void* data, unsigned int dataSize)
+{
+	Job* job = CreateJob(function, data, dataSize);
+	if (!job)
+		return 0;
+
+	parent->unfinishedJobs.fetch_add(1, std::memory_order_relaxed);
+	job->parent = parent;
+	return job;
+}
+
+// --------------------------------------------------------
+// Queues a job on this thread, where any thread can steal it
+// --------------------------------------------------------
+void JobSystem::Run(Job* job)
+{
+	// Queue is full (or this thread has none), so just do it now
+	if (currentThreadIndex < 0 || !threads[currentThreadIndex].queue.Push(job))
+	{
+		Execute(job);
+		return;
+	}
+
+	if (sleepingWorkers.load(std::memory_order_relaxed) > 0)
+		sleepCondition.notify_one();
+}
+
+// --------------------------------------------------------
+// Runs other jobs until the given one (and its children) finish
+// --------------------------------------------------------
+void JobSystem::Wait(const Job* job)
+{
+	while (!IsFinished(job))
+	{
+		Job* next = currentThreadIndex >= 0 ? GetJob() : 0;
+		if (next)
+			Execute(next);
+		else
+			std::this_thread::yield();
+	}
+}
+
+// --------------------------------------------------------
+// Finds something to do - our own newest job first, then
+// the oldest job of another thread, starting at a random one
+// --------------------------------------------------------
+Job* JobSystem::GetJob()
+{
+	Job* job = threads[currentThreadIndex].queue.Pop();
+	if (job)
+		return job;
+
+	// xorshift - cheap and good enough to spread thieves out
+	if (stealSeed == 0)
+		stealSeed = 0x9E3779B9u * (unsigned int)(currentThreadIndex + 1);
+	stealSeed ^= stealSeed << 13;
+	stealSeed ^= stealSeed >> 17;
+	stealSeed ^= stealSeed << 5;
+
+	unsigned int start = stealSeed % threadCount;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		unsigned int victim = (start + i) % threadCount;
+		if (victim == (unsigned int)currentThreadIndex)
+			continue;
+
+		job = threads[victim].queue.Steal();
+		if (job)
+			return job;
+	}
+
+	return 0;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->function(job, job->data);
+	Finish(job);
+}
+
+// --------------------------------------------------------
+// Marks one unit of a job as done, and passes that up to
+// its parent once the job and all its children are done
+// --------------------------------------------------------
+void JobSystem::Finish(Job* job)
+{
+	// Once it's finished, its slot can be handed out again
+	Job* parent = job->parent;
+	int unfinished = job->unfinishedJobs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+	if (unfinished == 0 && parent)
+		Finish(parent);
+}
+
+bool JobSystem::IsFinished(const Job* job)
+{
+	return job->unfinishedJobs.load(std::memory_order_acquire) == 0;
+}
+
+// --------------------------------------------------------
+// Body of each worker thread - runs or steals jobs, and
+// sleeps for a moment when there's nothing to run
+// --------------------------------------------------------
+void JobSystem::WorkerLoop(unsigned int index)
+{
+#ifdef _WIN32
+	CoInitializeEx(0, COINIT_MULTITHREADED);
+#endif
+
+	currentThreadIndex = (int)index;
+
+	unsigned int idleSpins = 0;
+	while (running.load(std::memory_order_relaxed))
+	{
+		Job* job = GetJob();
+		if (job)
+		{
+			Execute(job);
+			idleSpins = 0;
+			continue;
+		}
+
+		// Spin for a bit in case more work is about to show up
+		if (++idleSpins < 64)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Then sleep - Run() wakes us, and the timeout covers a wake
+		// that arrives between checking the queues and going to sleep
+		sleepingWorkers.fetch_add(1);
+		{
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepCondition.wait_for(lock, std::chrono::milliseconds(1));
+		}
+		sleepingWorkers.fetch_sub(1);
+	}
+
+	currentThreadIndex = -1;
+
+#ifdef _WIN32
+	CoUninitialize();
+#endif
+}
+
+// --------------------------------------------------------
+// Starts a ParallelFor and waits for it
+// --------------------------------------------------------
+void JobSystem::RunParallelFor(const ParallelForRange& range, unsigned int minChunkSize)
+{
+	unsigned int count = range.end - range.begin;
+	if (count == 0)
+		return;
+
+	// The smallest range a thread can be handed.  Ranges are only split
+	// when another thread is looking for work, so this can be fine.
+	unsigned int chunkSize = count / ((workerCount + 1) * SplitsPerThread);
+	if (chunkSize < minChunkSize)
+		chunkSize = minChunkSize;
+	if (chunkSize < 1)
+		chunkSize = 1;
+
+	// Not worth splitting, or this thread can't run jobs
+	if (currentThreadIndex < 0 || count <= chunkSize)
+	{
+		range.invoke(range.function, range.begin, range.end);
+		return;
+	}
+
+	ParallelForRange root = range;
+	root.chunkSize = chunkSize;
+
+	static_assert(sizeof(ParallelForRange) <= Job::DataSize, "ParallelForRange has to fit in a job");
+	Job* job = CreateJob(ParallelForJob, &root, sizeof(root));
+	Run(job);
+	Wait(job);
+}
+
+// --------------------------------------------------------
+// Splits off the upper half of the range for other threads
+// to steal, but only when they're taking what's offered: if
+// the last half split off is still in this thread's queue,
+// nobody needed it, so this runs one chunk itself and looks
+// again.  Busy threads run long stretches with no job
+// overhead, and idle ones get work as soon as they steal.
+// --------------------------------------------------------
+void JobSystem::ParallelForJob(Job* job, const void* data)
+{
+	ParallelForRange range = *static_cast<const ParallelForRange*>(data);
+	JobSystem& jobSystem = GetInstance();
+	const WorkStealingQueue& queue = jobSystem.threads[currentThreadIndex].queue;
+
+	while (range.end - range.begin > range.chunkSize)
+	{
+		if (!queue.IsEmpty())
+		{
+			range.invoke(range.function, range.begin, range.begin + range.chunkSize);
+			range.begin += range.chunkSize;
+			continue;
+		}
+
+		ParallelForRange upper = range;
+		upper.begin = range.begin + (range.end - range.begin) / 2;
+		range.end = upper.begin;
+
+		jobSystem.Run(jobSystem.CreateJobAsChild(job, ParallelForJob, &upper, sizeof(upper)));
+	}
+
+	range.invoke(range.function, range.begin, range.end);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+typedef void (*JobFunction)(Job* job, const void* data);
+
+// --------------------------------------------------------
+// A single unit of work.  Jobs are never allocated on the
+// heap - each thread hands them out from its own ring.  A
+// slot isn't handed out again until its job has finished, so
+// a thread with JobsPerThread jobs unfinished runs others
+// until one is before it can create another - jobs have to
+// be Run() before that many more are created.
+//
+// unfinishedJobs starts at 1 (the job itself) and goes up by
+// one for every child, so a parent only finishes once all of
+// its children have.
+// --------------------------------------------------------
+struct alignas(64) Job
+{
+	static const unsigned int DataSize = 40;	// Keeps a job to one cache line
+
+	JobFunction function;
+	Job* parent;
+	std::atomic<int> unfinishedJobs;
+	alignas(8) unsigned char data[DataSize];	// Arguments, copied in by CreateJob
+};
+
+// --------------------------------------------------------
+// Chase-Lev work-stealing deque.  The owning thread pushes
+// and pops at the bottom; any other thread steals from the top.
+// --------------------------------------------------------
+class WorkStealingQueue
+{
+public:
+	static const unsigned int Capacity = 4096;	// Must be a power of two
+
+	WorkStealingQueue();
+
+	bool Push(Job* job);	// Owner only - returns false if full
+	Job* Pop();				// Owner only
+	Job* Steal();			// Any thread
+
+	bool IsEmpty() const;
+
+private:
+	std::atomic<long long> top;
+	std::atomic<long long> bottom;
+	std::atomic<Job*> jobs[Capacity];
+};
+
+// --------------------------------------------------------
+// Work-stealing job system.  The thread that calls
+// Initialize() (the main thread) is a worker too, and any
+// other long-lived thread that wants to create or wait on
+// jobs must call RegisterThread() first.  Unregistered
+// threads can still call ParallelFor(), it just runs inline.
+// --------------------------------------------------------
+class JobSystem
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static JobSystem& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new JobSystem();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	JobSystem(JobSystem const&) = delete;
+	void operator=(JobSystem const&) = delete;
+
+private:
+	static JobSystem* instance;
+	JobSystem();
+#pragma endregion
+
+public:
+	~JobSystem();
+
+	static const unsigned int JobsPerThread = 4096;		// Must be a power of two
+	static const unsigned int MaxExternalThreads = 2;	// Threads that may RegisterThread()
+
+	// workerCount of zero means one worker per hardware thread, minus this one
+	void Initialize(unsigned int workerCount = 0);
+	void Shutdown();
+
+	bool RegisterThread();
+	void UnregisterThread();
+
+	// Total threads that can run jobs (main + workers + registered)
+	unsigned int GetThreadCount() { return threadCount; }
+	unsigned int GetWorkerCount() { return workerCount; }
+
+	// Index of the calling thread, or -1 if it can't run jobs
+	int GetThreadIndex();
+
+	// Creating and running jobs
+	Job* CreateJob(JobFunction function, const void* data = 0, unsigned int dataSize = 0);
+	Job* CreateJobAsChild(Job* parent, JobFunction function, const void* data = 0, unsigned int dataSize = 0);
+	void Run(Job* job);
+	void Wait(const Job* job);	// Runs other jobs while waiting
+
+	// --------------------------------------------------------
+	// Calls function(begin, end) over sub-ranges of [0, count)
+	// on all threads and returns once every range is done.
+	// Ranges are split in half as other threads steal them, so
+	// how finely a loop is split follows how many threads are
+	// free for it.  Nothing is split smaller than
+	// count / (threads * SplitsPerThread), or minChunkSize, so
+	// small loops stay on one thread.
+	// --------------------------------------------------------
+	template <typename Function>
+	void ParallelFor(unsigned int count, const Function& function, unsigned int minChunkSize = 1)
+	{
+		ParallelForRange range = {};
+		range.invoke = [](const void* f, unsigned int begin, unsigned int end) { (*static_cast<const Function*>(f))(begin, end); };
+		range.function = &function;
+		range.begin = 0;
+		range.end = count;
+		RunParallelFor(range, minChunkSize);
+	}
+
+private:
+	// Type-erased ParallelFor body, small enough to live in Job::data
+	struct ParallelForRange
+	{
+		void (*invoke)(const void* function, unsigned int begin, unsigned int end);
+		const void* function;
+		unsigned int begin;
+		unsigned int end;
+		unsigned int chunkSize;
+	};
+	static const unsigned int SplitsPerThread = 16;
+
+	// Per-thread state - each gets its own cache lines
+	struct alignas(64) ThreadData
+	{
+		WorkStealingQueue queue;
+		Job* jobPool;
+		unsigned int allocatedJobs;
+		std::atomic<bool> inUse;	// Only meaningful for external slots
+	};
+
+	unsigned int workerCount;
+	unsigned int threadCount;
+	ThreadData* threads;
+	std::vector<std::thread> workers;
+	std::atomic<bool> running;
+
+	// Idle workers sleep here instead of spinning
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	std::atomic<int> sleepingWorkers;
+
+	Job* AllocateJob();
+	Job* GetJob();
+	void Execute(Job* job);
+	void Finish(Job* job);
+	bool IsFinished(const Job* job);
+	void WorkerLoop(unsigned int index);
+
+	void RunParallelFor(const ParallelForRange& range, unsigned int minChunkSize);
+	static void ParallelForJob(Job* job, const void* data);
+};
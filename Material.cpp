@@ -1,11 +1,33 @@
 #include "Material.h"
 
-Material::Material(DirectX::XMFLOAT4 _colorTint, float _roughness, std::shared_ptr<SimplePixelShader> _pixelShader, std::shared_ptr<SimpleVertexShader> _vertexShader)
+#include <map>
+#include <mutex>
+
+//gives every distinct set of bindings (pipeline, then each slot range) a small id
+static unsigned int InternBindings(const std::vector<const void*>& bindings)
+{
+	static std::mutex mutex;
+	static std::map<std::vector<const void*>, unsigned int> ids;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = ids.find(bindings);
+	if (found != ids.end())
+		return found->second;
+
+	unsigned int id = (unsigned int)ids.size();
+	ids.emplace(bindings, id);
+	return id;
+}
+
+Material::Material(DirectX::XMFLOAT4 _colorTint, float _roughness, std::shared_ptr<PipelineState> _pipelineState)
 {
 	colorTint = _colorTint;
 	roughness = _roughness;
-	pixelShader = _pixelShader;
-	vertexShader = _vertexShader;
+	pipelineState = _pipelineState;
+	pixelShader = pipelineState->GetPixelShader();
+	vertexShader = pipelineState->GetVertexShader();
+	parameterVersion = 1;
+	BuildBindTables();
 }
 
 Material::~Material()
@@ -17,6 +39,11 @@ DirectX::XMFLOAT4 Material::GetColor()
 	return colorTint;
 }
 
+std::shared_ptr<PipelineState> Material::GetPipelineState()
+{
+	return pipelineState;
+}
+
 std::shared_ptr<SimplePixelShader> Material::GetPixelShader()
 {
 	return pixelShader;
@@ -32,38 +59,149 @@ float Material::GetRoughness()
 	return roughness;
 }
 
-void Material::SetColor(DirectX::XMFLOAT4 _colorTint)
+MaterialData Material::GetParameters()
 {
-	colorTint = _colorTint;
+	MaterialData data = {};
+	data.colorTint = colorTint;
+	data.roughness = roughness;
+	for (unsigned int i = 0; i < MaterialData::MaxTextureSlices; i++)
+		data.textureSlices[i] = slotSlices[i];
+	return data;
 }
 
-void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> _pixelShader)
+unsigned int Material::GetParameterVersion()
 {
-	pixelShader = _pixelShader;
+	return parameterVersion;
 }
 
-void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> _vertexShader)
+unsigned int Material::GetBindingId()
 {
-	vertexShader = _vertexShader;
+	return bindingId;
+}
+
+void Material::SetColor(DirectX::XMFLOAT4 _colorTint)
+{
+	colorTint = _colorTint;
+	parameterVersion++;
+}
+
+void Material::SetPipelineState(std::shared_ptr<PipelineState> _pipelineState)
+{
+	pipelineState = _pipelineState;
+	pixelShader = pipelineState->GetPixelShader();
+	vertexShader = pipelineState->GetVertexShader();
+	BuildBindTables();
 }
 
 void Material::SetRoughness(float _roughness)
 {
 	roughness = _roughness;
+	parameterVersion++;
 }
 
-void Material::PrepareMaterials()
+//sets this material's textures on its shaders - only needed when the previous draw had another binding id.
+//the parameters aren't set here, the shaders read them from the MaterialTable.
+void Material::PrepareMaterials(CommandStream& stream)
 {
-	for (auto& t : textureSRVs) { pixelShader->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto& s : samplers) { pixelShader->SetSamplerState(s.first.c_str(), s.second); }
+	//one command each for all the textures and samplers, no name lookups
+	stream.SetResources(ShaderStage::Pixel, firstSRVSlot, (unsigned int)srvSlots.size(), (void* const*)srvSlots.data());
+	stream.SetSamplers(ShaderStage::Pixel, firstSamplerSlot, (unsigned int)samplerSlots.size(), (void* const*)samplerSlots.data());
 }
 
-void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV)
+void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV, unsigned int slice)
 {
 	textureSRVs.insert({ name, SRV });
+	textureSlices.insert({ name, slice });
+	BuildBindTables();
 }
 
 void Material::AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
 {
 	samplers.insert({ name, sampler });
+	BuildBindTables();
+}
+
+//looks up the register of every texture and sampler once, so binding is just handing over the arrays.
+//names the pixel shader doesn't use are left out.
+void Material::BuildBindTables()
+{
+	firstSRVSlot = 0;
+	srvSlots.clear();
+	firstSamplerSlot = 0;
+	samplerSlots.clear();
+
+	//the slices can move with the registers, so the table's entry has to be rewritten
+	for (unsigned int i = 0; i < MaterialData::MaxTextureSlices; i++)
+		slotSlices[i] = 0;
+	parameterVersion++;
+
+	if (!pixelShader)
+	{
+		bindingId = InternBindings({ pipelineState.get(), 0 });
+		return;
+	}
+
+	//range of registers used
+	unsigned int srvEnd = 0;
+	firstSRVSlot = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	for (auto& t : textureSRVs)
+	{
+		const SimpleSRV* info = pixelShader->GetShaderResourceViewInfo(t.first);
+		if (!info) continue;
+		if (info->BindIndex < firstSRVSlot) firstSRVSlot = info->BindIndex;
+		if (info->BindIndex + 1 > srvEnd) srvEnd = info->BindIndex + 1;
+	}
+
+	unsigned int samplerEnd = 0;
+	firstSamplerSlot = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	for (auto& s : samplers)
+	{
+		const SimpleSampler* info = pixelShader->GetSamplerInfo(s.first);
+		if (!info) continue;
+		if (info->BindIndex < firstSamplerSlot) firstSamplerSlot = info->BindIndex;
+		if (info->BindIndex + 1 > samplerEnd) samplerEnd = info->BindIndex + 1;
+	}
+
+	//fill them in
+	if (srvEnd > 0)
+	{
+		srvSlots.resize(srvEnd - firstSRVSlot, 0);
+		for (auto& t : textureSRVs)
+		{
+			const SimpleSRV* info = pixelShader->GetShaderResourceViewInfo(t.first);
+			if (!info) continue;
+			srvSlots[info->BindIndex - firstSRVSlot] = t.second.Get();
+			if (info->BindIndex < MaterialData::MaxTextureSlices)
+				slotSlices[info->BindIndex] = textureSlices[t.first];
+		}
+	}
+	else
+	{
+		firstSRVSlot = 0;
+	}
+
+	if (samplerEnd > 0)
+	{
+		samplerSlots.resize(samplerEnd - firstSamplerSlot, 0);
+		for (auto& s : samplers)
+		{
+			const SimpleSampler* info = pixelShader->GetSamplerInfo(s.first);
+			if (info) samplerSlots[info->BindIndex - firstSamplerSlot] = s.second.Get();
+		}
+	}
+	else
+	{
+		firstSamplerSlot = 0;
+	}
+
+	//everything PrepareMaterials and the pipeline bind, with the counts so ranges can't run together
+	std::vector<const void*> bindings;
+	bindings.push_back(pipelineState.get());
+	bindings.push_back((const void*)(size_t)firstSRVSlot);
+	bindings.push_back((const void*)srvSlots.size());
+	bindings.insert(bindings.end(), srvSlots.begin(), srvSlots.end());
+	bindings.push_back((const void*)(size_t)firstSamplerSlot);
+	bindings.push_back((const void*)samplerSlots.size());
+	bindings.insert(bindings.end(), samplerSlots.begin(), samplerSlots.end());
+	bindingId = InternBindings(bindings);
 }
@@ -6,37 +6,70 @@
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <memory>
 #include <unordered_map>
+#include <vector>
+#include "Pool.h"
+#include "BufferStructs.h"
+#include "CommandStream.h"
+#include "PipelineState.h"
 
 class Material
 {
 public:
-	Material(DirectX::XMFLOAT4 _colorTint, float roughness, std::shared_ptr<SimplePixelShader> _pixelShader, std::shared_ptr<SimpleVertexShader> _vertexShader);
+	Material(DirectX::XMFLOAT4 _colorTint, float roughness, std::shared_ptr<PipelineState> _pipelineState);
 	~Material();
 
 	//Getters
 	DirectX::XMFLOAT4 GetColor();
-	std::shared_ptr<SimplePixelShader> GetPixelShader();
+	std::shared_ptr<PipelineState> GetPipelineState();
+	std::shared_ptr<SimplePixelShader> GetPixelShader();	//the pipeline's
 	std::shared_ptr<SimpleVertexShader> GetVertexShader();
 	float GetRoughness();
 
+	//colorTint and roughness, as they go in the MaterialTable.  the version goes up
+	//every time either changes, so the table knows when to rewrite its entry.
+	MaterialData GetParameters();
+	unsigned int GetParameterVersion();
+
+	//materials with the same shaders, textures and samplers get the same id - drawing
+	//one right after another needs no rebinds, so they can share an instanced draw
+	unsigned int GetBindingId();
+
 	//Setters
 	void SetColor(DirectX::XMFLOAT4 _colorTint);
-	void SetPixelShader(std::shared_ptr<SimplePixelShader> _pixelShader);
-	void SetVertexShader(std::shared_ptr<SimpleVertexShader> _vertexShader);
+	void SetPipelineState(std::shared_ptr<PipelineState> _pipelineState);
 	void SetRoughness(float _roughness);
 
-	void PrepareMaterials();
+	void PrepareMaterials(CommandStream& stream);
 
-	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV);
+	//slice is the texture's layer when SRV is a packed Texture2DArray (see TextureArrayPacker).
+	//it goes in the MaterialTable, by the texture's register.
+	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV, unsigned int slice = 0);
 	void AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
 
 private:
 	DirectX::XMFLOAT4 colorTint;
 	float roughness;
+	std::shared_ptr<PipelineState> pipelineState;
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	unsigned int parameterVersion;
+	unsigned int bindingId;
 
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
+	std::unordered_map<std::string, unsigned int> textureSlices;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+
+	//the maps above resolved against the pixel shader's registers - entry i goes in slot first + i,
+	//with nulls in any gaps.  The maps own the references, these are just for binding.
+	unsigned int firstSRVSlot;
+	std::vector<ID3D11ShaderResourceView*> srvSlots;
+	unsigned int slotSlices[MaterialData::MaxTextureSlices];	//textureSlices by register
+	unsigned int firstSamplerSlot;
+	std::vector<ID3D11SamplerState*> samplerSlots;
+
+	void BuildBindTables();
 };
 
+//materials live in a Pool and are referred to by handle
+typedef Handle<Material> MaterialHandle;
+
@@ -0,0 +1,136 @@
+#include "MaterialTable.h"
+
+#include <algorithm>
+#include <cstdio>
+
+MaterialTable::MaterialTable(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device),
+	capacity(0),
+	growFailed(false),
+	uploadCount(0)
+{
+}
+
+// --------------------------------------------------------
+// Compares every material's version with the last one seen
+// in its slot.  A new material in a reused slot has another
+// generation, so it's picked up even if the versions match.
+// --------------------------------------------------------
+void MaterialTable::CollectChanges(Pool<Material>& materials, FrameVector<MaterialTableEntry>& changes)
+{
+	changes.clear();
+
+	materials.ForEach([&](MaterialHandle handle, Material& material)
+	{
+		if (handle.index >= seen.size())
+			seen.resize(handle.index + 1, SeenVersion{ 0, 0 });
+
+		SeenVersion& last = seen[handle.index];
+		unsigned int version = material.GetParameterVersion();
+		if (last.generation == handle.generation && last.version == version)
+			return;
+
+		last.generation = handle.generation;
+		last.version = version;
+
+		MaterialTableEntry entry;
+		entry.index = handle.index;
+		entry.data = material.GetParameters();
+		changes.push_back(entry);
+	});
+}
+
+// --------------------------------------------------------
+// Copies the changed entries in, then encodes one upload of
+// the range that covers all of them
+// --------------------------------------------------------
+void MaterialTable::Apply(CommandStream& stream, const FrameVector<MaterialTableEntry>& changes)
+{
+	// A table bigger than the buffer is one that failed to grow last time
+	if (changes.empty() && table.size() <= capacity)
+		return;
+
+	unsigned int first = 0xFFFFFFFF;
+	unsigned int end = 0;
+	for (const MaterialTableEntry& entry : changes)
+	{
+		if (entry.index >= table.size())
+			table.resize(entry.index + 1, MaterialData());
+		table[entry.index] = entry.data;
+
+		if (entry.index < first) first = entry.index;
+		if (entry.index + 1 > end) end = entry.index + 1;
+	}
+
+	// A new buffer starts out with the whole table, so that's the upload
+	if (table.size() > capacity)
+	{
+		bool grown = Grow(stream, (unsigned int)table.size());
+		if (!grown && !growFailed)
+			printf("MaterialTable: couldn't create a buffer for %u materials - trying again every frame\n", (unsigned int)table.size());
+		growFailed = !grown;
+		return;
+	}
+
+	stream.UpdateBuffer(
+		buffer.Get(),
+		(unsigned int)(first * sizeof(MaterialData)),
+		(unsigned int)((end - first) * sizeof(MaterialData)),
+		&table[first],
+		UpdateBufferCommand::Range);
+	uploadCount++;
+}
+
+void MaterialTable::Bind(CommandStream& stream)
+{
+	void* view = srv.Get();
+	stream.SetResources(ShaderStage::Pixel, TableRegister, 1, &view);
+}
+
+// --------------------------------------------------------
+// Recreates the buffer with room for at least count
+// materials (the next power of two), filled with the table
+// --------------------------------------------------------
+bool MaterialTable::Grow(CommandStream& stream, unsigned int count)
+{
+	unsigned int newCapacity = capacity ? capacity : 64;
+	while (newCapacity < count)
+		newCapacity *= 2;
+
+	// Unbind the old one first - the cache only knows it by
+	// address, and the new one could end up at the same one
+	void* nullView = 0;
+	stream.SetResources(ShaderStage::Pixel, TableRegister, 1, &nullView);
+
+	buffer.Reset();
+	srv.Reset();
+	capacity = 0;
+
+	// Every entry has to be valid, including ones past the table's end
+	std::vector<MaterialData> initialData(newCapacity, MaterialData());
+	std::copy(table.begin(), table.end(), initialData.begin());
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = newCapacity * sizeof(MaterialData);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(MaterialData);
+
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = initialData.data();
+	if (FAILED(device->CreateBuffer(&desc, &data, buffer.GetAddressOf())))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = newCapacity;
+	if (FAILED(device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv.GetAddressOf())))
+		return false;
+
+	capacity = newCapacity;
+	uploadCount++;
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <vector>
+
+#include "BufferStructs.h"
+#include "CommandStream.h"
+#include "Material.h"
+#include "Pool.h"
+#include "SceneState.h"
+
+// --------------------------------------------------------
+// Every material's parameters in one structured buffer, at
+// the material's pool index, so shaders look them up by the
+// object's material index instead of a per-material cbuffer.
+// Entities whose materials differ only in parameters then
+// bind the same state and can be drawn together.
+//
+// Split across the two frame threads like everything else:
+// CollectChanges() runs in Update and puts the materials that
+// changed in the snapshot, Apply() runs in Draw and writes
+// only those into the buffer.  Nothing changed, nothing is
+// uploaded.
+// --------------------------------------------------------
+class MaterialTable
+{
+public:
+	// Materials in PixelShader.hlsl
+	static const unsigned int TableRegister = 5;
+
+	MaterialTable(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Update thread - adds an entry for every material created or changed since the last call
+	void CollectChanges(Pool<Material>& materials, FrameVector<MaterialTableEntry>& changes);
+
+	// Draw thread - encodes writing the changes into the buffer, growing it if needed.
+	// If growing fails, the changes wait in the CPU copy and it's tried again next time.
+	void Apply(CommandStream& stream, const FrameVector<MaterialTableEntry>& changes);
+
+	// Puts the table in the pixel shader's TableRegister
+	void Bind(CommandStream& stream);
+
+	unsigned int GetUploadCount() const { return uploadCount; }	// Buffer writes since startup
+
+private:
+	// What CollectChanges has already seen, per pool index
+	struct SeenVersion
+	{
+		unsigned int generation;
+		unsigned int version;
+	};
+	std::vector<SeenVersion> seen;
+
+	// The Apply side
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	unsigned int capacity;					// In materials
+	std::vector<MaterialData> table;		// CPU copy, so a grown buffer can be filled
+	bool growFailed;						// Reported once, then retried every Apply() until it works
+	std::atomic<unsigned int> uploadCount;
+
+	bool Grow(CommandStream& stream, unsigned int count);
+};
@@ -1,61 +1,38 @@
 #include "Mesh.h"
+#include <cstdio>
 #include <fstream>
 #include <vector>
 #include <DirectXMath.h>
 using namespace DirectX;
 
-Mesh::Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+std::atomic<unsigned int> Mesh::nextId;
+
+Mesh::Mesh(Vertex* vertices, int vertexCount, unsigned int* indices, int indexCount, std::shared_ptr<GeometryArena> arena, bool keepGeometry)
 {
 	//setting private variables
-	_indexCount = indexCount;
-	_context = context;
+	this->arena = arena;
+	id = nextId++;
 
 	CalculateTangents(vertices, vertexCount, indices, indexCount);
 
-	// Create the VERTEX BUFFER description -----------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
-	D3D11_BUFFER_DESC vbd;
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * vertexCount;       // vertexCount = number of vertices in the buffer
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells DirectX this is a vertex buffer
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial vertex data
-	// - This is how we put the initial data into the buffer
-	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = vertices;
-
-	// Actually create the buffer with the initial data
-	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
-
-	// Create the INDEX BUFFER description ------------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * indexCount;	// indexCount = number of indices in the buffer
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;	// Tells DirectX this is an index buffer
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial index data
-	// - This is how we put the initial data into the buffer
-	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = indices;
-
-	// Actually create the buffer with the initial data
-	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
+	// Copy the geometry into the shared buffers
+	// - The arena uploads it before the next frame is drawn, so
+	//    it's safe to do this on any thread
+	// - If there's no room the range stays invalid and the mesh just doesn't draw
+	if (!arena->Allocate(vertices, vertexCount, indices, indexCount, range))
+		printf("Mesh: no room for %d vertices and %d indices in the geometry arena\n", vertexCount, indexCount);
+
+	if (keepGeometry)
+	{
+		this->vertices.assign(vertices, vertices + vertexCount);
+		this->indices.assign(indices, indices + indexCount);
+	}
 }
 
-Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+Mesh::Mesh(const char* objFile, std::shared_ptr<GeometryArena> arena, bool keepGeometry)
 {
-	_context = context;
+	this->arena = arena;
+	id = nextId++;
 
 	// Author: Chris Cascioli
 // Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
@@ -261,11 +238,11 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, Mic
 
 	CalculateTangents(&verts[0], vertCounter, &indices[0], indexCounter);
 
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
+	// - At this point, "verts" is a vector of Vertex structs, and can be copied
+	//    directly into the arena's vertex buffer:  &verts[0] is the address of the first vert
 	//
 	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
+	//    can be copied directly into the index buffer: &indices[0] is the address of the first int
 	//
 	// - "vertCounter" is the number of vertices
 	// - "indexCounter" is the number of indices
@@ -273,68 +250,50 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, Mic
 	//    an index buffer isn't doing much for us.  We could try to optimize the mesh ourselves
 	//    and detect duplicate vertices, but at that point it would be better to use a more
 	//    sophisticated model loading library like TinyOBJLoader or AssImp (yes, that's its name)
-	// 
-	// Create the VERTEX BUFFER description -----------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
-	D3D11_BUFFER_DESC vbd;
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * vertCounter;       // vertexCount = number of vertices in the buffer
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells DirectX this is a vertex buffer
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial vertex data
-	// - This is how we put the initial data into the buffer
-	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = &verts[0];
-
-	// Actually create the buffer with the initial data
-	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
-
-	// Create the INDEX BUFFER description ------------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * indexCounter;	// indexCount = number of indices in the buffer
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;	// Tells DirectX this is an index buffer
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial index data
-	// - This is how we put the initial data into the buffer
-	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = &indices[0];
-
-	// Actually create the buffer with the initial data
-	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
-
-
-	_indexCount = indexCounter;
+	if (!arena->Allocate(&verts[0], vertCounter, &indices[0], indexCounter, range))
+		printf("Mesh: no room for %s in the geometry arena\n", objFile);
+
+	// Keep them if asked - nothing else needs the vectors now
+	if (keepGeometry)
+	{
+		vertices = std::move(verts);
+		this->indices = std::move(indices);
+	}
 }
 
 Mesh::~Mesh()
 {
+	arena->Free(range);
+}
+
+// --------------------------------------------------------
+// Frees the cpu copy once nothing is left to bake from it -
+// the arena has the geometry the mesh draws with
+// --------------------------------------------------------
+void Mesh::ReleaseGeometry()
+{
+	vertices = std::vector<Vertex>();
+	indices = std::vector<unsigned int>();
 }
 
 ID3D11Buffer* Mesh::GetVertexBuffer()
 {
-	return vertexBuffer.Get();
+	return arena->GetVertexBuffer(range.page);
 }
 
 ID3D11Buffer* Mesh::GetIndexBuffer()
 {
-	return indexBuffer.Get();
+	return arena->GetIndexBuffer(range.page);
 }
 
 int Mesh::GetIndexCount()
 {
-	return _indexCount;
+	return range.indexCount;
+}
+
+unsigned int Mesh::GetId()
+{
+	return id;
 }
 
 // --------------------------------------------------------
@@ -427,18 +386,16 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 	}
 }
 
-void Mesh::Draw()
+void Mesh::Draw(CommandStream& stream)
 {
+	// Never made it into the arena - there's nothing to draw
+	if (!range.IsValid())
+		return;
+
 	// Set buffers in the input assembler
-	//  - Do this ONCE PER OBJECT you're drawing, since each object might
-	//    have different geometry.
-	//  - for this demo, this step *could* simply be done once during Init(),
-	//    but I'm doing it here because it's often done multiple times per frame
-	//    in a larger application/game
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	_context->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
-	_context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	//  - Every mesh in the same arena page shares them, so the state
+	//    cache skips this unless the last mesh drawn was in another page
+	arena->Bind(stream, range.page);
 
 
 	// Finally do the actual drawing
@@ -446,8 +403,24 @@ void Mesh::Draw()
 	//  - This will use all of the currently set DirectX "stuff" (shaders, buffers, etc)
 	//  - DrawIndexed() uses the currently set INDEX BUFFER to look up corresponding
 	//     vertices in the currently set VERTEX BUFFER
-	_context->DrawIndexed(
-		_indexCount,     // The number of indices to use (we could draw a subset if we wanted)
-		0,     // Offset to the first index we want to use
-		0);    // Offset to add to each index when looking up vertices
+	stream.DrawIndexed(
+		range.indexCount,	// The number of indices to use
+		range.firstIndex,	// Where this mesh's indices start in the page
+		range.baseVertex);	// Where its vertices start - added to each index
+}
+
+//same as Draw, but for instanceCount copies - the per-instance data must already be bound to slot 1
+void Mesh::DrawInstanced(CommandStream& stream, unsigned int instanceCount, unsigned int firstInstance)
+{
+	if (!range.IsValid())
+		return;
+
+	arena->Bind(stream, range.page);
+
+	stream.DrawIndexedInstanced(
+		range.indexCount,
+		instanceCount,
+		range.firstIndex,
+		range.baseVertex,
+		firstInstance);
 }
@@ -5,7 +5,15 @@
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include "Vertex.h"
 #include <memory>
+#include <atomic>
+#include <vector>
+#include "CommandStream.h"
+#include "GeometryArena.h"
 
+// --------------------------------------------------------
+// A range of a GeometryArena's buffers.  Meshes in the same
+// page draw without rebinding anything.
+// --------------------------------------------------------
 class Mesh
 {
 
@@ -16,26 +24,41 @@ public:
 		int vertexCount, 
 		unsigned int* indices, 
 		int indexCount, 
-		Microsoft::WRL::ComPtr<ID3D11Device> device, 
-		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
+		std::shared_ptr<GeometryArena> arena,
+		bool keepGeometry = false
 	);
 
-	Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	//keepGeometry keeps a cpu copy of the geometry too, until ReleaseGeometry()
+	Mesh(const char* objFile, std::shared_ptr<GeometryArena> arena, bool keepGeometry = false);
 
 	~Mesh();
 
 	ID3D11Buffer* GetVertexBuffer();
 	ID3D11Buffer* GetIndexBuffer();
 	int GetIndexCount();
+	const GeometryRange& GetRange() { return range; }
+
+	//cpu copy of the geometry, for baking it into other meshes (static batching) -
+	//empty unless the mesh was made with keepGeometry, and once it's released
+	const std::vector<Vertex>& GetVertices() { return vertices; }
+	const std::vector<unsigned int>& GetIndices() { return indices; }
+	void ReleaseGeometry();
+
+	unsigned int GetId();	//unique per mesh, for sort keys
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
-	void Draw();
+	void Draw(CommandStream& stream);
+	void DrawInstanced(CommandStream& stream, unsigned int instanceCount, unsigned int firstInstance);
 
 private:
-	// Buffers to hold actual geometry data
-	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+	// Where the geometry actually is - the arena is kept alive
+	// so the range can be given back
+	std::shared_ptr<GeometryArena> arena;
+	GeometryRange range;
+
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
 
-	Microsoft::WRL::ComPtr<ID3D11DeviceContext> _context;
-	int _indexCount;
+	static std::atomic<unsigned int> nextId;
+	unsigned int id;
 };
 
@@ -0,0 +1,346 @@
+#include "NullCommandExecutor.h"
+
+#include <cstring>
+
+namespace
+{
+	const char* StageNames[] = { "Vertex", "Hull", "Domain", "Geometry", "Pixel", "Compute" };
+
+	// FNV-1a
+	const unsigned long long ChecksumBasis = 14695981039346656037ull;
+	const unsigned long long ChecksumPrime = 1099511628211ull;
+}
+
+NullCommandExecutor::NullCommandExecutor(bool logging)
+	: logging(logging)
+{
+	Reset();
+}
+
+void NullCommandExecutor::Reset()
+{
+	memset(&stats, 0, sizeof(stats));
+	memset(&bound, 0, sizeof(bound));
+	checksum = ChecksumBasis;
+	objectNumbers.clear();
+	log.str("");
+	log.clear();
+}
+
+void NullCommandExecutor::Execute(const CommandStream& stream)
+{
+	stats.streamBytes += stream.GetSize();
+	CommandExecutor::Execute(stream);
+}
+
+// --------------------------------------------------------
+// The object's number, handing out the next one if it's new.
+// Null is always 0.
+// --------------------------------------------------------
+unsigned int NullCommandExecutor::Number(void* object)
+{
+	if (!object)
+		return 0;
+
+	auto found = objectNumbers.find(object);
+	if (found != objectNumbers.end())
+		return found->second;
+
+	unsigned int number = (unsigned int)objectNumbers.size() + 1;
+	objectNumbers.insert({ object, number });
+	return number;
+}
+
+void NullCommandExecutor::Begin(CommandType type, const char* name)
+{
+	stats.commands[(unsigned int)type]++;
+	Hash((unsigned int)type);
+
+	if (logging)
+		log << name;
+}
+
+void NullCommandExecutor::Hash(unsigned int value)
+{
+	HashBytes(&value, sizeof(value));
+}
+
+void NullCommandExecutor::HashBytes(const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		checksum ^= bytes[i];
+		checksum *= ChecksumPrime;
+	}
+}
+
+// --------------------------------------------------------
+// Sets a tracked slot, counting the bind as redundant if the
+// slot already held the value
+// --------------------------------------------------------
+bool NullCommandExecutor::Bind(unsigned int& slot, unsigned int value)
+{
+	Hash(value);
+	if (slot == value)
+	{
+		stats.redundantBinds++;
+		return false;
+	}
+
+	slot = value;
+	return true;
+}
+
+void NullCommandExecutor::SetRenderTargets(const SetRenderTargetsCommand& command)
+{
+	Begin(CommandType::SetRenderTargets, "SetRenderTargets");
+	Hash(command.count);
+
+	for (unsigned int i = 0; i < command.count; i++)
+	{
+		unsigned int target = Number(command.targets[i]);
+		Hash(target);
+		if (logging) log << " #" << target;
+	}
+
+	unsigned int depthStencil = Number(command.depthStencil);
+	Hash(depthStencil);
+	if (logging) log << " depth #" << depthStencil << "\n";
+}
+
+void NullCommandExecutor::ClearRenderTarget(const ClearRenderTargetCommand& command)
+{
+	Begin(CommandType::ClearRenderTarget, "ClearRenderTarget");
+
+	unsigned int target = Number(command.target);
+	Hash(target);
+	HashBytes(command.color, sizeof(command.color));
+	if (logging) log << " #" << target << "\n";
+}
+
+void NullCommandExecutor::ClearDepthStencil(const ClearDepthStencilCommand& command)
+{
+	Begin(CommandType::ClearDepthStencil, "ClearDepthStencil");
+
+	unsigned int depthStencil = Number(command.depthStencil);
+	Hash(depthStencil);
+	Hash(command.flags);
+	HashBytes(&command.depth, sizeof(command.depth));
+	Hash(command.stencil);
+	if (logging) log << " #" << depthStencil << " flags " << command.flags << " depth " << command.depth << " stencil " << command.stencil << "\n";
+}
+
+void NullCommandExecutor::SetViewport(const SetViewportCommand& command)
+{
+	Begin(CommandType::SetViewport, "SetViewport");
+	HashBytes(&command, sizeof(command));
+	if (logging) log << " " << command.x << "," << command.y << " " << command.width << "x" << command.height << "\n";
+}
+
+void NullCommandExecutor::SetRasterizerState(const SetRasterizerStateCommand& command)
+{
+	Begin(CommandType::SetRasterizerState, "SetRasterizerState");
+	unsigned int state = Number(command.state);
+	Bind(bound.rasterizerState, state);
+	if (logging) log << " #" << state << "\n";
+}
+
+void NullCommandExecutor::SetDepthStencilState(const SetDepthStencilStateCommand& command)
+{
+	Begin(CommandType::SetDepthStencilState, "SetDepthStencilState");
+	unsigned int state = Number(command.state);
+	Bind(bound.depthStencilState, state);
+	Hash(command.stencilRef);
+	if (logging) log << " #" << state << " ref " << command.stencilRef << "\n";
+}
+
+void NullCommandExecutor::SetBlendState(const SetBlendStateCommand& command)
+{
+	Begin(CommandType::SetBlendState, "SetBlendState");
+	unsigned int state = Number(command.state);
+	Bind(bound.blendState, state);
+	HashBytes(command.blendFactor, sizeof(command.blendFactor));
+	Hash(command.sampleMask);
+	if (logging) log << " #" << state << " mask " << command.sampleMask << "\n";
+}
+
+void NullCommandExecutor::SetTopology(const SetTopologyCommand& command)
+{
+	Begin(CommandType::SetTopology, "SetTopology");
+	Bind(bound.topology, command.topology);
+	if (logging) log << " " << command.topology << "\n";
+}
+
+void NullCommandExecutor::SetInputLayout(const SetInputLayoutCommand& command)
+{
+	Begin(CommandType::SetInputLayout, "SetInputLayout");
+	unsigned int layout = Number(command.layout);
+	Bind(bound.inputLayout, layout);
+	if (logging) log << " #" << layout << "\n";
+}
+
+void NullCommandExecutor::SetShader(const SetShaderCommand& command)
+{
+	Begin(CommandType::SetShader, "SetShader");
+	unsigned int stage = (unsigned int)command.stage;
+	unsigned int shader = Number(command.shader);
+	Hash(stage);
+	if (stage < StageCount)
+		Bind(bound.shaders[stage], shader);
+	if (logging) log << " " << (stage < StageCount ? StageNames[stage] : "?") << " #" << shader << "\n";
+}
+
+void NullCommandExecutor::SetConstantBuffer(const SetConstantBufferCommand& command)
+{
+	Begin(CommandType::SetConstantBuffer, "SetConstantBuffer");
+	unsigned int stage = (unsigned int)command.stage;
+	unsigned int buffer = Number(command.buffer);
+	Hash(stage);
+	Hash(command.slot);
+	Hash(buffer);
+	Hash(command.firstConstant);
+	Hash(command.constantCount);
+
+	// The same buffer at another offset is a change too
+	if (stage < StageCount && command.slot < ConstantBufferSlots)
+	{
+		unsigned int& boundBuffer = bound.constantBuffers[stage][command.slot];
+		unsigned int& boundOffset = bound.constantOffsets[stage][command.slot];
+		if (boundBuffer == buffer && boundOffset == command.firstConstant)
+			stats.redundantBinds++;
+
+		boundBuffer = buffer;
+		boundOffset = command.firstConstant;
+	}
+
+	if (logging)
+	{
+		log << " " << (stage < StageCount ? StageNames[stage] : "?") << " b" << command.slot << " #" << buffer;
+		if (command.constantCount)
+			log << " constants " << command.firstConstant << "+" << command.constantCount;
+		log << "\n";
+	}
+}
+
+void NullCommandExecutor::SetResources(const SetResourcesCommand& command, void* const* views)
+{
+	Begin(CommandType::SetResources, "SetResources");
+	unsigned int stage = (unsigned int)command.stage;
+	Hash(stage);
+	Hash(command.startSlot);
+	Hash(command.count);
+	if (logging) log << " " << (stage < StageCount ? StageNames[stage] : "?") << " t" << command.startSlot;
+
+	for (unsigned int i = 0; i < command.count; i++)
+	{
+		unsigned int view = Number(views[i]);
+		unsigned int slot = command.startSlot + i;
+		if (stage < StageCount && slot < ResourceSlots)
+			Bind(bound.resources[stage][slot], view);
+		else
+			Hash(view);
+		if (logging) log << " #" << view;
+	}
+	if (logging) log << "\n";
+}
+
+void NullCommandExecutor::SetSamplers(const SetResourcesCommand& command, void* const* samplers)
+{
+	Begin(CommandType::SetSamplers, "SetSamplers");
+	unsigned int stage = (unsigned int)command.stage;
+	Hash(stage);
+	Hash(command.startSlot);
+	Hash(command.count);
+	if (logging) log << " " << (stage < StageCount ? StageNames[stage] : "?") << " s" << command.startSlot;
+
+	for (unsigned int i = 0; i < command.count; i++)
+	{
+		unsigned int sampler = Number(samplers[i]);
+		unsigned int slot = command.startSlot + i;
+		if (stage < StageCount && slot < SamplerSlots)
+			Bind(bound.samplers[stage][slot], sampler);
+		else
+			Hash(sampler);
+		if (logging) log << " #" << sampler;
+	}
+	if (logging) log << "\n";
+}
+
+void NullCommandExecutor::SetVertexBuffers(const SetVertexBuffersCommand& command, const VertexBufferBinding* buffers)
+{
+	Begin(CommandType::SetVertexBuffers, "SetVertexBuffers");
+	Hash(command.startSlot);
+	Hash(command.count);
+	if (logging) log << " " << command.startSlot;
+
+	for (unsigned int i = 0; i < command.count; i++)
+	{
+		unsigned int buffer = Number(buffers[i].buffer);
+		unsigned int slot = command.startSlot + i;
+		if (slot < VertexBufferSlots)
+			Bind(bound.vertexBuffers[slot], buffer);
+		else
+			Hash(buffer);
+		Hash(buffers[i].stride);
+		Hash(buffers[i].offset);
+		if (logging) log << " #" << buffer << " stride " << buffers[i].stride << " offset " << buffers[i].offset;
+	}
+	if (logging) log << "\n";
+}
+
+void NullCommandExecutor::SetIndexBuffer(const SetIndexBufferCommand& command)
+{
+	Begin(CommandType::SetIndexBuffer, "SetIndexBuffer");
+	unsigned int buffer = Number(command.buffer);
+	Bind(bound.indexBuffer, buffer);
+	Hash(command.format);
+	Hash(command.offset);
+	if (logging) log << " #" << buffer << " format " << command.format << " offset " << command.offset << "\n";
+}
+
+void NullCommandExecutor::UpdateBuffer(const UpdateBufferCommand& command, const void* data)
+{
+	Begin(CommandType::UpdateBuffer, "UpdateBuffer");
+	unsigned int buffer = Number(command.buffer);
+	Hash(buffer);
+	Hash(command.offset);
+	Hash(command.size);
+	Hash(command.mode);
+	HashBytes(data, command.size);
+	stats.uploadBytes += command.size;
+
+	if (logging)
+	{
+		log << " #" << buffer << " " << command.size << " bytes";
+		if (command.mode == UpdateBufferCommand::Range)
+			log << " at " << command.offset;
+		else if (command.mode == UpdateBufferCommand::Discard)
+			log << " discarding";
+		log << "\n";
+	}
+}
+
+void NullCommandExecutor::DrawIndexed(const DrawIndexedCommand& command)
+{
+	Begin(CommandType::DrawIndexed, "DrawIndexed");
+	HashBytes(&command, sizeof(command));
+	stats.draws++;
+	stats.instances++;
+	stats.triangles += command.indexCount / 3;
+	if (logging) log << " " << command.indexCount << " from " << command.firstIndex << " base " << command.baseVertex << "\n";
+}
+
+void NullCommandExecutor::DrawIndexedInstanced(const DrawIndexedInstancedCommand& command)
+{
+	Begin(CommandType::DrawIndexedInstanced, "DrawIndexedInstanced");
+	HashBytes(&command, sizeof(command));
+	stats.draws++;
+	stats.instances += command.instanceCount;
+	stats.triangles += (unsigned long long)(command.indexCount / 3) * command.instanceCount;
+	if (logging)
+	{
+		log << " " << command.indexCount << " from " << command.firstIndex << " base " << command.baseVertex <<
+			" x" << command.instanceCount << " from " << command.firstInstance << "\n";
+	}
+}
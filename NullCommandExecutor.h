@@ -0,0 +1,106 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include "CommandStream.h"
+
+// --------------------------------------------------------
+// What a NullCommandExecutor saw, since its last Reset()
+// --------------------------------------------------------
+struct CommandStreamStats
+{
+	unsigned int commands[(unsigned int)CommandType::Count];	// By type
+	unsigned int redundantBinds;	// Binds that didn't change anything
+	unsigned int draws;
+	unsigned long long instances;
+	unsigned long long triangles;
+	unsigned long long uploadBytes;
+	unsigned long long streamBytes;
+};
+
+// --------------------------------------------------------
+// Plays command streams back on nothing.  It only keeps
+// track of what was bound and counts, so a frame's CPU side
+// can be timed, or checked, without a GPU or Direct3D.
+//
+// GPU objects are numbered in the order they're first seen,
+// so the checksum (and the log, if there is one) stays the
+// same from run to run even though the pointers don't.  Two
+// builds that encode the same frame get the same checksum.
+// --------------------------------------------------------
+class NullCommandExecutor : public CommandExecutor
+{
+public:
+	// Logging writes a line per command, which is slow - for
+	// captures to compare, not for timing
+	NullCommandExecutor(bool logging = false);
+
+	// Forgets the counts, checksum, log and object numbers
+	void Reset();
+
+	// Also counts the stream's size
+	void Execute(const CommandStream& stream);
+
+	const CommandStreamStats& GetStats() const { return stats; }
+	unsigned long long GetChecksum() const { return checksum; }
+	std::string GetLog() const { return log.str(); }
+
+protected:
+	void SetRenderTargets(const SetRenderTargetsCommand& command);
+	void ClearRenderTarget(const ClearRenderTargetCommand& command);
+	void ClearDepthStencil(const ClearDepthStencilCommand& command);
+	void SetViewport(const SetViewportCommand& command);
+	void SetRasterizerState(const SetRasterizerStateCommand& command);
+	void SetDepthStencilState(const SetDepthStencilStateCommand& command);
+	void SetBlendState(const SetBlendStateCommand& command);
+	void SetTopology(const SetTopologyCommand& command);
+	void SetInputLayout(const SetInputLayoutCommand& command);
+	void SetShader(const SetShaderCommand& command);
+	void SetConstantBuffer(const SetConstantBufferCommand& command);
+	void SetResources(const SetResourcesCommand& command, void* const* views);
+	void SetSamplers(const SetResourcesCommand& command, void* const* samplers);
+	void SetVertexBuffers(const SetVertexBuffersCommand& command, const VertexBufferBinding* buffers);
+	void SetIndexBuffer(const SetIndexBufferCommand& command);
+	void UpdateBuffer(const UpdateBufferCommand& command, const void* data);
+	void DrawIndexed(const DrawIndexedCommand& command);
+	void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command);
+
+private:
+	static const unsigned int StageCount = (unsigned int)ShaderStage::Count;
+	static const unsigned int ConstantBufferSlots = 14;
+	static const unsigned int ResourceSlots = 128;
+	static const unsigned int SamplerSlots = 16;
+	static const unsigned int VertexBufferSlots = 32;
+
+	// What's bound, by object number (0 is nothing)
+	struct BoundState
+	{
+		unsigned int shaders[StageCount];
+		unsigned int constantBuffers[StageCount][ConstantBufferSlots];
+		unsigned int constantOffsets[StageCount][ConstantBufferSlots];
+		unsigned int resources[StageCount][ResourceSlots];
+		unsigned int samplers[StageCount][SamplerSlots];
+		unsigned int vertexBuffers[VertexBufferSlots];
+		unsigned int indexBuffer;
+		unsigned int inputLayout;
+		unsigned int topology;
+		unsigned int rasterizerState;
+		unsigned int depthStencilState;
+		unsigned int blendState;
+	};
+
+	bool logging;
+	std::ostringstream log;
+	CommandStreamStats stats;
+	BoundState bound;
+	unsigned long long checksum;
+	std::unordered_map<void*, unsigned int> objectNumbers;
+
+	unsigned int Number(void* object);
+	void Begin(CommandType type, const char* name);
+	void Hash(unsigned int value);
+	void HashBytes(const void* data, size_t size);
+	bool Bind(unsigned int& slot, unsigned int value);
+};
@@ -0,0 +1,224 @@
+#include "PipelineState.h"
+#include "CommandRecorder.h"
+
+#include <cstring>
+
+namespace
+{
+	// FNV-1a
+	const unsigned long long HashBasis = 14695981039346656037ull;
+	const unsigned long long HashPrime = 1099511628211ull;
+
+	unsigned long long FloatBits(float value)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	void AddStencilOp(std::vector<unsigned long long>& key, const D3D11_DEPTH_STENCILOP_DESC& op)
+	{
+		key.push_back(op.StencilFailOp);
+		key.push_back(op.StencilDepthFailOp);
+		key.push_back(op.StencilPassOp);
+		key.push_back(op.StencilFunc);
+	}
+}
+
+PipelineStateDesc::PipelineStateDesc()
+	: rasterizer(CD3D11_RASTERIZER_DESC(CD3D11_DEFAULT())),
+	depthStencil(CD3D11_DEPTH_STENCIL_DESC(CD3D11_DEFAULT())),
+	blend(CD3D11_BLEND_DESC(CD3D11_DEFAULT())),
+	stencilRef(0),
+	sampleMask(0xFFFFFFFF)
+{
+	for (int i = 0; i < 4; i++)
+		blendFactor[i] = 1.0f;
+}
+
+PipelineState::PipelineState(unsigned int id, unsigned long long hash, const std::vector<unsigned long long>& key, const PipelineStateDesc& desc,
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState,
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencilState,
+	Microsoft::WRL::ComPtr<ID3D11BlendState> blendState)
+	: id(id),
+	hash(hash),
+	key(key),
+	vertexShader(desc.vertexShader),
+	pixelShader(desc.pixelShader),
+	rasterizerState(rasterizerState),
+	depthStencilState(depthStencilState),
+	blendState(blendState),
+	stencilRef(desc.stencilRef),
+	sampleMask(desc.sampleMask)
+{
+	if (vertexShader)
+		inputLayout = vertexShader->GetInputLayout();
+
+	for (int i = 0; i < 4; i++)
+		blendFactor[i] = desc.blendFactor[i];
+}
+
+void PipelineState::Bind(RenderContext& context) const
+{
+	const PipelineState* current = context.GetPipelineState();
+	if (current == this)
+		return;
+
+	CommandStream& stream = context.GetStream();
+
+	// Setting a shader also sets its layout and constant buffers
+	if (!current || current->vertexShader != vertexShader)
+	{
+		if (vertexShader)
+			vertexShader->SetShader(context);
+		else
+		{
+			stream.SetInputLayout(0);
+			stream.SetShader(ShaderStage::Vertex, 0);
+		}
+	}
+
+	if (!current || current->pixelShader != pixelShader)
+	{
+		if (pixelShader)
+			pixelShader->SetShader(context);
+		else
+			stream.SetShader(ShaderStage::Pixel, 0);
+	}
+
+	if (!current || current->rasterizerState != rasterizerState)
+		stream.SetRasterizerState(rasterizerState.Get());
+
+	if (!current || current->depthStencilState != depthStencilState || current->stencilRef != stencilRef)
+		stream.SetDepthStencilState(depthStencilState.Get(), stencilRef);
+
+	if (!current || current->blendState != blendState || current->sampleMask != sampleMask ||
+		memcmp(current->blendFactor, blendFactor, sizeof(blendFactor)) != 0)
+		stream.SetBlendState(blendState.Get(), blendFactor, sampleMask);
+
+	context.SetPipelineState(this);
+}
+
+PipelineStateCache::PipelineStateCache(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device),
+	count(0),
+	requestCount(0)
+{
+}
+
+// --------------------------------------------------------
+// Every field that makes two pipelines different, one per
+// entry.  Shaders count by object, since they're shared.
+// --------------------------------------------------------
+std::vector<unsigned long long> PipelineStateCache::MakeKey(const PipelineStateDesc& desc)
+{
+	std::vector<unsigned long long> key;
+	key.reserve(64);
+
+	key.push_back((unsigned long long)(size_t)desc.vertexShader.get());
+	key.push_back((unsigned long long)(size_t)desc.pixelShader.get());
+
+	const D3D11_RASTERIZER_DESC& r = desc.rasterizer;
+	key.push_back(r.FillMode);
+	key.push_back(r.CullMode);
+	key.push_back(r.FrontCounterClockwise);
+	key.push_back((unsigned int)r.DepthBias);
+	key.push_back(FloatBits(r.DepthBiasClamp));
+	key.push_back(FloatBits(r.SlopeScaledDepthBias));
+	key.push_back(r.DepthClipEnable);
+	key.push_back(r.ScissorEnable);
+	key.push_back(r.MultisampleEnable);
+	key.push_back(r.AntialiasedLineEnable);
+
+	const D3D11_DEPTH_STENCIL_DESC& d = desc.depthStencil;
+	key.push_back(d.DepthEnable);
+	key.push_back(d.DepthWriteMask);
+	key.push_back(d.DepthFunc);
+	key.push_back(d.StencilEnable);
+	key.push_back(d.StencilReadMask);
+	key.push_back(d.StencilWriteMask);
+	AddStencilOp(key, d.FrontFace);
+	AddStencilOp(key, d.BackFace);
+
+	const D3D11_BLEND_DESC& b = desc.blend;
+	key.push_back(b.AlphaToCoverageEnable);
+	key.push_back(b.IndependentBlendEnable);
+
+	// Without independent blending only the first target's is used
+	unsigned int targets = b.IndependentBlendEnable ? 8 : 1;
+	for (unsigned int i = 0; i < targets; i++)
+	{
+		const D3D11_RENDER_TARGET_BLEND_DESC& t = b.RenderTarget[i];
+		key.push_back(t.BlendEnable);
+		key.push_back(t.SrcBlend);
+		key.push_back(t.DestBlend);
+		key.push_back(t.BlendOp);
+		key.push_back(t.SrcBlendAlpha);
+		key.push_back(t.DestBlendAlpha);
+		key.push_back(t.BlendOpAlpha);
+		key.push_back(t.RenderTargetWriteMask);
+	}
+
+	key.push_back(desc.stencilRef);
+	for (int i = 0; i < 4; i++)
+		key.push_back(FloatBits(desc.blendFactor[i]));
+	key.push_back(desc.sampleMask);
+	return key;
+}
+
+unsigned long long PipelineStateCache::HashKey(const std::vector<unsigned long long>& key)
+{
+	unsigned long long hash = HashBasis;
+	for (unsigned long long value : key)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= HashPrime;
+		}
+	}
+	return hash;
+}
+
+std::shared_ptr<PipelineState> PipelineStateCache::Get(const PipelineStateDesc& desc)
+{
+	std::vector<unsigned long long> key = MakeKey(desc);
+	unsigned long long hash = HashKey(key);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	requestCount++;
+
+	// Same hash is only likely the same desc - the key decides
+	std::vector<std::shared_ptr<PipelineState>>& bucket = states[hash];
+	for (const std::shared_ptr<PipelineState>& state : bucket)
+	{
+		if (state->GetKey() == key)
+			return state;
+	}
+
+	// Direct3D hands back its own object for a desc it has seen,
+	// so pipelines that only differ in shaders share states too
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencilState;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> blendState;
+	device->CreateRasterizerState(&desc.rasterizer, rasterizerState.GetAddressOf());
+	device->CreateDepthStencilState(&desc.depthStencil, depthStencilState.GetAddressOf());
+	device->CreateBlendState(&desc.blend, blendState.GetAddressOf());
+
+	std::shared_ptr<PipelineState> state = std::make_shared<PipelineState>(count, hash, key, desc, rasterizerState, depthStencilState, blendState);
+	bucket.push_back(state);
+	count++;
+	return state;
+}
+
+unsigned int PipelineStateCache::GetCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return count;
+}
+
+unsigned int PipelineStateCache::GetRequestCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return requestCount;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "SimpleShader.h"
+
+class RenderContext;
+
+// --------------------------------------------------------
+// Everything a draw's pipeline is made of.  The states are
+// plain descs - the cache makes (and shares) the objects.
+// --------------------------------------------------------
+struct PipelineStateDesc
+{
+	std::shared_ptr<SimpleVertexShader> vertexShader;	// Brings its input layout
+	std::shared_ptr<SimplePixelShader> pixelShader;		// Null for depth only
+	D3D11_RASTERIZER_DESC rasterizer;
+	D3D11_DEPTH_STENCIL_DESC depthStencil;
+	D3D11_BLEND_DESC blend;
+	unsigned int stencilRef;
+	float blendFactor[4];
+	unsigned int sampleMask;
+
+	// Direct3D's default for every state, which is what binding
+	// none of them gives
+	PipelineStateDesc();
+};
+
+// --------------------------------------------------------
+// Shaders, input layout and fixed-function states, bound as
+// one.  Made only by a PipelineStateCache, and never changed
+// after, so two draws with the same pipeline share the same
+// object - comparing pointers (or ids) is comparing states.
+//
+// The id is small and handed out in creation order, for
+// draw sort keys.
+// --------------------------------------------------------
+class PipelineState
+{
+public:
+	PipelineState(unsigned int id, unsigned long long hash, const std::vector<unsigned long long>& key, const PipelineStateDesc& desc,
+		Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState,
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencilState,
+		Microsoft::WRL::ComPtr<ID3D11BlendState> blendState);
+
+	// --------------------------------------------------------
+	// Encodes binding the pipeline.  Does nothing if it's the
+	// context's current one, and otherwise only binds what's
+	// different from the current one.
+	// --------------------------------------------------------
+	void Bind(RenderContext& context) const;
+
+	unsigned int GetId() const { return id; }
+	unsigned long long GetHash() const { return hash; }
+	const std::vector<unsigned long long>& GetKey() const { return key; }
+
+	std::shared_ptr<SimpleVertexShader> GetVertexShader() const { return vertexShader; }
+	std::shared_ptr<SimplePixelShader> GetPixelShader() const { return pixelShader; }
+	ID3D11InputLayout* GetInputLayout() const { return inputLayout.Get(); }
+	ID3D11RasterizerState* GetRasterizerState() const { return rasterizerState.Get(); }
+	ID3D11DepthStencilState* GetDepthStencilState() const { return depthStencilState.Get(); }
+	ID3D11BlendState* GetBlendState() const { return blendState.Get(); }
+
+private:
+	unsigned int id;
+	unsigned long long hash;
+	std::vector<unsigned long long> key;
+
+	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimplePixelShader> pixelShader;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencilState;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> blendState;
+	unsigned int stencilRef;
+	float blendFactor[4];
+	unsigned int sampleMask;
+};
+
+// --------------------------------------------------------
+// Makes pipeline states, once per distinct desc.  Descs are
+// reduced to a key of their fields (so padding never counts)
+// and looked up by the key's hash - asking again for one
+// that exists returns it instead of making another.
+//
+// Safe to call from several threads.
+// --------------------------------------------------------
+class PipelineStateCache
+{
+public:
+	PipelineStateCache(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	std::shared_ptr<PipelineState> Get(const PipelineStateDesc& desc);
+
+	unsigned int GetCount();			// Distinct pipelines
+	unsigned int GetRequestCount();		// Calls to Get()
+
+	static std::vector<unsigned long long> MakeKey(const PipelineStateDesc& desc);
+	static unsigned long long HashKey(const std::vector<unsigned long long>& key);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::mutex mutex;
+	std::unordered_map<unsigned long long, std::vector<std::shared_ptr<PipelineState>>> states;	// By hash
+	unsigned int count;
+	unsigned int requestCount;
+};
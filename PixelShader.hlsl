@@ -4,21 +4,33 @@ static const float F0_NON_METAL = 0.04f;
 static const float MIN_ROUGHNESS = 0.0000001f; // Minimum roughness for when spec distribution function denominator goes to zero
 static const float PI = 3.14159265359f; // Handy to have this as a constant
 
-Texture2D SurfaceTexture	: register(t0);	//"t" registers for textures
-Texture2D SurfaceRoughness	: register(t1);
-Texture2D NormalMap			: register(t2);
-Texture2D MetalnessMap		: register(t3);
-Texture2D ShadowMap			: register(t4);
+// Material textures are packed into arrays - each material's
+// slice of each is in its MaterialData.textureSlices
+Texture2DArray SurfaceTexture	: register(t0);	//"t" registers for textures
+Texture2DArray SurfaceRoughness	: register(t1);
+Texture2DArray NormalMap		: register(t2);
+Texture2DArray MetalnessMap		: register(t3);
+Texture2D ShadowMap				: register(t4);
+
+// Every material's parameters, indexed by materialIndex
+StructuredBuffer<MaterialData> Materials	: register(t5);
 
 SamplerState BasicSampler				: register(s0);	//"s" registers for samplers
 SamplerComparisonState ShadowSampler	: register(s1);
 
-cbuffer ExternalData : register(b0)
+// Buffers are split by how often they change, so a draw
+// only has to upload the one that's actually different
+
+// Set once per frame
+cbuffer PerFrame : register(b0)
 {
-	float4 colorTint;
-	float roughness;
 	float3 cameraPos;
 	float3 ambient;
+}
+
+// Set when the lights change
+cbuffer PerLight : register(b1)
+{
 	//Light directionalLight1;
 	//Light directionalLight2;
 	Light directionalLight3;
@@ -126,14 +138,14 @@ float3 MicrofacetBRDF(float3 n, float3 l, float3 v, float roughness, float3 spec
 	return (D * F * G) / (4 * max(dot(n, v), dot(n, l)));
 }
 
-float3 Diffuse(float3 normal, float3 dirToLight, float3 color)
+float3 Diffuse(float3 normal, float3 dirToLight, float3 color, float4 colorTint)
 {
 	float3 normalizedDirection = normalize(-dirToLight);
 	float3 NdotL = saturate(dot(normal, normalizedDirection));
 	return NdotL * colorTint * color;
 }
 
-float3 Specular(float3 normal, float3 dirFromLight, float3 viewVec, float specExponent)
+float3 Specular(float3 normal, float3 dirFromLight, float3 viewVec, float specExponent, float4 colorTint)
 {
 	float3 R = reflect(normalize(dirFromLight), normal);
 	return pow(saturate(dot(R, viewVec)), specExponent) * colorTint;
@@ -163,15 +175,21 @@ float4 main(VertexToPixel input) : SV_TARGET
 	float3 bi_tangent = cross(tangent, normal);
 	float3x3 TBN = float3x3(tangent, bi_tangent, normal);
 
-	float3 unpackedNormal = NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1;
+	MaterialData material = Materials[input.materialIndex];
+	float3 surfaceUV = float3(input.uv, material.textureSlices.x);
+	float3 roughnessUV = float3(input.uv, material.textureSlices.y);
+	float3 normalUV = float3(input.uv, material.textureSlices.z);
+	float3 metalnessUV = float3(input.uv, material.textureSlices.w);
+
+	float3 unpackedNormal = NormalMap.Sample(BasicSampler, normalUV).rgb * 2 - 1;
 
 	input.normal = mul(unpackedNormal, TBN);
 
-	float pixelRoughness = 1.0f - (SurfaceRoughness.Sample(BasicSampler, input.uv).r);
+	float pixelRoughness = 1.0f - (SurfaceRoughness.Sample(BasicSampler, roughnessUV).r);
 
-	float pixelMetalness = MetalnessMap.Sample(BasicSampler, input.uv).r;
+	float pixelMetalness = MetalnessMap.Sample(BasicSampler, metalnessUV).r;
 
-	float3 surfaceColor = pow(SurfaceTexture.Sample(BasicSampler, input.uv).rgb, 2.2f);
+	float3 surfaceColor = pow(SurfaceTexture.Sample(BasicSampler, surfaceUV).rgb, 2.2f) * material.colorTint.rgb;
 
 	float3 specularColor = lerp(F0_NON_METAL.rrr, surfaceColor.rgb, pixelMetalness);
 
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cassert>
+#include <cstdio>
+#include <new>
+#include <utility>
+#include <vector>
+
+// --------------------------------------------------------
+// Refers to an object in a Pool.  The generation is bumped
+// every time a slot's object is destroyed, so a handle to a
+// destroyed object never finds whatever was created in its
+// place.
+// --------------------------------------------------------
+template <typename T>
+struct Handle
+{
+	static const unsigned int InvalidIndex = 0xFFFFFFFF;
+
+	unsigned int index = InvalidIndex;
+	unsigned int generation = 0;
+
+	bool IsNull() const { return index == InvalidIndex; }
+
+	bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// --------------------------------------------------------
+// Fixed-block object pool.  Objects live in blocks of
+// BlockSize slots that are never moved or freed until the
+// pool is, so creating and destroying objects just pops and
+// pushes a free list - no heap calls once the pool is big
+// enough, and no fragmentation.
+//
+// Destroy() makes the handle stale straight away, but the
+// object itself is retired rather than destroyed: snapshots
+// hold plain pointers to objects, and the frame drawing one
+// may still be running.  It's destroyed, and its slot reused,
+// RetireFrames calls to EndFrame() later.
+//
+// Not thread-safe for Create/Destroy.  Get() may be called
+// from any thread while nothing is being created or destroyed.
+//
+// In debug builds Get() and Destroy() check the handle's
+// generation and report stale handles.  Release builds trust
+// the handle; use IsValid() where a handle may be stale.
+// --------------------------------------------------------
+template <typename T, unsigned int BlockSize = 256>
+class Pool
+{
+public:
+	// A snapshot taken in one Update() is drawn while the next one
+	// runs, so an object destroyed in either is still in use until
+	// the EndFrame() after that
+	static const unsigned int RetireFrames = 2;
+
+	Pool() : freeList(Handle<T>::InvalidIndex), liveCount(0), retiring(0) {}
+
+	~Pool()
+	{
+		for (unsigned int i = 0; i < blocks.size() * BlockSize; i++)
+		{
+			Slot& slot = GetSlot(i);
+			if (slot.alive || slot.retired)
+				slot.Get()->~T();
+		}
+
+		for (Slot* block : blocks)
+			delete[] block;
+	}
+
+	Pool(Pool const&) = delete;
+	void operator=(Pool const&) = delete;
+
+	template <typename... Args>
+	Handle<T> Create(Args&&... args)
+	{
+		if (freeList == Handle<T>::InvalidIndex)
+			Grow();
+
+		unsigned int index = freeList;
+		Slot& slot = GetSlot(index);
+		freeList = slot.nextFree;
+
+		new (slot.storage) T(std::forward<Args>(args)...);
+		slot.alive = true;
+		liveCount++;
+
+		Handle<T> handle;
+		handle.index = index;
+		handle.generation = slot.generation;
+		return handle;
+	}
+
+	void Destroy(Handle<T> handle)
+	{
+		if (!IsValid(handle))
+		{
+			ReportStale(handle, "Destroy");
+			return;
+		}
+
+		Slot& slot = GetSlot(handle.index);
+		slot.alive = false;
+		slot.retired = true;
+		slot.generation++;
+		retired[retiring].push_back(handle.index);
+		liveCount--;
+	}
+
+	// --------------------------------------------------------
+	// Destroys the objects retired RetireFrames calls ago and
+	// frees their slots.  Call once a frame, while nothing that
+	// was handed pointers to them can still be running.
+	// --------------------------------------------------------
+	void EndFrame()
+	{
+		retiring = (retiring + 1) % RetireFrames;
+		for (unsigned int index : retired[retiring])
+		{
+			Slot& slot = GetSlot(index);
+			slot.Get()->~T();
+			slot.retired = false;
+			slot.nextFree = freeList;
+			freeList = index;
+		}
+		retired[retiring].clear();
+	}
+
+	T* Get(Handle<T> handle) const
+	{
+		if (handle.IsNull())
+			return 0;
+
+#if defined(DEBUG) || defined(_DEBUG)
+		if (!IsValid(handle))
+		{
+			ReportStale(handle, "Get");
+			return 0;
+		}
+#endif
+
+		return GetSlot(handle.index).Get();
+	}
+
+	bool IsValid(Handle<T> handle) const
+	{
+		if (handle.index >= blocks.size() * BlockSize)
+			return false;
+
+		const Slot& slot = GetSlot(handle.index);
+		return slot.alive && slot.generation == handle.generation;
+	}
+
+	unsigned int GetCount() const { return liveCount; }
+	unsigned int GetCapacity() const { return (unsigned int)blocks.size() * BlockSize; }
+
+	// Destroyed, but not yet freed by EndFrame()
+	unsigned int GetRetiredCount() const
+	{
+		unsigned int count = 0;
+		for (const std::vector<unsigned int>& list : retired)
+			count += (unsigned int)list.size();
+		return count;
+	}
+
+	// Calls function(handle, object) for every live object, in index order
+	template <typename Function>
+	void ForEach(const Function& function)
+	{
+		for (unsigned int i = 0; i < blocks.size() * BlockSize; i++)
+		{
+			Slot& slot = GetSlot(i);
+			if (!slot.alive)
+				continue;
+
+			Handle<T> handle;
+			handle.index = i;
+			handle.generation = slot.generation;
+			function(handle, *slot.Get());
+		}
+	}
+
+private:
+	struct Slot
+	{
+		alignas(T) unsigned char storage[sizeof(T)];
+		unsigned int generation;
+		unsigned int nextFree;
+		bool alive;
+		bool retired;	// Destroyed, but the object is still there until EndFrame() frees it
+
+		T* Get() { return reinterpret_cast<T*>(storage); }
+	};
+
+	std::vector<Slot*> blocks;
+	unsigned int freeList;
+	unsigned int liveCount;
+
+	// Slots destroyed since each of the last RetireFrames calls to EndFrame()
+	std::vector<unsigned int> retired[RetireFrames];
+	unsigned int retiring;
+
+	Slot& GetSlot(unsigned int index) const { return blocks[index / BlockSize][index % BlockSize]; }
+
+	// --------------------------------------------------------
+	// Adds a block and threads its slots onto the free list
+	// --------------------------------------------------------
+	void Grow()
+	{
+		unsigned int first = (unsigned int)blocks.size() * BlockSize;
+		Slot* block = new Slot[BlockSize];
+		blocks.push_back(block);
+
+		// Lowest index first, so objects are handed out in order
+		for (unsigned int i = 0; i < BlockSize; i++)
+		{
+			block[i].generation = 1;
+			block[i].alive = false;
+			block[i].retired = false;
+			block[i].nextFree = (i + 1 < BlockSize) ? first + i + 1 : freeList;
+		}
+		freeList = first;
+	}
+
+	void ReportStale(Handle<T> handle, const char* operation) const
+	{
+#if defined(DEBUG) || defined(_DEBUG)
+		printf("Pool: stale or invalid handle (index %u, generation %u) passed to %s\n", handle.index, handle.generation, operation);
+		assert(false && "Stale pool handle");
+#else
+		(void)handle;
+		(void)operation;
+#endif
+	}
+};
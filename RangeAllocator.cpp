@@ -0,0 +1,300 @@
+#include "RangeAllocator.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the lowest/highest set bit - bits must not be 0
+static unsigned int LowestBit(unsigned int bits)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, bits);
+	return index;
+#else
+	return __builtin_ctz(bits);
+#endif
+}
+
+static unsigned int HighestBit(unsigned int bits)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse(&index, bits);
+	return index;
+#else
+	return 31 - __builtin_clz(bits);
+#endif
+}
+
+RangeAllocator::RangeAllocator(unsigned int capacity)
+{
+	Reset(capacity);
+}
+
+void RangeAllocator::Reset(unsigned int capacity)
+{
+	nodes.clear();
+	unusedNodes.clear();
+
+	classBitmap = 0;
+	for (unsigned int c = 0; c < Classes; c++)
+	{
+		subClassBitmaps[c] = 0;
+		for (unsigned int s = 0; s < SubClasses; s++)
+			freeLists[c][s] = None;
+	}
+
+	this->capacity = capacity;
+	used = 0;
+	freeRangeCount = 0;
+
+	// Everything starts as one free range
+	if (capacity > 0)
+	{
+		unsigned int node = NewNode();
+		nodes[node].offset = 0;
+		nodes[node].size = capacity;
+		InsertFree(node);
+	}
+}
+
+// --------------------------------------------------------
+// Takes size units from the smallest size class that is
+// sure to fit, and gives the rest back as a new free range
+// --------------------------------------------------------
+RangeAllocation RangeAllocator::Allocate(unsigned int size)
+{
+	RangeAllocation allocation;
+	if (size == 0 || size > capacity - used)
+		return allocation;
+
+	unsigned int node = FindFree(size);
+	if (node == None)
+		return allocation;
+
+	RemoveFree(node);
+
+	// Split off whatever isn't needed
+	if (nodes[node].size > size)
+	{
+		unsigned int rest = NewNode();
+		nodes[rest].offset = nodes[node].offset + size;
+		nodes[rest].size = nodes[node].size - size;
+		nodes[rest].previous = node;
+		nodes[rest].next = nodes[node].next;
+		if (nodes[node].next != None)
+			nodes[nodes[node].next].previous = rest;
+		nodes[node].next = rest;
+		nodes[node].size = size;
+		InsertFree(rest);
+	}
+
+	used += size;
+	allocation.offset = nodes[node].offset;
+	allocation.node = node;
+	return allocation;
+}
+
+void RangeAllocator::Free(RangeAllocation allocation)
+{
+	if (!allocation.IsValid() || allocation.node >= nodes.size() || nodes[allocation.node].free)
+		return;
+
+	unsigned int node = allocation.node;
+	used -= nodes[node].size;
+
+	// Merge with free neighbors, so the free ranges are
+	// always as large as they can be
+	unsigned int next = nodes[node].next;
+	if (next != None && nodes[next].free)
+	{
+		RemoveFree(next);
+		Merge(node, next);
+	}
+
+	unsigned int previous = nodes[node].previous;
+	if (previous != None && nodes[previous].free)
+	{
+		RemoveFree(previous);
+		Merge(previous, node);
+		node = previous;
+	}
+
+	InsertFree(node);
+}
+
+unsigned int RangeAllocator::GetLargestFreeRange() const
+{
+	if (classBitmap == 0)
+		return 0;
+
+	// Only the highest non-empty list can hold the largest
+	// range, but its sizes still differ, so check them all
+	unsigned int sizeClass = HighestBit(classBitmap);
+	unsigned int subClass = HighestBit(subClassBitmaps[sizeClass]);
+
+	unsigned int largest = 0;
+	for (unsigned int node = freeLists[sizeClass][subClass]; node != None; node = nodes[node].nextFree)
+	{
+		if (nodes[node].size > largest)
+			largest = nodes[node].size;
+	}
+	return largest;
+}
+
+float RangeAllocator::GetFragmentation() const
+{
+	unsigned int freeUnits = capacity - used;
+	if (freeUnits == 0)
+		return 0.0f;
+
+	return 1.0f - (float)GetLargestFreeRange() / (float)freeUnits;
+}
+
+// --------------------------------------------------------
+// Rounds size up to the next list boundary.  Every range in
+// that list (and the ones above it) is big enough.
+// --------------------------------------------------------
+unsigned int RangeAllocator::GetFitSize(unsigned int size)
+{
+	if (size < SmallSize)
+		return size;
+
+	unsigned int roundUp = (1u << (HighestBit(size) - SubClassBits)) - 1;
+	if (size > 0xFFFFFFFF - roundUp)
+		return 0;
+
+	return (size + roundUp) & ~roundUp;
+}
+
+// --------------------------------------------------------
+// Which list a range of this size goes in
+// --------------------------------------------------------
+void RangeAllocator::SizeClass(unsigned int size, unsigned int& sizeClass, unsigned int& subClass)
+{
+	if (size < SmallSize)
+	{
+		sizeClass = 0;
+		subClass = size;
+		return;
+	}
+
+	unsigned int highestBit = HighestBit(size);
+	sizeClass = highestBit - SubClassBits + 1;
+	subClass = (size >> (highestBit - SubClassBits)) ^ SubClasses;
+}
+
+unsigned int RangeAllocator::NewNode()
+{
+	unsigned int node;
+	if (!unusedNodes.empty())
+	{
+		node = unusedNodes.back();
+		unusedNodes.pop_back();
+	}
+	else
+	{
+		node = (unsigned int)nodes.size();
+		nodes.emplace_back();
+	}
+
+	Node& n = nodes[node];
+	n.offset = 0;
+	n.size = 0;
+	n.previous = None;
+	n.next = None;
+	n.previousFree = None;
+	n.nextFree = None;
+	n.free = false;
+	return node;
+}
+
+void RangeAllocator::InsertFree(unsigned int node)
+{
+	unsigned int sizeClass, subClass;
+	SizeClass(nodes[node].size, sizeClass, subClass);
+
+	unsigned int head = freeLists[sizeClass][subClass];
+	nodes[node].free = true;
+	nodes[node].previousFree = None;
+	nodes[node].nextFree = head;
+	if (head != None)
+		nodes[head].previousFree = node;
+	freeLists[sizeClass][subClass] = node;
+
+	classBitmap |= 1u << sizeClass;
+	subClassBitmaps[sizeClass] |= 1u << subClass;
+	freeRangeCount++;
+}
+
+void RangeAllocator::RemoveFree(unsigned int node)
+{
+	unsigned int sizeClass, subClass;
+	SizeClass(nodes[node].size, sizeClass, subClass);
+
+	Node& n = nodes[node];
+	if (n.previousFree != None)
+		nodes[n.previousFree].nextFree = n.nextFree;
+	else
+		freeLists[sizeClass][subClass] = n.nextFree;
+	if (n.nextFree != None)
+		nodes[n.nextFree].previousFree = n.previousFree;
+
+	// Last one in its list?
+	if (freeLists[sizeClass][subClass] == None)
+	{
+		subClassBitmaps[sizeClass] &= ~(1u << subClass);
+		if (subClassBitmaps[sizeClass] == 0)
+			classBitmap &= ~(1u << sizeClass);
+	}
+
+	n.free = false;
+	n.previousFree = None;
+	n.nextFree = None;
+	freeRangeCount--;
+}
+
+// --------------------------------------------------------
+// Finds a free range of at least size units.  The size is
+// rounded up to the next list boundary first, so whatever
+// is at the head of the list found is big enough - no
+// searching along the list.
+// --------------------------------------------------------
+unsigned int RangeAllocator::FindFree(unsigned int size) const
+{
+	size = GetFitSize(size);
+	if (size == 0)
+		return None;
+
+	unsigned int sizeClass, subClass;
+	SizeClass(size, sizeClass, subClass);
+
+	// Anything at least this big in the same class?
+	unsigned int subClasses = subClassBitmaps[sizeClass] & (~0u << subClass);
+	if (subClasses == 0)
+	{
+		// No - take the smallest list of any larger class
+		unsigned int classes = sizeClass + 1 < 32 ? classBitmap & (~0u << (sizeClass + 1)) : 0;
+		if (classes == 0)
+			return None;
+
+		sizeClass = LowestBit(classes);
+		subClasses = subClassBitmaps[sizeClass];
+	}
+
+	return freeLists[sizeClass][LowestBit(subClasses)];
+}
+
+// --------------------------------------------------------
+// Folds next (which must directly follow node) into node
+// --------------------------------------------------------
+void RangeAllocator::Merge(unsigned int node, unsigned int next)
+{
+	nodes[node].size += nodes[next].size;
+	nodes[node].next = nodes[next].next;
+	if (nodes[next].next != None)
+		nodes[nodes[next].next].previous = node;
+
+	unusedNodes.push_back(next);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// Where a RangeAllocator put something.  node is needed to
+// free it again.
+// --------------------------------------------------------
+struct RangeAllocation
+{
+	static const unsigned int InvalidOffset = 0xFFFFFFFF;
+
+	unsigned int offset = InvalidOffset;
+	unsigned int node = InvalidOffset;
+
+	bool IsValid() const { return offset != InvalidOffset; }
+};
+
+// --------------------------------------------------------
+// Hands out variable-sized ranges of [0, capacity), in
+// whatever units the caller likes (vertices, indices...).
+// Like RingAllocator it only does the bookkeeping, so it
+// has no Direct3D dependency and can be tested on its own.
+//
+// Two-level segregated fit (TLSF): free ranges are kept in
+// lists by size class, with a bitmap of which lists are
+// non-empty, so Allocate() and Free() are constant time.
+// Freed ranges merge with free neighbors straight away.
+//
+// Not thread-safe.
+// --------------------------------------------------------
+class RangeAllocator
+{
+public:
+	RangeAllocator(unsigned int capacity = 0);
+
+	// Forgets every allocation and starts over with a new size
+	void Reset(unsigned int capacity);
+
+	RangeAllocation Allocate(unsigned int size);
+	void Free(RangeAllocation allocation);
+
+	unsigned int GetCapacity() const { return capacity; }
+	unsigned int GetUsed() const { return used; }
+	unsigned int GetFree() const { return capacity - used; }
+	unsigned int GetFreeRangeCount() const { return freeRangeCount; }
+	unsigned int GetLargestFreeRange() const;
+
+	// 0 when all free space is one range, approaching 1 as
+	// it gets split into more, smaller ones
+	float GetFragmentation() const;
+
+	// --------------------------------------------------------
+	// The smallest free range Allocate(size) is sure to use.
+	// Free ranges are found by size class, so one of exactly
+	// size may be passed over - an allocator made to hold
+	// one thing needs this capacity.  0 if it would overflow.
+	// --------------------------------------------------------
+	static unsigned int GetFitSize(unsigned int size);
+
+private:
+	// Sizes below SmallSize each get their own list; above
+	// it, every power of two is split into SubClasses lists
+	static const unsigned int SubClassBits = 4;
+	static const unsigned int SubClasses = 1 << SubClassBits;
+	static const unsigned int SmallSize = SubClasses;
+	static const unsigned int Classes = 32 - SubClassBits + 1;
+
+	static const unsigned int None = 0xFFFFFFFF;
+
+	// A contiguous range, free or used.  Neighbors are in
+	// address order; free ranges are also in a size list.
+	struct Node
+	{
+		unsigned int offset;
+		unsigned int size;
+		unsigned int previous;
+		unsigned int next;
+		unsigned int previousFree;
+		unsigned int nextFree;
+		bool free;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<unsigned int> unusedNodes;
+
+	unsigned int classBitmap;
+	unsigned int subClassBitmaps[Classes];
+	unsigned int freeLists[Classes][SubClasses];
+
+	unsigned int capacity;
+	unsigned int used;
+	unsigned int freeRangeCount;
+
+	static void SizeClass(unsigned int size, unsigned int& sizeClass, unsigned int& subClass);
+
+	unsigned int NewNode();
+	void InsertFree(unsigned int node);
+	void RemoveFree(unsigned int node);
+	unsigned int FindFree(unsigned int size) const;
+	void Merge(unsigned int node, unsigned int next);
+};
@@ -0,0 +1,621 @@
+#include "RenderGraph.h"
+#include "CommandStream.h"
+
+#include <algorithm>
+
+bool RenderGraphTextureDesc::operator==(const RenderGraphTextureDesc& other) const
+{
+	return
+		width == other.width &&
+		height == other.height &&
+		format == other.format &&
+		shaderResourceFormat == other.shaderResourceFormat &&
+		renderTargetFormat == other.renderTargetFormat &&
+		depthStencilFormat == other.depthStencilFormat;
+}
+
+RenderGraph::RenderGraph()
+	: compiled(false)
+{
+}
+
+void RenderGraph::Clear()
+{
+	passes.clear();
+	resources.clear();
+	order.clear();
+	physicals.clear();
+	finalUnbinds.clear();
+	compiled = false;
+	error.clear();
+}
+
+RenderGraphResource RenderGraph::CreateTexture(const std::string& name, const RenderGraphTextureDesc& desc)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.desc = desc;
+	resource.physical = NoPhysical;
+	resources.push_back(resource);
+
+	compiled = false;
+	RenderGraphResource handle;
+	handle.index = (unsigned int)resources.size() - 1;
+	return handle;
+}
+
+RenderGraphResource RenderGraph::ImportTexture(const std::string& name)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.imported = true;
+	resource.physical = NoPhysical;
+	resources.push_back(resource);
+
+	compiled = false;
+	RenderGraphResource handle;
+	handle.index = (unsigned int)resources.size() - 1;
+	return handle;
+}
+
+void RenderGraph::MarkOutput(RenderGraphResource resource)
+{
+	resources[resource.index].output = true;
+	compiled = false;
+}
+
+unsigned int RenderGraph::AddPass(const std::string& name, RecordFunction record)
+{
+	Pass pass;
+	pass.name = name;
+	pass.record = record;
+	pass.sideEffects = false;
+	pass.parts = 1;
+	pass.culled = true;
+	passes.push_back(pass);
+
+	compiled = false;
+	return (unsigned int)passes.size() - 1;
+}
+
+void RenderGraph::AddRead(unsigned int pass, RenderGraphResource resource, ShaderStage stage, unsigned int slot)
+{
+	Read read;
+	read.resource = resource;
+	read.binding.stage = stage;
+	read.binding.slot = slot;
+	passes[pass].reads.push_back(read);
+	compiled = false;
+}
+
+void RenderGraph::AddWrite(unsigned int pass, RenderGraphResource resource, RenderGraphBindFlags usage, bool clear, const float clearColor[4], float clearDepth, bool clearStencil)
+{
+	Write write = {};
+	write.resource = resource;
+	write.usage = usage;
+	write.clear = clear;
+	if (clearColor)
+	{
+		for (int i = 0; i < 4; i++)
+			write.clearColor[i] = clearColor[i];
+	}
+	write.clearDepth = clearDepth;
+	write.clearStencil = clearStencil;
+	passes[pass].writes.push_back(write);
+	compiled = false;
+}
+
+void RenderGraph::AddRenderTarget(unsigned int pass, RenderGraphResource resource)
+{
+	AddWrite(pass, resource, RenderGraphRenderTarget, false, 0, 0.0f, false);
+}
+
+void RenderGraph::AddRenderTarget(unsigned int pass, RenderGraphResource resource, const float clearColor[4])
+{
+	AddWrite(pass, resource, RenderGraphRenderTarget, true, clearColor, 0.0f, false);
+}
+
+void RenderGraph::AddDepthStencil(unsigned int pass, RenderGraphResource resource)
+{
+	AddWrite(pass, resource, RenderGraphDepthStencil, false, 0, 0.0f, false);
+}
+
+void RenderGraph::AddDepthStencil(unsigned int pass, RenderGraphResource resource, float clearDepth, bool clearStencil)
+{
+	AddWrite(pass, resource, RenderGraphDepthStencil, true, 0, clearDepth, clearStencil);
+}
+
+void RenderGraph::SetSideEffects(unsigned int pass, bool sideEffects)
+{
+	passes[pass].sideEffects = sideEffects;
+	compiled = false;
+}
+
+void RenderGraph::SetPartCount(unsigned int pass, unsigned int parts)
+{
+	passes[pass].parts = parts > 0 ? parts : 1;
+}
+
+unsigned int RenderGraph::GetTransientCount() const
+{
+	unsigned int count = 0;
+	for (const Resource& resource : resources)
+	{
+		if (!resource.imported && resource.physical != NoPhysical)
+			count++;
+	}
+	return count;
+}
+
+void RenderGraph::EncodePassSetup(unsigned int pass, unsigned int part, const RenderGraphViews* views, CommandStream& stream) const
+{
+	const Pass& info = passes[pass];
+
+	void* nullView = 0;
+	for (const RenderGraphBinding& unbind : info.unbinds)
+		stream.SetResources(unbind.stage, unbind.slot, 1, &nullView);
+
+	if (!info.writes.empty())
+	{
+		void* targets[MaxRenderTargets] = {};
+		unsigned int targetCount = 0;
+		void* depthStencil = 0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+
+		for (const Write& write : info.writes)
+		{
+			const RenderGraphViews& written = views[write.resource.index];
+			if (write.usage == RenderGraphDepthStencil)
+				depthStencil = written.depthStencil;
+			else
+				targets[targetCount++] = written.renderTarget;
+
+			width = written.width;
+			height = written.height;
+		}
+
+		stream.SetRenderTargets(targetCount, targets, depthStencil);
+		stream.SetViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
+
+		if (part == 0)
+		{
+			for (const Write& write : info.writes)
+			{
+				if (!write.clear)
+					continue;
+
+				const RenderGraphViews& written = views[write.resource.index];
+				if (write.usage == RenderGraphDepthStencil)
+				{
+					unsigned int flags = ClearDepthStencilCommand::Depth;
+					if (write.clearStencil)
+						flags |= ClearDepthStencilCommand::Stencil;
+					stream.ClearDepthStencil(written.depthStencil, flags, write.clearDepth, 0);
+				}
+				else
+					stream.ClearRenderTarget(written.renderTarget, write.clearColor);
+			}
+		}
+	}
+
+	for (const Read& read : info.reads)
+	{
+		void* view = views[read.resource.index].shaderResource;
+		stream.SetResources(read.binding.stage, read.binding.slot, 1, &view);
+	}
+}
+
+void RenderGraph::EncodeFinalUnbinds(CommandStream& stream) const
+{
+	void* nullView = 0;
+	for (const RenderGraphBinding& unbind : finalUnbinds)
+		stream.SetResources(unbind.stage, unbind.slot, 1, &nullView);
+}
+
+bool RenderGraph::Fail(const std::string& message)
+{
+	error = message;
+	order.clear();
+	physicals.clear();
+	finalUnbinds.clear();
+	return false;
+}
+
+// --------------------------------------------------------
+// Checks the declarations, then works out - in this order -
+// which passes run, their order, which transients share a
+// texture, and where shader resources get unbound
+// --------------------------------------------------------
+bool RenderGraph::Compile()
+{
+	compiled = false;
+	error.clear();
+	order.clear();
+	physicals.clear();
+	finalUnbinds.clear();
+
+	for (Pass& pass : passes)
+	{
+		pass.culled = true;
+		pass.unbinds.clear();
+	}
+
+	for (Resource& resource : resources)
+	{
+		resource.bindFlags = 0;
+		resource.physical = NoPhysical;
+		resource.firstUse = 0;
+		resource.lastUse = 0;
+	}
+
+	// Every transient that's read has to be written somewhere
+	std::vector<bool> written(resources.size(), false);
+
+	for (Pass& pass : passes)
+	{
+		unsigned int renderTargets = 0;
+		unsigned int depthStencils = 0;
+
+		for (size_t w = 0; w < pass.writes.size(); w++)
+		{
+			unsigned int resource = pass.writes[w].resource.index;
+			if (resource >= resources.size())
+				return Fail(pass.name + " writes a resource that doesn't exist");
+
+			for (size_t other = 0; other < w; other++)
+			{
+				if (pass.writes[other].resource.index == resource)
+					return Fail(pass.name + " writes " + resources[resource].name + " twice");
+			}
+
+			if (pass.writes[w].usage == RenderGraphDepthStencil)
+				depthStencils++;
+			else
+				renderTargets++;
+
+			written[resource] = true;
+		}
+
+		if (renderTargets > MaxRenderTargets)
+			return Fail(pass.name + " writes too many render targets");
+		if (depthStencils > 1)
+			return Fail(pass.name + " writes more than one depth buffer");
+
+		for (const Read& read : pass.reads)
+		{
+			unsigned int resource = read.resource.index;
+			if (resource >= resources.size())
+				return Fail(pass.name + " reads a resource that doesn't exist");
+
+			for (const Write& write : pass.writes)
+			{
+				if (write.resource.index == resource)
+					return Fail(pass.name + " reads " + resources[resource].name + ", which it writes");
+			}
+		}
+	}
+
+	for (const Pass& pass : passes)
+	{
+		for (const Read& read : pass.reads)
+		{
+			const Resource& resource = resources[read.resource.index];
+			if (!resource.imported && !written[read.resource.index])
+				return Fail(pass.name + " reads " + resource.name + ", which nothing writes");
+		}
+	}
+
+	Cull();
+	if (!Sort())
+		return false;
+	Alias();
+	PlaceUnbinds();
+
+	compiled = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// Starts from the passes whose work is seen outside the
+// graph, and keeps adding the passes they need until
+// nothing changes
+// --------------------------------------------------------
+void RenderGraph::Cull()
+{
+	std::vector<bool> needed(resources.size(), false);
+
+	for (Pass& pass : passes)
+	{
+		if (pass.sideEffects)
+			pass.culled = false;
+
+		for (const Write& write : pass.writes)
+		{
+			if (resources[write.resource.index].output)
+				pass.culled = false;
+		}
+	}
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		for (size_t p = 0; p < passes.size(); p++)
+		{
+			Pass& pass = passes[p];
+
+			if (pass.culled)
+			{
+				// Writes something a running pass needs
+				for (const Write& write : pass.writes)
+				{
+					if (needed[write.resource.index])
+					{
+						pass.culled = false;
+						changed = true;
+						break;
+					}
+				}
+				continue;
+			}
+
+			for (const Read& read : pass.reads)
+			{
+				if (!needed[read.resource.index])
+				{
+					needed[read.resource.index] = true;
+					changed = true;
+				}
+			}
+
+			// Drawing over a texture without clearing it keeps
+			// whatever earlier writers drew
+			for (const Write& write : pass.writes)
+			{
+				if (write.clear)
+					continue;
+
+				for (size_t earlier = 0; earlier < p; earlier++)
+				{
+					if (!passes[earlier].culled)
+						continue;
+
+					for (const Write& earlierWrite : passes[earlier].writes)
+					{
+						if (earlierWrite.resource.index == write.resource.index)
+						{
+							passes[earlier].culled = false;
+							changed = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Orders the running passes so every writer of a resource
+// runs before its readers, and writers run in the order
+// they were added.  Of the passes that are free to run next,
+// the one added first goes, so a graph that's declared in a
+// working order keeps it.
+// --------------------------------------------------------
+bool RenderGraph::Sort()
+{
+	unsigned int passCount = (unsigned int)passes.size();
+	std::vector<std::vector<unsigned int>> after(passCount);
+	std::vector<unsigned int> waitingOn(passCount, 0);
+
+	// Each resource's running writers and readers, in declaration order
+	std::vector<std::vector<unsigned int>> writers(resources.size());
+	std::vector<std::vector<unsigned int>> readers(resources.size());
+	unsigned int running = 0;
+
+	for (unsigned int p = 0; p < passCount; p++)
+	{
+		if (passes[p].culled)
+			continue;
+
+		running++;
+		for (const Write& write : passes[p].writes)
+			writers[write.resource.index].push_back(p);
+		for (const Read& read : passes[p].reads)
+		{
+			// A pass reading through two slots only waits once
+			std::vector<unsigned int>& resourceReaders = readers[read.resource.index];
+			if (resourceReaders.empty() || resourceReaders.back() != p)
+				resourceReaders.push_back(p);
+		}
+	}
+
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		for (size_t w = 0; w < writers[r].size(); w++)
+		{
+			if (w + 1 < writers[r].size())
+			{
+				after[writers[r][w]].push_back(writers[r][w + 1]);
+				waitingOn[writers[r][w + 1]]++;
+			}
+
+			for (unsigned int reader : readers[r])
+			{
+				after[writers[r][w]].push_back(reader);
+				waitingOn[reader]++;
+			}
+		}
+	}
+
+	std::vector<bool> placed(passCount, false);
+	while (order.size() < running)
+	{
+		unsigned int next = passCount;
+		for (unsigned int p = 0; p < passCount; p++)
+		{
+			if (!passes[p].culled && !placed[p] && waitingOn[p] == 0)
+			{
+				next = p;
+				break;
+			}
+		}
+
+		if (next == passCount)
+			return Fail("Passes need each other's writes before they can run");
+
+		placed[next] = true;
+		order.push_back(next);
+		for (unsigned int following : after[next])
+			waitingOn[following]--;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Works out each transient's lifetime over the order, then
+// gives it the first texture with a matching desc that's
+// free by then.  Transients are placed by when they're first
+// used, so a texture is reused as soon as it's free.
+// --------------------------------------------------------
+void RenderGraph::Alias()
+{
+	std::vector<bool> used(resources.size(), false);
+
+	for (unsigned int position = 0; position < order.size(); position++)
+	{
+		const Pass& pass = passes[order[position]];
+
+		auto use = [&](unsigned int index, unsigned int flag)
+		{
+			Resource& resource = resources[index];
+			if (!used[index])
+			{
+				used[index] = true;
+				resource.firstUse = position;
+			}
+			resource.lastUse = position;
+			resource.bindFlags |= flag;
+		};
+
+		for (const Write& write : pass.writes)
+			use(write.resource.index, write.usage);
+		for (const Read& read : pass.reads)
+			use(read.resource.index, RenderGraphShaderResource);
+	}
+
+	std::vector<unsigned int> transients;
+	for (unsigned int r = 0; r < resources.size(); r++)
+	{
+		if (!used[r] || resources[r].imported)
+			continue;
+
+		// Outputs are read after the graph, so nothing can follow them
+		if (resources[r].output)
+			resources[r].lastUse = (unsigned int)order.size();
+
+		transients.push_back(r);
+	}
+
+	std::stable_sort(transients.begin(), transients.end(), [&](unsigned int a, unsigned int b)
+	{
+		return resources[a].firstUse < resources[b].firstUse;
+	});
+
+	std::vector<unsigned int> physicalLastUse;
+	for (unsigned int r : transients)
+	{
+		Resource& resource = resources[r];
+
+		unsigned int chosen = NoPhysical;
+		for (unsigned int p = 0; p < physicals.size(); p++)
+		{
+			if (physicalLastUse[p] < resource.firstUse && physicals[p].desc == resource.desc)
+			{
+				chosen = p;
+				break;
+			}
+		}
+
+		if (chosen == NoPhysical)
+		{
+			Physical physical;
+			physical.desc = resource.desc;
+			physical.bindFlags = 0;
+			physicals.push_back(physical);
+			physicalLastUse.push_back(0);
+			chosen = (unsigned int)physicals.size() - 1;
+		}
+
+		physicals[chosen].bindFlags |= resource.bindFlags;
+		physicalLastUse[chosen] = resource.lastUse;
+		resource.physical = chosen;
+	}
+}
+
+// --------------------------------------------------------
+// Follows what's bound as a shader resource through the
+// order.  Bindings are tracked by the texture underneath,
+// so a pass writing a transient also unbinds another one
+// sharing its texture.
+// --------------------------------------------------------
+void RenderGraph::PlaceUnbinds()
+{
+	struct BoundRead
+	{
+		RenderGraphBinding binding;
+		unsigned int texture;
+	};
+
+	// Imported resources are numbered after the physicals
+	auto textureOf = [&](unsigned int index)
+	{
+		const Resource& resource = resources[index];
+		return resource.imported ? (unsigned int)physicals.size() + index : resource.physical;
+	};
+
+	std::vector<BoundRead> bound;
+	for (unsigned int p : order)
+	{
+		Pass& pass = passes[p];
+
+		for (const Write& write : pass.writes)
+		{
+			unsigned int texture = textureOf(write.resource.index);
+			for (size_t b = 0; b < bound.size();)
+			{
+				if (bound[b].texture == texture)
+				{
+					pass.unbinds.push_back(bound[b].binding);
+					bound.erase(bound.begin() + b);
+				}
+				else
+					b++;
+			}
+		}
+
+		for (const Read& read : pass.reads)
+		{
+			// Binding over a slot replaces what was there
+			for (size_t b = 0; b < bound.size(); b++)
+			{
+				if (bound[b].binding.stage == read.binding.stage && bound[b].binding.slot == read.binding.slot)
+				{
+					bound.erase(bound.begin() + b);
+					break;
+				}
+			}
+
+			BoundRead boundRead;
+			boundRead.binding = read.binding;
+			boundRead.texture = textureOf(read.resource.index);
+			bound.push_back(boundRead);
+		}
+	}
+
+	for (const BoundRead& boundRead : bound)
+		finalUnbinds.push_back(boundRead.binding);
+}
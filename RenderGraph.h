@@ -0,0 +1,229 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ShaderStage.h"
+
+class CommandStream;
+class RenderContext;
+
+// --------------------------------------------------------
+// How a pass uses a texture, and so which views it needs
+// --------------------------------------------------------
+enum RenderGraphBindFlags : unsigned int
+{
+	RenderGraphShaderResource = 1,
+	RenderGraphRenderTarget = 2,
+	RenderGraphDepthStencil = 4,
+};
+
+// --------------------------------------------------------
+// A texture the graph owns.  Formats are the API's raw
+// values; a view format of 0 means the texture's own, so a
+// typeless texture can have typed views.
+// --------------------------------------------------------
+struct RenderGraphTextureDesc
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int format = 0;
+	unsigned int shaderResourceFormat = 0;
+	unsigned int renderTargetFormat = 0;
+	unsigned int depthStencilFormat = 0;
+
+	bool operator==(const RenderGraphTextureDesc& other) const;
+};
+
+struct RenderGraphResource
+{
+	static const unsigned int InvalidIndex = 0xFFFFFFFF;
+
+	unsigned int index = InvalidIndex;
+
+	bool IsValid() const { return index != InvalidIndex; }
+};
+
+// --------------------------------------------------------
+// A texture's views for a frame, as the API's objects.
+// Whatever runs the graph has one for every resource.
+// --------------------------------------------------------
+struct RenderGraphViews
+{
+	void* renderTarget = 0;
+	void* depthStencil = 0;
+	void* shaderResource = 0;
+	unsigned int width = 0;
+	unsigned int height = 0;
+};
+
+// A shader resource slot, which the graph binds a read into
+struct RenderGraphBinding
+{
+	ShaderStage stage;
+	unsigned int slot;
+};
+
+// --------------------------------------------------------
+// The frame's passes and the textures they pass between
+// them.  Passes only say what they read and write - the
+// graph works out the rest when it's compiled:
+//
+//  - Order.  Every pass that writes a texture runs before
+//    every pass that reads it, and writers keep the order
+//    they were added in.  Otherwise passes stay in the order
+//    they were added.
+//  - Culling.  A pass runs only if it has side effects, or
+//    writes an output or something a running pass reads.
+//    A running pass that writes without clearing keeps the
+//    texture's earlier writers running too.
+//  - Aliasing.  Textures the graph owns (transients) share
+//    one texture when their descs match and their lifetimes
+//    don't overlap, so a pass whose texture is only used
+//    inside it doesn't add a texture of its own.
+//  - Unbinds.  A pass that writes a texture still bound as a
+//    shader resource - as another transient sharing it, too -
+//    first unbinds it, and whatever is still bound at the end
+//    is unbound then.
+//
+// Since all of a texture's writes come before its reads, a
+// texture that's written again after being read needs to be
+// a second resource.  Reading a texture in a pass that writes
+// it fails to compile, as do passes that need each other's
+// writes first.
+//
+// Compile() only works with the declarations, not with any
+// GPU objects, so it can be run and checked without a GPU -
+// as can what it encodes around each pass, given some views.
+// RenderGraphExecutor makes the textures and runs the passes.
+// --------------------------------------------------------
+class RenderGraph
+{
+public:
+	static const unsigned int MaxRenderTargets = 8;
+
+	// Records the pass, or the given part of it, into the context.
+	// The graph has already set its targets, viewport and reads.
+	typedef std::function<void(unsigned int part, RenderContext& context)> RecordFunction;
+
+	struct Read
+	{
+		RenderGraphResource resource;
+		RenderGraphBinding binding;
+	};
+
+	struct Write
+	{
+		RenderGraphResource resource;
+		RenderGraphBindFlags usage;	// RenderTarget or DepthStencil
+		bool clear;
+		float clearColor[4];
+		float clearDepth;
+		bool clearStencil;		// To 0, with the depth
+	};
+
+	struct Pass
+	{
+		std::string name;
+		RecordFunction record;
+		std::vector<Read> reads;
+		std::vector<Write> writes;
+		bool sideEffects;
+		unsigned int parts;
+
+		// From Compile()
+		bool culled;
+		std::vector<RenderGraphBinding> unbinds;	// Before the pass
+	};
+
+	struct Resource
+	{
+		std::string name;
+		bool imported;
+		bool output;
+		RenderGraphTextureDesc desc;	// Transients only
+
+		// From Compile()
+		unsigned int bindFlags;
+		unsigned int physical;		// Transients' shared texture, or NoPhysical
+		unsigned int firstUse;		// Position in the order
+		unsigned int lastUse;
+	};
+
+	struct Physical
+	{
+		RenderGraphTextureDesc desc;
+		unsigned int bindFlags;		// Everything its transients are used as
+	};
+
+	static const unsigned int NoPhysical = 0xFFFFFFFF;
+
+	RenderGraph();
+
+	// Forgets every pass and resource
+	void Clear();
+
+	// Textures
+	RenderGraphResource CreateTexture(const std::string& name, const RenderGraphTextureDesc& desc);
+	RenderGraphResource ImportTexture(const std::string& name);
+	void MarkOutput(RenderGraphResource resource);
+
+	// Passes, by index
+	unsigned int AddPass(const std::string& name, RecordFunction record);
+	void AddRead(unsigned int pass, RenderGraphResource resource, ShaderStage stage, unsigned int slot);
+	void AddRenderTarget(unsigned int pass, RenderGraphResource resource);
+	void AddRenderTarget(unsigned int pass, RenderGraphResource resource, const float clearColor[4]);
+	void AddDepthStencil(unsigned int pass, RenderGraphResource resource);
+	void AddDepthStencil(unsigned int pass, RenderGraphResource resource, float clearDepth, bool clearStencil = false);
+	void SetSideEffects(unsigned int pass, bool sideEffects = true);
+
+	// How many contexts a pass can be recorded into at once.  Can
+	// change between frames without compiling again.
+	void SetPartCount(unsigned int pass, unsigned int parts);
+
+	// Orders, culls, aliases and places unbinds.  False (with the
+	// reason in GetError()) if the declarations don't make sense.
+	bool Compile();
+	bool IsCompiled() const { return compiled; }
+	const std::string& GetError() const { return error; }
+
+	// Declarations, and what Compile() made of them
+	const Pass& GetPass(unsigned int pass) const { return passes[pass]; }
+	const Resource& GetResource(RenderGraphResource resource) const { return resources[resource.index]; }
+	unsigned int GetPassCount() const { return (unsigned int)passes.size(); }
+	unsigned int GetResourceCount() const { return (unsigned int)resources.size(); }
+	const std::vector<unsigned int>& GetOrder() const { return order; }	// Running passes only
+	const std::vector<Physical>& GetPhysicals() const { return physicals; }
+	const std::vector<RenderGraphBinding>& GetFinalUnbinds() const { return finalUnbinds; }
+	unsigned int GetCulledCount() const { return (unsigned int)(passes.size() - order.size()); }
+	unsigned int GetTransientCount() const;
+
+	// --------------------------------------------------------
+	// Encodes what comes before a pass's record function: its
+	// unbinds, its targets and a viewport covering them, its
+	// clears and its reads.  Only the first part clears, since
+	// the parts run in order into the same targets.  views has
+	// one entry per resource.
+	// --------------------------------------------------------
+	void EncodePassSetup(unsigned int pass, unsigned int part, const RenderGraphViews* views, CommandStream& stream) const;
+
+	// Encodes unbinding whatever reads are still bound after the last pass
+	void EncodeFinalUnbinds(CommandStream& stream) const;
+
+private:
+	std::vector<Pass> passes;
+	std::vector<Resource> resources;
+	std::vector<unsigned int> order;
+	std::vector<Physical> physicals;
+	std::vector<RenderGraphBinding> finalUnbinds;
+	bool compiled;
+	std::string error;
+
+	bool Fail(const std::string& message);
+	void AddWrite(unsigned int pass, RenderGraphResource resource, RenderGraphBindFlags usage, bool clear, const float clearColor[4], float clearDepth, bool clearStencil);
+	void Cull();
+	bool Sort();
+	void Alias();
+	void PlaceUnbinds();
+};
@@ -0,0 +1,164 @@
+#include "RenderGraphExecutor.h"
+#include "FrameArena.h"
+
+RenderGraphExecutor::RenderGraphExecutor(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device)
+{
+}
+
+void RenderGraphExecutor::SetImported(RenderGraphResource resource, ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil,
+	ID3D11ShaderResourceView* shaderResource, unsigned int width, unsigned int height)
+{
+	if (resource.index >= imported.size())
+		imported.resize(resource.index + 1, RenderGraphViews());
+
+	RenderGraphViews& importedViews = imported[resource.index];
+	importedViews.renderTarget = renderTarget;
+	importedViews.depthStencil = depthStencil;
+	importedViews.shaderResource = shaderResource;
+	importedViews.width = width;
+	importedViews.height = height;
+}
+
+// --------------------------------------------------------
+// Makes (or remakes) any physical texture that doesn't match
+// what the graph asks for now.  Ones that do are kept, so
+// compiling the same graph again doesn't make anything.
+// --------------------------------------------------------
+void RenderGraphExecutor::CreateTextures(const RenderGraph& graph)
+{
+	const std::vector<RenderGraph::Physical>& physicals = graph.GetPhysicals();
+	textures.resize(physicals.size());
+
+	for (size_t i = 0; i < physicals.size(); i++)
+	{
+		const RenderGraph::Physical& physical = physicals[i];
+		Texture& texture = textures[i];
+		if (texture.texture && texture.desc == physical.desc && texture.bindFlags == physical.bindFlags)
+			continue;
+
+		texture = Texture();
+		texture.desc = physical.desc;
+		texture.bindFlags = physical.bindFlags;
+
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = physical.desc.width;
+		desc.Height = physical.desc.height;
+		desc.ArraySize = 1;
+		desc.MipLevels = 1;
+		desc.Format = (DXGI_FORMAT)physical.desc.format;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		if (physical.bindFlags & RenderGraphShaderResource) desc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+		if (physical.bindFlags & RenderGraphRenderTarget) desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+		if (physical.bindFlags & RenderGraphDepthStencil) desc.BindFlags |= D3D11_BIND_DEPTH_STENCIL;
+		if (FAILED(device->CreateTexture2D(&desc, 0, texture.texture.GetAddressOf())))
+			continue;
+
+		// A view format of 0 is the texture's own
+		if (physical.bindFlags & RenderGraphShaderResource)
+		{
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.Format = (DXGI_FORMAT)(physical.desc.shaderResourceFormat ? physical.desc.shaderResourceFormat : physical.desc.format);
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			srvDesc.Texture2D.MipLevels = 1;
+			device->CreateShaderResourceView(texture.texture.Get(), &srvDesc, texture.shaderResource.GetAddressOf());
+		}
+
+		if (physical.bindFlags & RenderGraphRenderTarget)
+		{
+			D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+			rtvDesc.Format = (DXGI_FORMAT)(physical.desc.renderTargetFormat ? physical.desc.renderTargetFormat : physical.desc.format);
+			rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+			device->CreateRenderTargetView(texture.texture.Get(), &rtvDesc, texture.renderTarget.GetAddressOf());
+		}
+
+		if (physical.bindFlags & RenderGraphDepthStencil)
+		{
+			D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+			dsvDesc.Format = (DXGI_FORMAT)(physical.desc.depthStencilFormat ? physical.desc.depthStencilFormat : physical.desc.format);
+			dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+			device->CreateDepthStencilView(texture.texture.Get(), &dsvDesc, texture.depthStencil.GetAddressOf());
+		}
+	}
+}
+
+RenderGraphViews RenderGraphExecutor::GetViews(const RenderGraph& graph, RenderGraphResource resource)
+{
+	const RenderGraph::Resource& info = graph.GetResource(resource);
+	if (info.imported)
+		return resource.index < imported.size() ? imported[resource.index] : RenderGraphViews();
+
+	RenderGraphViews textureViews;
+	if (info.physical < textures.size())
+	{
+		Texture& texture = textures[info.physical];
+		textureViews.renderTarget = texture.renderTarget.Get();
+		textureViews.depthStencil = texture.depthStencil.Get();
+		textureViews.shaderResource = texture.shaderResource.Get();
+		textureViews.width = texture.desc.width;
+		textureViews.height = texture.desc.height;
+	}
+	return textureViews;
+}
+
+// Everything the graph sets up for a pass, then the pass
+void RenderGraphExecutor::RecordPass(const RenderGraph& graph, unsigned int pass, unsigned int part, RenderContext& context)
+{
+	graph.EncodePassSetup(pass, part, views.data(), context.GetStream());
+
+	const RenderGraph::Pass& info = graph.GetPass(pass);
+	if (info.record)
+		info.record(part, context);
+}
+
+unsigned int RenderGraphExecutor::Execute(const RenderGraph& graph, RenderContext& immediate, CommandRecorder* recorder)
+{
+	if (!graph.IsCompiled())
+		return 0;
+
+	CreateTextures(graph);
+
+	// Looked up by every pass, maybe on several threads at once
+	views.resize(graph.GetResourceCount());
+	for (unsigned int i = 0; i < graph.GetResourceCount(); i++)
+	{
+		RenderGraphResource resource;
+		resource.index = i;
+		views[i] = GetViews(graph, resource);
+	}
+
+	// Pass and part, in order
+	FrameVector<std::pair<unsigned int, unsigned int>> work;
+	for (unsigned int pass : graph.GetOrder())
+	{
+		for (unsigned int part = 0; part < graph.GetPass(pass).parts; part++)
+			work.push_back(std::make_pair(pass, part));
+	}
+
+	unsigned int listCount = 0;
+	if (recorder && work.size() > 1 && work.size() <= recorder->GetContextCount())
+	{
+		recorder->Record((unsigned int)work.size(), [&](unsigned int list, RenderContext& context)
+		{
+			RecordPass(graph, work[list].first, work[list].second, context);
+		});
+
+		// Whatever the caller encoded first has to run before the lists
+		immediate.Submit();
+		recorder->Execute(immediate.GetStateCache());
+		immediate.ResetPipelineState();
+		listCount = (unsigned int)work.size();
+	}
+	else
+	{
+		for (const std::pair<unsigned int, unsigned int>& item : work)
+			RecordPass(graph, item.first, item.second, immediate);
+	}
+
+	// The lists leave the immediate context cleared, but a frame
+	// recorded on it still has reads bound
+	graph.EncodeFinalUnbinds(immediate.GetStream());
+
+	return listCount;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <utility>
+#include <vector>
+
+#include "CommandRecorder.h"
+#include "RenderGraph.h"
+
+// --------------------------------------------------------
+// Runs a compiled RenderGraph on Direct3D 11.
+//
+// Each of the graph's physical textures is made here, with
+// the views its transients are used through, and kept for
+// as long as later compiles still ask for one like it.
+// Direct3D 11 can't place two resources in the same memory,
+// so aliasing is at the texture level: transients whose
+// lifetimes don't overlap are the same texture.
+//
+// Before recording a pass, the executor has the graph encode
+// its unbinds, targets and a viewport covering them, clears
+// and reads (see RenderGraph::EncodePassSetup) - passes only
+// draw.
+// --------------------------------------------------------
+class RenderGraphExecutor
+{
+public:
+	RenderGraphExecutor(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// --------------------------------------------------------
+	// Views of an imported texture, for this frame.  They aren't
+	// held on to - the swap chain's have to be released before
+	// it can resize - so they're set again every frame.
+	// --------------------------------------------------------
+	void SetImported(RenderGraphResource resource, ID3D11RenderTargetView* renderTarget, ID3D11DepthStencilView* depthStencil,
+		ID3D11ShaderResourceView* shaderResource, unsigned int width, unsigned int height);
+
+	// --------------------------------------------------------
+	// Encodes every running pass, in order, into immediate - or,
+	// given a recorder with a context for every part of every
+	// pass, records each part in parallel and executes the
+	// lists after submitting what immediate already holds.
+	// Either way the final unbinds end up in immediate's stream,
+	// which is left for the caller to submit.
+	//
+	// Returns the number of command lists recorded.
+	// --------------------------------------------------------
+	unsigned int Execute(const RenderGraph& graph, RenderContext& immediate, CommandRecorder* recorder);
+
+	// Only on the thread that calls Execute, which resizes them
+	unsigned int GetTextureCount() { return (unsigned int)textures.size(); }
+
+private:
+	// A physical texture, and the desc it was made for
+	struct Texture
+	{
+		RenderGraphTextureDesc desc;
+		unsigned int bindFlags;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> renderTarget;
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthStencil;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shaderResource;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::vector<Texture> textures;			// By physical index
+	std::vector<RenderGraphViews> imported;	// By resource index
+	std::vector<RenderGraphViews> views;	// Every resource's, for the Execute in progress
+
+	void CreateTextures(const RenderGraph& graph);
+	RenderGraphViews GetViews(const RenderGraph& graph, RenderGraphResource resource);
+	void RecordPass(const RenderGraph& graph, unsigned int pass, unsigned int part, RenderContext& context);
+};
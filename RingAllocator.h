@@ -0,0 +1,150 @@
+#pragma once
+
+// --------------------------------------------------------
+// Hands out space in a circular buffer, frame by frame.
+// It only does the bookkeeping (offsets, not memory), so it
+// has no Direct3D dependency and can be tested on its own.
+//
+// Allocations made between two FinishFrame() calls belong
+// to that frame.  Once the GPU is done with the oldest
+// frame, RetireOldestFrame() gives its space back.
+// --------------------------------------------------------
+class RingAllocator
+{
+public:
+	static const unsigned int InvalidOffset = 0xFFFFFFFF;
+	static const unsigned int MaxFrames = 8;	// Frames that can be unretired at once
+
+	RingAllocator(unsigned int capacity = 0, unsigned int alignment = 256)
+	{
+		Reset(capacity, alignment);
+	}
+
+	// Starts over with a new size.  alignment must be a power of two.
+	void Reset(unsigned int capacity, unsigned int alignment)
+	{
+		this->capacity = capacity;
+		this->alignment = alignment;
+		Clear();
+	}
+
+	// Forgets every allocation and frame at once
+	void Clear()
+	{
+		head = 0;
+		tail = 0;
+		used = 0;
+		frameBytes = 0;
+		firstFrame = 0;
+		frameCount = 0;
+	}
+
+	// --------------------------------------------------------
+	// Returns the offset of size bytes (rounded up to the
+	// alignment), or InvalidOffset if there isn't room.
+	// An allocation never wraps - if it doesn't fit before the
+	// end, the rest of the buffer is skipped and it starts at 0.
+	// --------------------------------------------------------
+	unsigned int Allocate(unsigned int size)
+	{
+		unsigned int alignedSize = (size + alignment - 1) & ~(alignment - 1);
+		if (alignedSize == 0 || alignedSize > capacity - used)
+			return InvalidOffset;
+
+		unsigned int offset;
+		if (head >= tail)
+		{
+			// Free space is [head, capacity) and [0, tail)
+			if (head + alignedSize <= capacity)
+			{
+				offset = head;
+			}
+			else if (alignedSize <= tail)
+			{
+				// Skip the end of the buffer - those bytes count
+				// as used until this frame is retired
+				unsigned int skipped = capacity - head;
+				used += skipped;
+				frameBytes += skipped;
+				offset = 0;
+			}
+			else
+			{
+				return InvalidOffset;
+			}
+		}
+		else
+		{
+			// Free space is [head, tail)
+			if (head + alignedSize > tail)
+				return InvalidOffset;
+
+			offset = head;
+		}
+
+		head = offset + alignedSize;
+		if (head == capacity)
+			head = 0;
+
+		used += alignedSize;
+		frameBytes += alignedSize;
+		return offset;
+	}
+
+	// --------------------------------------------------------
+	// Closes the current frame.  Returns false (and does
+	// nothing) if MaxFrames frames are already unretired.
+	// --------------------------------------------------------
+	bool FinishFrame()
+	{
+		if (frameCount == MaxFrames)
+			return false;
+
+		Frame& frame = frames[(firstFrame + frameCount) % MaxFrames];
+		frame.end = head;
+		frame.bytes = frameBytes;
+		frameCount++;
+
+		frameBytes = 0;
+		return true;
+	}
+
+	// --------------------------------------------------------
+	// Frees everything allocated in the oldest finished frame
+	// --------------------------------------------------------
+	void RetireOldestFrame()
+	{
+		if (frameCount == 0)
+			return;
+
+		Frame& frame = frames[firstFrame];
+		tail = frame.end;
+		used -= frame.bytes;
+
+		firstFrame = (firstFrame + 1) % MaxFrames;
+		frameCount--;
+	}
+
+	unsigned int GetCapacity() const { return capacity; }
+	unsigned int GetUsed() const { return used; }
+	unsigned int GetFramesInFlight() const { return frameCount; }
+
+private:
+	struct Frame
+	{
+		unsigned int end;	// head when the frame finished
+		unsigned int bytes;	// Bytes the frame used, including skipped ones
+	};
+
+	unsigned int capacity;
+	unsigned int alignment;
+
+	unsigned int head;		// Next free byte
+	unsigned int tail;		// Oldest byte still in use
+	unsigned int used;		// Bytes in use - tells full from empty when head == tail
+	unsigned int frameBytes;
+
+	Frame frames[MaxFrames];
+	unsigned int firstFrame;
+	unsigned int frameCount;
+};
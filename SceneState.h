@@ -0,0 +1,87 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include "Lights.h"
+#include "BufferStructs.h"
+#include "FrameArena.h"
+
+class Mesh;
+class Material;
+
+// --------------------------------------------------------
+// Render data for a single entity, copied out of the
+// simulation at the end of Update() so that drawing never
+// reads a Transform that is being changed
+// --------------------------------------------------------
+struct EntitySnapshot
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+	Mesh* mesh;				// Not owned - the Entity keeps the mesh alive
+	Material* material;		// Not owned - resolved from the entity's handle when the snapshot is taken
+	unsigned int materialIndex;	// The handle's pool index, for the object buffer
+	unsigned long long sortKey;	// See DrawKey - where it goes in the submission order
+};
+
+// --------------------------------------------------------
+// A material's parameters as of this frame, for its slot
+// in the MaterialTable
+// --------------------------------------------------------
+struct MaterialTableEntry
+{
+	unsigned int index;		// The material's pool index
+	MaterialData data;
+};
+
+// --------------------------------------------------------
+// Everything Draw() needs for one frame.  Update() fills
+// one of these in, and Draw() only ever reads from one.
+//
+// The lists are in the frame arena, which keeps them alive
+// until the Draw() reading them is done.  Their arena is
+// reset before this buffer is written again, so Game's
+// PublishFrame() swaps them for new ones first.
+// --------------------------------------------------------
+struct SceneSnapshot
+{
+	float deltaTime;
+	float totalTime;
+
+	//camera
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMFLOAT3 cameraPosition;
+
+	//lights
+	DirectX::XMFLOAT3 ambient;
+	Light directionalLight;		//the overhead light, which is also the shadow caster
+	DirectX::XMFLOAT4X4 shadowView;
+	DirectX::XMFLOAT4X4 shadowProjection;
+
+	//entities
+	FrameVector<EntitySnapshot> entities;
+	bool instancing;	//draw entities sharing a mesh and material together
+	bool parallelRecording;	//record the passes into deferred contexts on the job system
+	bool captureCommands;	//also play this frame's command streams on a logging null backend
+
+	//materials whose parameters changed during this Update - usually none
+	FrameVector<MaterialTableEntry> materialChanges;
+};
+
+// --------------------------------------------------------
+// Two copies of some state: one being written by Update()
+// and one being read by Draw().  Swap() must only be called
+// while nobody is reading or writing (DXCore::PublishFrame)
+// --------------------------------------------------------
+template <typename T>
+class DoubleBuffer
+{
+public:
+	T& GetWrite() { return buffers[writeIndex]; }
+	const T& GetRead() const { return buffers[writeIndex ^ 1]; }
+	void Swap() { writeIndex ^= 1; }
+
+private:
+	T buffers[2] = {};
+	int writeIndex = 0;
+};
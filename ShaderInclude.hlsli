@@ -12,6 +12,27 @@
 // - The name of the struct itself is unimportant
 // - The variable names don't have to match other shaders (just the semantics)
 // - Each variable must have a semantic, which defines its usage
+// One element of the per-frame object buffer (ObjectData in Vertex.h).  Vertex
+// shaders read it at the index in their OBJECTINDEX_PER_INSTANCE input, which is
+// the draw's first instance plus the instance - see InstanceBatcher
+struct ObjectData
+{
+	matrix world;
+	matrix worldInvTranspose;
+	uint materialIndex;
+	uint3 padding;
+};
+
+// One element of the material table (MaterialData in BufferStructs.h), at the
+// material's pool index - see MaterialTable
+struct MaterialData
+{
+	float4 colorTint;
+	float roughness;
+	float3 padding;
+	uint4 textureSlices;	// Slice of the texture array in t0, t1, t2 and t3
+};
+
 struct VertexToPixel
 {
 	// Data type
@@ -25,6 +46,7 @@ struct VertexToPixel
 	float3 worldPosition	: POSITION;		//world position
 	float3 tangent			: TANGENT;		//tangent to surface in u direction
 	float4 posForShadow		: SHADOWPOS;
+	nointerpolation uint materialIndex	: MATERIALINDEX;	//into Materials
 };
 
 struct Light
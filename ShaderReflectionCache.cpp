@@ -0,0 +1,276 @@
+#include "ShaderReflectionCache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+// --------------------------------------------------------
+// Appends little endian values to a byte array
+// --------------------------------------------------------
+struct ReflectionWriter
+{
+	std::vector<unsigned char>& bytes;
+
+	void U16(unsigned int value)
+	{
+		bytes.push_back((unsigned char)(value & 0xFF));
+		bytes.push_back((unsigned char)((value >> 8) & 0xFF));
+	}
+
+	void U32(unsigned int value)
+	{
+		for (int i = 0; i < 4; i++)
+			bytes.push_back((unsigned char)((value >> (i * 8)) & 0xFF));
+	}
+
+	void U64(unsigned long long value)
+	{
+		for (int i = 0; i < 8; i++)
+			bytes.push_back((unsigned char)((value >> (i * 8)) & 0xFF));
+	}
+
+	void String(const std::string& value)
+	{
+		// Names longer than this don't come out of the compiler
+		size_t length = value.size() > 0xFFFF ? 0xFFFF : value.size();
+		U16((unsigned int)length);
+		bytes.insert(bytes.end(), value.begin(), value.begin() + length);
+	}
+};
+
+// --------------------------------------------------------
+// Reads little endian values back, failing (for good) on
+// the first read past the end
+// --------------------------------------------------------
+struct ReflectionReader
+{
+	const unsigned char* bytes;
+	size_t byteCount;
+	size_t position;
+	bool failed;
+
+	bool Has(size_t count)
+	{
+		if (failed || byteCount - position < count)
+			failed = true;
+		return !failed;
+	}
+
+	unsigned int U16()
+	{
+		if (!Has(2)) return 0;
+		unsigned int value = bytes[position] | (bytes[position + 1] << 8);
+		position += 2;
+		return value;
+	}
+
+	unsigned int U32()
+	{
+		if (!Has(4)) return 0;
+		unsigned int value = 0;
+		for (int i = 0; i < 4; i++)
+			value |= (unsigned int)bytes[position + i] << (i * 8);
+		position += 4;
+		return value;
+	}
+
+	unsigned long long U64()
+	{
+		if (!Has(8)) return 0;
+		unsigned long long value = 0;
+		for (int i = 0; i < 8; i++)
+			value |= (unsigned long long)bytes[position + i] << (i * 8);
+		position += 8;
+		return value;
+	}
+
+	std::string String()
+	{
+		unsigned int length = U16();
+		if (!Has(length)) return std::string();
+		std::string value((const char*)bytes + position, length);
+		position += length;
+		return value;
+	}
+
+	// A count that can't possibly fit in what's left is corrupt -
+	// checked before resizing anything to it
+	unsigned int Count(size_t minRecordSize)
+	{
+		unsigned int count = U32();
+		if (!failed && count > (byteCount - position) / minRecordSize)
+			failed = true;
+		return failed ? 0 : count;
+	}
+};
+
+unsigned long long ShaderReflectionCache::HashBlob(const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::wstring ShaderReflectionCache::GetSidecarPath(const std::wstring& shaderFile)
+{
+	std::filesystem::path path(shaderFile);
+	path.replace_extension(L".refl");
+	return path.wstring();
+}
+
+// --------------------------------------------------------
+// Writes the reflection data out in the sidecar format
+// --------------------------------------------------------
+std::vector<unsigned char> ShaderReflectionCache::Serialize(const ShaderReflectionData& data, unsigned long long blobHash, unsigned long long blobSize)
+{
+	std::vector<unsigned char> bytes;
+	ReflectionWriter out = { bytes };
+
+	out.U32(Magic);
+	out.U32(Version);
+	out.U64(blobHash);
+	out.U64(blobSize);
+
+	out.U32((unsigned int)data.ConstantBuffers.size());
+	for (const ShaderReflectionData::ConstantBuffer& cb : data.ConstantBuffers)
+	{
+		out.String(cb.Name);
+		out.U32(cb.Type);
+		out.U32(cb.Size);
+		out.U32(cb.BindPoint);
+		out.U32((unsigned int)cb.Variables.size());
+		for (const ShaderReflectionData::Variable& var : cb.Variables)
+		{
+			out.String(var.Name);
+			out.U32(var.ByteOffset);
+			out.U32(var.Size);
+		}
+	}
+
+	out.U32((unsigned int)data.Resources.size());
+	for (const ShaderReflectionData::Resource& res : data.Resources)
+	{
+		out.String(res.Name);
+		out.U32(res.Type);
+		out.U32(res.BindPoint);
+	}
+
+	out.U32((unsigned int)data.InputParameters.size());
+	for (const ShaderReflectionData::InputParameter& param : data.InputParameters)
+	{
+		out.String(param.SemanticName);
+		out.U32(param.SemanticIndex);
+		out.U32(param.ComponentType);
+		out.U32(param.Mask);
+	}
+
+	for (int i = 0; i < 3; i++)
+		out.U32(data.ThreadGroupSize[i]);
+
+	return bytes;
+}
+
+// --------------------------------------------------------
+// Reads the sidecar format back.  Only fills in data if
+// everything checks out.
+// --------------------------------------------------------
+bool ShaderReflectionCache::Deserialize(const unsigned char* bytes, size_t byteCount, unsigned long long blobHash, unsigned long long blobSize, ShaderReflectionData& data)
+{
+	ReflectionReader in = { bytes, byteCount, 0, false };
+
+	if (in.U32() != Magic || in.U32() != Version)
+		return false;
+	if (in.U64() != blobHash || in.U64() != blobSize)
+		return false;
+
+	// Smallest possible record sizes, for sanity checking counts
+	const size_t minBufferSize = 2 + 4 * 4;
+	const size_t minVariableSize = 2 + 4 * 2;
+	const size_t minResourceSize = 2 + 4 * 2;
+	const size_t minParameterSize = 2 + 4 * 3;
+
+	ShaderReflectionData result;
+
+	result.ConstantBuffers.resize(in.Count(minBufferSize));
+	for (ShaderReflectionData::ConstantBuffer& cb : result.ConstantBuffers)
+	{
+		cb.Name = in.String();
+		cb.Type = in.U32();
+		cb.Size = in.U32();
+		cb.BindPoint = in.U32();
+
+		cb.Variables.resize(in.Count(minVariableSize));
+		for (ShaderReflectionData::Variable& var : cb.Variables)
+		{
+			var.Name = in.String();
+			var.ByteOffset = in.U32();
+			var.Size = in.U32();
+
+			// A variable outside its buffer would be written out of bounds later
+			if (var.ByteOffset > cb.Size || var.Size > cb.Size - var.ByteOffset)
+				return false;
+		}
+	}
+
+	result.Resources.resize(in.Count(minResourceSize));
+	for (ShaderReflectionData::Resource& res : result.Resources)
+	{
+		res.Name = in.String();
+		res.Type = in.U32();
+		res.BindPoint = in.U32();
+	}
+
+	result.InputParameters.resize(in.Count(minParameterSize));
+	for (ShaderReflectionData::InputParameter& param : result.InputParameters)
+	{
+		param.SemanticName = in.String();
+		param.SemanticIndex = in.U32();
+		param.ComponentType = in.U32();
+		param.Mask = in.U32();
+	}
+
+	for (int i = 0; i < 3; i++)
+		result.ThreadGroupSize[i] = in.U32();
+
+	// Trailing bytes mean it isn't the format we think it is
+	if (in.failed || in.position != byteCount)
+		return false;
+
+	data = std::move(result);
+	return true;
+}
+
+bool ShaderReflectionCache::Load(const std::wstring& sidecarFile, unsigned long long blobHash, unsigned long long blobSize, ShaderReflectionData& data)
+{
+	std::ifstream file(std::filesystem::path(sidecarFile), std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::streamoff size = file.tellg();
+	if (size <= 0)
+		return false;
+
+	std::vector<unsigned char> bytes((size_t)size);
+	file.seekg(0);
+	if (!file.read((char*)bytes.data(), size))
+		return false;
+
+	return Deserialize(bytes.data(), bytes.size(), blobHash, blobSize, data);
+}
+
+bool ShaderReflectionCache::Save(const std::wstring& sidecarFile, const ShaderReflectionData& data, unsigned long long blobHash, unsigned long long blobSize)
+{
+	std::vector<unsigned char> bytes = Serialize(data, blobHash, blobSize);
+
+	std::ofstream file(std::filesystem::path(sidecarFile), std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	file.write((const char*)bytes.data(), bytes.size());
+	return (bool)file;
+}
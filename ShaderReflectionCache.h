@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Everything SimpleShader needs to know from reflecting a
+// compiled shader.  Types are the raw Direct3D enum values
+// (D3D_CBUFFER_TYPE, D3D_SHADER_INPUT_TYPE...), so this has
+// no Direct3D dependency.
+// --------------------------------------------------------
+struct ShaderReflectionData
+{
+	struct Variable
+	{
+		std::string Name;
+		unsigned int ByteOffset;
+		unsigned int Size;
+	};
+
+	struct ConstantBuffer
+	{
+		std::string Name;
+		unsigned int Type;		// D3D_CBUFFER_TYPE
+		unsigned int Size;
+		unsigned int BindPoint;
+		std::vector<Variable> Variables;
+	};
+
+	struct Resource
+	{
+		std::string Name;
+		unsigned int Type;		// D3D_SHADER_INPUT_TYPE
+		unsigned int BindPoint;
+	};
+
+	struct InputParameter
+	{
+		std::string SemanticName;
+		unsigned int SemanticIndex;
+		unsigned int ComponentType;	// D3D_REGISTER_COMPONENT_TYPE
+		unsigned int Mask;
+	};
+
+	std::vector<ConstantBuffer> ConstantBuffers;
+	std::vector<Resource> Resources;
+	std::vector<InputParameter> InputParameters;
+	unsigned int ThreadGroupSize[3] = { 0, 0, 0 };	// Compute shaders only
+};
+
+// --------------------------------------------------------
+// Reads and writes ShaderReflectionData as a small sidecar
+// file next to a compiled shader (Shader.cso -> Shader.refl).
+// The file holds a hash of the blob it was made from, so a
+// recompiled shader is never paired with stale reflection.
+//
+// Format (little endian):
+//   u32 magic, u32 version, u64 blob hash, u64 blob size
+//   u32 count, then that many constant buffers
+//     (name, type, size, bind point, u32 count, variables)
+//   u32 count, then resources (name, type, bind point)
+//   u32 count, then input parameters (semantic, index,
+//     component type, mask)
+//   u32 x3 thread group size
+// Strings are a u16 length followed by the characters.
+// --------------------------------------------------------
+class ShaderReflectionCache
+{
+public:
+	static const unsigned int Magic = 0x4C464552;	// "REFL"
+	static const unsigned int Version = 1;
+
+	// 64-bit FNV-1a of a compiled shader
+	static unsigned long long HashBlob(const void* data, size_t size);
+
+	// The sidecar that goes with a compiled shader file
+	static std::wstring GetSidecarPath(const std::wstring& shaderFile);
+
+	static std::vector<unsigned char> Serialize(const ShaderReflectionData& data, unsigned long long blobHash, unsigned long long blobSize);
+
+	// False if the bytes are malformed or were made from a different blob
+	static bool Deserialize(const unsigned char* bytes, size_t byteCount, unsigned long long blobHash, unsigned long long blobSize, ShaderReflectionData& data);
+
+	// Whole-file helpers - one read, one write
+	static bool Load(const std::wstring& sidecarFile, unsigned long long blobHash, unsigned long long blobSize, ShaderReflectionData& data);
+	static bool Save(const std::wstring& sidecarFile, const ShaderReflectionData& data, unsigned long long blobHash, unsigned long long blobSize);
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+// --------------------------------------------------------
+// The programmable stages, for calls that are the same on
+// every stage apart from the prefix (VS, PS...)
+// --------------------------------------------------------
+enum class ShaderStage : unsigned int
+{
+	Vertex,
+	Hull,
+	Domain,
+	Geometry,
+	Pixel,
+	Compute,
+
+	Count
+};
@@ -1,8 +1,11 @@
 #include "ShaderInclude.hlsli"
 
-cbuffer externalData : register(b0)
+// Every object drawn this frame
+StructuredBuffer<ObjectData> Objects	: register(t0);
+
+// Set once per shadow pass
+cbuffer PerFrame : register(b0)
 {
-	matrix world;
 	matrix view;
 	matrix projection;
 }
@@ -18,6 +21,9 @@ struct VertexShaderInput
 	float2 uv				: TEXCOORD;		//UV
 	float3 normal			: NORMAL;		//surface normal
 	float3 tangent			: TANGENT;		//vector tangent to surface in u direction
+
+	//per instance (vertex buffer slot 1) - where this entity is in Objects
+	uint objectIndex		: OBJECTINDEX_PER_INSTANCE;
 };
 
 VertexToPixel_Shadow main( VertexShaderInput input)
@@ -26,6 +32,7 @@ VertexToPixel_Shadow main( VertexShaderInput input)
 	VertexToPixel_Shadow output;
 
 	//calculate output position
+	matrix world = Objects[input.objectIndex].world;
 	matrix wvp = mul(projection, mul(view, world));
 	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
 
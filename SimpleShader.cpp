@@ -1,9 +1,21 @@
 #include "SimpleShader.h"
+#include "CommandRecorder.h"
+#include "CommandStream.h"
+#include "ConstantBufferRing.h"
 
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
 bool ISimpleShader::ReportWarnings = false;
 
+// Constant buffer upload stats
+std::atomic<unsigned long long> ISimpleShader::bytesUploaded;
+std::atomic<unsigned long long> ISimpleShader::bytesSkipped;
+std::atomic<unsigned int> ISimpleShader::nextId;
+
+// Layouts shared between instances of the same file
+std::mutex ISimpleShader::layoutCacheMutex;
+std::unordered_map<std::wstring, std::weak_ptr<const SimpleShaderLayout>> ISimpleShader::layoutCache;
+
 // To enable error reporting, use either or both 
 // of the following lines somewhere in your program, 
 // preferably before loading/using any shaders.
@@ -26,9 +38,27 @@ ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Micros
 	this->deviceContext = context;
 
 	// Set up fields
+	this->id = nextId++;
 	this->constantBufferCount = 0;
 	this->constantBuffers = 0;
+	this->instanceData = 0;
+	for (unsigned int i = 0; i < MaxContextSlots; i++)
+	{
+		this->contextBuffers[i] = 0;
+		this->contextData[i] = 0;
+	}
 	this->shaderValid = false;
+	this->compareOnSet = false;
+	this->stateCache = std::make_shared<StateCache>(context, false);
+
+	// Partial constant buffer updates need 11.1 - without them,
+	// a dirty buffer is always uploaded in full
+	context.As(&deviceContext1);
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	this->partialUpdates =
+		deviceContext1 &&
+		SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferPartialUpdate;
 }
 
 // --------------------------------------------------------
@@ -40,39 +70,25 @@ ISimpleShader::~ISimpleShader()
 }
 
 // --------------------------------------------------------
-// Cleans up the variable table and buffers - Some things will
-// be handled by derived classes
+// Cleans up this instance's buffers - Some things will
+// be handled by derived classes.  The shared layout stays.
 // --------------------------------------------------------
 void ISimpleShader::CleanUp()
 {
-	// Handle constant buffers and local data buffers
-	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		delete[] constantBuffers[i].LocalDataBuffer;
-	}
-
-	if (constantBuffers)
+	DestroyBufferSet(instanceData, constantBuffers);
+	for (unsigned int i = 1; i < MaxContextSlots; i++)
 	{
-		delete[] constantBuffers;
-		constantBufferCount = 0;
+		DestroyBufferSet(contextData[i], contextBuffers[i]);
 	}
 
-	for (unsigned int i = 0; i < shaderResourceViews.size(); i++)
-		delete shaderResourceViews[i];
-	
-	for (unsigned int i = 0; i < samplerStates.size(); i++)
-		delete samplerStates[i];
-
-	// Clean up tables
-	varTable.clear();
-	cbTable.clear();
-	samplerTable.clear();
-	textureTable.clear();
+	constantBufferCount = 0;
 }
 
 // --------------------------------------------------------
-// Loads the specified shader and builds the variable table 
-// using shader reflection.
+// Loads the specified shader and sets up its variables.
+// The layout comes from the first instance that loaded
+// the file, or from the reflection sidecar next to it, and
+// only if neither has it is the shader actually reflected.
 //
 // shaderFile - A "wide string" specifying the compiled shader to load
 // 
@@ -80,18 +96,69 @@ void ISimpleShader::CleanUp()
 // --------------------------------------------------------
 bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 {
-	// Load the shader to a blob and ensure it worked
-	HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
-	if (hr != S_OK)
+	// Has another instance loaded this file already?
 	{
-		if (ReportErrors)
+		std::lock_guard<std::mutex> lock(layoutCacheMutex);
+		auto cached = layoutCache.find(shaderFile);
+		if (cached != layoutCache.end())
+			layout = cached->second.lock();
+	}
+
+	if (layout)
+	{
+		shaderBlob = layout->ShaderBlob;
+	}
+	else
+	{
+		// Load the shader to a blob and ensure it worked
+		HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
+		if (hr != S_OK)
 		{
-			LogError("SimpleShader::LoadShaderFile() - Error loading file '");
-			LogW(shaderFile);
-			LogError("'. Ensure this file exists and is spelled correctly.\n");
+			if (ReportErrors)
+			{
+				LogError("SimpleShader::LoadShaderFile() - Error loading file '");
+				LogW(shaderFile);
+				LogError("'. Ensure this file exists and is spelled correctly.\n");
+			}
+
+			return false;
 		}
 
-		return false;
+		// Use the sidecar if it was made from this exact blob,
+		// otherwise reflect and (re)write it for next time
+		unsigned long long blobHash = ShaderReflectionCache::HashBlob(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
+		unsigned long long blobSize = shaderBlob->GetBufferSize();
+		std::wstring sidecarFile = ShaderReflectionCache::GetSidecarPath(shaderFile);
+
+		ShaderReflectionData reflection;
+		if (!ShaderReflectionCache::Load(sidecarFile, blobHash, blobSize, reflection))
+		{
+			if (!ReflectShader(shaderBlob, reflection))
+			{
+				if (ReportErrors)
+				{
+					LogError("SimpleShader::LoadShaderFile() - Error reflecting file '");
+					LogW(shaderFile);
+					LogError("'.\n");
+				}
+
+				return false;
+			}
+
+			ShaderReflectionCache::Save(sidecarFile, reflection, blobHash, blobSize);
+		}
+
+		// Share it - unless another thread got there first, then use theirs
+		std::shared_ptr<const SimpleShaderLayout> built = BuildLayout(shaderBlob, std::move(reflection));
+
+		std::lock_guard<std::mutex> lock(layoutCacheMutex);
+		std::weak_ptr<const SimpleShaderLayout>& entry = layoutCache[shaderFile];
+		layout = entry.lock();
+		if (!layout)
+		{
+			layout = built;
+			entry = built;
+		}
 	}
 
 	// Create the shader - Calls an overloaded version of this abstract
@@ -109,128 +176,289 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	// This instance's own buffers
+	CreateInstanceData();
+
+	// All set
+	return true;
+}
+
+// --------------------------------------------------------
+// Pulls everything SimpleShader needs out of a compiled
+// shader using shader reflection
+// --------------------------------------------------------
+bool ISimpleShader::ReflectShader(Microsoft::WRL::ComPtr<ID3DBlob> blob, ShaderReflectionData& reflection)
+{
 	// Set up shader reflection to get information about
 	// this shader and its variables,  buffers, etc.
 	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
+	HRESULT hr = D3DReflect(
+		blob->GetBufferPointer(),
+		blob->GetBufferSize(),
 		IID_ID3D11ShaderReflection,
 		(void**)refl.GetAddressOf());
-	
+	if (FAILED(hr))
+		return false;
+
 	// Get the description of the shader
 	D3D11_SHADER_DESC shaderDesc;
 	refl->GetDesc(&shaderDesc);
 
-	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
-	
-	// Handle bound resources (like shaders and samplers)
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	// Every bound resource (textures, samplers, UAVs...)
+	for (unsigned int r = 0; r < shaderDesc.BoundResources; r++)
 	{
-		// Get this resource's description
 		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
 		refl->GetResourceBindingDesc(r, &resourceDesc);
 
+		ShaderReflectionData::Resource res;
+		res.Name = resourceDesc.Name;
+		res.Type = resourceDesc.Type;
+		res.BindPoint = resourceDesc.BindPoint;
+		reflection.Resources.push_back(res);
+	}
+
+	// Constant buffers and their variables
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
+	{
+		ID3D11ShaderReflectionConstantBuffer* cb =
+			refl->GetConstantBufferByIndex(b);
+
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		cb->GetDesc(&bufferDesc);
+
+		// Get the description of the resource binding, so
+		// we know exactly how it's bound in the shader
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+
+		ShaderReflectionData::ConstantBuffer cbData;
+		cbData.Name = bufferDesc.Name;
+		cbData.Type = bufferDesc.Type;
+		cbData.Size = bufferDesc.Size;
+		cbData.BindPoint = bindDesc.BindPoint;
+
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			ID3D11ShaderReflectionVariable* var =
+				cb->GetVariableByIndex(v);
+
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			var->GetDesc(&varDesc);
+
+			ShaderReflectionData::Variable varData;
+			varData.Name = varDesc.Name;
+			varData.ByteOffset = varDesc.StartOffset;
+			varData.Size = varDesc.Size;
+			cbData.Variables.push_back(varData);
+		}
+
+		reflection.ConstantBuffers.push_back(cbData);
+	}
+
+	// The input signature, for building input layouts
+	for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+	{
+		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+		refl->GetInputParameterDesc(i, &paramDesc);
+
+		ShaderReflectionData::InputParameter param;
+		param.SemanticName = paramDesc.SemanticName;
+		param.SemanticIndex = paramDesc.SemanticIndex;
+		param.ComponentType = paramDesc.ComponentType;
+		param.Mask = paramDesc.Mask;
+		reflection.InputParameters.push_back(param);
+	}
+
+	// Thread group size (zeros for anything but compute)
+	refl->GetThreadGroupSize(
+		&reflection.ThreadGroupSize[0],
+		&reflection.ThreadGroupSize[1],
+		&reflection.ThreadGroupSize[2]);
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Builds the variable and resource tables for a shader
+// from its reflection data
+// --------------------------------------------------------
+std::shared_ptr<SimpleShaderLayout> ISimpleShader::BuildLayout(Microsoft::WRL::ComPtr<ID3DBlob> blob, ShaderReflectionData reflection)
+{
+	std::shared_ptr<SimpleShaderLayout> newLayout = std::make_shared<SimpleShaderLayout>();
+	newLayout->ShaderBlob = blob;
+
+	// The tables key on views of the names in here, so it
+	// must not change once they're built
+	newLayout->Reflection = std::move(reflection);
+	const ShaderReflectionData& refl = newLayout->Reflection;
+
+	// Handle bound resources (like shaders and samplers)
+	for (const ShaderReflectionData::Resource& res : refl.Resources)
+	{
 		// Check the type
-		switch (resourceDesc.Type)
+		switch (res.Type)
 		{
 		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
 		case D3D_SIT_TEXTURE: // A texture resource
 		{
-			// Create the SRV wrapper
-			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
-			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
+			SimpleSRV srv = {};
+			srv.BindIndex = res.BindPoint;										// Shader bind point
+			srv.Index = (unsigned int)newLayout->ShaderResourceViews.size();	// Raw index
 
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
-			shaderResourceViews.push_back(srv);
+			newLayout->TextureTable.insert(std::pair<std::string_view, unsigned int>(res.Name, srv.Index));
+			newLayout->ShaderResourceViews.push_back(srv);
 		}
 			break;
 
 		case D3D_SIT_SAMPLER: // A sampler resource
 		{
-			// Create the sampler wrapper
-			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
-			samp->Index = (unsigned int)samplerStates.size();	// Raw index
+			SimpleSampler samp = {};
+			samp.BindIndex = res.BindPoint;								// Shader bind point
+			samp.Index = (unsigned int)newLayout->SamplerStates.size();	// Raw index
 
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
-			samplerStates.push_back(samp);
+			newLayout->SamplerTable.insert(std::pair<std::string_view, unsigned int>(res.Name, samp.Index));
+			newLayout->SamplerStates.push_back(samp);
 		}
 			break;
+
+		case D3D_SIT_UAV_APPEND_STRUCTURED:
+		case D3D_SIT_UAV_CONSUME_STRUCTURED:
+		case D3D_SIT_UAV_RWBYTEADDRESS:
+		case D3D_SIT_UAV_RWSTRUCTURED:
+		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
+		case D3D_SIT_UAV_RWTYPED:
+			newLayout->UAVTable.insert(std::pair<std::string_view, unsigned int>(res.Name, res.BindPoint));
+			break;
 		}
 	}
 
+	// Sized up front - the table keys are views of these names,
+	// so the array must never move
+	newLayout->ConstantBuffers.resize(refl.ConstantBuffers.size());
+
 	// Loop through all constant buffers
-	for (unsigned int b = 0; b < constantBufferCount; b++)
+	for (unsigned int b = 0; b < refl.ConstantBuffers.size(); b++)
 	{
-		// Get this buffer
-		ID3D11ShaderReflectionConstantBuffer* cb =
-			refl->GetConstantBufferByIndex(b);
-		
-		// Get the description of this buffer
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		cb->GetDesc(&bufferDesc);
+		const ShaderReflectionData::ConstantBuffer& cbData = refl.ConstantBuffers[b];
+		SimpleConstantBufferLayout& cbLayout = newLayout->ConstantBuffers[b];
 
-		// Save the type, which we reference when setting these buffers
-		constantBuffers[b].Type = bufferDesc.Type;
-		
-		// Get the description of the resource binding, so
-		// we know exactly how it's bound in the shader
-		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
-		
-		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
-		constantBuffers[b].Name = bufferDesc.Name;
-		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
+		// Save the buffer's details and put it in the table
+		cbLayout.Name = cbData.Name;
+		cbLayout.Type = (D3D_CBUFFER_TYPE)cbData.Type;
+		cbLayout.Size = cbData.Size;
+		cbLayout.BindIndex = cbData.BindPoint;
+		cbLayout.DataOffset = newLayout->DataSize;
+		newLayout->CBTable.insert(std::pair<std::string_view, unsigned int>(cbLayout.Name, b));
+
+		// Keep each buffer's local data 16-byte aligned
+		newLayout->DataSize += (cbData.Size + 15) & ~15u;
+
+		// Loop through all variables in this buffer
+		for (const ShaderReflectionData::Variable& varData : cbData.Variables)
+		{
+			// Create the variable struct
+			SimpleShaderVariable varStruct = {};
+			varStruct.ConstantBufferIndex = b;
+			varStruct.ByteOffset = varData.ByteOffset;
+			varStruct.Size = varData.Size;
+			
+			// Add this variable to the table and the constant buffer
+			newLayout->VarTable.insert(std::pair<std::string_view, SimpleShaderVariable>(varData.Name, varStruct));
+			cbLayout.Variables.push_back(varStruct);
+		}
+	}
+
+	return newLayout;
+}
+
+// --------------------------------------------------------
+// Creates this instance's constant buffers
+// --------------------------------------------------------
+void ISimpleShader::CreateInstanceData()
+{
+	constantBufferCount = (unsigned int)layout->ConstantBuffers.size();
+	instanceData = CreateBufferSet(constantBuffers);
+}
+
+// --------------------------------------------------------
+// Creates one copy of every constant buffer the layout has.
+// The buffer array and all of their local data share one
+// allocation, which is returned.
+// --------------------------------------------------------
+unsigned char* ISimpleShader::CreateBufferSet(SimpleConstantBuffer*& buffers)
+{
+	size_t arraySize = (sizeof(SimpleConstantBuffer) * constantBufferCount + 15) & ~(size_t)15;
+	unsigned char* data = new unsigned char[arraySize + layout->DataSize];
+	buffers = reinterpret_cast<SimpleConstantBuffer*>(data);
+
+	unsigned char* localData = data + arraySize;
+	ZeroMemory(localData, layout->DataSize);
+
+	for (unsigned int b = 0; b < constantBufferCount; b++)
+	{
+		const SimpleConstantBufferLayout& cbLayout = layout->ConstantBuffers[b];
+		SimpleConstantBuffer* cb = new (&buffers[b]) SimpleConstantBuffer();
+		cb->Layout = &cbLayout;
+		cb->Type = cbLayout.Type;
+		cb->Size = cbLayout.Size;
+		cb->BindIndex = cbLayout.BindIndex;
+		cb->LocalDataBuffer = localData + cbLayout.DataOffset;
 
 		// Create this constant buffer
 		D3D11_BUFFER_DESC newBuffDesc = {};
 		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = bufferDesc.Size;
+		newBuffDesc.ByteWidth = cbLayout.Size;
 		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 		newBuffDesc.CPUAccessFlags = 0;
 		newBuffDesc.MiscFlags = 0;
 		newBuffDesc.StructureByteStride = 0;
-		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
+		device->CreateBuffer(&newBuffDesc, 0, cb->ConstantBuffer.GetAddressOf());
 
-		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		// Starts dirty, so the zeroed data goes up on the first copy
+		cb->Dirty = true;
+		cb->DirtyStart = 0;
+		cb->DirtyEnd = cbLayout.Size;
+	}
 
-		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
-		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-			
-			// Get the description of the variable and its type
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
+	return data;
+}
 
-			// Create the variable struct
-			SimpleShaderVariable varStruct = {};
-			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
-			varStruct.Size = varDesc.Size;
-			
-			// Get a string version
-			std::string varName(varDesc.Name);
+// --------------------------------------------------------
+// Frees a set made by CreateBufferSet()
+// --------------------------------------------------------
+void ISimpleShader::DestroyBufferSet(unsigned char*& data, SimpleConstantBuffer*& buffers)
+{
+	if (!data)
+		return;
 
-			// Add this variable to the table and the constant buffer
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
-			constantBuffers[b].Variables.push_back(varStruct);
-		}
+	// The constant buffer array was placement-constructed
+	// into the data block, so destroy the buffers by hand
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		buffers[i].~SimpleConstantBuffer();
 	}
 
-	// All set
-	return true;
+	delete[] data;
+	data = 0;
+	buffers = 0;
+}
+
+// --------------------------------------------------------
+// The constant buffers a RenderContext slot writes to and
+// binds.  Slot 0 is this shader's own; any other slot's are
+// created the first time it asks.
+// --------------------------------------------------------
+SimpleConstantBuffer* ISimpleShader::GetContextBuffers(RenderContext& context)
+{
+	unsigned int slot = context.GetSlot();
+	if (slot == 0)
+		return constantBuffers;
+	if (slot >= MaxContextSlots || !layout)
+		return 0;
+
+	if (!contextData[slot])
+		contextData[slot] = CreateBufferSet(contextBuffers[slot]);
+	return contextBuffers[slot];
 }
 
 // --------------------------------------------------------
@@ -240,18 +468,20 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 // name - the name of the variable to look for
 // size - the size of the variable (for verification), or -1 to bypass
 // --------------------------------------------------------
-SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
+const SimpleShaderVariable* ISimpleShader::FindVariable(std::string_view name, int size)
 {
+	if (!layout)
+		return 0;
+
 	// Look for the key
-	std::unordered_map<std::string, SimpleShaderVariable>::iterator result =
-		varTable.find(name);
+	auto result = layout->VarTable.find(name);
 
 	// Did we find the key?
-	if (result == varTable.end())
+	if (result == layout->VarTable.end())
 		return 0;
 
 	// Grab the result from the iterator
-	SimpleShaderVariable* var = &(result->second);
+	const SimpleShaderVariable* var = &(result->second);
 
 	// Is the data size correct ?
 	if (size > 0 && var->Size != size)
@@ -264,18 +494,68 @@ SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
 // --------------------------------------------------------
 // Helper for looking up a constant buffer by name
 // --------------------------------------------------------
-SimpleConstantBuffer* ISimpleShader::FindConstantBuffer(std::string name)
+SimpleConstantBuffer* ISimpleShader::FindConstantBuffer(std::string_view name)
 {
+	if (!layout)
+		return 0;
+
 	// Look for the key
-	std::unordered_map<std::string, SimpleConstantBuffer*>::iterator result =
-		cbTable.find(name);
+	auto result = layout->CBTable.find(name);
 
 	// Did we find the key?
-	if (result == cbTable.end())
+	if (result == layout->CBTable.end())
 		return 0;
 
 	// Success
-	return result->second;
+	return &constantBuffers[result->second];
+}
+
+// --------------------------------------------------------
+// Checks a C++ struct's layout against a constant buffer
+// from reflection.  Every variable in the buffer has to be
+// one of the fields, at the same offset and size.
+//
+// Returns the buffer's index, or -1 if they don't match
+// --------------------------------------------------------
+int ISimpleShader::MatchConstantBuffer(std::string_view name, unsigned int size, const ConstantBufferField* fields, unsigned int fieldCount)
+{
+	SimpleConstantBuffer* cb = FindConstantBuffer(name);
+	if (cb == 0 || cb->Type != D3D11_CT_CBUFFER)
+	{
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::MatchConstantBuffer() - Constant buffer '");
+			Log(std::string(name));
+			LogError("' not found in the shader.\n");
+		}
+		return -1;
+	}
+
+	unsigned int index = (unsigned int)(cb - constantBuffers);
+	bool match = cb->Size == size && cb->Layout->Variables.size() == fieldCount;
+
+	for (unsigned int i = 0; match && i < fieldCount; i++)
+	{
+		const SimpleShaderVariable* var = FindVariable(fields[i].Name, -1);
+		match =
+			var != 0 &&
+			var->ConstantBufferIndex == index &&
+			var->ByteOffset == fields[i].ByteOffset &&
+			var->Size == fields[i].Size;
+	}
+
+	if (!match)
+	{
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::MatchConstantBuffer() - Constant buffer '");
+			Log(std::string(name));
+			LogError("' doesn't match its C++ struct. Ensure the members, their order and any padding are the same as the HLSL.\n");
+		}
+		return -1;
+	}
+
+	return (int)index;
 }
 
 // --------------------------------------------------------
@@ -332,26 +612,70 @@ void ISimpleShader::SetShader()
 
 	// Set the shader and any relevant constant buffers, which
 	// is an overloaded method in a subclass
-	SetShaderAndCBs();
+	SetShaderAndCBs(*stateCache, constantBuffers);
+}
+
+// --------------------------------------------------------
+// Encodes setting the shader and the context's copy of its
+// constant buffers
+// --------------------------------------------------------
+void ISimpleShader::SetShader(RenderContext& context)
+{
+	if (!shaderValid) return;
+
+	SimpleConstantBuffer* buffers = GetContextBuffers(context);
+	if (!buffers)
+		return;
+
+	CommandStream& stream = context.GetStream();
+	EncodeShader(stream);
+
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		// Skip "buffers" that aren't true constant buffers
+		if (buffers[i].Type != D3D11_CT_CBUFFER)
+			continue;
+
+		EncodeConstantBuffer(stream, buffers[i]);
+	}
 }
 
 // --------------------------------------------------------
 // Copies the relevant data to the all of this 
 // shader's constant buffers.  To just copy one
 // buffer, use CopyBufferData()
+//
+// Buffers that haven't changed since their last copy
+// are skipped.
 // --------------------------------------------------------
 void ISimpleShader::CopyAllBufferData()
 {
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy any that changed
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
+		UploadBuffer(constantBuffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Encodes uploads of the context's changed constants
+// --------------------------------------------------------
+void ISimpleShader::CopyAllBufferData(RenderContext& context)
+{
+	if (!shaderValid) return;
+
+	SimpleConstantBuffer* buffers = GetContextBuffers(context);
+	if (!buffers)
+		return;
+
+	// Only slot 0 is on the render thread, where the ring is mapped
+	bool immediate = context.GetSlot() == 0;
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		EncodeUpload(context.GetStream(), buffers[i], immediate);
 	}
 }
 
@@ -379,10 +703,8 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(*cb);
 }
 
 // --------------------------------------------------------
@@ -392,7 +714,7 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 //              Useful for updating more frequently-changing
 //              variables without having to re-copy all buffers.
 // --------------------------------------------------------
-void ISimpleShader::CopyBufferData(std::string bufferName)
+void ISimpleShader::CopyBufferData(std::string_view bufferName)
 {
 	// Ensure the shader is valid
 	if (!shaderValid) return;
@@ -401,10 +723,265 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(*cb);
+}
+
+// --------------------------------------------------------
+// Copies a constant buffer's local data to the GPU, if any
+// of it changed since the last copy.  Only the dirty range
+// is sent when the device supports partial updates.
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer& cb)
+{
+	if (constantBufferRing && cb.Type == D3D11_CT_CBUFFER)
+	{
+		// Ring data only lasts until the generation changes, so even a
+		// clean buffer is copied again once per generation
+		if (!cb.Dirty && cb.RingGeneration == constantBufferRing->GetGeneration())
+		{
+			bytesSkipped += cb.Size;
+			return;
+		}
+
+		if (constantBufferRing->Allocate(cb.LocalDataBuffer, cb.Size, cb.RingFirstConstant, cb.RingConstantCount))
+		{
+			cb.RingGeneration = constantBufferRing->GetGeneration();
+			cb.Dirty = false;
+			bytesUploaded += cb.Size;
+
+			// The data moved, so whatever is bound now is stale
+			BindConstantBuffer(*stateCache, cb);
+			return;
+		}
+
+		// The ring couldn't take it - fall back to the buffer itself,
+		// which may be missing everything written while in the ring
+		cb.RingGeneration = 0;
+		cb.Dirty = true;
+		cb.DirtyStart = 0;
+		cb.DirtyEnd = cb.Size;
+		BindConstantBuffer(*stateCache, cb);
+	}
+
+	if (!cb.Dirty)
+	{
+		bytesSkipped += cb.Size;
+		return;
+	}
+
+	if (partialUpdates)
+	{
+		// Partial constant buffer updates work in whole 16-byte registers
+		D3D11_BOX box = {};
+		box.left = cb.DirtyStart & ~15u;
+		box.right = (cb.DirtyEnd + 15) & ~15u;
+		box.bottom = 1;
+		box.back = 1;
+		if (box.right > cb.Size)
+			box.right = cb.Size;
+
+		deviceContext1->UpdateSubresource1(
+			cb.ConstantBuffer.Get(), 0, &box,
+			cb.LocalDataBuffer + box.left, 0, 0, 0);
+
+		bytesUploaded += box.right - box.left;
+		bytesSkipped += cb.Size - (box.right - box.left);
+	}
+	else
+	{
+		deviceContext->UpdateSubresource(
+			cb.ConstantBuffer.Get(), 0, 0,
+			cb.LocalDataBuffer, 0, 0);
+
+		bytesUploaded += cb.Size;
+	}
+
+	cb.Dirty = false;
+}
+
+// --------------------------------------------------------
+// Encodes a constant buffer's upload, if any of it changed.
+//
+// The immediate context's buffers go the way UploadBuffer()
+// sends them - into the ring, or just the dirty range - but
+// the ring isn't allowed to orphan its buffer, since slices
+// encoded earlier haven't been read yet.  When it's full
+// the buffer itself is updated instead.
+//
+// Other slots never use the ring, which is mapped on the
+// immediate context, and always send the whole buffer -
+// partial updates on deferred contexts are emulated by some
+// drivers, and get the box wrong on others.
+// --------------------------------------------------------
+void ISimpleShader::EncodeUpload(CommandStream& stream, SimpleConstantBuffer& cb, bool immediate)
+{
+	if (immediate && constantBufferRing && cb.Type == D3D11_CT_CBUFFER)
+	{
+		if (!cb.Dirty && cb.RingGeneration == constantBufferRing->GetGeneration())
+		{
+			bytesSkipped += cb.Size;
+			return;
+		}
+
+		if (constantBufferRing->Allocate(cb.LocalDataBuffer, cb.Size, cb.RingFirstConstant, cb.RingConstantCount, false))
+		{
+			cb.RingGeneration = constantBufferRing->GetGeneration();
+			cb.Dirty = false;
+			bytesUploaded += cb.Size;
+
+			// The data moved, so whatever is bound now is stale
+			EncodeConstantBuffer(stream, cb);
+			return;
+		}
+
+		// Same as UploadBuffer() - the buffer may be missing
+		// everything written while in the ring
+		cb.RingGeneration = 0;
+		cb.Dirty = true;
+		cb.DirtyStart = 0;
+		cb.DirtyEnd = cb.Size;
+		EncodeConstantBuffer(stream, cb);
+	}
+
+	if (!cb.Dirty)
+	{
+		bytesSkipped += cb.Size;
+		return;
+	}
+
+	if (immediate && partialUpdates)
+	{
+		// Partial constant buffer updates work in whole 16-byte registers
+		unsigned int start = cb.DirtyStart & ~15u;
+		unsigned int end = (cb.DirtyEnd + 15) & ~15u;
+		if (end > cb.Size)
+			end = cb.Size;
+
+		stream.UpdateBuffer(cb.ConstantBuffer.Get(), start, end - start, cb.LocalDataBuffer + start, UpdateBufferCommand::Range);
+		bytesUploaded += end - start;
+		bytesSkipped += cb.Size - (end - start);
+	}
+	else
+	{
+		stream.UpdateBuffer(cb.ConstantBuffer.Get(), 0, cb.Size, cb.LocalDataBuffer, UpdateBufferCommand::Whole);
+		bytesUploaded += cb.Size;
+	}
+
+	cb.Dirty = false;
+}
+
+// --------------------------------------------------------
+// Encodes binding one constant buffer to this shader's
+// stage - from the ring, if that's where its data is
+// --------------------------------------------------------
+void ISimpleShader::EncodeConstantBuffer(CommandStream& stream, SimpleConstantBuffer& cb)
+{
+	if (IsInRing(cb))
+		stream.SetConstantBuffer(GetStage(), cb.BindIndex, constantBufferRing->GetBuffer(), cb.RingFirstConstant, cb.RingConstantCount);
+	else
+		stream.SetConstantBuffer(GetStage(), cb.BindIndex, cb.ConstantBuffer.Get());
+}
+
+// --------------------------------------------------------
+// Whether a buffer's current data is in the constant buffer
+// ring (and should be bound from there)
+// --------------------------------------------------------
+bool ISimpleShader::IsInRing(const SimpleConstantBuffer& cb)
+{
+	return constantBufferRing && cb.RingGeneration == constantBufferRing->GetGeneration();
+}
+
+// --------------------------------------------------------
+// Switches constant buffer uploads to (or away from) a ring
+// --------------------------------------------------------
+void ISimpleShader::SetConstantBufferRing(std::shared_ptr<ConstantBufferRing> ring)
+{
+	if (ring && (!ring->IsSupported() || !deviceContext1))
+		ring = 0;
+
+	constantBufferRing = ring;
+
+	// Either way, nothing uploaded so far is where it will be looked for
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		constantBuffers[i].RingGeneration = 0;
+		constantBuffers[i].Dirty = true;
+		constantBuffers[i].DirtyStart = 0;
+		constantBuffers[i].DirtyEnd = constantBuffers[i].Size;
+	}
+}
+
+// --------------------------------------------------------
+// Switches binding to a shared state cache (or back to a
+// private one that filters nothing)
+// --------------------------------------------------------
+void ISimpleShader::SetStateCache(std::shared_ptr<StateCache> cache)
+{
+	if (!cache)
+		cache = std::make_shared<StateCache>(deviceContext, false);
+
+	stateCache = cache;
+}
+
+// --------------------------------------------------------
+// Encodes setting a shader resource view on a RenderContext,
+// in whichever stage this shader is
+//
+// Returns true if a texture of the given name was found, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::SetShaderResourceView(RenderContext& context, std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
+	if (srvInfo == 0)
+		return false;
+
+	void* view = srv.Get();
+	context.GetStream().SetResources(GetStage(), srvInfo->BindIndex, 1, &view);
+	return true;
+}
+
+// --------------------------------------------------------
+// Encodes setting a sampler state on a RenderContext, in
+// whichever stage this shader is
+//
+// Returns true if a sampler of the given name was found, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::SetSamplerState(RenderContext& context, std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+{
+	const SimpleSampler* sampInfo = GetSamplerInfo(name);
+	if (sampInfo == 0)
+		return false;
+
+	void* sampler = samplerState.Get();
+	context.GetStream().SetSamplers(GetStage(), sampInfo->BindIndex, 1, &sampler);
+	return true;
+}
+
+// --------------------------------------------------------
+// Copies data into a constant buffer's local data and
+// widens its dirty range to cover it
+// --------------------------------------------------------
+void ISimpleShader::WriteBufferData(SimpleConstantBuffer& cb, unsigned int offset, const void* data, unsigned int size)
+{
+	unsigned char* destination = cb.LocalDataBuffer + offset;
+
+	// Same as what's there already?  Then there's nothing to upload
+	if (compareOnSet && memcmp(destination, data, size) == 0)
+		return;
+
+	memcpy(destination, data, size);
+
+	if (!cb.Dirty)
+	{
+		cb.Dirty = true;
+		cb.DirtyStart = offset;
+		cb.DirtyEnd = offset + size;
+		return;
+	}
+
+	if (offset < cb.DirtyStart) cb.DirtyStart = offset;
+	if (offset + size > cb.DirtyEnd) cb.DirtyEnd = offset + size;
 }
 
 
@@ -417,16 +994,16 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 //
 // Returns true if data is copied, false if variable doesn't exist
 // --------------------------------------------------------
-bool ISimpleShader::SetData(std::string name, const void* data, unsigned int size)
+bool ISimpleShader::SetData(std::string_view name, const void* data, unsigned int size)
 {
 	// Look for the variable and verify
-	SimpleShaderVariable* var = FindVariable(name, -1);
+	const SimpleShaderVariable* var = FindVariable(name, -1);
 	if (var == 0)
 	{
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleShader::SetData() - Shader variable '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' not found. Ensure the name is spelled correctly and that it exists in a constant buffer in the shader.\n");
 		}
 		return false;
@@ -439,15 +1016,16 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleShader::SetData() - Shader variable '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' is smaller than the size of the data being set. Ensure the variable is large enough for the specified data.\n");
 		}
 		return false;
 	}
 
 	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
+	WriteBufferData(
+		constantBuffers[var->ConstantBufferIndex],
+		var->ByteOffset,
 		data,
 		size);
 
@@ -458,7 +1036,7 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 // --------------------------------------------------------
 // Sets INTEGER data
 // --------------------------------------------------------
-bool ISimpleShader::SetInt(std::string name, int data)
+bool ISimpleShader::SetInt(std::string_view name, int data)
 {
 	return this->SetData(name, (void*)(&data), sizeof(int));
 }
@@ -466,7 +1044,7 @@ bool ISimpleShader::SetInt(std::string name, int data)
 // --------------------------------------------------------
 // Sets a FLOAT variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat(std::string name, float data)
+bool ISimpleShader::SetFloat(std::string_view name, float data)
 {
 	return this->SetData(name, (void*)(&data), sizeof(float));
 }
@@ -474,7 +1052,7 @@ bool ISimpleShader::SetFloat(std::string name, float data)
 // --------------------------------------------------------
 // Sets a FLOAT2 variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat2(std::string name, const float data[2])
+bool ISimpleShader::SetFloat2(std::string_view name, const float data[2])
 {
 	return this->SetData(name, (void*)data, sizeof(float) * 2);
 }
@@ -482,7 +1060,7 @@ bool ISimpleShader::SetFloat2(std::string name, const float data[2])
 // --------------------------------------------------------
 // Sets a FLOAT2 variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat2(std::string name, const DirectX::XMFLOAT2 data)
+bool ISimpleShader::SetFloat2(std::string_view name, const DirectX::XMFLOAT2 data)
 {
 	return this->SetData(name, &data, sizeof(float) * 2);
 }
@@ -490,7 +1068,7 @@ bool ISimpleShader::SetFloat2(std::string name, const DirectX::XMFLOAT2 data)
 // --------------------------------------------------------
 // Sets a FLOAT3 variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat3(std::string name, const float data[3])
+bool ISimpleShader::SetFloat3(std::string_view name, const float data[3])
 {
 	return this->SetData(name, (void*)data, sizeof(float) * 3);
 }
@@ -498,7 +1076,7 @@ bool ISimpleShader::SetFloat3(std::string name, const float data[3])
 // --------------------------------------------------------
 // Sets a FLOAT3 variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat3(std::string name, const DirectX::XMFLOAT3 data)
+bool ISimpleShader::SetFloat3(std::string_view name, const DirectX::XMFLOAT3 data)
 {
 	return this->SetData(name, &data, sizeof(float) * 3);
 }
@@ -506,7 +1084,7 @@ bool ISimpleShader::SetFloat3(std::string name, const DirectX::XMFLOAT3 data)
 // --------------------------------------------------------
 // Sets a FLOAT4 variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat4(std::string name, const float data[4])
+bool ISimpleShader::SetFloat4(std::string_view name, const float data[4])
 {
 	return this->SetData(name, (void*)data, sizeof(float) * 4);
 }
@@ -514,7 +1092,7 @@ bool ISimpleShader::SetFloat4(std::string name, const float data[4])
 // --------------------------------------------------------
 // Sets a FLOAT4 variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat4(std::string name, const DirectX::XMFLOAT4 data)
+bool ISimpleShader::SetFloat4(std::string_view name, const DirectX::XMFLOAT4 data)
 {
 	return this->SetData(name, &data, sizeof(float) * 4);
 }
@@ -522,7 +1100,7 @@ bool ISimpleShader::SetFloat4(std::string name, const DirectX::XMFLOAT4 data)
 // --------------------------------------------------------
 // Sets a MATRIX (4x4) variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetMatrix4x4(std::string name, const float data[16])
+bool ISimpleShader::SetMatrix4x4(std::string_view name, const float data[16])
 {
 	return this->SetData(name, (void*)data, sizeof(float) * 16);
 }
@@ -530,16 +1108,54 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const float data[16])
 // --------------------------------------------------------
 // Sets a MATRIX (4x4) variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data)
+bool ISimpleShader::SetMatrix4x4(std::string_view name, const DirectX::XMFLOAT4X4 data)
 {
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
 
+// --------------------------------------------------------
+// Sets a variable through a handle from GetVariableHandle(),
+// which skips the name lookup entirely
+//
+// handle - The variable's handle (from this shader)
+// data   - The data to set in the buffer
+// size   - The size of the data (this must be less than or equal to the variable's size)
+//
+// Returns true if data is copied, false if the handle is
+// invalid or the data doesn't fit
+// --------------------------------------------------------
+bool ISimpleShader::SetData(ShaderVarHandle handle, const void* data, unsigned int size)
+{
+	// Bounds check against both the variable and its buffer, so a
+	// handle from a different shader can't write out of bounds
+	if (handle.BufferIndex >= constantBufferCount ||
+		size > handle.Size ||
+		handle.ByteOffset + size > constantBuffers[handle.BufferIndex].Size)
+		return false;
+
+	WriteBufferData(constantBuffers[handle.BufferIndex], handle.ByteOffset, data, size);
+	return true;
+}
+
+// --------------------------------------------------------
+// Handle versions of the typed setters above
+// --------------------------------------------------------
+bool ISimpleShader::SetInt(ShaderVarHandle handle, int data) { return SetData(handle, &data, sizeof(int)); }
+bool ISimpleShader::SetFloat(ShaderVarHandle handle, float data) { return SetData(handle, &data, sizeof(float)); }
+bool ISimpleShader::SetFloat2(ShaderVarHandle handle, const float data[2]) { return SetData(handle, data, sizeof(float) * 2); }
+bool ISimpleShader::SetFloat2(ShaderVarHandle handle, const DirectX::XMFLOAT2 data) { return SetData(handle, &data, sizeof(float) * 2); }
+bool ISimpleShader::SetFloat3(ShaderVarHandle handle, const float data[3]) { return SetData(handle, data, sizeof(float) * 3); }
+bool ISimpleShader::SetFloat3(ShaderVarHandle handle, const DirectX::XMFLOAT3 data) { return SetData(handle, &data, sizeof(float) * 3); }
+bool ISimpleShader::SetFloat4(ShaderVarHandle handle, const float data[4]) { return SetData(handle, data, sizeof(float) * 4); }
+bool ISimpleShader::SetFloat4(ShaderVarHandle handle, const DirectX::XMFLOAT4 data) { return SetData(handle, &data, sizeof(float) * 4); }
+bool ISimpleShader::SetMatrix4x4(ShaderVarHandle handle, const float data[16]) { return SetData(handle, data, sizeof(float) * 16); }
+bool ISimpleShader::SetMatrix4x4(ShaderVarHandle handle, const DirectX::XMFLOAT4X4 data) { return SetData(handle, &data, sizeof(float) * 16); }
+
 // --------------------------------------------------------
 // Determines if the shader contains the specified
 // variable within one of its constant buffers
 // --------------------------------------------------------
-bool ISimpleShader::HasVariable(std::string name)
+bool ISimpleShader::HasVariable(std::string_view name)
 {
 	return FindVariable(name, -1) != 0;
 }
@@ -547,7 +1163,7 @@ bool ISimpleShader::HasVariable(std::string name)
 // --------------------------------------------------------
 // Determines if the shader contains the specified SRV
 // --------------------------------------------------------
-bool ISimpleShader::HasShaderResourceView(std::string name)
+bool ISimpleShader::HasShaderResourceView(std::string_view name)
 {
 	return GetShaderResourceViewInfo(name) != 0;
 }
@@ -555,7 +1171,7 @@ bool ISimpleShader::HasShaderResourceView(std::string name)
 // --------------------------------------------------------
 // Determines if the shader contains the specified sampler
 // --------------------------------------------------------
-bool ISimpleShader::HasSamplerState(std::string name)
+bool ISimpleShader::HasSamplerState(std::string_view name)
 {
 	return GetSamplerInfo(name) != 0;
 }
@@ -563,28 +1179,57 @@ bool ISimpleShader::HasSamplerState(std::string name)
 // --------------------------------------------------------
 // Gets info about a shader variable, if it exists
 // --------------------------------------------------------
-const SimpleShaderVariable* ISimpleShader::GetVariableInfo(std::string name)
+const SimpleShaderVariable* ISimpleShader::GetVariableInfo(std::string_view name)
 {
 	return FindVariable(name, -1);
 }
 
+// --------------------------------------------------------
+// Looks up a variable once so it can be set by handle
+// afterwards.  Returns an invalid handle if the variable
+// doesn't exist - setting through one just returns false.
+// --------------------------------------------------------
+ShaderVarHandle ISimpleShader::GetVariableHandle(std::string_view name)
+{
+	ShaderVarHandle handle;
+
+	const SimpleShaderVariable* var = FindVariable(name, -1);
+	if (var == 0)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::GetVariableHandle() - Shader variable '");
+			Log(std::string(name));
+			LogWarning("' not found. Ensure the name is spelled correctly and that it exists in a constant buffer in the shader.\n");
+		}
+		return handle;
+	}
+
+	handle.BufferIndex = (unsigned short)var->ConstantBufferIndex;
+	handle.ByteOffset = (unsigned short)var->ByteOffset;
+	handle.Size = var->Size;
+	return handle;
+}
+
 // --------------------------------------------------------
 // Gets info about an SRV in the shader (or null)
 //
 // name - the name of the SRV
 // --------------------------------------------------------
-const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(std::string name)
+const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(std::string_view name)
 {
+	if (!layout)
+		return 0;
+
 	// Look for the key
-	std::unordered_map<std::string, SimpleSRV*>::iterator result =
-		textureTable.find(name);
+	auto result = layout->TextureTable.find(name);
 
 	// Did we find the key?
-	if (result == textureTable.end())
+	if (result == layout->TextureTable.end())
 		return 0;
 
 	// Success
-	return result->second;
+	return &layout->ShaderResourceViews[result->second];
 }
 
 
@@ -596,10 +1241,10 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(std::string name)
 const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(unsigned int index)
 {
 	// Valid index?
-	if (index >= shaderResourceViews.size()) return 0;
+	if (!layout || index >= layout->ShaderResourceViews.size()) return 0;
 
 	// Grab the bind index
-	return shaderResourceViews[index];
+	return &layout->ShaderResourceViews[index];
 }
 
 
@@ -608,18 +1253,20 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(unsigned int index)
 // 
 // name - the name of the sampler
 // --------------------------------------------------------
-const SimpleSampler* ISimpleShader::GetSamplerInfo(std::string name)
+const SimpleSampler* ISimpleShader::GetSamplerInfo(std::string_view name)
 {
+	if (!layout)
+		return 0;
+
 	// Look for the key
-	std::unordered_map<std::string, SimpleSampler*>::iterator result =
-		samplerTable.find(name);
+	auto result = layout->SamplerTable.find(name);
 
 	// Did we find the key?
-	if (result == samplerTable.end())
+	if (result == layout->SamplerTable.end())
 		return 0;
 
 	// Success
-	return result->second;
+	return &layout->SamplerStates[result->second];
 }
 
 // --------------------------------------------------------
@@ -630,10 +1277,10 @@ const SimpleSampler* ISimpleShader::GetSamplerInfo(std::string name)
 const SimpleSampler* ISimpleShader::GetSamplerInfo(unsigned int index)
 {
 	// Valid index?
-	if (index >= samplerStates.size()) return 0;
+	if (!layout || index >= layout->SamplerStates.size()) return 0;
 
 	// Grab the bind index
-	return samplerStates[index];
+	return &layout->SamplerStates[index];
 }
 
 
@@ -661,7 +1308,7 @@ unsigned int ISimpleShader::GetBufferSize(unsigned int index)
 // Gets info about a particular constant buffer 
 // by name, if it exists
 // --------------------------------------------------------
-const SimpleConstantBuffer * ISimpleShader::GetBufferInfo(std::string name)
+const SimpleConstantBuffer * ISimpleShader::GetBufferInfo(std::string_view name)
 {
 	return FindConstantBuffer(name);
 }
@@ -767,29 +1414,14 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		return true;
 
 	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
+	// reflected input signature to create an input layout that 
 	// matches what the vertex shader expects.  Code adapted from:
 	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
 
-	// Reflect shader info
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-	
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
 	// Read input layout description from shader info
 	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i< shaderDesc.InputParameters; i++)
+	for (const ShaderReflectionData::InputParameter& paramDesc : layout->Reflection.InputParameters)
 	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
-
 		// Check the semantic name for "_PER_INSTANCE"
 		std::string perInstanceStr = "_PER_INSTANCE";
 		std::string sem = paramDesc.SemanticName;
@@ -800,7 +1432,7 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 
 		// Fill out input element desc
 		D3D11_INPUT_ELEMENT_DESC elementDesc = {};
-		elementDesc.SemanticName = paramDesc.SemanticName;
+		elementDesc.SemanticName = paramDesc.SemanticName.c_str();
 		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
 		elementDesc.InputSlot = 0;
 		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
@@ -863,30 +1495,53 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 // Sets the vertex shader, input layout and constant buffers
 // for future  Direct3D drawing
 // --------------------------------------------------------
-void SimpleVertexShader::SetShaderAndCBs()
+void SimpleVertexShader::SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	cache.IASetInputLayout(inputLayout.Get());
+	cache.VSSetShader(shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (buffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		BindConstantBuffer(cache, buffers[i]);
 	}
 }
 
+// --------------------------------------------------------
+// Binds one constant buffer to the vertex stage - from the
+// ring, if that's where its data is
+// --------------------------------------------------------
+void SimpleVertexShader::BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb)
+{
+	if (IsInRing(cb))
+	{
+		ID3D11Buffer* ringBuffer = constantBufferRing->GetBuffer();
+		cache.SetConstantBuffers1(ShaderStage::Vertex, cb.BindIndex, 1, &ringBuffer, &cb.RingFirstConstant, &cb.RingConstantCount);
+	}
+	else
+	{
+		cache.SetConstantBuffers(ShaderStage::Vertex, cb.BindIndex, 1, cb.ConstantBuffer.GetAddressOf());
+	}
+}
+
+// --------------------------------------------------------
+// Encodes setting the shader and input layout
+// --------------------------------------------------------
+void SimpleVertexShader::EncodeShader(CommandStream& stream)
+{
+	stream.SetInputLayout(inputLayout.Get());
+	stream.SetShader(ShaderStage::Vertex, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the vertex shader stage
 //
@@ -895,7 +1550,7 @@ void SimpleVertexShader::SetShaderAndCBs()
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+bool SimpleVertexShader::SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -904,14 +1559,14 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleVertexShader::SetShaderResourceView() - SRV named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	stateCache->SetShaderResources(ShaderStage::Vertex, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -925,7 +1580,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+bool SimpleVertexShader::SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -934,14 +1589,14 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleVertexShader::SetSamplerState() - Sampler named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	stateCache->SetSamplers(ShaderStage::Vertex, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1006,29 +1661,51 @@ bool SimplePixelShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob
 // Sets the pixel shader and constant buffers for
 // future  Direct3D drawing
 // --------------------------------------------------------
-void SimplePixelShader::SetShaderAndCBs()
+void SimplePixelShader::SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	cache.PSSetShader(shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (buffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		BindConstantBuffer(cache, buffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the pixel stage - from the
+// ring, if that's where its data is
+// --------------------------------------------------------
+void SimplePixelShader::BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb)
+{
+	if (IsInRing(cb))
+	{
+		ID3D11Buffer* ringBuffer = constantBufferRing->GetBuffer();
+		cache.SetConstantBuffers1(ShaderStage::Pixel, cb.BindIndex, 1, &ringBuffer, &cb.RingFirstConstant, &cb.RingConstantCount);
+	}
+	else
+	{
+		cache.SetConstantBuffers(ShaderStage::Pixel, cb.BindIndex, 1, cb.ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Encodes setting the shader
+// --------------------------------------------------------
+void SimplePixelShader::EncodeShader(CommandStream& stream)
+{
+	stream.SetShader(ShaderStage::Pixel, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the pixel shader stage
 //
@@ -1037,7 +1714,7 @@ void SimplePixelShader::SetShaderAndCBs()
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+bool SimplePixelShader::SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -1046,14 +1723,14 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 		if (ReportWarnings)
 		{
 			LogWarning("SimplePixelShader::SetShaderResourceView() - SRV named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	stateCache->SetShaderResources(ShaderStage::Pixel, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1067,7 +1744,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+bool SimplePixelShader::SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -1076,14 +1753,14 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 		if (ReportWarnings)
 		{
 			LogWarning("SimplePixelShader::SetSamplerState() - Sampler named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	stateCache->SetSamplers(ShaderStage::Pixel, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1150,29 +1827,51 @@ bool SimpleDomainShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 // Sets the domain shader and constant buffers for
 // future  Direct3D drawing
 // --------------------------------------------------------
-void SimpleDomainShader::SetShaderAndCBs()
+void SimpleDomainShader::SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->DSSetShader(shader.Get(), 0, 0);
+	cache.DSSetShader(shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (buffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->DSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		BindConstantBuffer(cache, buffers[i]);
 	}
 }
 
+// --------------------------------------------------------
+// Binds one constant buffer to the domain stage - from the
+// ring, if that's where its data is
+// --------------------------------------------------------
+void SimpleDomainShader::BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb)
+{
+	if (IsInRing(cb))
+	{
+		ID3D11Buffer* ringBuffer = constantBufferRing->GetBuffer();
+		cache.SetConstantBuffers1(ShaderStage::Domain, cb.BindIndex, 1, &ringBuffer, &cb.RingFirstConstant, &cb.RingConstantCount);
+	}
+	else
+	{
+		cache.SetConstantBuffers(ShaderStage::Domain, cb.BindIndex, 1, cb.ConstantBuffer.GetAddressOf());
+	}
+}
+
+// --------------------------------------------------------
+// Encodes setting the shader
+// --------------------------------------------------------
+void SimpleDomainShader::EncodeShader(CommandStream& stream)
+{
+	stream.SetShader(ShaderStage::Domain, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the domain shader stage
 //
@@ -1181,7 +1880,7 @@ void SimpleDomainShader::SetShaderAndCBs()
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleDomainShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+bool SimpleDomainShader::SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -1190,14 +1889,14 @@ bool SimpleDomainShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleDomainShader::SetShaderResourceView() - SRV named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	stateCache->SetShaderResources(ShaderStage::Domain, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1211,7 +1910,7 @@ bool SimpleDomainShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+bool SimpleDomainShader::SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -1220,14 +1919,14 @@ bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleDomainShader::SetSamplerState() - Sampler named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	stateCache->SetSamplers(ShaderStage::Domain, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1293,29 +1992,51 @@ bool SimpleHullShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 // Sets the hull shader and constant buffers for
 // future  Direct3D drawing
 // --------------------------------------------------------
-void SimpleHullShader::SetShaderAndCBs()
+void SimpleHullShader::SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->HSSetShader(shader.Get(), 0, 0);
+	cache.HSSetShader(shader.Get());
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (buffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->HSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		BindConstantBuffer(cache, buffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the hull stage - from the
+// ring, if that's where its data is
+// --------------------------------------------------------
+void SimpleHullShader::BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb)
+{
+	if (IsInRing(cb))
+	{
+		ID3D11Buffer* ringBuffer = constantBufferRing->GetBuffer();
+		cache.SetConstantBuffers1(ShaderStage::Hull, cb.BindIndex, 1, &ringBuffer, &cb.RingFirstConstant, &cb.RingConstantCount);
+	}
+	else
+	{
+		cache.SetConstantBuffers(ShaderStage::Hull, cb.BindIndex, 1, cb.ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Encodes setting the shader
+// --------------------------------------------------------
+void SimpleHullShader::EncodeShader(CommandStream& stream)
+{
+	stream.SetShader(ShaderStage::Hull, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the hull shader stage
 //
@@ -1324,7 +2045,7 @@ void SimpleHullShader::SetShaderAndCBs()
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleHullShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+bool SimpleHullShader::SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -1333,14 +2054,14 @@ bool SimpleHullShader::SetShaderResourceView(std::string name, Microsoft::WRL::C
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleHullShader::SetShaderResourceView() - SRV named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	stateCache->SetShaderResources(ShaderStage::Hull, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1354,7 +2075,7 @@ bool SimpleHullShader::SetShaderResourceView(std::string name, Microsoft::WRL::C
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+bool SimpleHullShader::SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -1363,14 +2084,14 @@ bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleHullShader::SetSamplerState() - Sampler named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	stateCache->SetSamplers(ShaderStage::Hull, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1567,29 +2288,51 @@ void SimpleGeometryShader::UnbindStreamOutStage(Microsoft::WRL::ComPtr<ID3D11Dev
 // Sets the geometry shader and constant buffers for
 // future  Direct3D drawing
 // --------------------------------------------------------
-void SimpleGeometryShader::SetShaderAndCBs()
+void SimpleGeometryShader::SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->GSSetShader(shader.Get(), 0, 0);
+	cache.GSSetShader(shader.Get());
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (buffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->GSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		BindConstantBuffer(cache, buffers[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Binds one constant buffer to the geometry stage - from the
+// ring, if that's where its data is
+// --------------------------------------------------------
+void SimpleGeometryShader::BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb)
+{
+	if (IsInRing(cb))
+	{
+		ID3D11Buffer* ringBuffer = constantBufferRing->GetBuffer();
+		cache.SetConstantBuffers1(ShaderStage::Geometry, cb.BindIndex, 1, &ringBuffer, &cb.RingFirstConstant, &cb.RingConstantCount);
+	}
+	else
+	{
+		cache.SetConstantBuffers(ShaderStage::Geometry, cb.BindIndex, 1, cb.ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Encodes setting the shader
+// --------------------------------------------------------
+void SimpleGeometryShader::EncodeShader(CommandStream& stream)
+{
+	stream.SetShader(ShaderStage::Geometry, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the Geometry shader stage
 //
@@ -1598,7 +2341,7 @@ void SimpleGeometryShader::SetShaderAndCBs()
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleGeometryShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+bool SimpleGeometryShader::SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -1607,14 +2350,14 @@ bool SimpleGeometryShader::SetShaderResourceView(std::string name, Microsoft::WR
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleGeometryShader::SetShaderResourceView() - SRV named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	stateCache->SetShaderResources(ShaderStage::Geometry, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1628,7 +2371,7 @@ bool SimpleGeometryShader::SetShaderResourceView(std::string name, Microsoft::WR
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleGeometryShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+bool SimpleGeometryShader::SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -1637,14 +2380,14 @@ bool SimpleGeometryShader::SetSamplerState(std::string name, Microsoft::WRL::Com
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleGeometryShader::SetSamplerState() - Sampler named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	stateCache->SetSamplers(ShaderStage::Geometry, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1702,8 +2445,6 @@ SimpleComputeShader::~SimpleComputeShader()
 void SimpleComputeShader::CleanUp()
 {
 	ISimpleShader::CleanUp();
-
-	uavTable.clear();
 }
 
 // --------------------------------------------------------
@@ -1730,44 +2471,11 @@ bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBl
 	if (result != S_OK)
 		return false;
 
-	// Set up shader reflection to get information about UAV's
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-	
-	// Grab the thread info
-	threadsTotal = refl->GetThreadGroupSize(
-		&threadsX,
-		&threadsY,
-		&threadsZ);
-
-	// Loop and get all UAV resources
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
-	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
-
-		// Check the type, looking for any kind of UAV
-		switch (resourceDesc.Type)
-		{
-		case D3D_SIT_UAV_APPEND_STRUCTURED:
-		case D3D_SIT_UAV_CONSUME_STRUCTURED:
-		case D3D_SIT_UAV_RWBYTEADDRESS:
-		case D3D_SIT_UAV_RWSTRUCTURED:
-		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
-		case D3D_SIT_UAV_RWTYPED:
-			uavTable.insert(std::pair<std::string, unsigned int>(resourceDesc.Name, resourceDesc.BindPoint));
-		}
-	}
+	// Grab the thread info - the UAVs are already in the layout
+	threadsX = layout->Reflection.ThreadGroupSize[0];
+	threadsY = layout->Reflection.ThreadGroupSize[1];
+	threadsZ = layout->Reflection.ThreadGroupSize[2];
+	threadsTotal = threadsX * threadsY * threadsZ;
 
 	// All set
 	return true;
@@ -1777,29 +2485,51 @@ bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBl
 // Sets the Compute shader and constant buffers for
 // future  Direct3D drawing
 // --------------------------------------------------------
-void SimpleComputeShader::SetShaderAndCBs()
+void SimpleComputeShader::SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->CSSetShader(shader.Get(), 0, 0);
+	cache.CSSetShader(shader.Get());
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		if (buffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->CSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		BindConstantBuffer(cache, buffers[i]);
 	}
 }
 
+// --------------------------------------------------------
+// Binds one constant buffer to the compute stage - from the
+// ring, if that's where its data is
+// --------------------------------------------------------
+void SimpleComputeShader::BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb)
+{
+	if (IsInRing(cb))
+	{
+		ID3D11Buffer* ringBuffer = constantBufferRing->GetBuffer();
+		cache.SetConstantBuffers1(ShaderStage::Compute, cb.BindIndex, 1, &ringBuffer, &cb.RingFirstConstant, &cb.RingConstantCount);
+	}
+	else
+	{
+		cache.SetConstantBuffers(ShaderStage::Compute, cb.BindIndex, 1, cb.ConstantBuffer.GetAddressOf());
+	}
+}
+
+// --------------------------------------------------------
+// Encodes setting the shader
+// --------------------------------------------------------
+void SimpleComputeShader::EncodeShader(CommandStream& stream)
+{
+	stream.SetShader(ShaderStage::Compute, shader.Get());
+}
+
 // --------------------------------------------------------
 // Dispatches the compute shader with the specified amount 
 // of groups, using the number of threads per group
@@ -1856,7 +2586,7 @@ void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int
 // --------------------------------------------------------
 // Determines if this shader has the specified UAV
 // --------------------------------------------------------
-bool SimpleComputeShader::HasUnorderedAccessView(std::string name)
+bool SimpleComputeShader::HasUnorderedAccessView(std::string_view name)
 {
 	return GetUnorderedAccessViewIndex(name) != -1;
 }
@@ -1869,7 +2599,7 @@ bool SimpleComputeShader::HasUnorderedAccessView(std::string name)
 //
 // Returns true if a texture of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleComputeShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+bool SimpleComputeShader::SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	// Look for the variable and verify
 	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
@@ -1878,14 +2608,14 @@ bool SimpleComputeShader::SetShaderResourceView(std::string name, Microsoft::WRL
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleComputeShader::SetShaderResourceView() - SRV named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	stateCache->SetShaderResources(ShaderStage::Compute, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1899,7 +2629,7 @@ bool SimpleComputeShader::SetShaderResourceView(std::string name, Microsoft::WRL
 //
 // Returns true if a sampler of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+bool SimpleComputeShader::SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
 	// Look for the variable and verify
 	const SimpleSampler* sampInfo = GetSamplerInfo(name);
@@ -1908,14 +2638,14 @@ bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComP
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleComputeShader::SetSamplerState() - Sampler named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	stateCache->SetSamplers(ShaderStage::Compute, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1930,7 +2660,7 @@ bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComP
 //
 // Returns true if a UAV of the given name was found, false otherwise
 // --------------------------------------------------------
-bool SimpleComputeShader::SetUnorderedAccessView(std::string name, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav, unsigned int appendConsumeOffset)
+bool SimpleComputeShader::SetUnorderedAccessView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav, unsigned int appendConsumeOffset)
 {
 	// Look for the variable and verify
 	unsigned int bindIndex = GetUnorderedAccessViewIndex(name);
@@ -1939,7 +2669,7 @@ bool SimpleComputeShader::SetUnorderedAccessView(std::string name, Microsoft::WR
 		if (ReportWarnings)
 		{
 			LogWarning("SimpleComputeShader::SetUnorderedAccessView() - UAV named '");
-			Log(name);
+			Log(std::string(name));
 			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
 		}
 		return false;
@@ -1955,14 +2685,16 @@ bool SimpleComputeShader::SetUnorderedAccessView(std::string name, Microsoft::WR
 // --------------------------------------------------------
 // Gets the index of the specified UAV (or -1)
 // --------------------------------------------------------
-int SimpleComputeShader::GetUnorderedAccessViewIndex(std::string name)
+int SimpleComputeShader::GetUnorderedAccessViewIndex(std::string_view name)
 {
+	if (!layout)
+		return -1;
+
 	// Look for the key
-	std::unordered_map<std::string, unsigned int>::iterator result =
-		uavTable.find(name);
+	auto result = layout->UAVTable.find(name);
 
 	// Did we find the key?
-	if (result == uavTable.end())
+	if (result == layout->UAVTable.end())
 		return -1;
 
 	// Success
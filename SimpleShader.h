@@ -3,14 +3,28 @@
 #pragma comment(lib, "d3dcompiler.lib")
 
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #include <wrl/client.h>
 
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
+#include "ShaderReflectionCache.h"
+#include "StateCache.h"
+
+class CommandStream;
+class ConstantBufferRing;
+class RenderContext;
 
 // --------------------------------------------------------
 // Used by simple shaders to store information about
@@ -24,21 +38,132 @@ struct SimpleShaderVariable
 };
 
 // --------------------------------------------------------
-// Contains information about a specific
-// constant buffer in a shader, as well as
-// the local data buffer for it
+// A shader variable that has already been looked up, so
+// setting it is just a bounds check and a memcpy.  Only
+// meaningful for the shader that handed it out.
 // --------------------------------------------------------
-struct SimpleConstantBuffer
+struct ShaderVarHandle
+{
+	unsigned short BufferIndex = 0xFFFF;	// Invalid until looked up
+	unsigned short ByteOffset = 0;			// Constant buffers are at most 64KB
+	unsigned int Size = 0;
+
+	bool IsValid() const { return BufferIndex != 0xFFFF; }
+};
+
+// --------------------------------------------------------
+// One member of a C++ struct that mirrors an HLSL cbuffer
+// --------------------------------------------------------
+struct ConstantBufferField
+{
+	const char* Name;
+	unsigned int ByteOffset;
+	unsigned int Size;
+};
+
+#define CBUFFER_FIELD(Struct, Member) ConstantBufferField{ #Member, (unsigned int)offsetof(Struct, Member), (unsigned int)sizeof(Struct::Member) }
+
+// --------------------------------------------------------
+// Says which cbuffer a C++ struct mirrors.  Specialize it
+// next to the struct, listing every member the shader has
+// (but not padding), in order:
+//
+//   template<> struct ConstantBufferLayout<MyData>
+//   {
+//       static constexpr const char* Name = "MyBuffer";
+//       static constexpr ConstantBufferField Fields[] =
+//       {
+//           CBUFFER_FIELD(MyData, color),
+//           CBUFFER_FIELD(MyData, intensity),
+//       };
+//   };
+//   static_assert(IsValidConstantBufferLayout<MyData>(), "...");
+//
+// The static_assert checks the HLSL packing rules.  Whether
+// it matches the compiled shader is checked when a handle
+// is looked up with GetConstantBufferHandle<MyData>().
+// --------------------------------------------------------
+template<typename T> struct ConstantBufferLayout;
+
+// A member can't straddle a 16-byte register unless it starts on one
+constexpr bool FitsConstantBufferPacking(unsigned int offset, unsigned int size)
+{
+	return offset % 16 == 0 || offset % 16 + size <= 16;
+}
+
+template<typename T>
+constexpr bool IsValidConstantBufferLayout()
+{
+	// Has to be memcpy-able, and a whole number of registers
+	if (!std::is_trivially_copyable<T>::value || !std::is_standard_layout<T>::value || sizeof(T) % 16 != 0)
+		return false;
+
+	unsigned int end = 0;
+	for (const ConstantBufferField& field : ConstantBufferLayout<T>::Fields)
+	{
+		if (field.ByteOffset < end || !FitsConstantBufferPacking(field.ByteOffset, field.Size))
+			return false;
+		end = field.ByteOffset + field.Size;
+	}
+	return end <= sizeof(T);
+}
+
+// --------------------------------------------------------
+// A constant buffer that has been checked against a C++
+// struct, so it can be filled with a single memcpy.  Only
+// meaningful for the shader that handed it out.
+// --------------------------------------------------------
+template<typename T>
+struct ConstantBufferHandle
+{
+	unsigned short BufferIndex = 0xFFFF;	// Invalid until looked up
+
+	bool IsValid() const { return BufferIndex != 0xFFFF; }
+};
+
+// --------------------------------------------------------
+// What reflection says about a specific constant buffer
+// in a shader - shared by every instance of the shader
+// --------------------------------------------------------
+struct SimpleConstantBufferLayout
 {
 	std::string Name;
 	D3D_CBUFFER_TYPE Type = D3D_CBUFFER_TYPE::D3D11_CT_CBUFFER;
 	unsigned int Size = 0;
 	unsigned int BindIndex = 0;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
-	unsigned char* LocalDataBuffer = 0;
+	unsigned int DataOffset = 0;	// Where its local data starts in an instance's data block
 	std::vector<SimpleShaderVariable> Variables;
 };
 
+// --------------------------------------------------------
+// Contains one shader instance's copy of a specific
+// constant buffer - the GPU buffer and the local data
+// buffer for it
+// --------------------------------------------------------
+struct SimpleConstantBuffer
+{
+	const SimpleConstantBufferLayout* Layout = 0;	// Name, variables, etc.
+
+	// Copied from the layout, since every upload and bind needs them
+	D3D_CBUFFER_TYPE Type = D3D_CBUFFER_TYPE::D3D11_CT_CBUFFER;
+	unsigned int Size = 0;
+	unsigned int BindIndex = 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
+	unsigned char* LocalDataBuffer = 0;	// Points into the shader's data block
+
+	// Bytes of LocalDataBuffer changed since the last upload - [DirtyStart, DirtyEnd)
+	bool Dirty = true;
+	unsigned int DirtyStart = 0;
+	unsigned int DirtyEnd = 0;
+
+	// Where the data last went in a ConstantBufferRing, in 16-byte
+	// constants, and the ring generation it went in (0 = never)
+	unsigned int RingGeneration = 0;
+	unsigned int RingFirstConstant = 0;
+	unsigned int RingConstantCount = 0;
+};
+
 // --------------------------------------------------------
 // Contains info about a single SRV in a shader
 // --------------------------------------------------------
@@ -57,6 +182,32 @@ struct SimpleSampler
 	unsigned int BindIndex; // The register of the Sampler
 };
 
+// --------------------------------------------------------
+// The reflected layout of one compiled shader file.  It's
+// built the first time the file is loaded, then shared
+// (read-only) by every shader instance loaded from it.
+// --------------------------------------------------------
+struct SimpleShaderLayout
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> ShaderBlob;
+
+	std::vector<SimpleConstantBufferLayout> ConstantBuffers;
+	std::vector<SimpleSRV> ShaderResourceViews;
+	std::vector<SimpleSampler> SamplerStates;
+	unsigned int DataSize = 0;	// All constant buffers' local data, back to back
+
+	// What the layout was built from (also has the input signature)
+	ShaderReflectionData Reflection;
+
+	// Lookup tables - keys are views of the names in Reflection
+	// (or of a constant buffer's own Name)
+	std::unordered_map<std::string_view, unsigned int> CBTable;		// Index into ConstantBuffers
+	std::unordered_map<std::string_view, SimpleShaderVariable> VarTable;
+	std::unordered_map<std::string_view, unsigned int> TextureTable;	// Index into ShaderResourceViews
+	std::unordered_map<std::string_view, unsigned int> SamplerTable;	// Index into SamplerStates
+	std::unordered_map<std::string_view, unsigned int> UAVTable;		// Bind point
+};
+
 // --------------------------------------------------------
 // Base abstract class for simplifying shader handling
 // --------------------------------------------------------
@@ -68,91 +219,213 @@ public:
 
 	// Simple helpers
 	bool IsShaderValid() { return shaderValid; }
+	unsigned int GetId() { return id; }	// Unique per shader object, for sort keys
 
 	// Activating the shader and copying data
 	void SetShader();
 	void CopyAllBufferData();
 	void CopyBufferData(unsigned int index);
-	void CopyBufferData(std::string bufferName);
+	void CopyBufferData(std::string_view bufferName);
+
+	// The same, encoded into a RenderContext's command stream, so
+	// more than one thread can draw at once.  Every RenderContext
+	// slot has its own copy of this shader's constants (slot 0 is
+	// the copy everything else here uses), set, uploaded and bound
+	// only through that context.
+	static const unsigned int MaxContextSlots = 16;
+	void SetShader(RenderContext& context);
+	void CopyAllBufferData(RenderContext& context);
 
 	// Sets arbitrary shader data
-	bool SetData(std::string name, const void* data, unsigned int size);
-
-	bool SetInt(std::string name, int data);
-	bool SetFloat(std::string name, float data);
-	bool SetFloat2(std::string name, const float data[2]);
-	bool SetFloat2(std::string name, const DirectX::XMFLOAT2 data);
-	bool SetFloat3(std::string name, const float data[3]);
-	bool SetFloat3(std::string name, const DirectX::XMFLOAT3 data);
-	bool SetFloat4(std::string name, const float data[4]);
-	bool SetFloat4(std::string name, const DirectX::XMFLOAT4 data);
-	bool SetMatrix4x4(std::string name, const float data[16]);
-	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
+	bool SetData(std::string_view name, const void* data, unsigned int size);
+
+	bool SetInt(std::string_view name, int data);
+	bool SetFloat(std::string_view name, float data);
+	bool SetFloat2(std::string_view name, const float data[2]);
+	bool SetFloat2(std::string_view name, const DirectX::XMFLOAT2 data);
+	bool SetFloat3(std::string_view name, const float data[3]);
+	bool SetFloat3(std::string_view name, const DirectX::XMFLOAT3 data);
+	bool SetFloat4(std::string_view name, const float data[4]);
+	bool SetFloat4(std::string_view name, const DirectX::XMFLOAT4 data);
+	bool SetMatrix4x4(std::string_view name, const float data[16]);
+	bool SetMatrix4x4(std::string_view name, const DirectX::XMFLOAT4X4 data);
+
+	// Sets shader data through handles from GetVariableHandle()
+	bool SetData(ShaderVarHandle handle, const void* data, unsigned int size);
+
+	bool SetInt(ShaderVarHandle handle, int data);
+	bool SetFloat(ShaderVarHandle handle, float data);
+	bool SetFloat2(ShaderVarHandle handle, const float data[2]);
+	bool SetFloat2(ShaderVarHandle handle, const DirectX::XMFLOAT2 data);
+	bool SetFloat3(ShaderVarHandle handle, const float data[3]);
+	bool SetFloat3(ShaderVarHandle handle, const DirectX::XMFLOAT3 data);
+	bool SetFloat4(ShaderVarHandle handle, const float data[4]);
+	bool SetFloat4(ShaderVarHandle handle, const DirectX::XMFLOAT4 data);
+	bool SetMatrix4x4(ShaderVarHandle handle, const float data[16]);
+	bool SetMatrix4x4(ShaderVarHandle handle, const DirectX::XMFLOAT4X4 data);
+
+	// Sets a whole constant buffer from its C++ mirror (see ConstantBufferLayout)
+	template<typename T>
+	bool SetBufferData(ConstantBufferHandle<T> handle, const T& data)
+	{
+		if (handle.BufferIndex >= constantBufferCount || sizeof(T) > constantBuffers[handle.BufferIndex].Size)
+			return false;
+
+		WriteBufferData(constantBuffers[handle.BufferIndex], 0, &data, sizeof(T));
+		return true;
+	}
+
+	template<typename T>
+	bool SetBufferData(RenderContext& context, ConstantBufferHandle<T> handle, const T& data)
+	{
+		SimpleConstantBuffer* buffers = GetContextBuffers(context);
+		if (!buffers || handle.BufferIndex >= constantBufferCount || sizeof(T) > buffers[handle.BufferIndex].Size)
+			return false;
+
+		WriteBufferData(buffers[handle.BufferIndex], 0, &data, sizeof(T));
+		return true;
+	}
 
 	// Setting shader resources
-	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
-	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
+	virtual bool SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
+	virtual bool SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
+
+	// Bound through the context's own state cache instead
+	bool SetShaderResourceView(RenderContext& context, std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(RenderContext& context, std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
 	// Simple resource checking
-	bool HasVariable(std::string name);
-	bool HasShaderResourceView(std::string name);
-	bool HasSamplerState(std::string name);
+	bool HasVariable(std::string_view name);
+	bool HasShaderResourceView(std::string_view name);
+	bool HasSamplerState(std::string_view name);
 
 	// Getting data about variables and resources
-	const SimpleShaderVariable* GetVariableInfo(std::string name);
+	const SimpleShaderVariable* GetVariableInfo(std::string_view name);
+	ShaderVarHandle GetVariableHandle(std::string_view name);
+
+	// Checks a struct against the cbuffer it mirrors, once.  Returns
+	// an invalid handle (and reports why) if they don't match.
+	template<typename T>
+	ConstantBufferHandle<T> GetConstantBufferHandle()
+	{
+		static_assert(IsValidConstantBufferLayout<T>(), "Struct doesn't follow HLSL constant buffer packing");
+
+		ConstantBufferHandle<T> handle;
+		int index = MatchConstantBuffer(
+			ConstantBufferLayout<T>::Name,
+			sizeof(T),
+			ConstantBufferLayout<T>::Fields,
+			(unsigned int)std::size(ConstantBufferLayout<T>::Fields));
+		if (index >= 0)
+			handle.BufferIndex = (unsigned short)index;
+		return handle;
+	}
 	
-	const SimpleSRV* GetShaderResourceViewInfo(std::string name);
+	const SimpleSRV* GetShaderResourceViewInfo(std::string_view name);
 	const SimpleSRV* GetShaderResourceViewInfo(unsigned int index);
-	size_t GetShaderResourceViewCount() { return textureTable.size(); }
+	size_t GetShaderResourceViewCount() { return layout ? layout->ShaderResourceViews.size() : 0; }
 	
-	const SimpleSampler* GetSamplerInfo(std::string name);
+	const SimpleSampler* GetSamplerInfo(std::string_view name);
 	const SimpleSampler* GetSamplerInfo(unsigned int index);
-	size_t GetSamplerCount() { return samplerTable.size(); }
+	size_t GetSamplerCount() { return layout ? layout->SamplerStates.size() : 0; }
 
 	// Get data about constant buffers
 	unsigned int GetBufferCount();
 	unsigned int GetBufferSize(unsigned int index);
-	const SimpleConstantBuffer* GetBufferInfo(std::string name);
+	const SimpleConstantBuffer* GetBufferInfo(std::string_view name);
 	const SimpleConstantBuffer* GetBufferInfo(unsigned int index);
 	
 	// Misc getters
 	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob() { return shaderBlob; }
 
+	// When on, setting a variable to the value it already has
+	// doesn't dirty its buffer (costs a memcmp per set)
+	void SetCompareOnSet(bool compare) { compareOnSet = compare; }
+
+	// Streams this shader's constant buffers through a shared ring
+	// instead of updating each buffer in place.  Ignored if the ring
+	// isn't supported; pass null to go back to the buffers.
+	void SetConstantBufferRing(std::shared_ptr<ConstantBufferRing> ring);
+
+	// Sends every bind through a shared cache, so binding what is
+	// already bound costs nothing.  Pass null to bind directly.
+	void SetStateCache(std::shared_ptr<StateCache> cache);
+
+	// Constant buffer upload stats, across all shaders
+	static unsigned long long GetBytesUploaded() { return bytesUploaded; }
+	static unsigned long long GetBytesSkipped() { return bytesSkipped; }
+	static void ResetUploadStats() { bytesUploaded = 0; bytesSkipped = 0; }
+
 	// Error reporting
 	static bool ReportErrors;
 	static bool ReportWarnings;
 
 protected:
 	
+	static std::atomic<unsigned int> nextId;
+	unsigned int id;
 	bool shaderValid;
+	bool compareOnSet;
 	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deviceContext1;	// Only set on 11.1 runtimes
+	bool partialUpdates;	// Constant buffers can be updated a range at a time
+	std::shared_ptr<ConstantBufferRing> constantBufferRing;
+	std::shared_ptr<StateCache> stateCache;	// Never null - a pass-through cache until one is set
 
-	// Resource counts
+	static std::atomic<unsigned long long> bytesUploaded;
+	static std::atomic<unsigned long long> bytesSkipped;
+
+	// Shared reflection data - variables, buffers and resources
+	std::shared_ptr<const SimpleShaderLayout> layout;
+
+	// This instance's constant buffers.  The array and every
+	// buffer's local data live in one allocation (instanceData).
 	unsigned int constantBufferCount;
-	
-	// Maps for variables and buffers
-	SimpleConstantBuffer*		constantBuffers; // For index-based lookup
-	std::vector<SimpleSRV*>		shaderResourceViews;
-	std::vector<SimpleSampler*>	samplerStates;
-	std::unordered_map<std::string, SimpleConstantBuffer*> cbTable;
-	std::unordered_map<std::string, SimpleShaderVariable> varTable;
-	std::unordered_map<std::string, SimpleSRV*> textureTable;
-	std::unordered_map<std::string, SimpleSampler*> samplerTable;
-
-	// Initialization method
+	SimpleConstantBuffer* constantBuffers; // For index-based lookup
+	unsigned char* instanceData;
+
+	// The same for every other RenderContext slot, made the first time
+	// the slot is used.  A slot only ever belongs to one thread at a
+	// time, so its entry needs no lock.  Entry 0 is unused.
+	SimpleConstantBuffer* contextBuffers[MaxContextSlots];
+	unsigned char* contextData[MaxContextSlots];
+
+	// Layouts already loaded, by file.  Weak, so a layout goes
+	// away along with the last shader using it.
+	static std::mutex layoutCacheMutex;
+	static std::unordered_map<std::wstring, std::weak_ptr<const SimpleShaderLayout>> layoutCache;
+
+	// Initialization methods
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	static bool ReflectShader(Microsoft::WRL::ComPtr<ID3DBlob> blob, ShaderReflectionData& reflection);
+	static std::shared_ptr<SimpleShaderLayout> BuildLayout(Microsoft::WRL::ComPtr<ID3DBlob> blob, ShaderReflectionData reflection);
+	void CreateInstanceData();
+	unsigned char* CreateBufferSet(SimpleConstantBuffer*& buffers);
+	void DestroyBufferSet(unsigned char*& data, SimpleConstantBuffer*& buffers);
+	SimpleConstantBuffer* GetContextBuffers(RenderContext& context);
 
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
-	virtual void SetShaderAndCBs() = 0;
+	virtual void SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers) = 0;
+	virtual void BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb) = 0;
+	virtual void EncodeShader(CommandStream& stream) = 0;
+	virtual ShaderStage GetStage() = 0;
 
 	virtual void CleanUp();
 
 	// Helpers for finding data by name
-	SimpleShaderVariable* FindVariable(std::string name, int size);
-	SimpleConstantBuffer* FindConstantBuffer(std::string name);
+	const SimpleShaderVariable* FindVariable(std::string_view name, int size);
+	SimpleConstantBuffer* FindConstantBuffer(std::string_view name);
+	int MatchConstantBuffer(std::string_view name, unsigned int size, const ConstantBufferField* fields, unsigned int fieldCount);
+
+	// Constant buffer data helpers
+	void WriteBufferData(SimpleConstantBuffer& cb, unsigned int offset, const void* data, unsigned int size);
+	void UploadBuffer(SimpleConstantBuffer& cb);
+	void EncodeUpload(CommandStream& stream, SimpleConstantBuffer& cb, bool immediate);
+	void EncodeConstantBuffer(CommandStream& stream, SimpleConstantBuffer& cb);
+	bool IsInRing(const SimpleConstantBuffer& cb);
 
 	// Error logging
 	void Log(std::string message, WORD color);
@@ -178,15 +451,20 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> GetInputLayout() { return inputLayout; }
 	bool GetPerInstanceCompatible() { return perInstanceCompatible; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	bool perInstanceCompatible;
 	 Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 	 Microsoft::WRL::ComPtr<ID3D11VertexShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
-	void SetShaderAndCBs();
+	void SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers);
+	void BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb);
+	void EncodeShader(CommandStream& stream);
+	ShaderStage GetStage() { return ShaderStage::Vertex; }
 	void CleanUp();
 };
 
@@ -201,13 +479,18 @@ public:
 	~SimplePixelShader();
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
-	void SetShaderAndCBs();
+	void SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers);
+	void BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb);
+	void EncodeShader(CommandStream& stream);
+	ShaderStage GetStage() { return ShaderStage::Pixel; }
 	void CleanUp();
 };
 
@@ -221,13 +504,18 @@ public:
 	~SimpleDomainShader();
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
-	void SetShaderAndCBs();
+	void SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers);
+	void BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb);
+	void EncodeShader(CommandStream& stream);
+	ShaderStage GetStage() { return ShaderStage::Domain; }
 	void CleanUp();
 };
 
@@ -241,13 +529,18 @@ public:
 	~SimpleHullShader();
 	Microsoft::WRL::ComPtr<ID3D11HullShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11HullShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
-	void SetShaderAndCBs();
+	void SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers);
+	void BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb);
+	void EncodeShader(CommandStream& stream);
+	ShaderStage GetStage() { return ShaderStage::Hull; }
 	void CleanUp();
 };
 
@@ -261,8 +554,10 @@ public:
 	~SimpleGeometryShader();
 	Microsoft::WRL::ComPtr<ID3D11GeometryShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	bool SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 	bool CreateCompatibleStreamOutBuffer(Microsoft::WRL::ComPtr<ID3D11Buffer> buffer, int vertexCount);
 
@@ -279,7 +574,10 @@ protected:
 
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	bool CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
-	void SetShaderAndCBs();
+	void SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers);
+	void BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb);
+	void EncodeShader(CommandStream& stream);
+	ShaderStage GetStage() { return ShaderStage::Geometry; }
 	void CleanUp();
 
 	// Helpers
@@ -300,17 +598,18 @@ public:
 	void DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ);
 	void DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ);
 
-	bool HasUnorderedAccessView(std::string name);
+	bool HasUnorderedAccessView(std::string_view name);
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
-	bool SetUnorderedAccessView(std::string name, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav, unsigned int appendConsumeOffset = -1);
+	bool SetShaderResourceView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(std::string_view name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
+	bool SetUnorderedAccessView(std::string_view name, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav, unsigned int appendConsumeOffset = -1);
 
-	int GetUnorderedAccessViewIndex(std::string name);
+	int GetUnorderedAccessViewIndex(std::string_view name);
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11ComputeShader> shader;
-	std::unordered_map<std::string, unsigned int> uavTable;
 
 	unsigned int threadsX;
 	unsigned int threadsY;
@@ -318,6 +617,9 @@ protected:
 	unsigned int threadsTotal;
 
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
-	void SetShaderAndCBs();
+	void SetShaderAndCBs(StateCache& cache, SimpleConstantBuffer* buffers);
+	void BindConstantBuffer(StateCache& cache, SimpleConstantBuffer& cb);
+	void EncodeShader(CommandStream& stream);
+	ShaderStage GetStage() { return ShaderStage::Compute; }
 	void CleanUp();
 };
\ No newline at end of file
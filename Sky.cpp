@@ -1,22 +1,23 @@
 #include "Sky.h"
 
-Sky::Sky(std::shared_ptr<Mesh> mesh, Microsoft::WRL::ComPtr<ID3D11SamplerState> _samplerState, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> _skySRV, std::shared_ptr<SimplePixelShader> _pixelShader, std::shared_ptr<SimpleVertexShader> _vertexShader)
+Sky::Sky(std::shared_ptr<Mesh> mesh, Microsoft::WRL::ComPtr<ID3D11SamplerState> _samplerState, std::shared_ptr<PipelineStateCache> pipelines, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> _skySRV, std::shared_ptr<SimplePixelShader> _pixelShader, std::shared_ptr<SimpleVertexShader> _vertexShader)
 {
 	skyMesh = mesh;
 	samplerState = _samplerState;
 	skySRV = _skySRV;
 	pixelShader = _pixelShader;
 	vertexShader = _vertexShader;
+	vsData = vertexShader->GetConstantBufferHandle<SkyVSData>();
 
-	D3D11_RASTERIZER_DESC rasterizerDesc = {};
-	rasterizerDesc.FillMode = D3D11_FILL_SOLID;
-	rasterizerDesc.CullMode = D3D11_CULL_FRONT;
-	device->CreateRasterizerState(&rasterizerDesc, rasterizerState.GetAddressOf());
-
-	D3D11_DEPTH_STENCIL_DESC stencilDesc = {};
-	stencilDesc.DepthEnable = true;
-	stencilDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-	device->CreateDepthStencilState(&stencilDesc, depthStencilState.GetAddressOf());
+	//culling the outside, and passing depth equal to the cleared far plane - without writing it
+	PipelineStateDesc desc;
+	desc.vertexShader = vertexShader;
+	desc.pixelShader = pixelShader;
+	desc.rasterizer.CullMode = D3D11_CULL_FRONT;
+	desc.rasterizer.DepthClipEnable = false;
+	desc.depthStencil.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	desc.depthStencil.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	pipelineState = pipelines->Get(desc);
 }
 
 Sky::~Sky()
@@ -52,33 +53,28 @@ Sky::~Sky()
 //	skySRV = CreateCubemap(right, left, up, down, front, back);
 //}
 
-void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera)
+void Sky::Draw(RenderContext& renderContext, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection)
 {
-	context->RSSetState(rasterizerState.Get());
-	context->OMSetDepthStencilState(depthStencilState.Get(), 0);
+	CommandStream& stream = renderContext.GetStream();
 
-	//activating shaders
-	vertexShader->SetShader();
-	pixelShader->SetShader();
+	//shaders and render states
+	pipelineState->Bind(renderContext);
 
-	pixelShader->SetSamplerState("BasicSampler", samplerState);
-	pixelShader->SetShaderResourceView("CubeMap", skySRV);
+	pixelShader->SetSamplerState(renderContext, "BasicSampler", samplerState);
+	pixelShader->SetShaderResourceView(renderContext, "CubeMap", skySRV);
 
 	//putting data into buffer
-	vertexShader->SetMatrix4x4("view", camera->GetView());
-	vertexShader->SetMatrix4x4("projection", camera->GetProjection());
+	SkyVSData data;
+	data.view = view;
+	data.projection = projection;
+	vertexShader->SetBufferData(renderContext, vsData, data);
 
-	//map, memcpy, unmap constant buffer
-	vertexShader->CopyAllBufferData();
-	pixelShader->CopyAllBufferData();
+	//copy constant buffers into the stream
+	vertexShader->CopyAllBufferData(renderContext);
+	pixelShader->CopyAllBufferData(renderContext);
 
 	//draw the mesh
-	skyMesh->Draw();
-
-	//resetting render states
-	//not entirely sure what should be reset here
-	context->RSSetState(0);
-	context->OMSetDepthStencilState(0, 0);
+	skyMesh->Draw(stream);
 }
 
 //void Sky::InitRenderStates()
@@ -6,6 +6,9 @@
 #include <memory>
 #include "Mesh.h"
 #include "SimpleShader.h"
+#include "BufferStructs.h"
+#include "CommandRecorder.h"
+#include "PipelineState.h"
 #include "DDSTextureLoader.h"
 #include "Camera.h"
 #include "WICTextureLoader.h"
@@ -15,7 +18,7 @@ class Sky
 public:
 	Sky(std::shared_ptr<Mesh> mesh, 
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> _samplerState, 
-		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		std::shared_ptr<PipelineStateCache> pipelines,
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> _skySRV, 
 		std::shared_ptr<SimplePixelShader> _pixelShader,
 		std::shared_ptr<SimpleVertexShader> _vertexShader);
@@ -38,7 +41,7 @@ public:
 	//	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
 	//);
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera);
+	void Draw(RenderContext& renderContext, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
 
 private:
 
@@ -55,8 +58,7 @@ private:
 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> skySRV;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencilState;
-	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState;
+	std::shared_ptr<PipelineState> pipelineState;	//sky shaders, drawing the inside of the mesh at the far plane
 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
@@ -66,5 +68,6 @@ private:
 	std::shared_ptr<Mesh> skyMesh;
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	ConstantBufferHandle<SkyVSData> vsData;
 };
 
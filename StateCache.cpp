@@ -0,0 +1,407 @@
+#include "StateCache.h"
+
+#include <cassert>
+#include <cstring>
+
+// --------------------------------------------------------
+// Starts out matching a freshly cleared context
+// --------------------------------------------------------
+StateCache::StateCache(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, bool filtering)
+	: context(context), filtering(filtering), callsIssued(0), callsFiltered(0)
+{
+	context.As(&context1);
+	Reset();
+}
+
+// --------------------------------------------------------
+// Sets every slot back to what ClearState leaves behind
+// --------------------------------------------------------
+void StateCache::Reset()
+{
+	memset(stages, 0, sizeof(stages));
+
+	inputLayout = 0;
+	topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	memset(vertexBuffers, 0, sizeof(vertexBuffers));
+	indexBuffer = 0;
+	indexFormat = DXGI_FORMAT_UNKNOWN;
+	indexOffset = 0;
+
+	rasterizerState = 0;
+	depthStencilState = 0;
+	stencilRef = 0;
+	blendState = 0;
+	for (int i = 0; i < 4; i++)
+		blendFactor[i] = 1.0f;
+	sampleMask = 0xFFFFFFFF;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ SHADERS -------------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+void StateCache::VSSetShader(ID3D11VertexShader* shader)
+{
+	if (ShaderChanged(ShaderStage::Vertex, shader))
+		context->VSSetShader(shader, 0, 0);
+}
+
+void StateCache::HSSetShader(ID3D11HullShader* shader)
+{
+	if (ShaderChanged(ShaderStage::Hull, shader))
+		context->HSSetShader(shader, 0, 0);
+}
+
+void StateCache::DSSetShader(ID3D11DomainShader* shader)
+{
+	if (ShaderChanged(ShaderStage::Domain, shader))
+		context->DSSetShader(shader, 0, 0);
+}
+
+void StateCache::GSSetShader(ID3D11GeometryShader* shader)
+{
+	if (ShaderChanged(ShaderStage::Geometry, shader))
+		context->GSSetShader(shader, 0, 0);
+}
+
+void StateCache::PSSetShader(ID3D11PixelShader* shader)
+{
+	if (ShaderChanged(ShaderStage::Pixel, shader))
+		context->PSSetShader(shader, 0, 0);
+}
+
+void StateCache::CSSetShader(ID3D11ComputeShader* shader)
+{
+	if (ShaderChanged(ShaderStage::Compute, shader))
+		context->CSSetShader(shader, 0, 0);
+}
+
+// --------------------------------------------------------
+// Records a stage's shader, and whether the call is needed
+// --------------------------------------------------------
+bool StateCache::ShaderChanged(ShaderStage stage, ID3D11DeviceChild* shader)
+{
+	ID3D11DeviceChild*& cached = stages[(unsigned int)stage].shader;
+	bool changed = cached != shader;
+	cached = shader;
+	return Filter(changed);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ PER-STAGE SLOTS -----------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+// --------------------------------------------------------
+// Binds whole constant buffers
+// --------------------------------------------------------
+void StateCache::SetConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+	if (count == 0)
+		return;
+
+	// Past the end of the cached slots - a caller bug, and D3D would ignore the call anyway
+	assert(startSlot + count <= ConstantBufferSlots && "constant buffer slots out of range");
+	if (startSlot + count > ConstantBufferSlots)
+		return;
+
+	ConstantBufferBinding* cached = stages[(unsigned int)stage].constantBuffers + startSlot;
+	unsigned int first = count;
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (cached[i].buffer == buffers[i] && cached[i].constantCount == 0)
+			continue;
+
+		cached[i].buffer = buffers[i];
+		cached[i].firstConstant = 0;
+		cached[i].constantCount = 0;
+		if (first == count) first = i;
+		last = i;
+	}
+
+	if (!Filter(first < count))
+		return;
+	if (!filtering)
+	{
+		first = 0;
+		last = count - 1;
+	}
+
+	unsigned int slot = startSlot + first;
+	unsigned int slotCount = last - first + 1;
+	switch (stage)
+	{
+	case ShaderStage::Vertex:	context->VSSetConstantBuffers(slot, slotCount, buffers + first); break;
+	case ShaderStage::Hull:		context->HSSetConstantBuffers(slot, slotCount, buffers + first); break;
+	case ShaderStage::Domain:	context->DSSetConstantBuffers(slot, slotCount, buffers + first); break;
+	case ShaderStage::Geometry:	context->GSSetConstantBuffers(slot, slotCount, buffers + first); break;
+	case ShaderStage::Pixel:	context->PSSetConstantBuffers(slot, slotCount, buffers + first); break;
+	case ShaderStage::Compute:	context->CSSetConstantBuffers(slot, slotCount, buffers + first); break;
+	default: break;
+	}
+}
+
+// --------------------------------------------------------
+// Binds ranges of constant buffers - needs an 11.1 context
+// --------------------------------------------------------
+void StateCache::SetConstantBuffers1(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts)
+{
+	if (!context1 || count == 0)
+		return;
+
+	assert(startSlot + count <= ConstantBufferSlots && "constant buffer slots out of range");
+	if (startSlot + count > ConstantBufferSlots)
+		return;
+
+	ConstantBufferBinding* cached = stages[(unsigned int)stage].constantBuffers + startSlot;
+	unsigned int first = count;
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (cached[i].buffer == buffers[i] &&
+			cached[i].firstConstant == firstConstants[i] &&
+			cached[i].constantCount == constantCounts[i])
+			continue;
+
+		cached[i].buffer = buffers[i];
+		cached[i].firstConstant = firstConstants[i];
+		cached[i].constantCount = constantCounts[i];
+		if (first == count) first = i;
+		last = i;
+	}
+
+	if (!Filter(first < count))
+		return;
+	if (!filtering)
+	{
+		first = 0;
+		last = count - 1;
+	}
+
+	unsigned int slot = startSlot + first;
+	unsigned int slotCount = last - first + 1;
+	switch (stage)
+	{
+	case ShaderStage::Vertex:	context1->VSSetConstantBuffers1(slot, slotCount, buffers + first, firstConstants + first, constantCounts + first); break;
+	case ShaderStage::Hull:		context1->HSSetConstantBuffers1(slot, slotCount, buffers + first, firstConstants + first, constantCounts + first); break;
+	case ShaderStage::Domain:	context1->DSSetConstantBuffers1(slot, slotCount, buffers + first, firstConstants + first, constantCounts + first); break;
+	case ShaderStage::Geometry:	context1->GSSetConstantBuffers1(slot, slotCount, buffers + first, firstConstants + first, constantCounts + first); break;
+	case ShaderStage::Pixel:	context1->PSSetConstantBuffers1(slot, slotCount, buffers + first, firstConstants + first, constantCounts + first); break;
+	case ShaderStage::Compute:	context1->CSSetConstantBuffers1(slot, slotCount, buffers + first, firstConstants + first, constantCounts + first); break;
+	default: break;
+	}
+}
+
+// --------------------------------------------------------
+// Binds shader resource views
+// --------------------------------------------------------
+void StateCache::SetShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+	if (count == 0)
+		return;
+
+	assert(startSlot + count <= ResourceSlots && "shader resource slots out of range");
+	if (startSlot + count > ResourceSlots)
+		return;
+
+	ID3D11ShaderResourceView** cached = stages[(unsigned int)stage].resources + startSlot;
+	unsigned int first = count;
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (cached[i] == views[i])
+			continue;
+
+		cached[i] = views[i];
+		if (first == count) first = i;
+		last = i;
+	}
+
+	if (!Filter(first < count))
+		return;
+	if (!filtering)
+	{
+		first = 0;
+		last = count - 1;
+	}
+
+	unsigned int slot = startSlot + first;
+	unsigned int slotCount = last - first + 1;
+	switch (stage)
+	{
+	case ShaderStage::Vertex:	context->VSSetShaderResources(slot, slotCount, views + first); break;
+	case ShaderStage::Hull:		context->HSSetShaderResources(slot, slotCount, views + first); break;
+	case ShaderStage::Domain:	context->DSSetShaderResources(slot, slotCount, views + first); break;
+	case ShaderStage::Geometry:	context->GSSetShaderResources(slot, slotCount, views + first); break;
+	case ShaderStage::Pixel:	context->PSSetShaderResources(slot, slotCount, views + first); break;
+	case ShaderStage::Compute:	context->CSSetShaderResources(slot, slotCount, views + first); break;
+	default: break;
+	}
+}
+
+// --------------------------------------------------------
+// Binds sampler states
+// --------------------------------------------------------
+void StateCache::SetSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	if (count == 0)
+		return;
+
+	assert(startSlot + count <= SamplerSlots && "sampler slots out of range");
+	if (startSlot + count > SamplerSlots)
+		return;
+
+	ID3D11SamplerState** cached = stages[(unsigned int)stage].samplers + startSlot;
+	unsigned int first = count;
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (cached[i] == samplers[i])
+			continue;
+
+		cached[i] = samplers[i];
+		if (first == count) first = i;
+		last = i;
+	}
+
+	if (!Filter(first < count))
+		return;
+	if (!filtering)
+	{
+		first = 0;
+		last = count - 1;
+	}
+
+	unsigned int slot = startSlot + first;
+	unsigned int slotCount = last - first + 1;
+	switch (stage)
+	{
+	case ShaderStage::Vertex:	context->VSSetSamplers(slot, slotCount, samplers + first); break;
+	case ShaderStage::Hull:		context->HSSetSamplers(slot, slotCount, samplers + first); break;
+	case ShaderStage::Domain:	context->DSSetSamplers(slot, slotCount, samplers + first); break;
+	case ShaderStage::Geometry:	context->GSSetSamplers(slot, slotCount, samplers + first); break;
+	case ShaderStage::Pixel:	context->PSSetSamplers(slot, slotCount, samplers + first); break;
+	case ShaderStage::Compute:	context->CSSetSamplers(slot, slotCount, samplers + first); break;
+	default: break;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ INPUT ASSEMBLER -----------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+void StateCache::IASetInputLayout(ID3D11InputLayout* layout)
+{
+	bool changed = inputLayout != layout;
+	inputLayout = layout;
+	if (Filter(changed))
+		context->IASetInputLayout(layout);
+}
+
+void StateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	bool changed = this->topology != topology;
+	this->topology = topology;
+	if (Filter(changed))
+		context->IASetPrimitiveTopology(topology);
+}
+
+void StateCache::IASetVertexBuffers(unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	if (count == 0)
+		return;
+
+	assert(startSlot + count <= VertexBufferSlots && "vertex buffer slots out of range");
+	if (startSlot + count > VertexBufferSlots)
+		return;
+
+	VertexBufferBinding* cached = vertexBuffers + startSlot;
+	unsigned int first = count;
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (cached[i].buffer == buffers[i] && cached[i].stride == strides[i] && cached[i].offset == offsets[i])
+			continue;
+
+		cached[i].buffer = buffers[i];
+		cached[i].stride = strides[i];
+		cached[i].offset = offsets[i];
+		if (first == count) first = i;
+		last = i;
+	}
+
+	if (!Filter(first < count))
+		return;
+	if (!filtering)
+	{
+		first = 0;
+		last = count - 1;
+	}
+
+	context->IASetVertexBuffers(startSlot + first, last - first + 1, buffers + first, strides + first, offsets + first);
+}
+
+void StateCache::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	bool changed = indexBuffer != buffer || indexFormat != format || indexOffset != offset;
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	if (Filter(changed))
+		context->IASetIndexBuffer(buffer, format, offset);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ------ FIXED FUNCTION STATES -----------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+
+void StateCache::RSSetState(ID3D11RasterizerState* state)
+{
+	bool changed = rasterizerState != state;
+	rasterizerState = state;
+	if (Filter(changed))
+		context->RSSetState(state);
+}
+
+void StateCache::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	bool changed = depthStencilState != state || this->stencilRef != stencilRef;
+	depthStencilState = state;
+	this->stencilRef = stencilRef;
+	if (Filter(changed))
+		context->OMSetDepthStencilState(state, stencilRef);
+}
+
+void StateCache::OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask)
+{
+	// A null factor means { 1, 1, 1, 1 }
+	static const FLOAT defaultFactor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	if (!blendFactor)
+		blendFactor = defaultFactor;
+
+	bool changed = blendState != state || this->sampleMask != sampleMask || memcmp(this->blendFactor, blendFactor, sizeof(this->blendFactor)) != 0;
+	blendState = state;
+	this->sampleMask = sampleMask;
+	memcpy(this->blendFactor, blendFactor, sizeof(this->blendFactor));
+	if (Filter(changed))
+		context->OMSetBlendState(state, blendFactor, sampleMask);
+}
+
+// --------------------------------------------------------
+// Counts a call, and decides whether it goes through
+// --------------------------------------------------------
+bool StateCache::Filter(bool changed)
+{
+	if (changed || !filtering)
+	{
+		callsIssued++;
+		return true;
+	}
+
+	callsFiltered++;
+	return false;
+}
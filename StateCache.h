@@ -0,0 +1,118 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3d11_1.h>
+#include <wrl/client.h>
+
+#include "ShaderStage.h"
+
+// --------------------------------------------------------
+// Sits in front of a device context and remembers what is
+// bound to each slot, so setting something that is already
+// set never reaches Direct3D.  Array calls are trimmed to
+// the slots that actually change.
+//
+// Everything that binds state on the context has to go
+// through the cache, or it goes stale.  If the context is
+// cleared (ClearState, or ExecuteCommandList without keeping
+// state), call Reset().
+//
+// Bound objects are remembered by address, without a
+// reference - don't release something while it's bound.
+// --------------------------------------------------------
+class StateCache
+{
+public:
+	// With filtering off every call goes straight through (but is still counted)
+	StateCache(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, bool filtering = true);
+
+	ID3D11DeviceContext* GetContext() { return context.Get(); }
+
+	// Forgets everything, matching a context that was just cleared
+	void Reset();
+
+	// Shaders
+	void VSSetShader(ID3D11VertexShader* shader);
+	void HSSetShader(ID3D11HullShader* shader);
+	void DSSetShader(ID3D11DomainShader* shader);
+	void GSSetShader(ID3D11GeometryShader* shader);
+	void PSSetShader(ID3D11PixelShader* shader);
+	void CSSetShader(ID3D11ComputeShader* shader);
+
+	// Per-stage slots - ranges past the last slot assert, and are dropped in release
+	void SetConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers);
+	void SetConstantBuffers1(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts);
+	void SetShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* views);
+	void SetSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+
+	// Input assembler
+	void IASetInputLayout(ID3D11InputLayout* layout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void IASetVertexBuffers(unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets);
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+
+	// Fixed function states
+	void RSSetState(ID3D11RasterizerState* state);
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef);
+	void OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask);
+
+	// How many calls were passed on and how many were dropped
+	unsigned long long GetCallsIssued() { return callsIssued; }
+	unsigned long long GetCallsFiltered() { return callsFiltered; }
+	void ResetCounters() { callsIssued = 0; callsFiltered = 0; }
+
+private:
+	static const unsigned int ConstantBufferSlots = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static const unsigned int ResourceSlots = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	static const unsigned int SamplerSlots = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	static const unsigned int VertexBufferSlots = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+
+	// A constant count of 0 means the whole buffer (bound without offsets)
+	struct ConstantBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		UINT firstConstant;
+		UINT constantCount;
+	};
+
+	struct StageState
+	{
+		ID3D11DeviceChild* shader;
+		ConstantBufferBinding constantBuffers[ConstantBufferSlots];
+		ID3D11ShaderResourceView* resources[ResourceSlots];
+		ID3D11SamplerState* samplers[SamplerSlots];
+	};
+
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		UINT stride;
+		UINT offset;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+	bool filtering;
+
+	StageState stages[(unsigned int)ShaderStage::Count];
+
+	ID3D11InputLayout* inputLayout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	VertexBufferBinding vertexBuffers[VertexBufferSlots];
+	ID3D11Buffer* indexBuffer;
+	DXGI_FORMAT indexFormat;
+	UINT indexOffset;
+
+	ID3D11RasterizerState* rasterizerState;
+	ID3D11DepthStencilState* depthStencilState;
+	UINT stencilRef;
+	ID3D11BlendState* blendState;
+	FLOAT blendFactor[4];
+	UINT sampleMask;
+
+	unsigned long long callsIssued;
+	unsigned long long callsFiltered;
+
+	bool ShaderChanged(ShaderStage stage, ID3D11DeviceChild* shader);
+	bool Filter(bool changed);
+};
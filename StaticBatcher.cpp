@@ -0,0 +1,187 @@
+#include "StaticBatcher.h"
+#include "DrawPacket.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+StaticBatcher::StaticBatcher(std::shared_ptr<GeometryArena> arena)
+	: arena(arena),
+	entityCount(0)
+{
+}
+
+// --------------------------------------------------------
+// Sorts the entities into (material, grid cell) groups and
+// merges each group's world-space geometry into chunks
+// --------------------------------------------------------
+void StaticBatcher::Build(Pool<Entity>& entities, const std::vector<EntityHandle>& staticEntities)
+{
+	chunks.clear();
+	entityCount = 0;
+
+	struct Placement
+	{
+		Entity* entity;
+		MaterialHandle material;
+		int cell[3];
+	};
+	std::vector<Placement> placements;
+	placements.reserve(staticEntities.size());
+
+	// Which cell each entity's center is in
+	for (EntityHandle handle : staticEntities)
+	{
+		Entity* entity = entities.Get(handle);
+		const std::vector<Vertex>& vertices = entity->GetMesh()->GetVertices();
+		if (vertices.empty())
+			continue;
+
+		BoundingBox localBounds;
+		BoundingBox::CreateFromPoints(localBounds, vertices.size(), &vertices[0].Position, sizeof(Vertex));
+
+		XMFLOAT4X4 world = entity->GetTransform()->GetWorldMatrix();
+		BoundingBox worldBounds;
+		localBounds.Transform(worldBounds, XMLoadFloat4x4(&world));
+
+		Placement placement;
+		placement.entity = entity;
+		placement.material = entity->GetMaterial();
+		placement.cell[0] = (int)floorf(worldBounds.Center.x / ChunkSize);
+		placement.cell[1] = (int)floorf(worldBounds.Center.y / ChunkSize);
+		placement.cell[2] = (int)floorf(worldBounds.Center.z / ChunkSize);
+		placements.push_back(placement);
+	}
+
+	auto sameGroup = [](const Placement& a, const Placement& b)
+	{
+		return a.material == b.material &&
+			a.cell[0] == b.cell[0] && a.cell[1] == b.cell[1] && a.cell[2] == b.cell[2];
+	};
+
+	// Stable, so a group's entities merge in the order they were made
+	std::stable_sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b)
+	{
+		if (a.material.index != b.material.index)
+			return a.material.index < b.material.index;
+		return std::lexicographical_compare(a.cell, a.cell + 3, b.cell, b.cell + 3);
+	});
+
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int chunkEntities = 0;
+
+	auto finishChunk = [&](MaterialHandle material)
+	{
+		if (vertices.empty())
+			return;
+
+		StaticChunk chunk;
+		chunk.mesh = std::make_shared<Mesh>(vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size(), arena);
+		chunk.material = material;
+		BoundingBox::CreateFromPoints(chunk.bounds, vertices.size(), &vertices[0].Position, sizeof(Vertex));
+		chunk.entityCount = chunkEntities;
+		chunks.push_back(chunk);
+
+		vertices.clear();
+		indices.clear();
+		chunkEntities = 0;
+	};
+
+	for (size_t i = 0; i < placements.size(); i++)
+	{
+		const Placement& placement = placements[i];
+		std::shared_ptr<Mesh> mesh = placement.entity->GetMesh();
+		const std::vector<Vertex>& meshVertices = mesh->GetVertices();
+		const std::vector<unsigned int>& meshIndices = mesh->GetIndices();
+
+		// A full chunk, or a new group, starts a new chunk
+		if (i > 0 && (!sameGroup(placement, placements[i - 1]) || vertices.size() + meshVertices.size() > MaxChunkVertices))
+			finishChunk(placements[i - 1].material);
+
+		XMFLOAT4X4 worldFloats = placement.entity->GetTransform()->GetWorldMatrix();
+		XMFLOAT4X4 worldInvTransposeFloats = placement.entity->GetTransform()->GetWorldInverseTransposeMatrix();
+		XMMATRIX world = XMLoadFloat4x4(&worldFloats);
+		XMMATRIX worldInvTranspose = XMLoadFloat4x4(&worldInvTransposeFloats);
+
+		// Into world space, the same way the vertex shader would.  Tangents
+		// are left alone - the merged Mesh recalculates them from the
+		// world-space positions.
+		unsigned int baseVertex = (unsigned int)vertices.size();
+		for (const Vertex& source : meshVertices)
+		{
+			Vertex vertex = source;
+			XMStoreFloat3(&vertex.Position, XMVector3TransformCoord(XMLoadFloat3(&source.Position), world));
+			XMStoreFloat3(&vertex.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&source.Normal), worldInvTranspose)));
+			vertices.push_back(vertex);
+		}
+
+		for (unsigned int index : meshIndices)
+			indices.push_back(baseVertex + index);
+
+		chunkEntities++;
+		entityCount++;
+	}
+
+	if (!placements.empty())
+		finishChunk(placements.back().material);
+}
+
+unsigned int StaticBatcher::AppendVisible(const Pool<Material>& materials, SceneSnapshot& scene)
+{
+	XMMATRIX view = XMLoadFloat4x4(&scene.view);
+	XMMATRIX shadowView = XMLoadFloat4x4(&scene.shadowView);
+
+	// The camera's frustum, in world space
+	BoundingFrustum viewSpaceFrustum(XMLoadFloat4x4(&scene.projection));
+	BoundingFrustum cameraFrustum;
+	viewSpaceFrustum.Transform(cameraFrustum, XMMatrixInverse(0, view));
+
+	// The shadow map's box, in the light's view space - solved
+	// from the orthographic projection, which maps it to x and
+	// y in [-1, 1] and z in [0, 1]
+	const XMFLOAT4X4& p = scene.shadowProjection;
+	XMFLOAT3 shadowMin((-1.0f - p._41) / p._11, (-1.0f - p._42) / p._22, (0.0f - p._43) / p._33);
+	XMFLOAT3 shadowMax((1.0f - p._41) / p._11, (1.0f - p._42) / p._22, (1.0f - p._43) / p._33);
+	BoundingBox shadowBox;
+	BoundingBox::CreateFromPoints(shadowBox, XMLoadFloat3(&shadowMin), XMLoadFloat3(&shadowMax));
+
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+	unsigned int inCameraCount = 0;
+	for (const StaticChunk& chunk : chunks)
+	{
+		BoundingBox lightSpaceBounds;
+		chunk.bounds.Transform(lightSpaceBounds, shadowView);
+
+		bool inCamera = cameraFrustum.Intersects(chunk.bounds);
+		if (!inCamera && !shadowBox.Intersects(lightSpaceBounds))
+			continue;
+
+		EntitySnapshot snapshot;
+		snapshot.world = identity;
+		snapshot.worldInvTranspose = identity;
+		snapshot.mesh = chunk.mesh.get();
+		snapshot.material = materials.Get(chunk.material);
+		snapshot.materialIndex = chunk.material.index;
+
+		// Depth of the chunk's center, for front to back within the pass
+		const XMFLOAT3& c = chunk.bounds.Center;
+		const XMFLOAT4X4& v = scene.view;
+		float viewDepth = c.x * v._13 + c.y * v._23 + c.z * v._33 + v._43;
+
+		snapshot.sortKey = DrawKey::Make(
+			inCamera ? DrawKey::Opaque : DrawKey::ShadowOnly,
+			snapshot.material->GetPipelineState()->GetId(),
+			snapshot.material->GetBindingId(),
+			chunk.mesh->GetId(),
+			viewDepth);
+		scene.entities.push_back(snapshot);
+
+		if (inCamera)
+			inCameraCount++;
+	}
+	return inCameraCount;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <DirectXCollision.h>
+#include <memory>
+#include <vector>
+
+#include "Entity.h"
+#include "GeometryArena.h"
+#include "Mesh.h"
+#include "Pool.h"
+#include "SceneState.h"
+
+// --------------------------------------------------------
+// Static entities baked into one world-space mesh, plus the
+// box around it for culling
+// --------------------------------------------------------
+struct StaticChunk
+{
+	std::shared_ptr<Mesh> mesh;
+	MaterialHandle material;
+	DirectX::BoundingBox bounds;	// World space
+	unsigned int entityCount;
+};
+
+// --------------------------------------------------------
+// Merges entities that never move into a few big meshes,
+// so they cost a handful of draws instead of one each.
+//
+// Build() (once, at load) transforms each static entity's
+// vertices into world space and merges them by material
+// and by ChunkSize grid cell, so a chunk stays small enough
+// to be culled.  Each frame AppendVisible() adds only the
+// chunks the camera or the shadow map can see, as snapshots
+// with an identity world matrix.
+// --------------------------------------------------------
+class StaticBatcher
+{
+public:
+	static constexpr float ChunkSize = 16.0f;				// World units along each side of a grid cell
+	static const unsigned int MaxChunkVertices = 1 << 16;	// A cell with more starts another chunk
+
+	StaticBatcher(std::shared_ptr<GeometryArena> arena);
+
+	// Replaces any earlier chunks.  The entities are left as they are.
+	// Reads each mesh's cpu copy, so they have to be made with
+	// keepGeometry - meshes without one are skipped.
+	void Build(Pool<Entity>& entities, const std::vector<EntityHandle>& staticEntities);
+
+	// --------------------------------------------------------
+	// Appends a snapshot for every chunk inside the camera's
+	// frustum or the shadow map's box.  Ones only the shadow
+	// map sees get the DrawKey::ShadowOnly pass.  Returns how
+	// many chunks the camera sees.
+	// --------------------------------------------------------
+	unsigned int AppendVisible(const Pool<Material>& materials, SceneSnapshot& scene);
+
+	const std::vector<StaticChunk>& GetChunks() const { return chunks; }
+	unsigned int GetEntityCount() const { return entityCount; }
+
+private:
+	std::shared_ptr<GeometryArena> arena;
+	std::vector<StaticChunk> chunks;
+	unsigned int entityCount;
+};
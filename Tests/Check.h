@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+
+// --------------------------------------------------------
+// Just enough for the CPU tests.  A failed CHECK prints the
+// condition and where it is, and keeps going - main()
+// returns CheckResult(), so ctest sees any failure.
+// --------------------------------------------------------
+inline int& CheckFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			CheckFailures()++; \
+		} \
+	} while (0)
+
+inline int CheckResult()
+{
+	if (CheckFailures())
+		printf("%d check(s) failed\n", CheckFailures());
+	return CheckFailures() ? 1 : 0;
+}
@@ -0,0 +1,564 @@
+#include "CommandStream.h"
+#include "DrawPacket.h"
+#include "JobSystem.h"
+#include "NullCommandExecutor.h"
+#include "RenderGraph.h"
+#include "Check.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// --------------------------------------------------------
+// Encodes a frame the way Game::Draw does - the uploads,
+// then the render graph's shadow, main (in two parts) and
+// sky passes over instanced batches - and plays it back on
+// a NullCommandExecutor.  The graph's own encoding runs as
+// is, around each pass, and the batches come from the same
+// sort keys and SortDrawPackets.  The log is compared with
+// CommandStreamFrame.log, so any change to what a frame
+// encodes (or how it's played back) shows up here.
+//
+//   CommandStreamTests             check against the log
+//   CommandStreamTests --update    rewrite the log
+//   CommandStreamTests --benchmark [frames]
+//                                  time encoding and playback
+// --------------------------------------------------------
+
+static const char* ExpectedLogFile = TESTS_DIR "/CommandStreamFrame.log";
+
+// Stand-ins for GPU objects - only their addresses matter
+struct FrameObjects
+{
+	char backBuffer, depthBuffer, shadowMap, shadowMapView;
+	char objectBuffer, objectView, instanceIndices;
+	char frameConstants, ringBuffer, materialTable, materialTableView;
+	char vertexPages[2], indexPages[2];
+	char inputLayout, mainVS, mainPS, shadowVS, skyVS, skyPS;
+	char rasterizer, shadowRasterizer, skyRasterizer;
+	char depthState, skyDepthState, blendState;
+	char textureArrays[3], sampler, shadowSampler, skyCube;
+};
+
+// Where a mesh is in the geometry arena
+struct MeshRange
+{
+	unsigned int page;
+	unsigned int indexCount;
+	unsigned int firstIndex;
+	int baseVertex;
+};
+
+static const MeshRange Meshes[] =
+{
+	{ 0, 36, 0, 0 },		// Cube
+	{ 0, 2880, 36, 24 },	// Sphere
+	{ 1, 1200, 0, 0 },		// Tree
+};
+
+// The same as InstanceBatch, with a mesh and bindings by index
+struct Batch
+{
+	unsigned int mesh;
+	unsigned int bindings;	// Which texture array
+	unsigned int pass;
+	unsigned int firstInstance;
+	unsigned int instanceCount;
+};
+
+static const unsigned int EntityCount = 40;
+static const unsigned int MaterialCount = 4;
+static const unsigned int ObjectSize = 144;		// Two matrices and a material index, padded
+static const unsigned int MaterialSize = 48;
+static const unsigned int VertexSize = 44;
+static const unsigned int MainParts = 2;
+
+// Materials 0 and 3 differ only in parameters, so they share bindings
+static unsigned int GetBindings(unsigned int material)
+{
+	return material % 3;
+}
+
+// Every tenth entity is a static chunk only the shadow map sees
+static unsigned long long GetSortKey(unsigned int entity)
+{
+	unsigned int pass = entity % 10 == 9 ? DrawKey::ShadowOnly : DrawKey::Opaque;
+	unsigned int material = entity % MaterialCount;
+	return DrawKey::Make(pass, 0, GetBindings(material), entity % 3, (float)((entity * 37) % 50));
+}
+
+// --------------------------------------------------------
+// Sorts and groups the entities like InstanceBatcher::Build,
+// and encodes their objects as its one discarding upload
+// --------------------------------------------------------
+static void BuildBatches(CommandStream& stream, FrameObjects& o, FrameVector<Batch>& batches)
+{
+	FrameVector<DrawPacket> packets(EntityCount);
+	FrameVector<DrawPacket> scratch;
+	for (unsigned int i = 0; i < EntityCount; i++)
+	{
+		packets[i].key = GetSortKey(i);
+		packets[i].entity = i;
+	}
+	SortDrawPackets(packets, scratch);
+
+	unsigned char objects[EntityCount * ObjectSize];
+	for (unsigned int i = 0; i < EntityCount; i++)
+	{
+		unsigned int entity = packets[i].entity;
+		memset(objects + i * ObjectSize, (int)entity, ObjectSize);
+
+		unsigned int mesh = entity % 3;
+		unsigned int bindings = GetBindings(entity % MaterialCount);
+		unsigned int pass = (unsigned int)(packets[i].key >> DrawKey::PassShift);
+		if (!batches.empty() && batches.back().mesh == mesh && batches.back().bindings == bindings && batches.back().pass == pass)
+		{
+			batches.back().instanceCount++;
+			continue;
+		}
+
+		Batch batch = { mesh, bindings, pass, i, 1 };
+		batches.push_back(batch);
+	}
+
+	stream.UpdateBuffer(&o.objectBuffer, 0, sizeof(objects), objects, UpdateBufferCommand::Discard);
+}
+
+// --------------------------------------------------------
+// What Draw encodes before the graph runs: a mesh loaded
+// since last frame (GeometryArena::FlushUploads), two
+// changed materials (MaterialTable::Apply) and the batches
+// --------------------------------------------------------
+static void EncodeUploads(CommandStream& stream, FrameObjects& o, FrameVector<Batch>& batches)
+{
+	unsigned char vertices[24 * VertexSize];
+	unsigned int indices[36];
+	for (unsigned int i = 0; i < sizeof(vertices); i++)
+		vertices[i] = (unsigned char)i;
+	for (unsigned int i = 0; i < 36; i++)
+		indices[i] = i % 24;
+	stream.UpdateBuffer(&o.vertexPages[1], 240 * VertexSize, sizeof(vertices), vertices, UpdateBufferCommand::Range);
+	stream.UpdateBuffer(&o.indexPages[1], 1200 * sizeof(unsigned int), sizeof(indices), indices, UpdateBufferCommand::Range);
+
+	// Materials 1 and 3 changed, so 1 to 3 go up in one range
+	unsigned char table[MaterialCount * MaterialSize];
+	for (unsigned int i = 0; i < sizeof(table); i++)
+		table[i] = (unsigned char)(i * 3);
+	stream.UpdateBuffer(&o.materialTable, MaterialSize, 3 * MaterialSize, table + MaterialSize, UpdateBufferCommand::Range);
+
+	BuildBatches(stream, o, batches);
+}
+
+// The frame's passes, declared like Game::BuildRenderGraph
+struct FrameGraph
+{
+	RenderGraph graph;
+	unsigned int shadowPass;
+	unsigned int mainPass;
+	unsigned int skyPass;
+	std::vector<RenderGraphViews> views;	// By resource
+};
+
+static void BuildGraph(FrameGraph& frame, FrameObjects& o)
+{
+	RenderGraph& graph = frame.graph;
+	RenderGraphResource backBuffer = graph.ImportTexture("BackBuffer");
+	RenderGraphResource depth = graph.ImportTexture("Depth");
+	graph.MarkOutput(backBuffer);
+
+	RenderGraphTextureDesc shadowDesc;
+	shadowDesc.width = 2048;
+	shadowDesc.height = 2048;
+	shadowDesc.format = 39;		// DXGI_FORMAT_R32_TYPELESS
+	RenderGraphResource shadowMap = graph.CreateTexture("ShadowMap", shadowDesc);
+
+	// The passes are encoded below rather than through their record functions
+	frame.shadowPass = graph.AddPass("Shadow", RenderGraph::RecordFunction());
+	graph.AddDepthStencil(frame.shadowPass, shadowMap, 1.0f);
+
+	frame.mainPass = graph.AddPass("Main", RenderGraph::RecordFunction());
+	graph.AddRead(frame.mainPass, shadowMap, ShaderStage::Pixel, 4);
+	const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	graph.AddRenderTarget(frame.mainPass, backBuffer, clearColor);
+	graph.AddDepthStencil(frame.mainPass, depth, 1.0f, true);
+	graph.SetPartCount(frame.mainPass, MainParts);
+
+	frame.skyPass = graph.AddPass("Sky", RenderGraph::RecordFunction());
+	graph.AddRenderTarget(frame.skyPass, backBuffer);
+	graph.AddDepthStencil(frame.skyPass, depth);
+
+	CHECK(graph.Compile());
+
+	// What RenderGraphExecutor would look up for each
+	frame.views.resize(graph.GetResourceCount());
+	RenderGraphViews& backBufferViews = frame.views[backBuffer.index];
+	backBufferViews.renderTarget = &o.backBuffer;
+	backBufferViews.width = 1280;
+	backBufferViews.height = 720;
+
+	RenderGraphViews& depthViews = frame.views[depth.index];
+	depthViews.depthStencil = &o.depthBuffer;
+	depthViews.width = 1280;
+	depthViews.height = 720;
+
+	RenderGraphViews& shadowMapViews = frame.views[shadowMap.index];
+	shadowMapViews.depthStencil = &o.shadowMap;
+	shadowMapViews.shaderResource = &o.shadowMapView;
+	shadowMapViews.width = 2048;
+	shadowMapViews.height = 2048;
+}
+
+// GeometryArena::Bind and Mesh::DrawInstanced
+static void DrawBatch(CommandStream& stream, FrameObjects& o, const Batch& batch)
+{
+	const MeshRange& mesh = Meshes[batch.mesh];
+	void* vertexBuffer = &o.vertexPages[mesh.page];
+	unsigned int stride = VertexSize;
+	unsigned int offset = 0;
+	stream.SetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	stream.SetIndexBuffer(&o.indexPages[mesh.page], 42, 0);
+	stream.DrawIndexedInstanced(mesh.indexCount, batch.instanceCount, mesh.firstIndex, mesh.baseVertex, batch.firstInstance);
+}
+
+// InstanceBatcher::Bind
+static void BindInstances(CommandStream& stream, FrameObjects& o)
+{
+	void* instanceIndices = &o.instanceIndices;
+	unsigned int indexStride = 4;
+	unsigned int zero = 0;
+	void* objectView = &o.objectView;
+	stream.SetVertexBuffers(1, 1, &instanceIndices, &indexStride, &zero);
+	stream.SetResources(ShaderStage::Vertex, 0, 1, &objectView);
+}
+
+// Game::RecordShadowPass - depth only, every batch
+static void EncodeShadowPass(CommandStream& stream, FrameObjects& o, const FrameVector<Batch>& batches)
+{
+	float blendFactor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	stream.SetTopology(4);
+
+	unsigned char frameData[128];
+	for (unsigned int i = 0; i < sizeof(frameData); i++)
+		frameData[i] = (unsigned char)i;
+	stream.UpdateBuffer(&o.frameConstants, 0, sizeof(frameData), frameData, UpdateBufferCommand::Whole);
+
+	stream.SetInputLayout(&o.inputLayout);
+	stream.SetShader(ShaderStage::Vertex, &o.shadowVS);
+	stream.SetShader(ShaderStage::Pixel, 0);
+	stream.SetRasterizerState(&o.shadowRasterizer);
+	stream.SetDepthStencilState(&o.depthState, 0);
+	stream.SetBlendState(&o.blendState, blendFactor, 0xFFFFFFFF);
+	stream.SetConstantBuffer(ShaderStage::Vertex, 0, &o.frameConstants);
+
+	BindInstances(stream, o);
+	for (const Batch& batch : batches)
+		DrawBatch(stream, o, batch);
+}
+
+// --------------------------------------------------------
+// Game::RecordMainPass for one part - what the camera sees,
+// with each part setting everything it uses, as if it were
+// on its own deferred context
+// --------------------------------------------------------
+static void EncodeMainPass(CommandStream& stream, FrameObjects& o, const FrameVector<Batch>& batches, unsigned int part)
+{
+	unsigned int batchesPerPart = ((unsigned int)batches.size() + MainParts - 1) / MainParts;
+	unsigned int first = part * batchesPerPart;
+	unsigned int end = first + batchesPerPart;
+	if (first > batches.size()) first = (unsigned int)batches.size();
+	if (end > batches.size()) end = (unsigned int)batches.size();
+
+	stream.SetTopology(4);
+
+	// Per-pass constants from the ring, at an offset
+	unsigned char passData[64] = {};
+	stream.UpdateBuffer(&o.ringBuffer, 256 + part * 256, sizeof(passData), passData, UpdateBufferCommand::Range);
+	stream.SetConstantBuffer(ShaderStage::Pixel, 1, &o.ringBuffer, 16 + part * 16, 16);
+
+	void* samplers[2] = { &o.sampler, &o.shadowSampler };
+	stream.SetSamplers(ShaderStage::Pixel, 0, 2, samplers);
+	void* materialTable = &o.materialTableView;
+	stream.SetResources(ShaderStage::Pixel, 5, 1, &materialTable);
+	BindInstances(stream, o);
+
+	unsigned int currentBindings = 0xFFFFFFFF;
+	for (unsigned int i = first; i < end; i++)
+	{
+		const Batch& batch = batches[i];
+		if (batch.pass == DrawKey::ShadowOnly)
+			continue;
+
+		// Material::PrepareMaterials and the pipeline, once per distinct set
+		if (batch.bindings != currentBindings)
+		{
+			void* textures = &o.textureArrays[batch.bindings];
+			stream.SetResources(ShaderStage::Pixel, 0, 1, &textures);
+			stream.SetInputLayout(&o.inputLayout);
+			stream.SetShader(ShaderStage::Vertex, &o.mainVS);
+			stream.SetShader(ShaderStage::Pixel, &o.mainPS);
+			stream.SetRasterizerState(&o.rasterizer);
+			currentBindings = batch.bindings;
+		}
+
+		DrawBatch(stream, o, batch);
+	}
+}
+
+// Sky::Draw - a cube from the first page, drawn where nothing else was
+static void EncodeSkyPass(CommandStream& stream, FrameObjects& o)
+{
+	void* skyCube = &o.skyCube;
+	stream.SetTopology(4);
+	stream.SetShader(ShaderStage::Vertex, &o.skyVS);
+	stream.SetShader(ShaderStage::Pixel, &o.skyPS);
+	stream.SetRasterizerState(&o.skyRasterizer);
+	stream.SetDepthStencilState(&o.skyDepthState, 0);
+	stream.SetResources(ShaderStage::Pixel, 0, 1, &skyCube);
+
+	void* vertexBuffer = &o.vertexPages[0];
+	unsigned int stride = VertexSize;
+	unsigned int offset = 0;
+	stream.SetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	stream.SetIndexBuffer(&o.indexPages[0], 42, 0);
+	stream.DrawIndexed(36, 0, 0);
+}
+
+// --------------------------------------------------------
+// The uploads, then every running pass and part in the
+// graph's order, each behind what the graph sets up for it -
+// RenderGraphExecutor::Execute, on one context
+// --------------------------------------------------------
+static void EncodeFrame(CommandStream& stream, FrameObjects& o, FrameGraph& frame, FrameVector<Batch>& batches)
+{
+	batches = FrameVector<Batch>();
+	EncodeUploads(stream, o, batches);
+
+	const RenderGraph& graph = frame.graph;
+	for (unsigned int pass : graph.GetOrder())
+	{
+		for (unsigned int part = 0; part < graph.GetPass(pass).parts; part++)
+		{
+			graph.EncodePassSetup(pass, part, frame.views.data(), stream);
+			if (pass == frame.shadowPass)
+				EncodeShadowPass(stream, o, batches);
+			else if (pass == frame.mainPass)
+				EncodeMainPass(stream, o, batches, part);
+			else if (pass == frame.skyPass)
+				EncodeSkyPass(stream, o);
+		}
+	}
+
+	graph.EncodeFinalUnbinds(stream);
+}
+
+static std::string ReadFile(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::stringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+// --------------------------------------------------------
+// The frame against the stored log, plus the counts that
+// follow from how it was built
+// --------------------------------------------------------
+static void TestFrame()
+{
+	FrameObjects objects;
+	FrameGraph frame;
+	BuildGraph(frame, objects);
+	const std::vector<unsigned int>& order = frame.graph.GetOrder();
+	CHECK(order.size() == 3 && order[0] == frame.shadowPass && order[1] == frame.mainPass && order[2] == frame.skyPass);
+
+	CommandStream stream;
+	FrameVector<Batch> batches;
+	EncodeFrame(stream, objects, frame, batches);
+
+	NullCommandExecutor executor(true);
+	executor.Execute(stream);
+	const CommandStreamStats& stats = executor.GetStats();
+
+	unsigned int commands = 0;
+	for (unsigned int i = 0; i < (unsigned int)CommandType::Count; i++)
+		commands += stats.commands[i];
+	CHECK(commands == stream.GetCommandCount());
+	CHECK(stats.streamBytes == stream.GetSize());
+
+	// Grouping made fewer batches than entities, and kept every entity
+	unsigned int shadowOnly = 0;
+	unsigned int mainBatches = 0;
+	unsigned int mainInstances = 0;
+	unsigned int instances = 0;
+	for (const Batch& batch : batches)
+	{
+		instances += batch.instanceCount;
+		if (batch.pass == DrawKey::ShadowOnly)
+			shadowOnly += batch.instanceCount;
+		else
+		{
+			mainBatches++;
+			mainInstances += batch.instanceCount;
+		}
+	}
+	CHECK(batches.size() < EntityCount);
+	CHECK(instances == EntityCount);
+	CHECK(shadowOnly == 4);
+
+	// Every batch in the shadow pass, the camera's in the main pass, and the sky
+	CHECK(stats.draws == batches.size() + mainBatches + 1);
+	CHECK(stats.commands[(unsigned int)CommandType::DrawIndexedInstanced] == batches.size() + mainBatches);
+	CHECK(stats.commands[(unsigned int)CommandType::DrawIndexed] == 1);
+	CHECK(stats.instances == EntityCount + mainInstances + 1);
+
+	// The geometry, material and object uploads, then the shader constants
+	CHECK(stats.commands[(unsigned int)CommandType::UpdateBuffer] == 4 + 1 + MainParts);
+	CHECK(stats.uploadBytes == 24 * VertexSize + 36 * 4 + 3 * MaterialSize + EntityCount * ObjectSize + 128 + MainParts * 64);
+
+	// Only the main pass's first part clears; the sky pass keeps what it drew
+	CHECK(stats.commands[(unsigned int)CommandType::ClearRenderTarget] == 1);
+	CHECK(stats.commands[(unsigned int)CommandType::ClearDepthStencil] == 2);
+	CHECK(stats.commands[(unsigned int)CommandType::SetRenderTargets] == 1 + MainParts + 1);
+
+	// Rebinding the page each batch is redundant after the first
+	// of a run - the state cache's job to drop when played for real
+	CHECK(stats.redundantBinds > 0);
+
+	std::string expected = ReadFile(ExpectedLogFile);
+	CHECK(!expected.empty());
+	CHECK(executor.GetLog() == expected);
+	if (executor.GetLog() != expected)
+		printf("The frame's log doesn't match %s - run with --update if the change is intended\n", ExpectedLogFile);
+
+	FrameArena::GetInstance().EndFrame();
+}
+
+// --------------------------------------------------------
+// Objects are numbered as they're met, so the same frame
+// checksums the same whatever the addresses, and a reused
+// stream encodes it the same again
+// --------------------------------------------------------
+static void TestChecksum()
+{
+	FrameObjects first;
+	FrameObjects second;
+	FrameGraph firstFrame;
+	FrameGraph secondFrame;
+	BuildGraph(firstFrame, first);
+	BuildGraph(secondFrame, second);
+	FrameVector<Batch> batches;
+
+	CommandStream stream;
+	EncodeFrame(stream, first, firstFrame, batches);
+	size_t size = stream.GetSize();
+
+	NullCommandExecutor executor;
+	executor.Execute(stream);
+	unsigned long long checksum = executor.GetChecksum();
+
+	stream.Reset();
+	EncodeFrame(stream, second, secondFrame, batches);
+	CHECK(stream.GetSize() == size);
+
+	executor.Reset();
+	executor.Execute(stream);
+	CHECK(executor.GetChecksum() == checksum);
+
+	// One different draw changes it
+	stream.DrawIndexed(3, 0, 0);
+	executor.Reset();
+	executor.Execute(stream);
+	CHECK(executor.GetChecksum() != checksum);
+
+	FrameArena::GetInstance().EndFrame();
+}
+
+static void UpdateExpectedLog()
+{
+	FrameObjects objects;
+	FrameGraph frame;
+	BuildGraph(frame, objects);
+
+	CommandStream stream;
+	FrameVector<Batch> batches;
+	EncodeFrame(stream, objects, frame, batches);
+
+	NullCommandExecutor executor(true);
+	executor.Execute(stream);
+
+	std::ofstream file(ExpectedLogFile, std::ios::binary | std::ios::trunc);
+	file << executor.GetLog();
+	printf("Wrote %s\n", ExpectedLogFile);
+}
+
+// --------------------------------------------------------
+// Encoding and playback times per frame, without logging -
+// the CPU cost of a frame's commands, minus the driver
+// --------------------------------------------------------
+static void Benchmark(unsigned int frames)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	FrameObjects objects;
+	FrameGraph frame;
+	BuildGraph(frame, objects);
+
+	CommandStream stream;
+	FrameVector<Batch> batches;
+	NullCommandExecutor executor;
+	double encodeSeconds = 0.0;
+	double executeSeconds = 0.0;
+
+	for (unsigned int i = 0; i < frames; i++)
+	{
+		Clock::time_point start = Clock::now();
+		stream.Reset();
+		EncodeFrame(stream, objects, frame, batches);
+		Clock::time_point encoded = Clock::now();
+		executor.Reset();
+		executor.Execute(stream);
+		Clock::time_point executed = Clock::now();
+
+		encodeSeconds += std::chrono::duration<double>(encoded - start).count();
+		executeSeconds += std::chrono::duration<double>(executed - encoded).count();
+		FrameArena::GetInstance().EndFrame();
+	}
+
+	printf("%u frames, %u commands (%zu bytes) each: encode %.2f us, execute %.2f us per frame\n",
+		frames,
+		stream.GetCommandCount(),
+		stream.GetSize(),
+		encodeSeconds * 1000000.0 / frames,
+		executeSeconds * 1000000.0 / frames);
+}
+
+int main(int argc, char* argv[])
+{
+	// The sort's scratch comes from the frame arena, which is per job system thread
+	JobSystem::GetInstance().Initialize(1);
+	FrameArena::GetInstance().Initialize(JobSystem::GetInstance().GetThreadCount());
+
+	int result = 0;
+	if (argc > 1 && strcmp(argv[1], "--update") == 0)
+	{
+		UpdateExpectedLog();
+	}
+	else if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+	{
+		int frames = argc > 2 ? atoi(argv[2]) : 10000;
+		Benchmark(frames > 0 ? (unsigned int)frames : 1);
+	}
+	else
+	{
+		TestFrame();
+		TestChecksum();
+		result = CheckResult();
+	}
+
+	delete &FrameArena::GetInstance();
+	delete &JobSystem::GetInstance();
+	return result;
+}
@@ -0,0 +1,210 @@
+#include "DrawPacket.h"
+#include "JobSystem.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+// --------------------------------------------------------
+//   DrawPacketTests                         run the tests
+//   DrawPacketTests --benchmark [packets]   time the sort
+//                                           against std::sort
+// --------------------------------------------------------
+
+static bool KeyLess(const DrawPacket& a, const DrawPacket& b)
+{
+	return a.key < b.key;
+}
+
+// Fields land where the layout says, and outer fields outweigh everything inside them
+static void TestKeyLayout()
+{
+	unsigned long long key = DrawKey::Make(DrawKey::ShadowOnly, 5, 6, 7, 0.0f);
+	CHECK((key >> DrawKey::PassShift) == DrawKey::ShadowOnly);
+	CHECK(((key >> DrawKey::PipelineShift) & ((1ull << DrawKey::PipelineBits) - 1)) == 5);
+	CHECK(((key >> DrawKey::MaterialShift) & ((1ull << DrawKey::MaterialBits) - 1)) == 6);
+	CHECK(((key >> DrawKey::MeshShift) & ((1ull << DrawKey::MeshBits) - 1)) == 7);
+	CHECK((key & ((1ull << DrawKey::DepthBits) - 1)) == 0);
+	CHECK(DrawKey::PassShift + DrawKey::PassBits == 64);
+
+	CHECK(DrawKey::Make(DrawKey::Opaque, 4095, 4095, 4095, 1e30f) < DrawKey::Make(DrawKey::ShadowOnly, 0, 0, 0, 0.0f));
+	CHECK(DrawKey::Make(0, 1, 0, 0, 0.0f) > DrawKey::Make(0, 0, 4095, 4095, 1e30f));
+	CHECK(DrawKey::Make(0, 0, 1, 0, 0.0f) > DrawKey::Make(0, 0, 0, 4095, 1e30f));
+	CHECK(DrawKey::Make(0, 0, 0, 1, 0.0f) > DrawKey::Make(0, 0, 0, 0, 1e30f));
+
+	// Ids wider than their field wrap, without spilling into the next one
+	CHECK(DrawKey::Make(0, 0, 4096 + 3, 0, 0.0f) == DrawKey::Make(0, 0, 3, 0, 0.0f));
+}
+
+// Near to far, and nothing in front of the camera sorts before anything behind it
+static void TestQuantizeDepth()
+{
+	CHECK(DrawKey::QuantizeDepth(0.0f) == 0);
+	CHECK(DrawKey::QuantizeDepth(-5.0f) == 0);
+	CHECK(DrawKey::QuantizeDepth(std::nanf("")) == 0);
+	CHECK(DrawKey::QuantizeDepth(1e30f) < (1u << DrawKey::DepthBits));
+
+	bool ordered = true;
+	float depth = 0.001f;
+	unsigned int last = DrawKey::QuantizeDepth(depth);
+	for (int i = 0; i < 200; i++)
+	{
+		depth *= 1.1f;
+		unsigned int quantized = DrawKey::QuantizeDepth(depth);
+		ordered &= quantized > last;
+		last = quantized;
+	}
+	CHECK(ordered);
+}
+
+// --------------------------------------------------------
+// Same order as a stable sort, for lists where every digit
+// varies, where only some do (the skipped passes), and
+// where none do.  Entity indices start in order, so they
+// show whether equal keys kept it.
+// --------------------------------------------------------
+static void CheckSortsLike(FrameVector<DrawPacket>& packets)
+{
+	std::vector<DrawPacket> expected(packets.begin(), packets.end());
+	std::stable_sort(expected.begin(), expected.end(), KeyLess);
+
+	FrameVector<DrawPacket> scratch;
+	SortDrawPackets(packets, scratch);
+
+	bool same = packets.size() == expected.size();
+	for (size_t i = 0; same && i < packets.size(); i++)
+		same = packets[i].key == expected[i].key && packets[i].entity == expected[i].entity;
+	CHECK(same);
+}
+
+static void TestSort()
+{
+	std::mt19937_64 random(1234);
+	const unsigned int counts[] = { 0, 1, 2, 3, 100, 5000 };
+	for (unsigned int count : counts)
+	{
+		// Anything at all - every digit gets a pass
+		FrameVector<DrawPacket> packets(count);
+		for (unsigned int i = 0; i < count; i++)
+			packets[i] = { random(), i };
+		CheckSortsLike(packets);
+
+		// Few distinct values in each field - lots of equal keys, and constant digits
+		packets = FrameVector<DrawPacket>(count);
+		for (unsigned int i = 0; i < count; i++)
+			packets[i] = { DrawKey::Make(random() % 2, 3, (unsigned int)(random() % 8), (unsigned int)(random() % 4), (float)(random() % 16)), i };
+		CheckSortsLike(packets);
+
+		// Only the depth differs, and only in its low bits
+		packets = FrameVector<DrawPacket>(count);
+		for (unsigned int i = 0; i < count; i++)
+			packets[i] = { DrawKey::Make(0, 1, 2, 3, 10.0f) + random() % 64, i };
+		CheckSortsLike(packets);
+
+		// All the same - left exactly as it was
+		packets = FrameVector<DrawPacket>(count);
+		for (unsigned int i = 0; i < count; i++)
+			packets[i] = { 42, i };
+		CheckSortsLike(packets);
+	}
+
+	FrameArena::GetInstance().EndFrame();
+}
+
+// --------------------------------------------------------
+// Keys like a scene's: one pass and pipeline for most, a
+// few hundred materials, a few dozen meshes and any depth
+// --------------------------------------------------------
+static void MakeSceneKeys(std::vector<DrawPacket>& packets, unsigned int count, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> depth(0.1f, 500.0f);
+	packets.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int pass = random() % 10 == 0 ? DrawKey::ShadowOnly : DrawKey::Opaque;
+		packets[i] = { DrawKey::Make(pass, random() % 4, random() % 300, random() % 40, depth(random)), i };
+	}
+}
+
+// --------------------------------------------------------
+// Times SortDrawPackets and std::sort on the same lists -
+// scene-like keys, and fully random ones where none of the
+// six digits can be skipped.  Best of a number of runs, from
+// an unsorted copy each time.
+// --------------------------------------------------------
+static void Benchmark(unsigned int count)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int Runs = 20;
+
+	std::mt19937 random(99);
+	std::mt19937_64 random64(99);
+	for (int uniform = 0; uniform < 2; uniform++)
+	{
+		std::vector<DrawPacket> source;
+		if (uniform)
+		{
+			source.resize(count);
+			for (unsigned int i = 0; i < count; i++)
+				source[i] = { random64(), i };
+		}
+		else
+		{
+			MakeSceneKeys(source, count, random);
+		}
+
+		double radixBest = 0.0;
+		double stdBest = 0.0;
+		for (int run = 0; run < Runs; run++)
+		{
+			FrameVector<DrawPacket> packets(source.begin(), source.end());
+			FrameVector<DrawPacket> scratch;
+			Clock::time_point start = Clock::now();
+			SortDrawPackets(packets, scratch);
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			if (run == 0 || seconds < radixBest)
+				radixBest = seconds;
+
+			std::vector<DrawPacket> copy(source);
+			start = Clock::now();
+			std::sort(copy.begin(), copy.end(), KeyLess);
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			if (run == 0 || seconds < stdBest)
+				stdBest = seconds;
+
+			FrameArena::GetInstance().EndFrame();
+		}
+
+		printf("%u packets, %s keys: SortDrawPackets %.3f ms, std::sort %.3f ms\n",
+			count, uniform ? "random" : "scene", radixBest * 1000.0, stdBest * 1000.0);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	// The arenas are per job system thread, and this one is it
+	JobSystem::GetInstance().Initialize(1);
+	FrameArena::GetInstance().Initialize(JobSystem::GetInstance().GetThreadCount());
+
+	int result = 0;
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+	{
+		int count = argc > 2 ? atoi(argv[2]) : 100000;
+		Benchmark(count > 0 ? (unsigned int)count : 1);
+	}
+	else
+	{
+		TestKeyLayout();
+		TestQuantizeDepth();
+		TestSort();
+		result = CheckResult();
+	}
+
+	delete &FrameArena::GetInstance();
+	delete &JobSystem::GetInstance();
+	return result;
+}
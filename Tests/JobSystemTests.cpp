@@ -0,0 +1,239 @@
+#include "JobSystem.h"
+#include "Check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+//   JobSystemTests                       run the tests
+//   JobSystemTests --benchmark [items]   ParallelFor's speedup
+//                                        at each thread count
+// --------------------------------------------------------
+
+struct CounterData
+{
+	std::atomic<unsigned int>* counter;
+};
+
+static void Increment(Job*, const void* data)
+{
+	static_cast<const CounterData*>(data)->counter->fetch_add(1, std::memory_order_relaxed);
+}
+
+// Every index is visited exactly once, however the range is split
+static void TestParallelForCoversRange()
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+
+	const unsigned int counts[] = { 0, 1, 7, 100, 1000, 100003 };
+	for (unsigned int count : counts)
+	{
+		std::vector<std::atomic<unsigned int>> visits(count);
+		for (std::atomic<unsigned int>& visit : visits)
+			visit = 0;
+
+		jobSystem.ParallelFor(count, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+				visits[i]++;
+		});
+
+		bool once = true;
+		for (std::atomic<unsigned int>& visit : visits)
+			once &= visit == 1;
+		CHECK(once);
+	}
+
+	// A minimum chunk bigger than the count keeps it in one call
+	unsigned int calls = 0;
+	jobSystem.ParallelFor(100, [&](unsigned int begin, unsigned int end)
+	{
+		calls++;
+		CHECK(begin == 0 && end == 100);
+	}, 1000);
+	CHECK(calls == 1);
+
+	// Loops inside loops
+	std::atomic<unsigned int> total(0);
+	jobSystem.ParallelFor(64, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			jobSystem.ParallelFor(1000, [&](unsigned int innerBegin, unsigned int innerEnd)
+			{
+				total += innerEnd - innerBegin;
+			});
+		}
+	});
+	CHECK(total == 64 * 1000);
+}
+
+// A parent finishes only once every child has
+static void TestChildren()
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	std::atomic<unsigned int> counter(0);
+	CounterData data = { &counter };
+
+	Job* parent = jobSystem.CreateJob(Increment, &data, sizeof(data));
+	for (int i = 0; i < 100; i++)
+		jobSystem.Run(jobSystem.CreateJobAsChild(parent, Increment, &data, sizeof(data)));
+	jobSystem.Run(parent);
+	jobSystem.Wait(parent);
+	CHECK(counter == 101);
+}
+
+// --------------------------------------------------------
+// More jobs outstanding than the ring holds - slots wait for
+// their last job to finish instead of being written over
+// --------------------------------------------------------
+static void SpawnMany(Job* job, const void* data)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	for (unsigned int i = 0; i < JobSystem::JobsPerThread * 3; i++)
+		jobSystem.Run(jobSystem.CreateJobAsChild(job, Increment, data, sizeof(CounterData)));
+}
+
+static void TestRingWrap()
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	std::atomic<unsigned int> counter(0);
+	CounterData data = { &counter };
+
+	for (int round = 0; round < 4; round++)
+	{
+		counter = 0;
+		Job* root = jobSystem.CreateJob(SpawnMany, &data, sizeof(data));
+		jobSystem.Run(root);
+		jobSystem.Wait(root);
+		CHECK(counter == JobSystem::JobsPerThread * 3);
+	}
+}
+
+// Other threads register to use jobs, and loops on threads that haven't just run inline
+static void TestOtherThreads()
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+
+	unsigned int inlineTotal = 0;
+	std::thread unregistered([&]()
+	{
+		CHECK(jobSystem.GetThreadIndex() == -1);
+		jobSystem.ParallelFor(10000, [&](unsigned int begin, unsigned int end)
+		{
+			inlineTotal += end - begin;
+		});
+	});
+	unregistered.join();
+	CHECK(inlineTotal == 10000);
+
+	std::atomic<unsigned int> total(0);
+	std::thread registered([&]()
+	{
+		CHECK(jobSystem.RegisterThread());
+		CHECK(jobSystem.GetThreadIndex() > (int)jobSystem.GetWorkerCount());
+		jobSystem.ParallelFor(10000, [&](unsigned int begin, unsigned int end)
+		{
+			total += end - begin;
+		});
+		jobSystem.UnregisterThread();
+		CHECK(jobSystem.GetThreadIndex() == -1);
+	});
+	registered.join();
+	CHECK(total == 10000);
+}
+
+// Some arithmetic per item that the compiler can't skip
+static float Work(unsigned int item, unsigned int iterations)
+{
+	float value = (float)item;
+	for (unsigned int i = 0; i < iterations; i++)
+		value = std::sqrt(value + 1.0f) * 1.0001f;
+	return value;
+}
+
+// --------------------------------------------------------
+// Times the same loop on one thread, then as a ParallelFor
+// with each number of threads up to the hardware's.  Items
+// either all cost the same, or later ones cost more (like
+// entities with more to do), which needs stealing to even out.
+// --------------------------------------------------------
+static void Benchmark(unsigned int items)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	printf("%u items, %u hardware threads\n", items, hardwareThreads);
+	if (hardwareThreads < 2)
+		printf("(only one hardware thread, so these show overhead, not scaling)\n");
+
+	std::vector<float> results(items);
+	for (int uneven = 0; uneven < 2; uneven++)
+	{
+		auto iterations = [&](unsigned int item) { return uneven ? 1 + 400 * item / items : 200; };
+		auto body = [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+				results[i] = Work(i, iterations(i));
+		};
+
+		Clock::time_point start = Clock::now();
+		body(0, items);
+		double serialSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		printf("%s items: serial %.2f ms\n", uneven ? "Uneven" : "Even", serialSeconds * 1000.0);
+
+		// Always at least one worker, so two threads, then doubling up to all of them
+		unsigned int maxThreads = hardwareThreads < 2 ? 2 : hardwareThreads;
+		std::vector<unsigned int> threadCounts;
+		for (unsigned int threads = 2; threads < maxThreads; threads *= 2)
+			threadCounts.push_back(threads);
+		threadCounts.push_back(maxThreads);
+
+		for (unsigned int threads : threadCounts)
+		{
+			// Workers plus this thread
+			JobSystem& jobSystem = JobSystem::GetInstance();
+			jobSystem.Shutdown();
+			jobSystem.Initialize(threads - 1);
+
+			// Best of a few, so a stray context switch doesn't count
+			double best = 0.0;
+			for (int run = 0; run < 5; run++)
+			{
+				start = Clock::now();
+				jobSystem.ParallelFor(items, body, 64);
+				double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+				if (run == 0 || seconds < best)
+					best = seconds;
+			}
+
+			printf("  %2u threads: %8.2f ms, %.2fx\n", threads, best * 1000.0, serialSeconds / best);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+	{
+		int items = argc > 2 ? atoi(argv[2]) : 200000;
+		Benchmark(items > 0 ? (unsigned int)items : 1);
+		delete &JobSystem::GetInstance();
+		return 0;
+	}
+
+	JobSystem::GetInstance().Initialize(3);
+
+	TestParallelForCoversRange();
+	TestChildren();
+	TestRingWrap();
+	TestOtherThreads();
+
+	delete &JobSystem::GetInstance();
+	return CheckResult();
+}
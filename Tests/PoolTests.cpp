@@ -0,0 +1,157 @@
+#include "Pool.h"
+#include "Check.h"
+
+// Counts constructions and destructions, so tests can see when an object really goes
+struct Tracked
+{
+	static int live;
+	int value;
+
+	Tracked(int value) : value(value) { live++; }
+	~Tracked() { live--; }
+};
+int Tracked::live = 0;
+
+// Objects are handed out in index order, and each handle finds its own
+static void TestCreate()
+{
+	Pool<Tracked, 4> pool;
+	Handle<Tracked> handles[10];
+	for (int i = 0; i < 10; i++)
+		handles[i] = pool.Create(i * 10);
+
+	CHECK(pool.GetCount() == 10);
+	CHECK(pool.GetCapacity() == 12);
+	CHECK(Tracked::live == 10);
+
+	bool found = true;
+	for (int i = 0; i < 10; i++)
+	{
+		found &= handles[i].index == (unsigned int)i;
+		found &= pool.IsValid(handles[i]);
+		found &= pool.Get(handles[i])->value == i * 10;
+	}
+	CHECK(found);
+
+	// Blocks never move, so pointers stay put as the pool grows
+	Tracked* first = pool.Get(handles[0]);
+	for (int i = 0; i < 100; i++)
+		pool.Create(i);
+	CHECK(pool.Get(handles[0]) == first);
+
+	Handle<Tracked> null;
+	CHECK(null.IsNull());
+	CHECK(pool.Get(null) == 0);
+	CHECK(!pool.IsValid(null));
+}
+
+// --------------------------------------------------------
+// A destroyed handle is stale straight away, but the object
+// lives on until RetireFrames EndFrame() calls later - only
+// then is its slot reused, with the generation bumped
+// --------------------------------------------------------
+static void TestRetireAndReuse()
+{
+	Pool<Tracked, 4> pool;
+	Handle<Tracked> a = pool.Create(1);
+	Handle<Tracked> b = pool.Create(2);
+	Tracked* objectA = pool.Get(a);
+
+	pool.Destroy(a);
+	CHECK(!pool.IsValid(a));
+	CHECK(pool.IsValid(b));
+	CHECK(pool.GetCount() == 1);
+	CHECK(pool.GetRetiredCount() == 1);
+
+	// Still there for a frame that was handed a pointer to it
+	CHECK(Tracked::live == 2);
+	CHECK(objectA->value == 1);
+
+	// Its slot isn't handed out while it's retired
+	Handle<Tracked> c = pool.Create(3);
+	CHECK(c.index != a.index);
+
+	pool.EndFrame();
+	CHECK(Tracked::live == 3);
+	CHECK(pool.Create(4).index != a.index);
+
+	pool.EndFrame();
+	CHECK(Tracked::live == 3);
+	CHECK(pool.GetRetiredCount() == 0);
+
+	// Now the slot comes back, one generation on
+	Handle<Tracked> reused = pool.Create(5);
+	CHECK(reused.index == a.index);
+	CHECK(reused.generation == a.generation + 1);
+	CHECK(pool.IsValid(reused));
+	CHECK(!pool.IsValid(a));
+	CHECK(pool.Get(reused)->value == 5);
+
+	// Destroying the same slot again bumps it again
+	pool.Destroy(reused);
+	for (unsigned int i = 0; i < Pool<Tracked, 4>::RetireFrames; i++)
+		pool.EndFrame();
+	CHECK(pool.Create(6).generation == a.generation + 2);
+}
+
+// Stale handles are refused, not acted on
+static void TestStaleHandles()
+{
+	Pool<Tracked, 4> pool;
+	Handle<Tracked> handle = pool.Create(1);
+	pool.Destroy(handle);
+
+	// Destroying twice doesn't retire it twice
+	pool.Destroy(handle);
+	CHECK(pool.GetRetiredCount() == 1);
+
+	// An index past the end, or a generation that never was
+	Handle<Tracked> pastEnd;
+	pastEnd.index = 1000;
+	CHECK(!pool.IsValid(pastEnd));
+
+	Handle<Tracked> live = pool.Create(2);
+	Handle<Tracked> wrongGeneration = live;
+	wrongGeneration.generation++;
+	CHECK(!pool.IsValid(wrongGeneration));
+	pool.Destroy(wrongGeneration);
+	CHECK(pool.IsValid(live));
+	CHECK(pool.GetCount() == 1);
+}
+
+// ForEach only visits live objects, and the pool destroys everything left, retired or not
+static void TestForEachAndCleanup()
+{
+	{
+		Pool<Tracked, 4> pool;
+		Handle<Tracked> handles[6];
+		for (int i = 0; i < 6; i++)
+			handles[i] = pool.Create(i);
+		pool.Destroy(handles[1]);
+		pool.Destroy(handles[4]);
+
+		int visited = 0;
+		int sum = 0;
+		pool.ForEach([&](Handle<Tracked> handle, Tracked& object)
+		{
+			CHECK(pool.IsValid(handle));
+			visited++;
+			sum += object.value;
+		});
+		CHECK(visited == 4);
+		CHECK(sum == 0 + 2 + 3 + 5);
+		CHECK(Tracked::live == 6);
+	}
+	CHECK(Tracked::live == 0);
+}
+
+int main()
+{
+	TestCreate();
+	CHECK(Tracked::live == 0);
+	TestRetireAndReuse();
+	CHECK(Tracked::live == 0);
+	TestStaleHandles();
+	TestForEachAndCleanup();
+	return CheckResult();
+}
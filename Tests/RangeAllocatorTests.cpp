@@ -0,0 +1,132 @@
+#include "RangeAllocator.h"
+#include "Check.h"
+
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Free ranges are found by size class, so an allocator of
+// exactly size can turn size down - but never one of
+// GetFitSize(size), which is what GeometryArena gives a
+// mesh that needs a page to itself
+// --------------------------------------------------------
+static void TestFitSize()
+{
+	CHECK(RangeAllocator::GetFitSize(1) == 1);
+	CHECK(RangeAllocator::GetFitSize(15) == 15);
+	CHECK(RangeAllocator::GetFitSize(1000) == 1024);
+	CHECK(RangeAllocator::GetFitSize(524288) == 524288);
+	CHECK(RangeAllocator::GetFitSize(524289) == 524288 + 32768);
+	CHECK(RangeAllocator::GetFitSize(0xFFFFFFFF) == 0);
+
+	// The sizes that used to leave a mesh with no geometry
+	const unsigned int sizes[] = { 1000, 600000, 524289, 1100000, 2000000 };
+	for (unsigned int size : sizes)
+	{
+		RangeAllocator exact(size);
+		CHECK(!exact.Allocate(size).IsValid());
+
+		RangeAllocator fit(RangeAllocator::GetFitSize(size));
+		RangeAllocation allocation = fit.Allocate(size);
+		CHECK(allocation.IsValid() && allocation.offset == 0);
+	}
+
+	// And every size in between
+	bool allFit = true;
+	for (unsigned int size = 1; size < 100000; size += 7)
+	{
+		unsigned int fitSize = RangeAllocator::GetFitSize(size);
+		RangeAllocator fit(fitSize);
+		allFit &= fitSize >= size && fit.Allocate(size).IsValid();
+	}
+	CHECK(allFit);
+}
+
+// Freed ranges merge back into one
+static void TestMerge()
+{
+	RangeAllocator allocator(1024);
+	RangeAllocation a = allocator.Allocate(100);
+	RangeAllocation b = allocator.Allocate(200);
+	RangeAllocation c = allocator.Allocate(300);
+	CHECK(a.offset == 0 && b.offset == 100 && c.offset == 300);
+	CHECK(allocator.GetUsed() == 600);
+
+	allocator.Free(b);
+	CHECK(allocator.GetFreeRangeCount() == 2);
+	CHECK(allocator.GetFragmentation() > 0.0f);
+
+	allocator.Free(a);
+	allocator.Free(c);
+	CHECK(allocator.GetUsed() == 0);
+	CHECK(allocator.GetFreeRangeCount() == 1);
+	CHECK(allocator.GetLargestFreeRange() == 1024);
+	CHECK(allocator.GetFragmentation() == 0.0f);
+}
+
+// Random allocations and frees never overlap, and used always adds up
+static void TestRandom()
+{
+	struct Live
+	{
+		RangeAllocation allocation;
+		unsigned int size;
+	};
+
+	const unsigned int capacity = 100000;
+	RangeAllocator allocator(capacity);
+	std::vector<Live> live;
+	std::vector<bool> owned(capacity, false);
+	std::mt19937 random(1);
+
+	bool overlaps = false;
+	bool usedMatches = true;
+	for (int i = 0; i < 100000; i++)
+	{
+		if (live.empty() || random() % 100 < 55)
+		{
+			unsigned int size = 1 + random() % (random() % 2 ? 30 : 3000);
+			RangeAllocation allocation = allocator.Allocate(size);
+			if (!allocation.IsValid())
+				continue;
+
+			CHECK(allocation.offset + size <= capacity);
+			for (unsigned int u = 0; u < size; u++)
+			{
+				overlaps |= owned[allocation.offset + u];
+				owned[allocation.offset + u] = true;
+			}
+			live.push_back(Live{ allocation, size });
+		}
+		else
+		{
+			unsigned int index = random() % live.size();
+			for (unsigned int u = 0; u < live[index].size; u++)
+				owned[live[index].allocation.offset + u] = false;
+
+			allocator.Free(live[index].allocation);
+			live[index] = live.back();
+			live.pop_back();
+		}
+
+		unsigned int used = 0;
+		for (const Live& l : live)
+			used += l.size;
+		usedMatches &= used == allocator.GetUsed();
+	}
+	CHECK(!overlaps);
+	CHECK(usedMatches);
+
+	for (const Live& l : live)
+		allocator.Free(l.allocation);
+	CHECK(allocator.GetUsed() == 0);
+	CHECK(allocator.GetLargestFreeRange() == capacity);
+}
+
+int main()
+{
+	TestFitSize();
+	TestMerge();
+	TestRandom();
+	return CheckResult();
+}
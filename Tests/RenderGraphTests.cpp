@@ -0,0 +1,329 @@
+#include "RenderGraph.h"
+#include "CommandStream.h"
+#include "NullCommandExecutor.h"
+#include "Check.h"
+
+#include <string>
+
+// DXGI_FORMAT_R16_TYPELESS
+static const unsigned int ShadowFormat = 53;
+
+static const float Black[4] = { 0, 0, 0, 1 };
+
+static RenderGraphTextureDesc MakeDesc(unsigned int size)
+{
+	RenderGraphTextureDesc desc;
+	desc.width = size;
+	desc.height = size;
+	desc.format = ShadowFormat;
+	return desc;
+}
+
+static std::string OrderNames(const RenderGraph& graph)
+{
+	std::string names;
+	for (unsigned int p : graph.GetOrder())
+		names += (names.empty() ? "" : " ") + graph.GetPass(p).name;
+	return names;
+}
+
+// --------------------------------------------------------
+// The game's frame, declared out of order: main reads the
+// shadow map, so shadow goes first, and a pass whose only
+// write nothing reads is culled
+// --------------------------------------------------------
+static void TestShadowBeforeMain()
+{
+	RenderGraph graph;
+	RenderGraphResource shadowMap = graph.CreateTexture("shadow map", MakeDesc(1024));
+	RenderGraphResource unused = graph.CreateTexture("unused", MakeDesc(1024));
+	RenderGraphResource backBuffer = graph.ImportTexture("back buffer");
+	RenderGraphResource depth = graph.ImportTexture("depth");
+
+	unsigned int mainPass = graph.AddPass("main", nullptr);
+	unsigned int shadow = graph.AddPass("shadow", nullptr);
+	unsigned int dead = graph.AddPass("dead", nullptr);
+
+	graph.AddRead(mainPass, shadowMap, ShaderStage::Pixel, 4);
+	graph.AddRenderTarget(mainPass, backBuffer, Black);
+	graph.AddDepthStencil(mainPass, depth, 1.0f);
+	graph.AddDepthStencil(shadow, shadowMap, 1.0f);
+	graph.AddDepthStencil(dead, unused, 1.0f);
+	graph.MarkOutput(backBuffer);
+
+	CHECK(graph.Compile());
+	CHECK(graph.IsCompiled());
+	CHECK(OrderNames(graph) == "shadow main");
+	CHECK(graph.GetCulledCount() == 1);
+	CHECK(graph.GetPass(dead).culled);
+	CHECK(!graph.GetPass(shadow).culled);
+
+	// Only the shadow map needs a texture, as a depth buffer and a shader resource
+	CHECK(graph.GetPhysicals().size() == 1);
+	CHECK(graph.GetResource(shadowMap).physical == 0);
+	CHECK(graph.GetResource(unused).physical == RenderGraph::NoPhysical);
+	CHECK(graph.GetResource(backBuffer).physical == RenderGraph::NoPhysical);
+	CHECK(graph.GetPhysicals()[0].bindFlags == (RenderGraphDepthStencil | RenderGraphShaderResource));
+
+	// Nothing is bound when either pass starts, and the shadow map is unbound at the end
+	CHECK(graph.GetPass(shadow).unbinds.empty());
+	CHECK(graph.GetPass(mainPass).unbinds.empty());
+	CHECK(graph.GetFinalUnbinds().size() == 1);
+	CHECK(graph.GetFinalUnbinds()[0].stage == ShaderStage::Pixel);
+	CHECK(graph.GetFinalUnbinds()[0].slot == 4);
+
+	// Side effects keep a pass that nothing reads
+	graph.SetSideEffects(dead);
+	CHECK(graph.Compile());
+	CHECK(graph.GetCulledCount() == 0);
+	CHECK(OrderNames(graph) == "shadow main dead");
+}
+
+// --------------------------------------------------------
+// Drawing over a texture without clearing it keeps its
+// earlier writer, even when nothing reads the texture and
+// only the later pass's side effects keep it running
+// --------------------------------------------------------
+static void TestLoadKeepsWriter()
+{
+	RenderGraph graph;
+	RenderGraphResource overlay = graph.CreateTexture("overlay", MakeDesc(256));
+	unsigned int base = graph.AddPass("base", nullptr);
+	unsigned int debug = graph.AddPass("debug", nullptr);
+	graph.AddRenderTarget(base, overlay, Black);
+	graph.AddRenderTarget(debug, overlay);
+	graph.SetSideEffects(debug);
+
+	CHECK(graph.Compile());
+	CHECK(OrderNames(graph) == "base debug");
+
+	// Clearing it means nothing earlier shows through
+	RenderGraph cleared;
+	overlay = cleared.CreateTexture("overlay", MakeDesc(256));
+	base = cleared.AddPass("base", nullptr);
+	debug = cleared.AddPass("debug", nullptr);
+	cleared.AddRenderTarget(base, overlay, Black);
+	cleared.AddRenderTarget(debug, overlay, Black);
+	cleared.SetSideEffects(debug);
+
+	CHECK(cleared.Compile());
+	CHECK(OrderNames(cleared) == "debug");
+}
+
+// Two passes that each read what the other writes can't be ordered
+static void TestCycle()
+{
+	RenderGraph graph;
+	RenderGraphResource a = graph.CreateTexture("a", MakeDesc(256));
+	RenderGraphResource b = graph.CreateTexture("b", MakeDesc(256));
+	unsigned int first = graph.AddPass("first", nullptr);
+	unsigned int second = graph.AddPass("second", nullptr);
+	graph.AddRead(first, b, ShaderStage::Pixel, 0);
+	graph.AddDepthStencil(first, a, 1.0f);
+	graph.AddRead(second, a, ShaderStage::Pixel, 0);
+	graph.AddDepthStencil(second, b, 1.0f);
+	graph.SetSideEffects(first);
+
+	CHECK(!graph.Compile());
+	CHECK(!graph.IsCompiled());
+	CHECK(!graph.GetError().empty());
+}
+
+// Declarations that can't work fail with a reason
+static void TestInvalid()
+{
+	RenderGraph readsOwnWrite;
+	RenderGraphResource a = readsOwnWrite.CreateTexture("a", MakeDesc(256));
+	unsigned int pass = readsOwnWrite.AddPass("pass", nullptr);
+	readsOwnWrite.AddRead(pass, a, ShaderStage::Pixel, 0);
+	readsOwnWrite.AddDepthStencil(pass, a, 1.0f);
+	readsOwnWrite.SetSideEffects(pass);
+	CHECK(!readsOwnWrite.Compile());
+	CHECK(readsOwnWrite.GetError() == "pass reads a, which it writes");
+
+	RenderGraph neverWritten;
+	a = neverWritten.CreateTexture("a", MakeDesc(256));
+	pass = neverWritten.AddPass("pass", nullptr);
+	neverWritten.AddRead(pass, a, ShaderStage::Pixel, 0);
+	neverWritten.SetSideEffects(pass);
+	CHECK(!neverWritten.Compile());
+	CHECK(neverWritten.GetError() == "pass reads a, which nothing writes");
+
+	RenderGraph twoDepths;
+	a = twoDepths.CreateTexture("a", MakeDesc(256));
+	RenderGraphResource b = twoDepths.CreateTexture("b", MakeDesc(256));
+	pass = twoDepths.AddPass("pass", nullptr);
+	twoDepths.AddDepthStencil(pass, a, 1.0f);
+	twoDepths.AddDepthStencil(pass, b, 1.0f);
+	twoDepths.SetSideEffects(pass);
+	CHECK(!twoDepths.Compile());
+
+	RenderGraph tooManyTargets;
+	pass = tooManyTargets.AddPass("pass", nullptr);
+	for (unsigned int i = 0; i <= RenderGraph::MaxRenderTargets; i++)
+		tooManyTargets.AddRenderTarget(pass, tooManyTargets.CreateTexture("target", MakeDesc(256)), Black);
+	tooManyTargets.SetSideEffects(pass);
+	CHECK(!tooManyTargets.Compile());
+}
+
+// --------------------------------------------------------
+// A chain x -> y -> z -> out: x is done with by the time z
+// is first written, so they share a texture, and the pass
+// writing z first unbinds x from where it was read
+// --------------------------------------------------------
+static void TestAliasing()
+{
+	RenderGraph graph;
+	RenderGraphResource x = graph.CreateTexture("x", MakeDesc(512));
+	RenderGraphResource y = graph.CreateTexture("y", MakeDesc(512));
+	RenderGraphResource z = graph.CreateTexture("z", MakeDesc(512));
+	RenderGraphResource small = graph.CreateTexture("small", MakeDesc(256));
+	RenderGraphResource out = graph.ImportTexture("out");
+
+	unsigned int writeX = graph.AddPass("write x", nullptr);
+	unsigned int xToY = graph.AddPass("x to y", nullptr);
+	unsigned int yToZ = graph.AddPass("y to z", nullptr);
+	unsigned int zToOut = graph.AddPass("z to out", nullptr);
+
+	graph.AddRenderTarget(writeX, x, Black);
+	graph.AddRead(xToY, x, ShaderStage::Pixel, 0);
+	graph.AddRenderTarget(xToY, y, Black);
+	graph.AddRead(yToZ, y, ShaderStage::Pixel, 1);
+	graph.AddRenderTarget(yToZ, z, Black);
+	graph.AddDepthStencil(yToZ, small, 1.0f);
+	graph.AddRead(zToOut, z, ShaderStage::Pixel, 2);
+	graph.AddRenderTarget(zToOut, out, Black);
+	graph.MarkOutput(out);
+
+	CHECK(graph.Compile());
+	CHECK(OrderNames(graph) == "write x x to y y to z z to out");
+
+	// A different desc never shares, even when it's free
+	CHECK(graph.GetPhysicals().size() == 3);
+	CHECK(graph.GetResource(x).physical == graph.GetResource(z).physical);
+	CHECK(graph.GetResource(y).physical != graph.GetResource(x).physical);
+	CHECK(graph.GetResource(small).physical != graph.GetResource(x).physical);
+	CHECK(graph.GetResource(small).physical != graph.GetResource(y).physical);
+	CHECK(graph.GetTransientCount() == 4);
+
+	CHECK(graph.GetPass(writeX).unbinds.empty());
+	CHECK(graph.GetPass(xToY).unbinds.empty());
+	CHECK(graph.GetPass(zToOut).unbinds.empty());
+
+	// x is still in slot 0 when z's writer starts
+	const std::vector<RenderGraphBinding>& unbinds = graph.GetPass(yToZ).unbinds;
+	CHECK(unbinds.size() == 1);
+	CHECK(unbinds.size() == 1 && unbinds[0].stage == ShaderStage::Pixel && unbinds[0].slot == 0);
+
+	// y and z are left bound
+	CHECK(graph.GetFinalUnbinds().size() == 2);
+
+	// Reading x a pass later keeps it alive past z's first write
+	RenderGraph longer;
+	x = longer.CreateTexture("x", MakeDesc(512));
+	y = longer.CreateTexture("y", MakeDesc(512));
+	z = longer.CreateTexture("z", MakeDesc(512));
+	out = longer.ImportTexture("out");
+	writeX = longer.AddPass("write x", nullptr);
+	xToY = longer.AddPass("x to y", nullptr);
+	yToZ = longer.AddPass("y to z", nullptr);
+	zToOut = longer.AddPass("z to out", nullptr);
+	longer.AddRenderTarget(writeX, x, Black);
+	longer.AddRead(xToY, x, ShaderStage::Pixel, 0);
+	longer.AddRenderTarget(xToY, y, Black);
+	longer.AddRead(yToZ, y, ShaderStage::Pixel, 1);
+	longer.AddRenderTarget(yToZ, z, Black);
+	longer.AddRead(zToOut, z, ShaderStage::Pixel, 2);
+	longer.AddRead(zToOut, x, ShaderStage::Pixel, 3);
+	longer.AddRenderTarget(zToOut, out, Black);
+	longer.MarkOutput(out);
+
+	CHECK(longer.Compile());
+	CHECK(longer.GetPhysicals().size() == 3);
+	CHECK(longer.GetResource(x).physical != longer.GetResource(z).physical);
+	CHECK(longer.GetPass(yToZ).unbinds.empty());
+}
+
+// Compiling again gives the same result rather than adding to the last one
+static void TestCompileAgain()
+{
+	RenderGraph graph;
+	RenderGraphResource shadowMap = graph.CreateTexture("shadow map", MakeDesc(1024));
+	RenderGraphResource backBuffer = graph.ImportTexture("back buffer");
+	unsigned int shadow = graph.AddPass("shadow", nullptr);
+	unsigned int mainPass = graph.AddPass("main", nullptr);
+	graph.AddDepthStencil(shadow, shadowMap, 1.0f);
+	graph.AddRead(mainPass, shadowMap, ShaderStage::Pixel, 4);
+	graph.AddRenderTarget(mainPass, backBuffer, Black);
+	graph.MarkOutput(backBuffer);
+
+	CHECK(graph.Compile());
+	CHECK(graph.Compile());
+	CHECK(graph.GetOrder().size() == 2);
+	CHECK(graph.GetPhysicals().size() == 1);
+	CHECK(graph.GetFinalUnbinds().size() == 1);
+
+	graph.Clear();
+	CHECK(graph.GetPassCount() == 0);
+	CHECK(graph.GetResourceCount() == 0);
+	CHECK(graph.Compile());
+	CHECK(graph.GetOrder().empty());
+}
+
+// --------------------------------------------------------
+// What's encoded around each pass: targets sized by the
+// views, clears only in a pass's first part, reads bound
+// after the targets, and the last read unbound at the end
+// --------------------------------------------------------
+static void TestEncodePassSetup()
+{
+	RenderGraph graph;
+	RenderGraphResource shadowMap = graph.CreateTexture("shadow map", MakeDesc(1024));
+	RenderGraphResource backBuffer = graph.ImportTexture("back buffer");
+	unsigned int shadow = graph.AddPass("shadow", nullptr);
+	unsigned int mainPass = graph.AddPass("main", nullptr);
+	graph.AddDepthStencil(shadow, shadowMap, 1.0f);
+	graph.AddRead(mainPass, shadowMap, ShaderStage::Pixel, 4);
+	graph.AddRenderTarget(mainPass, backBuffer, Black);
+	graph.SetPartCount(mainPass, 2);
+	graph.MarkOutput(backBuffer);
+	CHECK(graph.Compile());
+
+	char depthView, shaderView, targetView;
+	std::vector<RenderGraphViews> views(graph.GetResourceCount());
+	views[shadowMap.index].depthStencil = &depthView;
+	views[shadowMap.index].shaderResource = &shaderView;
+	views[shadowMap.index].width = 1024;
+	views[shadowMap.index].height = 1024;
+	views[backBuffer.index].renderTarget = &targetView;
+	views[backBuffer.index].width = 1280;
+	views[backBuffer.index].height = 720;
+
+	CommandStream stream;
+	graph.EncodePassSetup(shadow, 0, views.data(), stream);
+	graph.EncodePassSetup(mainPass, 0, views.data(), stream);
+	graph.EncodePassSetup(mainPass, 1, views.data(), stream);
+	graph.EncodeFinalUnbinds(stream);
+
+	NullCommandExecutor executor;
+	executor.Execute(stream);
+	const CommandStreamStats& stats = executor.GetStats();
+	CHECK(stats.commands[(unsigned int)CommandType::SetRenderTargets] == 3);
+	CHECK(stats.commands[(unsigned int)CommandType::SetViewport] == 3);
+	CHECK(stats.commands[(unsigned int)CommandType::ClearDepthStencil] == 1);
+	CHECK(stats.commands[(unsigned int)CommandType::ClearRenderTarget] == 1);
+	CHECK(stats.commands[(unsigned int)CommandType::SetResources] == 3);	// Once per main part, then the unbind
+	CHECK(stats.draws == 0);
+}
+
+int main()
+{
+	TestShadowBeforeMain();
+	TestLoadKeepsWriter();
+	TestCycle();
+	TestInvalid();
+	TestAliasing();
+	TestCompileAgain();
+	TestEncodePassSetup();
+	return CheckResult();
+}
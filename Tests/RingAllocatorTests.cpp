@@ -0,0 +1,215 @@
+#include "RingAllocator.h"
+#include "Check.h"
+
+#include <deque>
+#include <random>
+#include <vector>
+
+// Sizes round up to the alignment, and allocations follow each other
+static void TestAlignment()
+{
+	RingAllocator ring(1024, 256);
+	CHECK(ring.Allocate(1) == 0);
+	CHECK(ring.Allocate(256) == 256);
+	CHECK(ring.Allocate(257) == 512);
+	CHECK(ring.GetUsed() == 1024);
+	CHECK(ring.Allocate(0) == RingAllocator::InvalidOffset);
+}
+
+// --------------------------------------------------------
+// An allocation that doesn't fit before the end starts at 0
+// instead, and the skipped bytes stay used until its frame
+// is retired
+// --------------------------------------------------------
+static void TestWraparound()
+{
+	RingAllocator ring(1024, 256);
+	CHECK(ring.Allocate(768) == 0);
+	CHECK(ring.FinishFrame());
+	ring.RetireOldestFrame();
+	CHECK(ring.GetUsed() == 0);
+
+	// Only 256 bytes left before the end
+	CHECK(ring.Allocate(512) == 0);
+	CHECK(ring.GetUsed() == 256 + 512);
+
+	// Right behind it, up to where the skipped bytes start
+	CHECK(ring.Allocate(256) == 512);
+	CHECK(ring.Allocate(256) == RingAllocator::InvalidOffset);
+
+	CHECK(ring.FinishFrame());
+	ring.RetireOldestFrame();
+	CHECK(ring.GetUsed() == 0);
+}
+
+// --------------------------------------------------------
+// A frame's space only comes back when it's retired (when
+// its fence has passed), and only the oldest frame's
+// --------------------------------------------------------
+static void TestFrameRelease()
+{
+	RingAllocator ring(1024, 256);
+	CHECK(ring.Allocate(512) == 0);
+	CHECK(ring.FinishFrame());
+	CHECK(ring.Allocate(512) == 512);
+	CHECK(ring.FinishFrame());
+	CHECK(ring.GetFramesInFlight() == 2);
+
+	CHECK(ring.Allocate(256) == RingAllocator::InvalidOffset);
+
+	ring.RetireOldestFrame();
+	CHECK(ring.GetFramesInFlight() == 1);
+	CHECK(ring.GetUsed() == 512);
+	CHECK(ring.Allocate(256) == 0);
+	CHECK(ring.Allocate(256) == 256);
+	CHECK(ring.Allocate(256) == RingAllocator::InvalidOffset);
+
+	// Nothing to retire is fine
+	CHECK(ring.FinishFrame());
+	ring.RetireOldestFrame();
+	ring.RetireOldestFrame();
+	ring.RetireOldestFrame();
+	CHECK(ring.GetFramesInFlight() == 0);
+	CHECK(ring.GetUsed() == 0);
+}
+
+// --------------------------------------------------------
+// EncodeUpload asks without letting the ring orphan its
+// buffer.  A full ring has to just say no, and leave what's
+// in flight (and where the next allocation goes) alone.
+// --------------------------------------------------------
+static void TestFullRingFailsCleanly()
+{
+	RingAllocator ring(1024, 256);
+	CHECK(ring.Allocate(256) == 0);
+	CHECK(ring.FinishFrame());
+	CHECK(ring.Allocate(512) == 256);
+
+	// Too big for the end and for the start - not even the
+	// skipped bytes may be counted
+	CHECK(ring.Allocate(512) == RingAllocator::InvalidOffset);
+	CHECK(ring.GetUsed() == 768);
+
+	// Bigger than the whole ring
+	CHECK(ring.Allocate(2048) == RingAllocator::InvalidOffset);
+	CHECK(ring.GetUsed() == 768);
+
+	// Still carries on from where it was
+	CHECK(ring.Allocate(256) == 768);
+	CHECK(ring.Allocate(1) == RingAllocator::InvalidOffset);
+
+	CHECK(ring.FinishFrame());
+	ring.RetireOldestFrame();
+	CHECK(ring.GetUsed() == 768);
+	CHECK(ring.Allocate(256) == 0);
+}
+
+// Too many unretired frames - FinishFrame refuses, and the frame stays open
+static void TestFrameLimit()
+{
+	RingAllocator ring(RingAllocator::MaxFrames * 512, 256);
+	for (unsigned int i = 0; i < RingAllocator::MaxFrames; i++)
+	{
+		CHECK(ring.Allocate(256) != RingAllocator::InvalidOffset);
+		CHECK(ring.FinishFrame());
+	}
+
+	CHECK(ring.Allocate(256) != RingAllocator::InvalidOffset);
+	CHECK(!ring.FinishFrame());
+
+	ring.RetireOldestFrame();
+	CHECK(ring.FinishFrame());
+	CHECK(ring.GetFramesInFlight() == RingAllocator::MaxFrames);
+}
+
+// Clear (what orphaning the buffer does) forgets everything
+static void TestClear()
+{
+	RingAllocator ring(1024, 256);
+	CHECK(ring.Allocate(512) == 0);
+	CHECK(ring.FinishFrame());
+	CHECK(ring.Allocate(256) == 512);
+
+	ring.Clear();
+	CHECK(ring.GetUsed() == 0);
+	CHECK(ring.GetFramesInFlight() == 0);
+	CHECK(ring.Allocate(1024) == 0);
+}
+
+// --------------------------------------------------------
+// Random frames against the rule that matters: nothing
+// handed out overlaps anything not yet retired
+// --------------------------------------------------------
+static void TestRandomFrames()
+{
+	struct Range
+	{
+		unsigned int offset;
+		unsigned int size;
+	};
+
+	const unsigned int capacity = 4096;
+	RingAllocator ring(capacity, 256);
+	std::mt19937 random(1);
+	std::deque<std::vector<Range>> inFlight;
+	std::vector<Range> current;
+
+	for (int frame = 0; frame < 20000; frame++)
+	{
+		unsigned int count = random() % 10;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int size = 1 + random() % 600;
+			unsigned int offset = ring.Allocate(size);
+			if (offset == RingAllocator::InvalidOffset)
+				continue;
+
+			CHECK(offset % 256 == 0);
+			CHECK(offset + size <= capacity);
+
+			bool overlaps = false;
+			for (const std::vector<Range>& ranges : inFlight)
+			{
+				for (const Range& range : ranges)
+					overlaps |= offset < range.offset + range.size && range.offset < offset + size;
+			}
+			for (const Range& range : current)
+				overlaps |= offset < range.offset + range.size && range.offset < offset + size;
+			CHECK(!overlaps);
+
+			current.push_back(Range{ offset, size });
+		}
+
+		if (!ring.FinishFrame())
+		{
+			ring.RetireOldestFrame();
+			inFlight.pop_front();
+			CHECK(ring.FinishFrame());
+		}
+		inFlight.push_back(current);
+		current.clear();
+
+		// Fences pass at random
+		unsigned int keep = random() % 4;
+		while (inFlight.size() > keep)
+		{
+			ring.RetireOldestFrame();
+			inFlight.pop_front();
+		}
+
+		if (inFlight.empty())
+			CHECK(ring.GetUsed() == 0);
+	}
+}
+
+int main()
+{
+	TestAlignment();
+	TestWraparound();
+	TestFrameRelease();
+	TestFullRingFailsCleanly();
+	TestFrameLimit();
+	TestClear();
+	TestRandomFrames();
+	return CheckResult();
+}
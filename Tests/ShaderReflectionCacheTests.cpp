@@ -0,0 +1,219 @@
+#include "ShaderReflectionCache.h"
+#include "Check.h"
+
+#include <filesystem>
+
+static const unsigned long long BlobHash = 0x0123456789ABCDEFull;
+static const unsigned long long BlobSize = 4096;
+
+// Offset of the constant buffer count - after magic, version, hash and size
+static const size_t BufferCountOffset = 4 + 4 + 8 + 8;
+
+static ShaderReflectionData MakeData()
+{
+	ShaderReflectionData data;
+
+	ShaderReflectionData::ConstantBuffer perFrame;
+	perFrame.Name = "PerFrame";
+	perFrame.Type = 0;
+	perFrame.Size = 128;
+	perFrame.BindPoint = 1;
+	perFrame.Variables.push_back({ "view", 0, 64 });
+	perFrame.Variables.push_back({ "projection", 64, 64 });
+	data.ConstantBuffers.push_back(perFrame);
+
+	ShaderReflectionData::ConstantBuffer empty;
+	empty.Name = "Empty";
+	empty.Type = 0;
+	empty.Size = 16;
+	empty.BindPoint = 3;
+	data.ConstantBuffers.push_back(empty);
+
+	data.Resources.push_back({ "Albedo", 2, 0 });
+	data.Resources.push_back({ "BasicSampler", 3, 0 });
+	data.InputParameters.push_back({ "POSITION", 0, 3, 7 });
+	data.InputParameters.push_back({ "TEXCOORD", 1, 3, 3 });
+	return data;
+}
+
+static void WriteU32(std::vector<unsigned char>& bytes, size_t offset, unsigned int value)
+{
+	for (int i = 0; i < 4; i++)
+		bytes[offset + i] = (unsigned char)(value >> (i * 8));
+}
+
+static bool Read(const std::vector<unsigned char>& bytes, ShaderReflectionData& data)
+{
+	return ShaderReflectionCache::Deserialize(bytes.data(), bytes.size(), BlobHash, BlobSize, data);
+}
+
+static void TestRoundTrip()
+{
+	ShaderReflectionData data = MakeData();
+	data.ThreadGroupSize[0] = 8;
+	data.ThreadGroupSize[1] = 4;
+	data.ThreadGroupSize[2] = 1;
+
+	ShaderReflectionData result;
+	CHECK(Read(ShaderReflectionCache::Serialize(data, BlobHash, BlobSize), result));
+
+	CHECK(result.ConstantBuffers.size() == 2);
+	CHECK(result.ConstantBuffers[0].Name == "PerFrame");
+	CHECK(result.ConstantBuffers[0].Size == 128);
+	CHECK(result.ConstantBuffers[0].BindPoint == 1);
+	CHECK(result.ConstantBuffers[0].Variables.size() == 2);
+	CHECK(result.ConstantBuffers[0].Variables[1].Name == "projection");
+	CHECK(result.ConstantBuffers[0].Variables[1].ByteOffset == 64);
+	CHECK(result.ConstantBuffers[0].Variables[1].Size == 64);
+	CHECK(result.ConstantBuffers[1].Variables.empty());
+	CHECK(result.ConstantBuffers[1].BindPoint == 3);
+
+	CHECK(result.Resources.size() == 2);
+	CHECK(result.Resources[1].Name == "BasicSampler");
+	CHECK(result.Resources[1].Type == 3);
+
+	CHECK(result.InputParameters.size() == 2);
+	CHECK(result.InputParameters[1].SemanticName == "TEXCOORD");
+	CHECK(result.InputParameters[1].SemanticIndex == 1);
+	CHECK(result.InputParameters[0].Mask == 7);
+
+	CHECK(result.ThreadGroupSize[0] == 8);
+	CHECK(result.ThreadGroupSize[1] == 4);
+	CHECK(result.ThreadGroupSize[2] == 1);
+
+	// Nothing at all is still a valid shader
+	ShaderReflectionData nothing;
+	CHECK(Read(ShaderReflectionCache::Serialize(ShaderReflectionData(), BlobHash, BlobSize), nothing));
+	CHECK(nothing.ConstantBuffers.empty() && nothing.Resources.empty() && nothing.InputParameters.empty());
+}
+
+// A recompiled shader has a different blob, so its old sidecar doesn't count
+static void TestRejectsOtherBlob()
+{
+	std::vector<unsigned char> bytes = ShaderReflectionCache::Serialize(MakeData(), BlobHash, BlobSize);
+	ShaderReflectionData result;
+	CHECK(!ShaderReflectionCache::Deserialize(bytes.data(), bytes.size(), BlobHash + 1, BlobSize, result));
+	CHECK(!ShaderReflectionCache::Deserialize(bytes.data(), bytes.size(), BlobHash, BlobSize + 1, result));
+
+	std::vector<unsigned char> badMagic = bytes;
+	badMagic[0] ^= 1;
+	CHECK(!Read(badMagic, result));
+
+	std::vector<unsigned char> badVersion = bytes;
+	WriteU32(badVersion, 4, ShaderReflectionCache::Version + 1);
+	CHECK(!Read(badVersion, result));
+
+	// A failed read leaves data alone
+	CHECK(result.ConstantBuffers.empty());
+}
+
+static void TestRejectsWrongLength()
+{
+	std::vector<unsigned char> bytes = ShaderReflectionCache::Serialize(MakeData(), BlobHash, BlobSize);
+	ShaderReflectionData result;
+
+	std::vector<unsigned char> trailing = bytes;
+	trailing.push_back(0);
+	CHECK(!Read(trailing, result));
+
+	// Cut off anywhere
+	bool anyRead = false;
+	for (size_t length = 0; length < bytes.size(); length++)
+		anyRead |= ShaderReflectionCache::Deserialize(bytes.data(), length, BlobHash, BlobSize, result);
+	CHECK(!anyRead);
+}
+
+// Counts are checked against what's left before anything is sized by them
+static void TestRejectsOversizedCount()
+{
+	std::vector<unsigned char> bytes = ShaderReflectionCache::Serialize(MakeData(), BlobHash, BlobSize);
+	ShaderReflectionData result;
+
+	std::vector<unsigned char> buffers = bytes;
+	WriteU32(buffers, BufferCountOffset, 0xFFFFFFFF);
+	CHECK(!Read(buffers, result));
+
+	// The first buffer's variable count - after its name, type, size and bind point
+	size_t variableCountOffset = BufferCountOffset + 4 + 2 + 8 + 4 * 3;
+	std::vector<unsigned char> variables = bytes;
+	WriteU32(variables, variableCountOffset, 0x10000000);
+	CHECK(!Read(variables, result));
+
+	// One more than is there is just as wrong
+	std::vector<unsigned char> oneMore = bytes;
+	WriteU32(oneMore, BufferCountOffset, 3);
+	CHECK(!Read(oneMore, result));
+}
+
+// A variable past the end of its buffer would be written out of bounds
+static void TestRejectsVariableOutsideBuffer()
+{
+	ShaderReflectionData result;
+
+	ShaderReflectionData past = MakeData();
+	past.ConstantBuffers[0].Variables[1].ByteOffset = 72;
+	CHECK(!Read(ShaderReflectionCache::Serialize(past, BlobHash, BlobSize), result));
+
+	ShaderReflectionData start = MakeData();
+	start.ConstantBuffers[0].Variables[0].ByteOffset = 129;
+	start.ConstantBuffers[0].Variables[0].Size = 0;
+	CHECK(!Read(ShaderReflectionCache::Serialize(start, BlobHash, BlobSize), result));
+
+	// Offset plus size wraps around to something small
+	ShaderReflectionData wraps = MakeData();
+	wraps.ConstantBuffers[0].Variables[1].Size = 0xFFFFFFF0;
+	CHECK(!Read(ShaderReflectionCache::Serialize(wraps, BlobHash, BlobSize), result));
+
+	// Right up to the end is fine
+	ShaderReflectionData end = MakeData();
+	end.ConstantBuffers[0].Variables[1].ByteOffset = 112;
+	end.ConstantBuffers[0].Variables[1].Size = 16;
+	CHECK(Read(ShaderReflectionCache::Serialize(end, BlobHash, BlobSize), result));
+}
+
+// Any byte changed to anything - has to fail or succeed, never crash
+static void TestCorruptBytes()
+{
+	std::vector<unsigned char> bytes = ShaderReflectionCache::Serialize(MakeData(), BlobHash, BlobSize);
+	ShaderReflectionData result;
+	for (size_t i = BufferCountOffset; i < bytes.size(); i++)
+	{
+		for (int value = 0; value < 256; value += 15)
+		{
+			std::vector<unsigned char> corrupt = bytes;
+			corrupt[i] = (unsigned char)value;
+			Read(corrupt, result);
+		}
+	}
+}
+
+static void TestFiles()
+{
+	CHECK(ShaderReflectionCache::GetSidecarPath(L"Shaders/VertexShader.cso") == std::filesystem::path(L"Shaders/VertexShader.refl").wstring());
+
+	// FNV-1a's published value for "a"
+	CHECK(ShaderReflectionCache::HashBlob("a", 1) == 0xAF63DC4C8601EC8Cull);
+
+	std::wstring file = (std::filesystem::temp_directory_path() / L"ShaderReflectionCacheTests.refl").wstring();
+	CHECK(ShaderReflectionCache::Save(file, MakeData(), BlobHash, BlobSize));
+
+	ShaderReflectionData result;
+	CHECK(ShaderReflectionCache::Load(file, BlobHash, BlobSize, result));
+	CHECK(result.Resources.size() == 2);
+	CHECK(!ShaderReflectionCache::Load(file, BlobHash ^ 1, BlobSize, result));
+
+	std::filesystem::remove(file);
+	CHECK(!ShaderReflectionCache::Load(file, BlobHash, BlobSize, result));
+}
+
+int main()
+{
+	TestRoundTrip();
+	TestRejectsOtherBlob();
+	TestRejectsWrongLength();
+	TestRejectsOversizedCount();
+	TestRejectsVariableOutsideBuffer();
+	TestCorruptBytes();
+	TestFiles();
+	return CheckResult();
+}
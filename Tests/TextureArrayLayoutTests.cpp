@@ -0,0 +1,132 @@
+#include "TextureArrayLayout.h"
+#include "Check.h"
+
+// DXGI_FORMAT_R8G8B8A8_UNORM and DXGI_FORMAT_R8_UNORM
+static const unsigned int Rgba8 = 28;
+static const unsigned int R8 = 61;
+
+static TextureShape MakeShape(unsigned int size, unsigned int mipLevels, unsigned int format)
+{
+	TextureShape shape;
+	shape.width = size;
+	shape.height = size;
+	shape.mipLevels = mipLevels;
+	shape.format = format;
+	return shape;
+}
+
+// --------------------------------------------------------
+// Same shape shares an array, one slice after another - any
+// difference (size, mips or format) means another array
+// --------------------------------------------------------
+static void TestSameShapeShares()
+{
+	TextureShape albedo = MakeShape(1024, 11, Rgba8);
+	TextureShape roughness = MakeShape(1024, 11, R8);
+	TextureShape small = MakeShape(128, 8, Rgba8);
+	TextureShape fewerMips = MakeShape(1024, 1, Rgba8);
+
+	TextureArrayLayout layout;
+	TextureSlot a0 = layout.Add(albedo);
+	TextureSlot r0 = layout.Add(roughness);
+	TextureSlot a1 = layout.Add(albedo);
+	TextureSlot s0 = layout.Add(small);
+	TextureSlot a2 = layout.Add(albedo);
+	TextureSlot m0 = layout.Add(fewerMips);
+
+	CHECK(a0.array == 0 && a0.slice == 0);
+	CHECK(a1.array == 0 && a1.slice == 1);
+	CHECK(a2.array == 0 && a2.slice == 2);
+	CHECK(r0.array == 1 && r0.slice == 0);
+	CHECK(s0.array == 2 && s0.slice == 0);
+	CHECK(m0.array == 3 && m0.slice == 0);
+
+	CHECK(layout.GetArrayCount() == 4);
+	CHECK(layout.GetTextureCount() == 6);
+	CHECK(layout.GetSliceCount(0) == 3);
+	CHECK(layout.GetSliceCount(1) == 1);
+	CHECK(layout.GetShape(1) == roughness);
+	CHECK(layout.GetShape(2) == small);
+
+	// Width and height count separately
+	TextureShape wide = albedo;
+	wide.height = 512;
+	CHECK(!(wide == albedo));
+	CHECK(layout.Add(wide).array == 4);
+}
+
+// A full array starts another of the same shape, and later ones fill that
+static void TestMaxSlicesOverflow()
+{
+	TextureShape shape = MakeShape(256, 9, Rgba8);
+	TextureShape other = MakeShape(256, 9, R8);
+
+	TextureArrayLayout layout(2);
+	CHECK(layout.Add(shape).array == 0);
+	CHECK(layout.Add(shape).array == 0);
+	CHECK(layout.Add(other).array == 1);
+
+	TextureSlot third = layout.Add(shape);
+	CHECK(third.array == 2 && third.slice == 0);
+	TextureSlot fourth = layout.Add(shape);
+	CHECK(fourth.array == 2 && fourth.slice == 1);
+	TextureSlot fifth = layout.Add(shape);
+	CHECK(fifth.array == 3 && fifth.slice == 0);
+
+	CHECK(layout.GetSliceCount(0) == 2);
+	CHECK(layout.GetSliceCount(2) == 2);
+	CHECK(layout.GetTextureCount() == 6);
+
+	// 1 is an array per texture (no packing at all)
+	TextureArrayLayout unpacked(1);
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		TextureSlot slot = unpacked.Add(shape);
+		CHECK(slot.array == i && slot.slice == 0);
+	}
+
+	// 0 means 1, and nothing goes past Direct3D's limit
+	TextureArrayLayout zero(0);
+	zero.Add(shape);
+	CHECK(zero.Add(shape).array == 1);
+
+	TextureArrayLayout tooMany(TextureArrayLayout::MaxArraySlices + 10);
+	for (unsigned int i = 0; i < TextureArrayLayout::MaxArraySlices; i++)
+		tooMany.Add(shape);
+	CHECK(tooMany.GetArrayCount() == 1);
+	CHECK(tooMany.Add(shape).array == 1);
+}
+
+// Same order as D3D11CalcSubresource - every mip of a slice, then the next slice
+static void TestSubresourceOrder()
+{
+	TextureShape shape = MakeShape(1024, 11, Rgba8);
+	CHECK(TextureArrayLayout::GetSubresource(shape, 0, 0) == 0);
+	CHECK(TextureArrayLayout::GetSubresource(shape, 0, 10) == 10);
+	CHECK(TextureArrayLayout::GetSubresource(shape, 1, 0) == 11);
+	CHECK(TextureArrayLayout::GetSubresource(shape, 2, 3) == 25);
+
+	// Each (slice, mip) has its own index, and they cover 0 to count - 1
+	const unsigned int slices = 5;
+	bool seen[slices * 11] = {};
+	bool unique = true;
+	for (unsigned int slice = 0; slice < slices; slice++)
+	{
+		for (unsigned int mip = 0; mip < shape.mipLevels; mip++)
+		{
+			unsigned int subresource = TextureArrayLayout::GetSubresource(shape, slice, mip);
+			unique &= subresource < slices * 11 && !seen[subresource];
+			if (subresource < slices * 11)
+				seen[subresource] = true;
+		}
+	}
+	CHECK(unique);
+}
+
+int main()
+{
+	TestSameShapeShares();
+	TestMaxSlicesOverflow();
+	TestSubresourceOrder();
+	return CheckResult();
+}
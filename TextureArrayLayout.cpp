@@ -0,0 +1,39 @@
+#include "TextureArrayLayout.h"
+
+TextureArrayLayout::TextureArrayLayout(unsigned int maxSlices)
+	: maxSlices(maxSlices ? maxSlices : 1),
+	textureCount(0)
+{
+	if (this->maxSlices > MaxArraySlices)
+		this->maxSlices = MaxArraySlices;
+}
+
+// --------------------------------------------------------
+// Puts the texture in the first array of its shape that has
+// room, or starts a new one.  There are only ever a handful
+// of arrays, so they're just searched in order.
+// --------------------------------------------------------
+TextureSlot TextureArrayLayout::Add(const TextureShape& shape)
+{
+	TextureSlot slot;
+	textureCount++;
+
+	for (unsigned int i = 0; i < arrays.size(); i++)
+	{
+		if (arrays[i].shape == shape && arrays[i].sliceCount < maxSlices)
+		{
+			slot.array = i;
+			slot.slice = arrays[i].sliceCount++;
+			return slot;
+		}
+	}
+
+	ArrayInfo info;
+	info.shape = shape;
+	info.sliceCount = 1;
+	arrays.push_back(info);
+
+	slot.array = (unsigned int)arrays.size() - 1;
+	slot.slice = 0;
+	return slot;
+}
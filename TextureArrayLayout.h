@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// What a texture has to match to share an array with others
+// --------------------------------------------------------
+struct TextureShape
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int mipLevels = 0;
+	unsigned int format = 0;	// A DXGI_FORMAT
+
+	bool operator==(const TextureShape& other) const
+	{
+		return width == other.width && height == other.height &&
+			mipLevels == other.mipLevels && format == other.format;
+	}
+};
+
+// --------------------------------------------------------
+// Where a TextureArrayLayout put a texture
+// --------------------------------------------------------
+struct TextureSlot
+{
+	unsigned int array = 0;
+	unsigned int slice = 0;
+};
+
+// --------------------------------------------------------
+// Decides which Texture2DArray, and which slice of it, each
+// texture goes in.  Textures with the same shape share an
+// array until it has maxSlices of them; a texture no other
+// matches ends up in an array of one.
+//
+// Only the bookkeeping, like RangeAllocator - no Direct3D,
+// so it can be tested on its own.  TextureArrayPacker does
+// the creating and copying.
+// --------------------------------------------------------
+class TextureArrayLayout
+{
+public:
+	// D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION
+	static const unsigned int MaxArraySlices = 2048;
+
+	// 1 gives every texture an array of its own
+	TextureArrayLayout(unsigned int maxSlices = MaxArraySlices);
+
+	TextureSlot Add(const TextureShape& shape);
+
+	unsigned int GetArrayCount() const { return (unsigned int)arrays.size(); }
+	unsigned int GetTextureCount() const { return textureCount; }
+	const TextureShape& GetShape(unsigned int array) const { return arrays[array].shape; }
+	unsigned int GetSliceCount(unsigned int array) const { return arrays[array].sliceCount; }
+
+	// The index of one mip of one slice, as D3D11CalcSubresource
+	// would give it - every mip of slice 0, then of slice 1...
+	static unsigned int GetSubresource(const TextureShape& shape, unsigned int slice, unsigned int mip)
+	{
+		return mip + slice * shape.mipLevels;
+	}
+
+private:
+	struct ArrayInfo
+	{
+		TextureShape shape;
+		unsigned int sliceCount;
+	};
+	std::vector<ArrayInfo> arrays;
+	unsigned int maxSlices;
+	unsigned int textureCount;
+};
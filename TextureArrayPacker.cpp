@@ -0,0 +1,156 @@
+#include "TextureArrayPacker.h"
+
+TextureArrayPacker::TextureArrayPacker(Microsoft::WRL::ComPtr<ID3D11Device> device, bool pack)
+	: device(device),
+	layout(pack ? TextureArrayLayout::MaxArraySlices : 1)
+{
+}
+
+unsigned int TextureArrayPacker::Add(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture)
+{
+	Source source;
+	source.valid = false;
+	source.unpacked = true;
+	source.fallback = texture;
+
+	// Only plain 2D textures can go in a slice
+	if (texture)
+	{
+		Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+		texture->GetResource(resource.GetAddressOf());
+		resource.As(&source.texture);
+	}
+
+	if (source.texture)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		source.texture->GetDesc(&desc);
+
+		if (desc.ArraySize == 1 && desc.SampleDesc.Count == 1)
+		{
+			TextureShape shape;
+			shape.width = desc.Width;
+			shape.height = desc.Height;
+			shape.mipLevels = desc.MipLevels;
+			shape.format = desc.Format;
+			source.slot = layout.Add(shape);
+			source.valid = true;
+			source.unpacked = false;
+		}
+		else
+		{
+			source.texture.Reset();
+		}
+	}
+
+	sources.push_back(source);
+	return (unsigned int)sources.size() - 1;
+}
+
+// --------------------------------------------------------
+// Creates an array for every shape with more than one
+// texture, then copies each of their mips into place
+// --------------------------------------------------------
+bool TextureArrayPacker::Build(ID3D11DeviceContext* context)
+{
+	bool succeeded = true;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Texture2D>> arrays(layout.GetArrayCount());
+	arraySRVs.assign(layout.GetArrayCount(), 0);
+
+	for (unsigned int i = 0; i < layout.GetArrayCount(); i++)
+	{
+		// Those get a view of the texture itself, below
+		unsigned int slices = layout.GetSliceCount(i);
+		if (slices == 1)
+			continue;
+
+		const TextureShape& shape = layout.GetShape(i);
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = shape.width;
+		desc.Height = shape.height;
+		desc.MipLevels = shape.mipLevels;
+		desc.ArraySize = slices;
+		desc.Format = (DXGI_FORMAT)shape.format;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		if (FAILED(device->CreateTexture2D(&desc, 0, arrays[i].GetAddressOf())) ||
+			!CreateArrayView(arrays[i].Get(), shape, slices, arraySRVs[i].GetAddressOf()))
+		{
+			arrays[i].Reset();
+			succeeded = false;
+		}
+	}
+
+	for (Source& source : sources)
+	{
+		if (!source.valid)
+			continue;
+
+		const TextureShape& shape = layout.GetShape(source.slot.array);
+		ID3D11Texture2D* array = arrays[source.slot.array].Get();
+
+		if (layout.GetSliceCount(source.slot.array) == 1)
+		{
+			if (!CreateArrayView(source.texture.Get(), shape, 1, arraySRVs[source.slot.array].GetAddressOf()))
+			{
+				source.unpacked = true;
+				succeeded = false;
+			}
+		}
+		else if (array)
+		{
+			for (unsigned int mip = 0; mip < shape.mipLevels; mip++)
+			{
+				unsigned int subresource = TextureArrayLayout::GetSubresource(shape, source.slot.slice, mip);
+				context->CopySubresourceRegion(array, subresource, 0, 0, 0, source.texture.Get(), mip, 0);
+			}
+		}
+		else
+		{
+			// Its array failed - it's used on its own, like an unpacked texture
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> view;
+			if (CreateArrayView(source.texture.Get(), shape, 1, view.GetAddressOf()))
+				source.fallback = view;
+			source.unpacked = true;
+		}
+
+		// Copied, or held by its own view
+		source.texture.Reset();
+		if (!source.unpacked)
+			source.fallback.Reset();
+	}
+
+	return succeeded;
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> TextureArrayPacker::GetSRV(unsigned int texture)
+{
+	if (texture >= sources.size())
+		return 0;
+
+	const Source& source = sources[texture];
+	if (source.unpacked || source.slot.array >= arraySRVs.size())
+		return source.fallback;
+	return arraySRVs[source.slot.array];
+}
+
+unsigned int TextureArrayPacker::GetSlice(unsigned int texture)
+{
+	if (texture >= sources.size() || sources[texture].unpacked)
+		return 0;
+	return sources[texture].slot.slice;
+}
+
+bool TextureArrayPacker::CreateArrayView(ID3D11Texture2D* texture, const TextureShape& shape, unsigned int slices, ID3D11ShaderResourceView** srv)
+{
+	D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
+	desc.Format = (DXGI_FORMAT)shape.format;
+	desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	desc.Texture2DArray.MostDetailedMip = 0;
+	desc.Texture2DArray.MipLevels = shape.mipLevels;
+	desc.Texture2DArray.FirstArraySlice = 0;
+	desc.Texture2DArray.ArraySize = slices;
+	return SUCCEEDED(device->CreateShaderResourceView(texture, &desc, srv));
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+#include "TextureArrayLayout.h"
+
+// --------------------------------------------------------
+// A texture as a TextureArrayPacker hands it out - a view of
+// the array it's in, and which slice of it
+// --------------------------------------------------------
+struct PackedTexture
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	unsigned int slice = 0;
+};
+
+// --------------------------------------------------------
+// Packs loaded textures into Texture2DArrays, so materials
+// whose textures are the same size and format bind the same
+// views and only differ by the slice they sample.  With the
+// slices in the MaterialTable, those materials have the same
+// binding id and draw together.
+//
+// Add() every texture once it's loaded (mips and all), then
+// Build() creates the arrays and copies each texture's mips
+// into its slice on the GPU.  A texture that matches no other
+// isn't copied - it gets an array view of itself instead, as
+// does every texture when packing is off, so shaders always
+// see a Texture2DArray.
+//
+// Only lives as long as loading does.  The views it hands out
+// keep the arrays alive, and the textures that were copied
+// are released by Build().
+// --------------------------------------------------------
+class TextureArrayPacker
+{
+public:
+	TextureArrayPacker(Microsoft::WRL::ComPtr<ID3D11Device> device, bool pack);
+
+	// Returns the texture's index, for GetSRV() and GetSlice() after Build()
+	unsigned int Add(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture);
+
+	// Records the copies on the context.  False if any array couldn't be created.
+	bool Build(ID3D11DeviceContext* context);
+
+	// A Texture2DArray view of the array the texture went in, and its slice.  A
+	// texture whose array couldn't be created gets an array view of just itself,
+	// and one that can't go in an array (not a plain 2D texture) gets back the
+	// view it was added with - both at slice 0.
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV(unsigned int texture);
+	unsigned int GetSlice(unsigned int texture);
+
+	unsigned int GetArrayCount() const { return layout.GetArrayCount(); }
+
+private:
+	struct Source
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		TextureSlot slot;
+		bool valid;
+		bool unpacked;	// Handed out on its own, as fallback, instead of in an array
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> fallback;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	TextureArrayLayout layout;
+	std::vector<Source> sources;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> arraySRVs;
+
+	bool CreateArrayView(ID3D11Texture2D* texture, const TextureShape& shape, unsigned int slices, ID3D11ShaderResourceView** srv);
+};
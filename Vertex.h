@@ -14,4 +14,17 @@ struct Vertex
 	DirectX::XMFLOAT2 UV;
 	DirectX::XMFLOAT3 Normal;
 	DirectX::XMFLOAT3 Tangent;
-};
\ No newline at end of file
+};
+
+// --------------------------------------------------------
+// Per-object data, one element of the frame's Objects
+// structured buffer (ObjectData in ShaderInclude.hlsli).
+// Matrices are transposed, the same as in constant buffers.
+// --------------------------------------------------------
+struct ObjectData
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInvTranspose;
+	unsigned int MaterialIndex;		// The material's pool index
+	unsigned int Padding[3];		// Keeps the stride a multiple of 16
+};
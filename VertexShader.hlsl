@@ -1,11 +1,16 @@
 #include "ShaderInclude.hlsli"
 
-cbuffer ExternalData : register(b0)
+// Buffers are split by how often they change, so a draw
+// only has to upload the one that's actually different
+
+// Every object drawn this frame
+StructuredBuffer<ObjectData> Objects	: register(t0);
+
+// Set once per frame
+cbuffer PerFrame : register(b0)
 {
-	float4x4 world;
 	matrix view;
 	matrix projection;
-	matrix worldInvTranspose;
 
 	matrix shadowView;
 	matrix shadowProjection;
@@ -28,6 +33,9 @@ struct VertexShaderInput
 	float2 uv				: TEXCOORD;		//UV
 	float3 normal			: NORMAL;		//surface normal
 	float3 tangent			: TANGENT;		//vector tangent to surface in u direction
+
+	//per instance (vertex buffer slot 1) - where this entity is in Objects
+	uint objectIndex		: OBJECTINDEX_PER_INSTANCE;
 };
 
 // --------------------------------------------------------
@@ -42,6 +50,10 @@ VertexToPixel main( VertexShaderInput input )
 	// Set up output struct
 	VertexToPixel output;
 
+	ObjectData object = Objects[input.objectIndex];
+	matrix world = object.world;
+	matrix worldInvTranspose = object.worldInvTranspose;
+
 	matrix wvp = mul(projection, mul(view, world));
 
 	// Here we're essentially passing the input position directly through to the next
@@ -59,6 +71,8 @@ VertexToPixel main( VertexShaderInput input )
 
 	output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
 
+	output.materialIndex = object.materialIndex;
+
 	// Pass the color through 
 	// - The values will be interpolated per-pixel by the rasterizer
 	// - We don't need to alter it here, but we do need to send it to the pixel shader